@@ -61,6 +61,8 @@
 
 static uint16_t hid_conn_id = 0;
 static bool sec_conn = false;
+// 現在の接続間隔（1.25ms単位）。分からないうちは30msとみなす
+static uint16_t hid_conn_itvl = 24;
 #define CHAR_DECLARATION_SIZE (sizeof(uint8_t))
 
 static void hidd_event_callback(esp_hidd_cb_event_t event,
@@ -132,6 +134,7 @@ static void hidd_event_callback(esp_hidd_cb_event_t event,
     }
     case ESP_HIDD_EVENT_BLE_DISCONNECT: {
       sec_conn = false;
+      hid_conn_itvl = 24;
       ESP_LOGI(HID_DEMO_TAG, "ESP_HIDD_EVENT_BLE_DISCONNECT");
       esp_ble_gap_start_advertising(&hidd_adv_params);
       break;
@@ -167,6 +170,16 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event,
       }
       esp_ble_gap_security_rsp(param->ble_security.ble_req.bd_addr, true);
       break;
+    case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+      // キーストロークの間隔を接続間隔に合わせる
+      if (param->update_conn_params.status == ESP_BT_STATUS_SUCCESS &&
+          param->update_conn_params.conn_int > 0) {
+        hid_conn_itvl = param->update_conn_params.conn_int;
+      }
+      ESP_LOGI(HID_DEMO_TAG, "conn params updated: interval %d latency %d",
+               param->update_conn_params.conn_int,
+               param->update_conn_params.latency);
+      break;
     case ESP_GAP_BLE_AUTH_CMPL_EVT:
       sec_conn = true;
       esp_bd_addr_t bd_addr;
@@ -190,6 +203,16 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event,
   }
 }
 
+/**
+ * @brief キーストロークの間に待つ。
+ *        以前は固定で50ms待っていたが、接続間隔1回分（切り上げ）だけ待つようにした。
+ *        1接続イベントに1レポートずつ送ることになる。
+ */
+static void hid_key_delay(void) {
+  TickType_t wait = pdMS_TO_TICKS(((uint32_t)hid_conn_itvl * 5 + 3) / 4);
+  vTaskDelay(wait > 0 ? wait : 1);
+}
+
 /**
  * @brief ペアリングできていれば、指定された文字列を１文字ずつHID-BLEのキーコードに変換して送信
  *        ただし、キーボードのキートップに印字されている文字に限る。
@@ -212,10 +235,10 @@ bool send_ble_hid_by_string(uint8_t *data, int len) {
       if (k != 0) {
         // 1文字送る
         esp_hidd_send_keyboard_value(hid_conn_id, m, &k, 1);
-        vTaskDelay(50 / portTICK_PERIOD_MS);
+        hid_key_delay();
         // 停止する（修飾キー無しの長さゼロのキーストロークを送る）
         esp_hidd_send_keyboard_value(hid_conn_id, 0, &k, 0);
-        vTaskDelay(50 / portTICK_PERIOD_MS);
+        hid_key_delay();
         cnt ++;
       }
     }
@@ -234,10 +257,10 @@ bool send_ble_hid_by_keycode(uint8_t k, key_mask_t m) {
   if (sec_conn) {
     // 1文字送る
     esp_hidd_send_keyboard_value(hid_conn_id, m, &k, 1);
-    vTaskDelay(50 / portTICK_PERIOD_MS);
+    hid_key_delay();
     // 停止する（修飾キー無しの長さゼロのキーストロークを送る）
     esp_hidd_send_keyboard_value(hid_conn_id, 0, &k, 0);
-    vTaskDelay(50 / portTICK_PERIOD_MS);
+    hid_key_delay();
     return true;
   } else {
     return false;
@@ -0,0 +1,200 @@
+/**
+ * @file bench_hid_func.c
+ *   hid_func のGATTアクセスとレポート送信の1回あたりの時間を測る。
+ *   gatt_svr_register_cb() と同じように全ての特性を hid_func に登録し、3つの接続を作る。
+ *   1つはブートプロトコルにする。
+ *   測る前に、属性ハンドルとHANDLE_*からレポートが正しく引けるかを調べ、違えばゼロ以外で終わる。
+ *
+ *   使い方: bench_hid_func [回数]
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "gatt_svr.h"
+#include "hid_func.h"
+#include "host/ble_hs.h"
+#include "host_test.h"
+#include "my_hid_mbuf.h"
+#include "my_latency.h"
+
+// 接続ハンドル。BENCH_CONN_BOOT はブートプロトコルを使う
+#define BENCH_CONN_A (1)
+#define BENCH_CONN_B (2)
+#define BENCH_CONN_BOOT (3)
+
+uint16_t Svc_char_handles[HANDLE_HID_COUNT];
+
+static uint8_t bench_leds = 0;
+
+void my_if_uart_set_leds(uint8_t leds) { bench_leds = leds; }
+
+void my_latency_notify_sent(uint16_t conn_handle) { (void)conn_handle; }
+
+struct os_mbuf *my_hid_mbuf_from_flat(const void *buf, uint16_t len) {
+    return ble_hs_mbuf_from_flat(buf, len);
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief gatt_svr_register_cb() の代わりに特性を登録し、接続して購読する
+ */
+static void setup(void) {
+    // 特性ごとに、宣言・値・CCCDの3つの属性がある
+    for (int i = 0; i < HANDLE_HID_COUNT; i++) {
+        Svc_char_handles[i] = (uint16_t)(3 + i * 3);
+        hid_index_report_chr(i, Svc_char_handles[i]);
+    }
+    static const uint16_t conns[] = {BENCH_CONN_A, BENCH_CONN_B,
+                                     BENCH_CONN_BOOT};
+    for (size_t i = 0; i < sizeof(conns) / sizeof(conns[0]); i++) {
+        struct ble_gap_conn_desc desc = {.conn_handle = conns[i]};
+        hid_clean_vars(&desc);
+    }
+    hid_set_report_mode(BENCH_CONN_BOOT, true);
+    hid_set_notify(BENCH_CONN_A, Svc_char_handles[HANDLE_HID_KB_IN_REPORT], 1,
+                   0);
+    hid_set_notify(BENCH_CONN_B, Svc_char_handles[HANDLE_HID_KB_IN_REPORT], 0,
+                   1);
+    hid_set_notify(BENCH_CONN_BOOT,
+                   Svc_char_handles[HANDLE_HID_BOOT_KB_IN_REPORT], 1, 0);
+}
+
+/**
+ * @brief 読んだ値の長さ。読めなければ-1
+ */
+static int read_len(uint16_t conn_handle, int handle_num) {
+    struct os_mbuf om = {.len = 0};
+    if (hid_read_buffer(conn_handle, &om, handle_num) != 0) return -1;
+    return om.len;
+}
+
+static void check(void) {
+    CHECK(hid_conn_count() == 3);
+
+    // HANDLE_* から、報告モードとブートモードの両方のレポートが引ける
+    CHECK(read_len(BENCH_CONN_A, HANDLE_HID_MOUSE_REPORT) ==
+          HIDD_LE_REPORT_MOUSE_SIZE);
+    CHECK(read_len(BENCH_CONN_A, HANDLE_HID_BOOT_MOUSE_REPORT) ==
+          HIDD_LE_REPORT_MOUSE_SIZE);
+    CHECK(read_len(BENCH_CONN_A, HANDLE_HID_KB_IN_REPORT) ==
+          HIDD_LE_REPORT_KB_IN_SIZE);
+    CHECK(read_len(BENCH_CONN_A, HANDLE_HID_BOOT_KB_IN_REPORT) ==
+          HIDD_LE_REPORT_KB_IN_SIZE);
+    CHECK(read_len(BENCH_CONN_A, HANDLE_HID_CC_REPORT) ==
+          HIDD_LE_REPORT_CC_SIZE);
+    CHECK(read_len(BENCH_CONN_A, HANDLE_BATTERY_LEVEL) ==
+          HIDD_LE_BATTERY_LEVEL_SIZE);
+    CHECK(read_len(BENCH_CONN_A, HANDLE_HID_FEATURE_REPORT) ==
+          HIDD_LE_REPORT_FEATURE);
+    // レポートでない特性と範囲外は引けない
+    CHECK(read_len(BENCH_CONN_A, HANDLE_HID_INFORMATION) == -1);
+    CHECK(read_len(BENCH_CONN_A, -1) == -1);
+    CHECK(read_len(BENCH_CONN_A, HANDLE_HID_COUNT) == -1);
+
+    // LEDは接続ごとに持つ
+    struct os_mbuf om = {.len = 1, .data = {0x02}};
+    CHECK(hid_write_buffer(BENCH_CONN_A, &om, HANDLE_HID_KB_OUT_REPORT) == 0);
+    CHECK(bench_leds == 0x02);
+    struct os_mbuf leds = {.len = 0};
+    CHECK(hid_read_buffer(BENCH_CONN_A, &leds, HANDLE_HID_BOOT_KB_OUT_REPORT) ==
+          0);
+    CHECK(leds.len == 1 && leds.data[0] == 0x02);
+    leds.len = 0;
+    CHECK(hid_read_buffer(BENCH_CONN_B, &leds, HANDLE_HID_KB_OUT_REPORT) == 0);
+    CHECK(leds.len == 1 && leds.data[0] == 0x00);
+    // 長さが違えば書かない
+    om.len = 2;
+    CHECK(hid_write_buffer(BENCH_CONN_A, &om, HANDLE_HID_KB_OUT_REPORT) != 0);
+
+    // 報告モードのHANDLE_*でだけ送れ、各接続にはそのプロトコルの特性で届く
+    CHECK(hid_send_report(HANDLE_HID_BOOT_KB_IN_REPORT) == 2);
+    CHECK(hid_send_report(HANDLE_HID_INFORMATION) == 2);
+    uint32_t sent = sim_nimble_sent;
+    CHECK(hid_send_report(HANDLE_HID_KB_IN_REPORT) == 0);
+    CHECK(sim_nimble_sent - sent == 3);
+    CHECK(sim_nimble_last_conn == BENCH_CONN_BOOT);
+    CHECK(sim_nimble_last_handle ==
+          Svc_char_handles[HANDLE_HID_BOOT_KB_IN_REPORT]);
+    // 購読していないレポートは送らない
+    sent = sim_nimble_sent;
+    hid_send_report(HANDLE_HID_MOUSE_REPORT);
+    CHECK(sim_nimble_sent == sent);
+
+    // ブートモードの接続は、報告モードの特性の購読では変わらない
+    hid_set_notify(BENCH_CONN_BOOT, Svc_char_handles[HANDLE_HID_MOUSE_REPORT],
+                   1, 0);
+    sent = sim_nimble_sent;
+    hid_send_report(HANDLE_HID_MOUSE_REPORT);
+    CHECK(sim_nimble_sent == sent);
+    hid_set_notify(BENCH_CONN_BOOT,
+                   Svc_char_handles[HANDLE_HID_BOOT_MOUSE_REPORT], 1, 0);
+    CHECK(hid_send_report(HANDLE_HID_MOUSE_REPORT) == 0);
+    CHECK(sim_nimble_sent - sent == 1);
+    CHECK(sim_nimble_last_handle ==
+          Svc_char_handles[HANDLE_HID_BOOT_MOUSE_REPORT]);
+
+    // レポートプログラムの送信
+    uint16_t handles[3];
+    CHECK(hid_keyboard_stream_conns(handles, 3) == 3);
+    static const uint8_t report[HIDD_LE_REPORT_KB_IN_SIZE] = {2, 0, 4};
+    CHECK(hid_keyboard_stream_report(BENCH_CONN_B, report) == 0);
+    CHECK(sim_nimble_last_conn == BENCH_CONN_B);
+    CHECK(sim_nimble_last_handle == Svc_char_handles[HANDLE_HID_KB_IN_REPORT]);
+    CHECK(sim_nimble_last_value.len == HIDD_LE_REPORT_KB_IN_SIZE &&
+          memcmp(sim_nimble_last_value.data, report, sizeof(report)) == 0);
+}
+
+int main(int argc, char *argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (count <= 0) count = 1;
+
+    setup();
+    check();
+    if (host_test_failed) return HOST_TEST_RESULT();
+
+    static const uint8_t report[HIDD_LE_REPORT_KB_IN_SIZE] = {0, 0, 5};
+    uint16_t kb_attr = Svc_char_handles[HANDLE_HID_KB_IN_REPORT];
+    int64_t t[6];
+    t[0] = now_ns();
+    for (int i = 0; i < count; i++) {
+        struct os_mbuf om = {.len = 0};
+        hid_read_buffer(BENCH_CONN_A, &om, HANDLE_HID_KB_IN_REPORT);
+    }
+    t[1] = now_ns();
+    for (int i = 0; i < count; i++) {
+        struct os_mbuf om = {.len = 1, .data = {(uint8_t)i}};
+        hid_write_buffer(BENCH_CONN_A, &om, HANDLE_HID_KB_OUT_REPORT);
+    }
+    t[2] = now_ns();
+    for (int i = 0; i < count; i++) {
+        hid_set_notify(BENCH_CONN_A, kb_attr, 1, 0);
+    }
+    t[3] = now_ns();
+    for (int i = 0; i < count; i++) {
+        hid_send_report(HANDLE_HID_KB_IN_REPORT);
+    }
+    t[4] = now_ns();
+    for (int i = 0; i < count; i++) {
+        hid_keyboard_stream_report(BENCH_CONN_A, report);
+    }
+    t[5] = now_ns();
+
+    static const char *const names[] = {
+        "hid_read_buffer", "hid_write_buffer", "hid_set_notify",
+        "hid_send_report (3 conns)", "hid_keyboard_stream_report"};
+    for (int i = 0; i < 5; i++) {
+        printf("%-28s %7.1f ns/call\n", names[i],
+               (double)(t[i + 1] - t[i]) / count);
+    }
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,131 @@
+/**
+ * @file bench_hid_program.c
+ *   my_hid_program の変換コストを測る。
+ *   入力1KBあたり、フレームをレポートプログラムに変換してから解放するまでにかかる時間を出す。
+ *   フレームの長さは、TC-101Aの15文字と、フレームの上限(99+40文字)の2通り。
+ *   測る前に、プールのレポートが my_hid_planner の結果と同じか、満杯・取り消し・折り返しが
+ *   正しいかを調べ、違えばゼロ以外で終わる。
+ *
+ *   使い方: bench_hid_program [入力のKB数]
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "host_test.h"
+#include "my_hid_planner.h"
+#include "my_hid_program.h"
+
+#define FRAME_MAX (99 + 40)
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief プログラムのレポートが my_hid_planner の結果と同じか
+ */
+static bool same_as_planner(const uint8_t *text, int len,
+                            const my_hid_program_t *prog) {
+    static uint8_t want[MY_HID_PLANNER_MAX_REPORTS(FRAME_MAX)]
+                       [MY_HID_PLANNER_REPORT_SIZE];
+    int n = my_hid_planner_plan(text, len, want,
+                                MY_HID_PLANNER_MAX_REPORTS(FRAME_MAX));
+    if (n != prog->count) return false;
+    for (int i = 0; i < n; i++) {
+        if (memcmp(my_hid_program_report(prog, i), want[i],
+                   MY_HID_PLANNER_REPORT_SIZE) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief プールの使い方を調べる
+ */
+static void check_pool(const uint8_t *text) {
+    static my_hid_program_t progs[MY_HID_PROGRAM_POOL_REPORTS];
+    // 満杯になるまで作り、作った順に解放しながら、折り返しても壊れないか
+    for (int round = 0; round < 3; round++) {
+        int n = 0;
+        int len = 10 + round * 37;
+        while (my_hid_program_compile(text + n % 7, len, &progs[n])) {
+            n++;
+        }
+        CHECK(n > 0);
+        CHECK(my_hid_program_pool_used() > MY_HID_PROGRAM_POOL_REPORTS -
+                                               MY_HID_PLANNER_MAX_REPORTS(len) -
+                                               MY_HID_PLANNER_MAX_REPORTS(len));
+        for (int i = 0; i < n; i++) {
+            CHECK(progs[i].start + progs[i].count <=
+                  MY_HID_PROGRAM_POOL_REPORTS);
+            CHECK(same_as_planner(text + i % 7, len, &progs[i]));
+            my_hid_program_free(&progs[i]);
+        }
+        CHECK(my_hid_program_pool_used() == 0);
+    }
+    // 取り消すと、作る前に戻る
+    my_hid_program_t prog;
+    CHECK(my_hid_program_compile(text, 15, &prog));
+    int used = my_hid_program_pool_used();
+    my_hid_program_t extra;
+    CHECK(my_hid_program_compile(text, 15, &extra));
+    my_hid_program_cancel(&extra);
+    CHECK(my_hid_program_pool_used() == used);
+    my_hid_program_free(&prog);
+    CHECK(my_hid_program_pool_used() == 0);
+}
+
+/**
+ * @brief 入力kbキロバイトを、frame_len文字ずつのフレームにして変換・解放する
+ * @return 入力1KBあたりの時間(ns)
+ */
+static double bench(const uint8_t *text, int text_len, int frame_len, int kb,
+                    int *reports) {
+    int64_t total = (int64_t)kb * 1024;
+    int64_t done = 0;
+    *reports = 0;
+    int64_t start = now_ns();
+    while (done < total) {
+        my_hid_program_t prog;
+        int off = (int)(done % (text_len - frame_len));
+        if (!my_hid_program_compile(text + off, frame_len, &prog)) {
+            return -1;
+        }
+        *reports += prog.count;
+        my_hid_program_free(&prog);
+        done += frame_len;
+    }
+    return (double)(now_ns() - start) / ((double)done / 1024);
+}
+
+int main(int argc, char *argv[]) {
+    int kb = argc > 1 ? atoi(argv[1]) : 4096;
+    if (kb <= 0) kb = 1;
+    // 数字、記号、英字、制御文字の混ざった入力
+    static uint8_t text[4096];
+    srand(1);
+    for (size_t i = 0; i < sizeof(text); i++) {
+        static const char chars[] = "0123456789+-.,: ABCabcxyzXYZ!\"#\r\n";
+        text[i] = (rand() % 4 == 0) ? (uint8_t)(rand() % 128)
+                                    : (uint8_t)chars[rand() % (sizeof(chars) - 1)];
+    }
+    check_pool(text);
+    if (host_test_failed) return HOST_TEST_RESULT();
+
+    static const int frame_lens[] = {15, FRAME_MAX};
+    for (size_t i = 0; i < sizeof(frame_lens) / sizeof(frame_lens[0]); i++) {
+        int reports;
+        double ns = bench(text, sizeof(text), frame_lens[i], kb, &reports);
+        CHECK(ns >= 0);
+        printf("%3d-char frames: %8.0f ns/KB  (%d KB, %.1f reports/KB)\n",
+               frame_lens[i], ns, kb, (double)reports / kb);
+    }
+    return HOST_TEST_RESULT();
+}
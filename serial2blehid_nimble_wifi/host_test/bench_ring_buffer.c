@@ -0,0 +1,253 @@
+/**
+ * @file bench_ring_buffer.c
+ *   my_ring_buffer と、以前の実装（添字を % size で求め、満杯フラグを持つ）の速さを比べる。
+ *   1バイトずつの格納と取り出し、まとめての格納と取り出し、
+ *   1フレーム（TC-101Aの15バイト）を格納して取り出すまでの、1秒あたりのバイト数を出す。
+ *   測る前に、乱数で操作した両方の中身が同じかを調べ、違えばゼロ以外で終わる。
+ *
+ *   使い方: bench_ring_buffer [MB数]
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "host_test.h"
+#include "my_ring_buffer.h"
+
+#define FRAME_LEN (15)
+#define CHUNK_LEN (16)
+#define STREAM_SIZE (100)
+
+/**
+ * @brief 以前のリングバッファ
+ */
+typedef struct {
+    uint8_t *buffer;
+    int size;
+    int head;
+    int tail;
+    bool is_full;
+} legacy_ring_t;
+
+static bool legacy_init(legacy_ring_t *rb, int size) {
+    rb->buffer = (uint8_t *)malloc(size);
+    rb->size = size;
+    rb->head = 0;
+    rb->tail = 0;
+    rb->is_full = false;
+    return rb->buffer != NULL;
+}
+
+__attribute__((noinline)) static int legacy_content_length(legacy_ring_t *rb) {
+    if (rb->is_full) {
+        return rb->size;
+    } else {
+        if (rb->head < rb->tail) {
+            return rb->size + rb->head - rb->tail;
+        } else {
+            return rb->head - rb->tail;
+        }
+    }
+}
+
+__attribute__((noinline)) static void legacy_push(legacy_ring_t *rb,
+                                                  uint8_t data) {
+    rb->buffer[rb->head] = data;
+    rb->head = (rb->head + 1) % rb->size;
+    if (rb->is_full) rb->tail = rb->head;
+    rb->is_full = (rb->head == rb->tail);
+}
+
+__attribute__((noinline)) static bool legacy_pop(legacy_ring_t *rb,
+                                                 uint8_t *data) {
+    if (!rb->is_full && rb->head == rb->tail) {
+        return false;  // empty
+    }
+    *data = rb->buffer[rb->tail];
+    rb->tail = (rb->tail + 1) % rb->size;
+    rb->is_full = false;
+    return true;
+}
+
+static void legacy_reset(legacy_ring_t *rb) {
+    rb->head = 0;
+    rb->tail = 0;
+    rb->is_full = false;
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief 乱数で同じ操作をして、中身が同じか
+ */
+static void check_same(void) {
+    static const int sizes[] = {1, 3, 15, 16, 100, 128};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        legacy_ring_t old;
+        my_ring_buffer_t rb = {0};
+        CHECK(legacy_init(&old, sizes[s]));
+        CHECK(my_ring_buffer_init(&rb, sizes[s]));
+        for (int i = 0; i < 100000; i++) {
+            uint8_t buf[300];
+            int n = rand() % (2 * sizes[s] + 2);
+            switch (rand() % 5) {
+                case 0:
+                    buf[0] = (uint8_t)rand();
+                    legacy_push(&old, buf[0]);
+                    my_ring_buffer_push(&rb, buf[0]);
+                    break;
+                case 1:
+                    for (int j = 0; j < n; j++) {
+                        buf[j] = (uint8_t)rand();
+                        legacy_push(&old, buf[j]);
+                    }
+                    my_ring_buffer_push_n(&rb, buf, n);
+                    break;
+                case 2: {
+                    uint8_t a = 0, b = 0;
+                    bool ra = legacy_pop(&old, &a);
+                    CHECK(ra == my_ring_buffer_pop(&rb, &b));
+                    CHECK(a == b);
+                    break;
+                }
+                case 3: {
+                    uint8_t want[300];
+                    int m = 0;
+                    while (m < n && legacy_pop(&old, &want[m])) m++;
+                    CHECK(my_ring_buffer_pop_n(&rb, buf, n) == m);
+                    CHECK(memcmp(buf, want, m) == 0);
+                    break;
+                }
+                default:
+                    if (rand() % 8 == 0) {
+                        legacy_reset(&old);
+                        my_ring_buffer_reset(&rb);
+                    }
+                    break;
+            }
+            CHECK(legacy_content_length(&old) ==
+                  my_ring_buffer_content_length(&rb));
+            if (host_test_failed) return;
+        }
+        free(old.buffer);
+        my_ring_buffer_deinit(&rb);
+    }
+}
+
+/**
+ * @brief 1つの測り方の結果を出す
+ */
+static void report(const char *name, int64_t bytes, int64_t old_ns,
+                   int64_t new_ns) {
+    printf("%-24s old %7.1f MB/s  new %7.1f MB/s  x%.1f\n", name,
+           bytes * 1e3 / old_ns, bytes * 1e3 / new_ns,
+           (double)old_ns / new_ns);
+}
+
+int main(int argc, char *argv[]) {
+    int mb = argc > 1 ? atoi(argv[1]) : 64;
+    if (mb <= 0) mb = 1;
+    int64_t bytes = (int64_t)mb * 1000 * 1000;
+    srand(1);
+    check_same();
+    if (host_test_failed) return HOST_TEST_RESULT();
+
+    static uint8_t data[4096];
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = (uint8_t)rand();
+    legacy_ring_t old;
+    my_ring_buffer_t rb = {0};
+    CHECK(legacy_init(&old, STREAM_SIZE));
+    CHECK(my_ring_buffer_init(&rb, STREAM_SIZE));
+    volatile uint8_t sink = 0;
+    int64_t t0, t1, t2;
+
+    // 1バイトずつ格納する。満杯になった後は古い方が捨てられる
+    t0 = now_ns();
+    for (int64_t i = 0; i < bytes; i++) legacy_push(&old, data[i & 4095]);
+    t1 = now_ns();
+    for (int64_t i = 0; i < bytes; i++) my_ring_buffer_push(&rb, data[i & 4095]);
+    t2 = now_ns();
+    report("push", bytes, t1 - t0, t2 - t1);
+
+    // 満杯にしてから、1バイトずつ全て取り出す
+    int64_t old_ns = 0, new_ns = 0;
+    for (int64_t done = 0; done < bytes; done += STREAM_SIZE) {
+        uint8_t c;
+        for (int i = 0; i < STREAM_SIZE; i++) legacy_push(&old, data[i]);
+        my_ring_buffer_push_n(&rb, data, STREAM_SIZE);
+        t0 = now_ns();
+        while (legacy_pop(&old, &c)) sink ^= c;
+        t1 = now_ns();
+        while (my_ring_buffer_pop(&rb, &c)) sink ^= c;
+        t2 = now_ns();
+        old_ns += t1 - t0;
+        new_ns += t2 - t1;
+    }
+    report("pop", bytes, old_ns, new_ns);
+
+    // uart_read_bytes() が返すようなチャンクで格納し、まとめて取り出す
+    t0 = now_ns();
+    for (int64_t done = 0; done < bytes; done += CHUNK_LEN) {
+        const uint8_t *p = &data[done & 4095 & ~(CHUNK_LEN - 1)];
+        for (int i = 0; i < CHUNK_LEN; i++) legacy_push(&old, p[i]);
+        uint8_t buf[CHUNK_LEN];
+        for (int i = 0; i < CHUNK_LEN && legacy_pop(&old, &buf[i]); i++) {
+        }
+        sink ^= buf[0];
+    }
+    t1 = now_ns();
+    for (int64_t done = 0; done < bytes; done += CHUNK_LEN) {
+        const uint8_t *p = &data[done & 4095 & ~(CHUNK_LEN - 1)];
+        my_ring_buffer_push_n(&rb, p, CHUNK_LEN);
+        uint8_t buf[CHUNK_LEN];
+        my_ring_buffer_pop_n(&rb, buf, CHUNK_LEN);
+        sink ^= buf[0];
+    }
+    t2 = now_ns();
+    report("16-byte chunk push+pop", bytes, t1 - t0, t2 - t1);
+
+    // 受信バッファ15バイトで、1フレームを格納してから共用バッファへ取り出す。
+    // 以前のUARTタスクは1バイトずつ、今はまとめて格納・取り出しする
+    legacy_ring_t old_frame;
+    my_ring_buffer_t rb_frame = {0};
+    CHECK(legacy_init(&old_frame, FRAME_LEN));
+    CHECK(my_ring_buffer_init(&rb_frame, FRAME_LEN));
+    uint8_t frame[FRAME_LEN + 1];
+    t0 = now_ns();
+    for (int64_t done = 0; done < bytes; done += FRAME_LEN) {
+        const uint8_t *p = &data[done & 4095 & ~15];
+        legacy_reset(&old_frame);
+        for (int i = 0; i < FRAME_LEN; i++) legacy_push(&old_frame, p[i]);
+        int n = 0;
+        while (legacy_pop(&old_frame, &frame[n])) n++;
+        frame[n] = 0;
+        sink ^= frame[0];
+    }
+    t1 = now_ns();
+    for (int64_t done = 0; done < bytes; done += FRAME_LEN) {
+        const uint8_t *p = &data[done & 4095 & ~15];
+        my_ring_buffer_reset(&rb_frame);
+        my_ring_buffer_push_n(&rb_frame, p, FRAME_LEN);
+        int n = my_ring_buffer_pop_n(
+            &rb_frame, frame, my_ring_buffer_content_length(&rb_frame));
+        frame[n] = 0;
+        sink ^= frame[0];
+    }
+    t2 = now_ns();
+    report("15-byte frame extract", bytes, t1 - t0, t2 - t1);
+
+    (void)sink;
+    free(old.buffer);
+    free(old_frame.buffer);
+    my_ring_buffer_deinit(&rb);
+    my_ring_buffer_deinit(&rb_frame);
+    return HOST_TEST_RESULT();
+}
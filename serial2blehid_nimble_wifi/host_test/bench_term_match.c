@@ -0,0 +1,105 @@
+/**
+ * @file bench_term_match.c
+ *   my_term_match に記録したバイト列を流して、1秒あたりのバイト数を出し、
+ *   921600bps 8N2 の回線速度（1バイト11ビットで 83782バイト/秒）と比べる。
+ *   記録は、途切れずに届くTC-101Aの15バイトのフレーム（13文字＋CR+LF）。
+ *   my_uart_framer と同じく my_term_match_scan でまとめて進める方法と、
+ *   my_term_match_feed で1バイトずつ進める方法を測る。
+ *   一致した数がフレームの数と違えば、ゼロ以外で終わる。
+ *
+ *   使い方: bench_term_match [記録のMB数]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "host_test.h"
+#include "my_term_match.h"
+
+#define FRAME_LEN (15)
+#define CHUNK_LEN (16)
+
+// 921600bps 8N2 で1秒に届くバイト数
+#define LINE_BYTES_PER_SEC (921600.0 / 11)
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief 受信したときと同じく、最大 CHUNK_LEN バイトずつ my_term_match_scan で進める
+ * @return 一致した数
+ */
+static uint32_t run_scan(my_term_match_t *m, const uint8_t *rec, uint32_t len) {
+    uint32_t frames = 0;
+    for (uint32_t pos = 0; pos < len;) {
+        uint32_t end = pos + CHUNK_LEN < len ? pos + CHUNK_LEN : len;
+        while (pos < end) {
+            int matched;
+            pos += my_term_match_scan(m, rec + pos, (int)(end - pos), &matched);
+            if (matched >= 0) frames++;
+        }
+    }
+    return frames;
+}
+
+/**
+ * @brief 1バイトずつ my_term_match_feed で進める
+ * @return 一致した数
+ */
+static uint32_t run_feed(my_term_match_t *m, const uint8_t *rec, uint32_t len) {
+    uint32_t frames = 0;
+    for (uint32_t pos = 0; pos < len; pos++) {
+        if (my_term_match_feed(m, rec[pos]) >= 0) frames++;
+    }
+    return frames;
+}
+
+int main(int argc, char *argv[]) {
+    int mb = argc > 1 ? atoi(argv[1]) : 16;
+    if (mb <= 0) mb = 1;
+    uint32_t frame_cnt = (uint32_t)mb * 1000 * 1000 / FRAME_LEN;
+    uint32_t len = frame_cnt * FRAME_LEN;
+    uint8_t *rec = malloc(len);
+    CHECK(rec != NULL);
+    if (rec == NULL) return HOST_TEST_RESULT();
+    srand(1);
+    for (uint32_t i = 0; i < frame_cnt; i++) {
+        char frame[FRAME_LEN + 1];
+        snprintf(frame, sizeof(frame), "01A%c%05u.%03u\r\n",
+                 (rand() & 1) ? '+' : '-', (unsigned)rand() % 100000u,
+                 (unsigned)rand() % 1000u);
+        for (int j = 0; j < FRAME_LEN; j++) rec[i * FRAME_LEN + j] = frame[j];
+    }
+
+    static my_term_match_t m;
+    const uint8_t *seqs[] = {(const uint8_t *)"\r\n"};
+    const int lens[] = {2};
+    CHECK(my_term_match_compile(&m, seqs, lens, 1) == 0);
+
+    static const struct {
+        const char *name;
+        uint32_t (*run)(my_term_match_t *, const uint8_t *, uint32_t);
+    } benches[] = {
+        {"scan 16-byte chunks", run_scan},
+        {"feed 1 byte", run_feed},
+    };
+    printf("%u bytes, %u frames, line rate %.0f bytes/s (921600bps 8N2)\n",
+           (unsigned)len, (unsigned)frame_cnt, LINE_BYTES_PER_SEC);
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        my_term_match_reset(&m);
+        int64_t t0 = now_ns();
+        uint32_t frames = benches[i].run(&m, rec, len);
+        int64_t ns = now_ns() - t0;
+        CHECK(frames == frame_cnt);
+        double bps = len * 1e9 / ns;
+        printf("%-20s %8.1f MB/s  x%.0f line rate\n", benches[i].name,
+               bps / 1e6, bps / LINE_BYTES_PER_SEC);
+    }
+    free(rec);
+    return HOST_TEST_RESULT();
+}
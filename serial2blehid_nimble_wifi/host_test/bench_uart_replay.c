@@ -0,0 +1,173 @@
+/**
+ * @file bench_uart_replay.c
+ *   連続受信モードの受信側を、記録したバイト列で再生して、1秒あたりのフレーム数とバイト数を出す。
+ *   my_if_uart_stream() と同じように、uart_read_bytes() が返すような1-16バイトのチャンクを
+ *   my_uart_framer に渡し、区切れるまでをリングバッファに溜め、区切れたら取り出す。
+ *   記録は、9600bps 8N2で連続して届くTC-101Aの15バイトのフレーム。
+ *   16フレームに1つは終端文字列が無く、その後に受信が途切れる。
+ *   取り出したフレームが記録と1つでも違えば、ゼロ以外で終わる。
+ *
+ *   使い方: bench_uart_replay [記録のMB数]
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "host_test.h"
+#include "my_ring_buffer.h"
+#include "my_term_match.h"
+#include "my_uart_framer.h"
+
+#define FRAME_LEN (15)
+#define IDLE_US (20000)
+#define RING_SIZE (256)
+
+// 9600bps 8N2 で1バイトにかかる時間(us)
+#define BYTE_US (11 * 1000000 / 9600)
+
+/**
+ * @brief 記録の1チャンク
+ */
+typedef struct {
+    int64_t us;   // 最後のバイトを受信した時刻
+    uint32_t off; // 記録の中の位置
+    uint8_t len;
+} chunk_t;
+
+static uint8_t *record;
+static chunk_t *chunks;
+static int chunk_cnt = 0;
+
+// 記録したフレームの終わりの位置と、終端文字列の長さ
+static uint32_t *frame_ends;
+static uint8_t *frame_terms;
+static int frame_cnt = 0;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief 記録を作る
+ * @param size 記録のバイト数
+ */
+static void make_record(uint32_t size) {
+    record = malloc(size);
+    frame_ends = malloc(sizeof(*frame_ends) * (size / (FRAME_LEN - 2) + 1));
+    frame_terms = malloc(size / (FRAME_LEN - 2) + 1);
+    chunks = malloc(sizeof(*chunks) * size);
+    uint32_t len = 0;
+    int64_t us = 0;
+    srand(1);
+    while (len + FRAME_LEN <= size) {
+        char frame[FRAME_LEN + 1];
+        snprintf(frame, sizeof(frame), "01A%c%05u.%03u\r\n",
+                 (rand() & 1) ? '+' : '-', (unsigned)rand() % 100000u,
+                 (unsigned)rand() % 1000u);
+        bool idle = frame_cnt % 16 == 15;
+        int n = idle ? FRAME_LEN - 2 : FRAME_LEN;
+        memcpy(record + len, frame, n);
+        // 1-16バイトずつ届く。区切りはチャンクの途中にもある
+        for (int off = 0; off < n;) {
+            int c = 1 + rand() % 16;
+            if (c > n - off) c = n - off;
+            us += (int64_t)c * BYTE_US;
+            chunks[chunk_cnt++] = (chunk_t){us, len + off, (uint8_t)c};
+            off += c;
+        }
+        len += n;
+        frame_ends[frame_cnt] = len;
+        frame_terms[frame_cnt++] = idle ? 0 : 2;
+        if (idle) us += IDLE_US * 3 / 2;
+    }
+}
+
+static my_term_match_t match;
+static my_uart_framer_t framer;
+static my_ring_buffer_t rb;
+static int frames_out = 0;
+static uint32_t bytes_out = 0;
+
+/**
+ * @brief my_if_uart_forward_frame() の代わり。取り出したフレームが記録と同じか
+ */
+static void forward_frame(int terminator_len) {
+    static uint8_t buf[RING_SIZE];
+    int n = my_ring_buffer_pop_n(&rb, buf, my_ring_buffer_content_length(&rb));
+    if (frames_out >= frame_cnt) {
+        CHECK(false);
+        return;
+    }
+    uint32_t start = frames_out > 0 ? frame_ends[frames_out - 1] : 0;
+    CHECK((uint32_t)n == frame_ends[frames_out] - start);
+    CHECK(memcmp(buf, record + start, n) == 0);
+    CHECK(terminator_len == frame_terms[frames_out]);
+    frames_out++;
+    bytes_out += n;
+}
+
+/**
+ * @brief 記録を再生する。my_if_uart_stream() の受信ループと同じ手順
+ */
+static void replay(void) {
+    for (int i = 0; i < chunk_cnt; i++) {
+        const chunk_t *c = &chunks[i];
+        // 次のチャンクより先に途切れるなら、イベント待ちが時間切れになって区切る
+        int64_t idle_us = my_uart_framer_wait_us(&framer, c->us);
+        if (idle_us >= 0 && framer.last_us + IDLE_US < c->us &&
+            my_uart_framer_poll(&framer, framer.last_us + IDLE_US) ==
+                MY_UART_FRAMER_END_IDLE) {
+            forward_frame(0);
+        }
+        const uint8_t *data = record + c->off;
+        int off = 0;
+        while (off < c->len) {
+            my_uart_framer_end_t end;
+            int used = my_uart_framer_feed(&framer, data + off, c->len - off,
+                                           c->us, &end);
+            my_ring_buffer_push_n(&rb, data + off, used);
+            off += used;
+            if (end != MY_UART_FRAMER_END_NONE) {
+                forward_frame(framer.term_len);
+            }
+        }
+    }
+    // 最後のフレームは途切れで区切る
+    if (my_uart_framer_poll(&framer, framer.last_us + IDLE_US) ==
+        MY_UART_FRAMER_END_IDLE) {
+        forward_frame(0);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int mb = argc > 1 ? atoi(argv[1]) : 4;
+    if (mb <= 0) mb = 1;
+    make_record((uint32_t)mb * 1024 * 1024);
+
+    const uint8_t *seqs[1] = {(const uint8_t *)"\r\n"};
+    int lens[1] = {2};
+    CHECK(my_term_match_compile(&match, seqs, lens, 1) == 0);
+    my_uart_framer_init(&framer, &match, IDLE_US);
+    CHECK(my_ring_buffer_init(&rb, RING_SIZE));
+
+    int64_t start = now_ns();
+    replay();
+    double sec = (double)(now_ns() - start) / 1e9;
+
+    CHECK(frames_out == frame_cnt);
+    CHECK(framer.terminated_cnt + framer.idle_cnt == (uint32_t)frame_cnt);
+    printf("%d frames (%u by idle gap), %u bytes in %d chunks\n", frames_out,
+           framer.idle_cnt, bytes_out, chunk_cnt);
+    printf("host replay: %.2f M frames/s  %.1f MB/s\n", frames_out / sec / 1e6,
+           bytes_out / sec / 1e6);
+    printf("9600 baud 8N2 line rate: %.0f B/s  %.1f frames/s\n",
+           1000000.0 / BYTE_US, 1000000.0 / BYTE_US / FRAME_LEN);
+    my_ring_buffer_deinit(&rb);
+    return HOST_TEST_RESULT();
+}
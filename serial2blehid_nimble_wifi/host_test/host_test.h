@@ -0,0 +1,25 @@
+/**
+ * @file host_test.h
+ *   ホストテストの共通部分。CHECKが失敗しても続け、最後に失敗数で終わる
+ */
+
+#ifndef host_test_h
+#define host_test_h 1
+
+#include <stdio.h>
+
+static int host_test_failed = 0;
+
+#define CHECK(cond)                                                      \
+    do {                                                                 \
+        if (!(cond)) {                                                   \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);       \
+            host_test_failed++;                                          \
+        }                                                                \
+    } while (0)
+
+#define HOST_TEST_RESULT()                                               \
+    (printf("%s: %s\n", __FILE__, host_test_failed ? "FAILED" : "ok"),   \
+     host_test_failed != 0)
+
+#endif
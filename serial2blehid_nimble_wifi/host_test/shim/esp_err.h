@@ -0,0 +1,18 @@
+/**
+ * @file esp_err.h
+ *   ホストテスト用。テストするモジュールが使うエラーコードだけを置く
+ */
+
+#ifndef esp_err_h
+#define esp_err_h 1
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_NVS_NOT_FOUND 0x1102
+#define ESP_ERR_NVS_NOT_ENOUGH_SPACE 0x1105
+#define ESP_ERR_NVS_INVALID_LENGTH 0x110c
+
+#endif
@@ -0,0 +1,18 @@
+/**
+ * @file esp_log.h
+ *   ホストテスト用。エラーだけを標準エラー出力に出し、他は捨てる
+ */
+
+#ifndef esp_log_h
+#define esp_log_h 1
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, fmt, ...) \
+    fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) do { } while (0)
+#define ESP_LOGI(tag, fmt, ...) do { } while (0)
+#define ESP_LOGD(tag, fmt, ...) do { } while (0)
+#define ESP_LOGV(tag, fmt, ...) do { } while (0)
+
+#endif
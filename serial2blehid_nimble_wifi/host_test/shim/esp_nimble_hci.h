@@ -0,0 +1,9 @@
+/**
+ * @file esp_nimble_hci.h
+ *   ホストテスト用。gatt_svr.h が読むだけなので空
+ */
+
+#ifndef esp_nimble_hci_h
+#define esp_nimble_hci_h 1
+
+#endif
@@ -0,0 +1,13 @@
+/**
+ * @file esp_timer.h
+ *   ホストテスト用。起動からの時間は freertos_sim.c のtickから作る
+ */
+
+#ifndef esp_timer_h
+#define esp_timer_h 1
+
+#include <stdint.h>
+
+extern int64_t esp_timer_get_time(void);
+
+#endif
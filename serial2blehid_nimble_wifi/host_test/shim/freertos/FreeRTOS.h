@@ -0,0 +1,35 @@
+/**
+ * @file FreeRTOS.h
+ *   ホストテスト用。1つのスレッドの中で、tickを進めながらFreeRTOSを真似る。
+ *   待ちが起きると、待った分だけtickを進め、1tickごとに sim_freertos_tick_hook を呼ぶ。
+ *   テストは、このフックで通信相手（コントローラなど）を動かす。
+ */
+
+#ifndef FreeRTOS_h
+#define FreeRTOS_h 1
+
+#include <assert.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS (pdTRUE)
+#define pdFAIL (pdFALSE)
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ (CONFIG_FREERTOS_HZ)
+#define pdMS_TO_TICKS(ms) \
+    ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+
+// 1tick進むごとに呼ばれる。NULLなら何もしない
+extern void (*sim_freertos_tick_hook)(TickType_t now);
+
+extern void sim_freertos_advance(TickType_t ticks);
+
+#endif
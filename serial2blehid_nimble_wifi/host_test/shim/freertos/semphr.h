@@ -0,0 +1,27 @@
+/**
+ * @file semphr.h
+ *   ホストテスト用。セマフォとミューテックスは、上限付きのカウンタで真似る。
+ *   待つときは、取れるようになるか待ち時間が過ぎるまでtickを進める。
+ */
+
+#ifndef semphr_h
+#define semphr_h 1
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct sim_freertos_sem *SemaphoreHandle_t;
+
+extern SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max,
+                                                  UBaseType_t initial);
+extern SemaphoreHandle_t xSemaphoreCreateBinary(void);
+extern SemaphoreHandle_t xSemaphoreCreateMutex(void);
+extern BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+extern BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+extern UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t sem);
+
+// 成功したTakeとGiveの回数、上限に達していて失敗したGiveの回数
+extern uint32_t sim_freertos_takes;
+extern uint32_t sim_freertos_gives;
+extern uint32_t sim_freertos_over_gives;
+
+#endif
@@ -0,0 +1,21 @@
+/**
+ * @file task.h
+ *   ホストテスト用。タスクは切り替わらない。
+ *   xTaskGetCurrentTaskHandle() は sim_freertos_current_task を返すので、
+ *   別のタスクから呼ばれたことにしたいときは、テストがこれを書き換える。
+ */
+
+#ifndef task_h
+#define task_h 1
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+
+extern TaskHandle_t sim_freertos_current_task;
+
+extern TickType_t xTaskGetTickCount(void);
+extern void vTaskDelay(TickType_t ticks);
+extern TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+#endif
@@ -0,0 +1,91 @@
+/**
+ * @file freertos_sim.c
+ *   ホストテスト用のFreeRTOS。FreeRTOS.h を参照
+ *   esp_timer_get_time() も、同じtickから作る
+ */
+
+#include <stdlib.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+struct sim_freertos_sem {
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+void (*sim_freertos_tick_hook)(TickType_t now) = NULL;
+TaskHandle_t sim_freertos_current_task = (TaskHandle_t)1;
+uint32_t sim_freertos_takes = 0;
+uint32_t sim_freertos_gives = 0;
+uint32_t sim_freertos_over_gives = 0;
+
+static TickType_t sim_freertos_now = 0;
+
+/**
+ * @brief tickを進める。1tickごとにフックを呼ぶ
+ */
+void sim_freertos_advance(TickType_t ticks) {
+    for (TickType_t i = 0; i < ticks; i++) {
+        sim_freertos_now++;
+        if (sim_freertos_tick_hook != NULL) {
+            sim_freertos_tick_hook(sim_freertos_now);
+        }
+    }
+}
+
+TickType_t xTaskGetTickCount(void) { return sim_freertos_now; }
+
+int64_t esp_timer_get_time(void) {
+    return (int64_t)sim_freertos_now * 1000000 / configTICK_RATE_HZ;
+}
+
+void vTaskDelay(TickType_t ticks) { sim_freertos_advance(ticks); }
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return sim_freertos_current_task;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max,
+                                           UBaseType_t initial) {
+    SemaphoreHandle_t sem = malloc(sizeof(*sem));
+    if (sem != NULL) {
+        sem->count = initial;
+        sem->max = max;
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait) {
+    for (TickType_t waited = 0; sem->count == 0; waited++) {
+        if (waited >= wait) {
+            return pdFALSE;
+        }
+        sim_freertos_advance(1);
+    }
+    sem->count--;
+    sim_freertos_takes++;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    if (sem->count >= sem->max) {
+        sim_freertos_over_gives++;
+        return pdFALSE;
+    }
+    sem->count++;
+    sim_freertos_gives++;
+    return pdTRUE;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t sem) { return sem->count; }
@@ -0,0 +1,15 @@
+/**
+ * @file ble_gap.h
+ *   ホストテスト用。hid_func.c が使う接続の情報だけを置く
+ */
+
+#ifndef ble_gap_h
+#define ble_gap_h 1
+
+#include <stdint.h>
+
+struct ble_gap_conn_desc {
+    uint16_t conn_handle;
+};
+
+#endif
@@ -0,0 +1,61 @@
+/**
+ * @file ble_hs.h
+ *   ホストテスト用。NimBLEのエラーコードと、hid_func.c が使うmbufとGATTの関数を置く。
+ *   関数は nimble_sim.c にある
+ */
+
+#ifndef ble_hs_h
+#define ble_hs_h 1
+
+#include <stdint.h>
+
+#define BLE_HS_EAGAIN 1
+#define BLE_HS_EALREADY 2
+#define BLE_HS_EINVAL 3
+#define BLE_HS_EMSGSIZE 4
+#define BLE_HS_ENOENT 5
+#define BLE_HS_ENOMEM 6
+#define BLE_HS_ENOTCONN 7
+#define BLE_HS_ENOTSUP 8
+#define BLE_HS_ETIMEOUT 13
+#define BLE_HS_EDONE 14
+
+// 1つのバッファだけのmbuf
+#define SIM_MBUF_SIZE (64)
+
+struct os_mbuf {
+    uint16_t len;
+    uint8_t data[SIM_MBUF_SIZE];
+};
+
+#define OS_MBUF_PKTLEN(om) ((om)->len)
+
+// gatt_svr.h の宣言に要る
+struct ble_gatt_access_ctxt;
+struct ble_gatt_svc_def {
+    uint8_t type;
+};
+
+extern int os_mbuf_append(struct os_mbuf *om, const void *data, uint16_t len);
+extern int os_mbuf_free_chain(struct os_mbuf *om);
+extern struct os_mbuf *ble_hs_mbuf_from_flat(const void *buf, uint16_t len);
+extern int ble_hs_mbuf_to_flat(const struct os_mbuf *om, void *flat,
+                               uint16_t max_len, uint16_t *out_copy_len);
+
+extern int ble_gattc_notify(uint16_t conn_handle, uint16_t chr_val_handle);
+extern int ble_gattc_notify_custom(uint16_t conn_handle,
+                                   uint16_t chr_val_handle,
+                                   struct os_mbuf *om);
+extern int ble_gattc_indicate(uint16_t conn_handle, uint16_t chr_val_handle);
+extern int ble_gattc_indicate_custom(uint16_t conn_handle,
+                                     uint16_t chr_val_handle,
+                                     struct os_mbuf *om);
+extern void ble_gatts_chr_updated(uint16_t chr_val_handle);
+
+// 送ったnotify/indicateの数と、最後に送ったもの
+extern uint32_t sim_nimble_sent;
+extern uint16_t sim_nimble_last_conn;
+extern uint16_t sim_nimble_last_handle;
+extern struct os_mbuf sim_nimble_last_value;
+
+#endif
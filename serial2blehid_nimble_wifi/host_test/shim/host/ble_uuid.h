@@ -0,0 +1,9 @@
+/**
+ * @file ble_uuid.h
+ *   ホストテスト用。gatt_svr.h が読むだけなので空
+ */
+
+#ifndef ble_uuid_h
+#define ble_uuid_h 1
+
+#endif
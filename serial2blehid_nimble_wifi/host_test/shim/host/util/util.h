@@ -0,0 +1,9 @@
+/**
+ * @file util.h
+ *   ホストテスト用。gatt_svr.h が読むだけなので空
+ */
+
+#ifndef util_h
+#define util_h 1
+
+#endif
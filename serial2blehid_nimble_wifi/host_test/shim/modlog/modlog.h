@@ -0,0 +1,9 @@
+/**
+ * @file modlog.h
+ *   ホストテスト用。gatt_svr.h が読むだけなので空
+ */
+
+#ifndef modlog_h
+#define modlog_h 1
+
+#endif
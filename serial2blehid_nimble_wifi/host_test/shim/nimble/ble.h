@@ -0,0 +1,9 @@
+/**
+ * @file ble.h
+ *   ホストテスト用。gatt_svr.h が読むだけなので空
+ */
+
+#ifndef ble_h
+#define ble_h 1
+
+#endif
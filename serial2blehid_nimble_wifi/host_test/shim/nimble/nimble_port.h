@@ -0,0 +1,9 @@
+/**
+ * @file nimble_port.h
+ *   ホストテスト用。gatt_svr.h が読むだけなので空
+ */
+
+#ifndef nimble_port_h
+#define nimble_port_h 1
+
+#endif
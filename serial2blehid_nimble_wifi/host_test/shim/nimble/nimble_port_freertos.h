@@ -0,0 +1,9 @@
+/**
+ * @file nimble_port_freertos.h
+ *   ホストテスト用。gatt_svr.h が読むだけなので空
+ */
+
+#ifndef nimble_port_freertos_h
+#define nimble_port_freertos_h 1
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * @file nimble_sim.c
+ *   ホストテスト用のmbufとGATTの送信。host/ble_hs.h を参照
+ *   mbufは SIM_MBUF_COUNT 個の中から借りる。送信は記録するだけで、mbufはすぐに返す。
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "host/ble_hs.h"
+
+#define SIM_MBUF_COUNT (16)
+
+static struct os_mbuf sim_mbufs[SIM_MBUF_COUNT];
+static bool sim_mbuf_used[SIM_MBUF_COUNT];
+
+uint32_t sim_nimble_sent = 0;
+uint16_t sim_nimble_last_conn = 0;
+uint16_t sim_nimble_last_handle = 0;
+struct os_mbuf sim_nimble_last_value;
+
+int os_mbuf_append(struct os_mbuf *om, const void *data, uint16_t len) {
+    if (om->len + len > SIM_MBUF_SIZE) {
+        return BLE_HS_ENOMEM;
+    }
+    memcpy(om->data + om->len, data, len);
+    om->len += len;
+    return 0;
+}
+
+int os_mbuf_free_chain(struct os_mbuf *om) {
+    if (om != NULL) {
+        sim_mbuf_used[om - sim_mbufs] = false;
+    }
+    return 0;
+}
+
+struct os_mbuf *ble_hs_mbuf_from_flat(const void *buf, uint16_t len) {
+    for (int i = 0; i < SIM_MBUF_COUNT; i++) {
+        if (!sim_mbuf_used[i]) {
+            sim_mbuf_used[i] = true;
+            sim_mbufs[i].len = 0;
+            if (os_mbuf_append(&sim_mbufs[i], buf, len) != 0) {
+                sim_mbuf_used[i] = false;
+                return NULL;
+            }
+            return &sim_mbufs[i];
+        }
+    }
+    return NULL;
+}
+
+int ble_hs_mbuf_to_flat(const struct os_mbuf *om, void *flat, uint16_t max_len,
+                        uint16_t *out_copy_len) {
+    uint16_t len = om->len < max_len ? om->len : max_len;
+    memcpy(flat, om->data, len);
+    if (out_copy_len != NULL) {
+        *out_copy_len = len;
+    }
+    return len < om->len ? BLE_HS_EMSGSIZE : 0;
+}
+
+/**
+ * @brief 送ったことを記録する。om がNULLなら値は空にする
+ */
+static int sim_nimble_send(uint16_t conn_handle, uint16_t chr_val_handle,
+                           struct os_mbuf *om) {
+    sim_nimble_sent++;
+    sim_nimble_last_conn = conn_handle;
+    sim_nimble_last_handle = chr_val_handle;
+    sim_nimble_last_value.len = 0;
+    if (om != NULL) {
+        sim_nimble_last_value = *om;
+        os_mbuf_free_chain(om);
+    }
+    return 0;
+}
+
+int ble_gattc_notify(uint16_t conn_handle, uint16_t chr_val_handle) {
+    return sim_nimble_send(conn_handle, chr_val_handle, NULL);
+}
+
+int ble_gattc_notify_custom(uint16_t conn_handle, uint16_t chr_val_handle,
+                            struct os_mbuf *om) {
+    return sim_nimble_send(conn_handle, chr_val_handle, om);
+}
+
+int ble_gattc_indicate(uint16_t conn_handle, uint16_t chr_val_handle) {
+    return sim_nimble_send(conn_handle, chr_val_handle, NULL);
+}
+
+int ble_gattc_indicate_custom(uint16_t conn_handle, uint16_t chr_val_handle,
+                              struct os_mbuf *om) {
+    return sim_nimble_send(conn_handle, chr_val_handle, om);
+}
+
+void ble_gatts_chr_updated(uint16_t chr_val_handle) {
+    sim_nimble_send(0xffff, chr_val_handle, NULL);
+}
@@ -0,0 +1,47 @@
+/**
+ * @file nvs.h
+ *   ホストテスト用。キーと値を nvs_sim.c のメモリに置く。
+ *   値は fork() した子プロセスと共有するので、子プロセスを前回の起動として、
+ *   親プロセスで再起動後の状態を調べられる。
+ */
+
+#ifndef nvs_h
+#define nvs_h 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE,
+} nvs_open_mode_t;
+
+extern esp_err_t nvs_open(const char *name, nvs_open_mode_t mode,
+                          nvs_handle_t *handle);
+extern esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key,
+                              void *value, size_t *length);
+extern esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key,
+                              const void *value, size_t length);
+extern esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key,
+                             uint32_t *value);
+extern esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key,
+                             uint32_t value);
+extern esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key);
+extern esp_err_t nvs_erase_all(nvs_handle_t handle);
+extern esp_err_t nvs_commit(nvs_handle_t handle);
+
+// 書き込みの回数（このプロセスで）
+extern uint32_t sim_nvs_writes;
+
+// trueなら書き込みを ESP_ERR_NVS_NOT_ENOUGH_SPACE で失敗させる
+extern bool sim_nvs_fail_writes;
+
+// 全ての名前空間の値を消す
+extern void sim_nvs_clear(void);
+
+#endif
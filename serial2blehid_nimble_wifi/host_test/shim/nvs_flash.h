@@ -0,0 +1,9 @@
+/**
+ * @file nvs_flash.h
+ *   ホストテスト用。hid_codes.h が読むだけなので空
+ */
+
+#ifndef nvs_flash_h
+#define nvs_flash_h 1
+
+#endif
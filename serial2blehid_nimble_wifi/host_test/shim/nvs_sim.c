@@ -0,0 +1,153 @@
+/**
+ * @file nvs_sim.c
+ *   ホストテスト用のNVS。nvs.h を参照
+ */
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include "nvs.h"
+
+#define SIM_NVS_NAMESPACES_MAX (8)
+#define SIM_NVS_KEYS_MAX (64)
+#define SIM_NVS_NAME_MAX (16)
+#define SIM_NVS_VALUE_MAX (2048)
+
+/**
+ * @brief 1つのキーと値
+ */
+typedef struct {
+    bool used;
+    nvs_handle_t handle;  // 名前空間
+    char key[SIM_NVS_NAME_MAX];
+    size_t len;
+    uint8_t value[SIM_NVS_VALUE_MAX];
+} sim_nvs_entry_t;
+
+/**
+ * @brief 全ての名前空間の値。fork() した子プロセスと共有する
+ */
+typedef struct {
+    char names[SIM_NVS_NAMESPACES_MAX][SIM_NVS_NAME_MAX];
+    sim_nvs_entry_t entries[SIM_NVS_KEYS_MAX];
+} sim_nvs_store_t;
+
+static sim_nvs_store_t *sim_nvs = NULL;
+
+uint32_t sim_nvs_writes = 0;
+bool sim_nvs_fail_writes = false;
+
+/**
+ * @brief 値を置く領域。初めて使うときに、子プロセスと共有するメモリに用意する
+ */
+static sim_nvs_store_t *sim_nvs_store(void) {
+    if (sim_nvs == NULL) {
+        void *p = mmap(NULL, sizeof(*sim_nvs), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        sim_nvs = p != MAP_FAILED ? p : NULL;
+        if (sim_nvs != NULL) {
+            memset(sim_nvs, 0, sizeof(*sim_nvs));
+        }
+    }
+    return sim_nvs;
+}
+
+static sim_nvs_entry_t *sim_nvs_find(nvs_handle_t handle, const char *key) {
+    sim_nvs_store_t *s = sim_nvs_store();
+    for (int i = 0; s != NULL && i < SIM_NVS_KEYS_MAX; i++) {
+        sim_nvs_entry_t *e = &s->entries[i];
+        if (e->used && e->handle == handle && strcmp(e->key, key) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+void sim_nvs_clear(void) {
+    sim_nvs_store_t *s = sim_nvs_store();
+    if (s != NULL) {
+        memset(s, 0, sizeof(*s));
+    }
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode,
+                   nvs_handle_t *handle) {
+    (void)mode;
+    sim_nvs_store_t *s = sim_nvs_store();
+    if (s == NULL || strlen(name) >= SIM_NVS_NAME_MAX) return ESP_FAIL;
+    for (int i = 0; i < SIM_NVS_NAMESPACES_MAX; i++) {
+        if (s->names[i][0] == '\0') {
+            strcpy(s->names[i], name);
+        }
+        if (strcmp(s->names[i], name) == 0) {
+            *handle = (nvs_handle_t)(i + 1);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value,
+                       size_t *length) {
+    const sim_nvs_entry_t *e = sim_nvs_find(handle, key);
+    if (e == NULL) return ESP_ERR_NVS_NOT_FOUND;
+    if (value == NULL) {
+        *length = e->len;
+        return ESP_OK;
+    }
+    if (*length < e->len) return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(value, e->value, e->len);
+    *length = e->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key,
+                       const void *value, size_t length) {
+    sim_nvs_store_t *s = sim_nvs_store();
+    if (s == NULL || sim_nvs_fail_writes || length > SIM_NVS_VALUE_MAX ||
+        strlen(key) >= SIM_NVS_NAME_MAX) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    sim_nvs_entry_t *e = sim_nvs_find(handle, key);
+    for (int i = 0; e == NULL && i < SIM_NVS_KEYS_MAX; i++) {
+        if (!s->entries[i].used) e = &s->entries[i];
+    }
+    if (e == NULL) return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    e->used = true;
+    e->handle = handle;
+    strcpy(e->key, key);
+    memcpy(e->value, value, length);
+    e->len = length;
+    sim_nvs_writes++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key,
+                      uint32_t *value) {
+    size_t len = sizeof(*value);
+    return nvs_get_blob(handle, key, value, &len);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    sim_nvs_entry_t *e = sim_nvs_find(handle, key);
+    if (e == NULL) return ESP_ERR_NVS_NOT_FOUND;
+    e->used = false;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    sim_nvs_store_t *s = sim_nvs_store();
+    for (int i = 0; s != NULL && i < SIM_NVS_KEYS_MAX; i++) {
+        if (s->entries[i].handle == handle) s->entries[i].used = false;
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    (void)handle;
+    return ESP_OK;
+}
@@ -0,0 +1,14 @@
+/**
+ * @file sdkconfig.h
+ *   ホストテスト用。../sdkconfig のうち、テストするモジュールが使う値だけを置く
+ */
+
+#ifndef sdkconfig_h
+#define sdkconfig_h 1
+
+#define CONFIG_FREERTOS_HZ 1000
+#define CONFIG_BT_NIMBLE_MAX_CONNECTIONS 3
+#define CONFIG_MY_FRAME_LOG_ENABLE 1
+#define CONFIG_MY_FRAME_LOG_NVS_SEGMENTS 8
+
+#endif
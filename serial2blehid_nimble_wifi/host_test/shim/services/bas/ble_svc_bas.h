@@ -0,0 +1,9 @@
+/**
+ * @file ble_svc_bas.h
+ *   ホストテスト用。gatt_svr.h が読むだけなので空
+ */
+
+#ifndef ble_svc_bas_h
+#define ble_svc_bas_h 1
+
+#endif
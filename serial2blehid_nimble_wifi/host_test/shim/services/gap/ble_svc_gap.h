@@ -0,0 +1,9 @@
+/**
+ * @file ble_svc_gap.h
+ *   ホストテスト用。gatt_svr.h が読むだけなので空
+ */
+
+#ifndef ble_svc_gap_h
+#define ble_svc_gap_h 1
+
+#endif
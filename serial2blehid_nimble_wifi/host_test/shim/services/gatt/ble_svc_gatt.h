@@ -0,0 +1,9 @@
+/**
+ * @file ble_svc_gatt.h
+ *   ホストテスト用。gatt_svr.h が読むだけなので空
+ */
+
+#ifndef ble_svc_gatt_h
+#define ble_svc_gatt_h 1
+
+#endif
@@ -0,0 +1,314 @@
+/**
+ * @file sim_hid_sched.c
+ *   my_hid_sched のホストシミュレーション
+ *
+ *   コントローラを次のように真似て、1フレームを送り終わるまでの時間と、1秒あたりの文字数を出す。
+ *     - 送信バッファは全接続で SIM_BUFFERS 個を共用する。空きが無ければ BLE_HS_ENOMEM を返す
+ *     - NimBLEと同じく、送信した関数の中で BLE_GAP_EVENT_NOTIFY_TX を呼ぶ（失敗したときも呼ぶ）
+ *     - 接続ごとに接続間隔で接続イベントが来て、1回に SIM_LINK_PER_EVENT 個まで送信バッファから送る
+ *     - 接続イベントの開始時刻は、接続ごとに少しずらす
+ *     - indicateでは、届いた接続イベントで応答が来たことにして、NimBLEホストタスクから
+ *       BLE_GAP_EVENT_NOTIFY_TX(BLE_HS_EDONE) を呼ぶ
+ *   フレームは、TC-101Aの15文字のフレームを my_hid_planner でレポートに変換したもの。
+ *
+ *   使い方: sim_hid_sched [接続間隔(ms) ...]
+ *   省略すると 7.5, 15, 30, 50ms で、1M/2M PHY、1-3接続を試す。
+ *   7.5msでは、indicateと、1つの接続で再送しても送れずに捨てる場合も試す。
+ *   フレームの途中で2番目の接続が切断され、同じ接続ハンドルで別のセントラルが接続する場合も試す。
+ *   切断と接続は、送り手が待っている間か、送信する関数を呼んでいる最中に、NimBLEホストタスクから来る。
+ *   次のどれかがあれば、ゼロ以外で終わる。
+ *     - 捨てたもの以外のレポートが、接続ごとに全て順番通りに届かない
+ *     - 切断された接続で、送信バッファに入らなかったレポートが捨てたものとして数えられない
+ *     - 切断したときに送っている途中だったレポートが、後から接続したセントラルに届く
+ *     - 全ての接続を閉じた後で、借りたクレジットが全て戻っていない、または戻しすぎた
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "host/ble_hs.h"
+#include "host_test.h"
+#include "my_hid_planner.h"
+#include "my_hid_sched.h"
+
+// 全接続で共用する送信バッファの数
+#define SIM_BUFFERS (12)
+
+// 1回の接続イベントで実際に送れるパケット数
+#define SIM_LINK_PER_EVENT_1M (6)
+#define SIM_LINK_PER_EVENT_2M (9)
+
+// 1接続に送るレポートの上限
+#define SIM_REPORTS_MAX (256)
+
+// レポートを送るタスクと、NimBLEホストタスク
+#define SIM_TASK_SENDER ((TaskHandle_t)1)
+#define SIM_TASK_HOST ((TaskHandle_t)2)
+
+// 送れずに捨てさせるレポートの番号
+#define SIM_DROP_REPORT (3)
+
+// 切断する接続と、このレポートを送り始めたら切断する番号
+#define SIM_CLOSE_CONN (1)
+#define SIM_CLOSE_REPORT (8)
+
+// フレームの途中で切断するか
+typedef enum {
+    SIM_CLOSE_NONE,
+    SIM_CLOSE_IN_WAIT,  // 送り手がその接続へ送るのを待っている間に切断する
+    SIM_CLOSE_IN_SEND,  // 送信する関数を呼んでいる最中に切断する
+} sim_close_t;
+
+/**
+ * @brief 1つの接続を真似る
+ */
+typedef struct {
+    uint32_t itvl_us;     // 接続間隔
+    uint64_t next_us;     // 次の接続イベントの時刻
+    int per_event;        // 1回の接続イベントで送れる数
+    bool indicate;        // notifyではなくindicateで送る
+    int fail_left;        // SIM_DROP_REPORT を BLE_HS_ENOMEM で失敗させる残り回数
+    int queued[SIM_REPORTS_MAX];  // 送信バッファに入っているレポートの番号
+    int queued_head;
+    int queued_tail;
+    bool reopened;        // 切断された後、同じ接続ハンドルで接続し直した
+    int accepted;         // 送信バッファに入れたレポート数
+    int lost;             // 送信バッファに入っていて、切断で消えたレポート数
+    int delivered;        // 届いたレポート数
+    int last_no;          // 最後に届いたレポートの番号
+    bool in_order;        // 全て順番通りに届いた
+    uint64_t last_us;     // 最後にレポートが届いた時刻
+} sim_conn_t;
+
+static sim_conn_t sim_conns[MY_HID_SCHED_CONN_MAX];
+static int sim_conn_cnt = 0;
+static int sim_buffers_used = 0;
+static sim_close_t sim_close = SIM_CLOSE_NONE;
+
+// my_hid_sched_send() で送っている接続。送っていなければ-1
+static int sim_sending_conn = -1;
+
+// SIM_CLOSE_CONN へ送っている途中で切断した
+static bool sim_closed_in_flight = false;
+
+// 次に送るレポートの番号
+static int sim_report_no = 0;
+
+/**
+ * @brief NimBLEホストタスクで SIM_CLOSE_CONN を切断し、同じ接続ハンドルで別のセントラルを接続する。
+ *        送信バッファに入っていた切断した接続のレポートは届かない
+ */
+static void sim_close_conn(void) {
+    sim_conn_t *c = &sim_conns[SIM_CLOSE_CONN];
+    TaskHandle_t task = sim_freertos_current_task;
+    sim_freertos_current_task = SIM_TASK_HOST;
+    my_hid_sched_conn_close(SIM_CLOSE_CONN);
+    my_hid_sched_conn_open(SIM_CLOSE_CONN, (uint16_t)(c->itvl_us / 1250));
+    sim_freertos_current_task = task;
+    c->lost = c->queued_head - c->queued_tail;
+    sim_buffers_used -= c->lost;
+    c->queued_tail = c->queued_head;
+    c->reopened = true;
+    sim_closed_in_flight = sim_sending_conn == SIM_CLOSE_CONN;
+    sim_close = SIM_CLOSE_NONE;
+}
+
+/**
+ * @brief 1tickごとに呼ばれる。過ぎた接続イベントで送信バッファから送る
+ */
+static void sim_tick(TickType_t now) {
+    uint64_t now_us = (uint64_t)now * 1000;
+    if (sim_close == SIM_CLOSE_IN_WAIT && sim_report_no >= SIM_CLOSE_REPORT &&
+        sim_sending_conn == SIM_CLOSE_CONN) {
+        sim_close_conn();
+    }
+    for (int i = 0; i < sim_conn_cnt; i++) {
+        sim_conn_t *c = &sim_conns[i];
+        while (c->next_us <= now_us) {
+            for (int n = 0; n < c->per_event && c->queued_tail != c->queued_head;
+                 n++) {
+                int r = c->queued[c->queued_tail++];
+                if (r <= c->last_no) c->in_order = false;
+                c->last_no = r;
+                c->delivered++;
+                c->last_us = c->next_us;
+                sim_buffers_used--;
+                if (c->indicate) {
+                    sim_freertos_current_task = SIM_TASK_HOST;
+                    my_hid_sched_notify_tx(i, BLE_HS_EDONE, true);
+                    sim_freertos_current_task = SIM_TASK_SENDER;
+                }
+            }
+            c->next_us += c->itvl_us;
+        }
+    }
+}
+
+/**
+ * @brief ble_gattc_notify_custom() の代わり
+ */
+static int sim_send(uint16_t conn_handle, const uint8_t *report) {
+    (void)report;
+    sim_conn_t *c = &sim_conns[conn_handle];
+    int rc = 0;
+    if (sim_close == SIM_CLOSE_IN_SEND && conn_handle == SIM_CLOSE_CONN &&
+        sim_report_no >= SIM_CLOSE_REPORT) {
+        // 送る前に切断された
+        sim_close_conn();
+        rc = BLE_HS_ENOTCONN;
+    } else if (c->reopened && sim_closed_in_flight) {
+        // 切断したセントラルへ送っていたレポートが、後から接続したセントラルへ送られた
+        CHECK(false);
+        rc = BLE_HS_ENOTCONN;
+    } else if (sim_report_no == SIM_DROP_REPORT && c->fail_left > 0) {
+        c->fail_left--;
+        rc = BLE_HS_ENOMEM;
+    } else if (sim_buffers_used >= SIM_BUFFERS) {
+        rc = BLE_HS_ENOMEM;
+    } else {
+        c->queued[c->queued_head++] = sim_report_no;
+        c->accepted++;
+        sim_buffers_used++;
+    }
+    my_hid_sched_notify_tx(conn_handle, rc, c->indicate);
+    return rc;
+}
+
+/**
+ * @brief 1つの条件で1フレームを送る
+ * @param itvl_ms 接続間隔(ms)
+ * @param phy_2m 2M PHYならtrue
+ * @param conns 接続数
+ * @param indicate indicateで送るならtrue
+ * @param drop 最初の接続で SIM_DROP_REPORT を再送しても送れないようにするならtrue
+ * @param close フレームの途中で SIM_CLOSE_CONN を切断するか
+ * @return 捨てたもの以外が全て順番通りに届き、クレジットが全て戻ればtrue
+ */
+static bool sim_run(double itvl_ms, bool phy_2m, int conns, bool indicate,
+                    bool drop, sim_close_t close) {
+    static const char frame[] = "01A+00012.345\r\n";
+    uint8_t reports[MY_HID_PLANNER_MAX_REPORTS(sizeof(frame))]
+                   [MY_HID_PLANNER_REPORT_SIZE];
+    int chars = (int)strlen(frame);
+    int n = my_hid_planner_plan((const uint8_t *)frame, chars, reports,
+                                MY_HID_PLANNER_MAX_REPORTS(sizeof(frame)));
+
+    uint16_t itvl = (uint16_t)(itvl_ms / 1.25 + 0.5);
+    memset(sim_conns, 0, sizeof(sim_conns));
+    sim_conn_cnt = conns;
+    sim_buffers_used = 0;
+    sim_close = close;
+    my_hid_sched_init();
+    uint32_t retried = my_hid_sched_retried();
+    uint32_t dropped = my_hid_sched_dropped();
+    uint32_t takes = sim_freertos_takes;
+    uint32_t gives = sim_freertos_gives;
+    uint32_t over_gives = sim_freertos_over_gives;
+    uint64_t start_us = (uint64_t)xTaskGetTickCount() * 1000;
+    for (int i = 0; i < conns; i++) {
+        sim_conn_t *c = &sim_conns[i];
+        c->itvl_us = itvl * 1250;
+        c->next_us = start_us + 1250 * (i + 1);
+        c->per_event = phy_2m ? SIM_LINK_PER_EVENT_2M : SIM_LINK_PER_EVENT_1M;
+        c->indicate = indicate;
+        c->fail_left = (drop && i == 0) ? MY_HID_SCHED_RETRY_MAX + 1 : 0;
+        c->last_no = -1;
+        c->in_order = true;
+        my_hid_sched_conn_open(i, itvl);
+        my_hid_sched_set_conn_phy(i, phy_2m);
+    }
+
+    for (sim_report_no = 0; sim_report_no < n; sim_report_no++) {
+        for (int i = 0; i < conns; i++) {
+            sim_sending_conn = i;
+            my_hid_sched_send(sim_send, i, reports[sim_report_no]);
+            sim_sending_conn = -1;
+            sim_closed_in_flight = false;
+        }
+    }
+    // 送信バッファが空になるまで進める
+    while (sim_buffers_used > 0) {
+        vTaskDelay(1);
+    }
+
+    bool ok = sim_close == SIM_CLOSE_NONE;
+    uint64_t end_us = start_us;
+    int expect_dropped = drop ? 1 : 0;
+    for (int i = 0; i < conns; i++) {
+        sim_conn_t *c = &sim_conns[i];
+        int expect = (drop && i == 0) ? n - 1 : n;
+        if (c->reopened) {
+            // 送信バッファに入れたレポートは、届いたか、切断で消えた。
+            // 切断したときに送っていたレポートは捨て、その後は接続し直したセントラルへ送る
+            expect_dropped += n - c->accepted;
+            if (c->delivered != c->accepted - c->lost) ok = false;
+        } else if (c->delivered != expect) {
+            ok = false;
+        }
+        if (!c->in_order) ok = false;
+        if (c->last_us > end_us) end_us = c->last_us;
+        my_hid_sched_conn_close(i);
+    }
+    if (my_hid_sched_dropped() - dropped != (uint32_t)expect_dropped) ok = false;
+    // 借りたクレジットは全て戻り、戻しすぎていない
+    bool credits_ok = sim_freertos_takes - takes == sim_freertos_gives - gives &&
+                      sim_freertos_over_gives == over_gives;
+    double ms = (end_us - start_us) / 1000.0;
+    static const char *const close_names[] = {"", "  close in wait",
+                                              "  close in send"};
+    printf("%6.2f ms  %s  %-8s %d conn  %2d chars %2d reports  %7.2f ms"
+           "  %7.1f chars/s  retried %lu  dropped %lu  %s  %s%s\n",
+           itvl * 1.25, phy_2m ? "2M" : "1M", indicate ? "indicate" : "notify",
+           conns, chars, n, ms,
+           ms > 0 ? chars * 1000.0 / ms : 0.0,
+           (unsigned long)(my_hid_sched_retried() - retried),
+           (unsigned long)(my_hid_sched_dropped() - dropped),
+           sim_close != SIM_CLOSE_NONE ? "NOT CLOSED"
+           : ok                        ? "ok"
+                                       : "LOST OR REORDERED",
+           credits_ok ? "credits ok" : "CREDITS LEAKED", close_names[close]);
+    return ok && credits_ok;
+}
+
+int main(int argc, char *argv[]) {
+    static const double itvls[] = {7.5, 15, 30, 50};
+    sim_freertos_tick_hook = sim_tick;
+    sim_freertos_current_task = SIM_TASK_SENDER;
+
+    // 以前は1文字ごとに押す・離すの2レポートを送り、それぞれの後に50ms待っていた
+    printf("fixed 50 ms delays: 15 chars  %d ms  %.1f chars/s\n", 15 * 2 * 50,
+           15 * 1000.0 / (15 * 2 * 50));
+    int fail = 0;
+    int cnt = argc > 1 ? argc - 1 : (int)(sizeof(itvls) / sizeof(itvls[0]));
+    for (int i = 0; i < cnt; i++) {
+        double itvl_ms = argc > 1 ? atof(argv[i + 1]) : itvls[i];
+        for (int phy = 0; phy < 2; phy++) {
+            for (int conns = 1; conns <= MY_HID_SCHED_CONN_MAX; conns++) {
+                if (!sim_run(itvl_ms, phy != 0, conns, false, false,
+                             SIM_CLOSE_NONE)) {
+                    fail++;
+                }
+            }
+        }
+    }
+    if (argc <= 1) {
+        for (int conns = 1; conns <= MY_HID_SCHED_CONN_MAX; conns += 2) {
+            if (!sim_run(7.5, false, conns, true, false, SIM_CLOSE_NONE)) fail++;
+            if (!sim_run(7.5, false, conns, false, true, SIM_CLOSE_NONE)) fail++;
+            if (!sim_run(7.5, false, conns, true, true, SIM_CLOSE_NONE)) fail++;
+        }
+        // フレームの途中で切断する。切断する接続が、クレジットか再送を待つ条件で試す
+        for (int close = SIM_CLOSE_IN_WAIT; close <= SIM_CLOSE_IN_SEND;
+             close++) {
+            if (!sim_run(7.5, false, 3, true, false, close)) fail++;
+            if (!sim_run(7.5, true, 2, true, false, close)) fail++;
+            if (!sim_run(15, true, 3, false, true, close)) fail++;
+        }
+    }
+    return fail != 0 || host_test_failed;
+}
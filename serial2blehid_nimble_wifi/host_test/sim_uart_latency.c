@@ -0,0 +1,302 @@
+/**
+ * @file sim_uart_latency.c
+ *   トリガーの立ち上がりから最初のHIDレポートが送られるまでの時間を、
+ *   以前のポーリングと、今の割り込み・イベント駆動の両方で再生して、段ごとに比べる。
+ *
+ *   どちらも同じ回線とセントラルを真似る。
+ *     - トリガーの立ち上がりでリクエストコマンド "QX\r\n" を送り、
+ *       TC-101Aが15バイトのフレーム "01A+00012.345\r\n" を返す。4800bps 8N2
+ *     - UARTドライバは、FIFOに閾値まで溜まるか、最後のバイトから閾値の時間だけ途切れたら、
+ *       受信したバイトをドライバのバッファに移す
+ *     - レポートは、呼んだ後の最初の接続イベントで送られる
+ *   タスクが動く時間（CPU時間）は数えず、待ち方だけで決まる時間を出す。
+ *
+ *   以前のポーリング（ESP-IDFの既定の閾値 FIFO 120バイト、途切れ10バイト分）
+ *     - UARTタスクは50msごとにトリガーピンを読み、立ち上がりを見つけたらセマフォを取って、
+ *       uart_read_bytes(50ms) と 100ms待ちを3回まで繰り返して終端文字列を待つ
+ *     - app_mainは50msごとにセマフォを10ms待って取り、共用バッファにフレームがあれば送る。
+ *       UARTタスクが受信中でセマフォを取れなければ、また50ms眠る
+ *   今の割り込み・イベント駆動（my_if_uart.c の閾値 FIFO 16バイト、途切れ2バイト分）
+ *     - 立ち上がりの割り込みでUARTタスクが起き、すぐにリクエストを送る
+ *     - UART_DATAイベントで起き、届いた分を my_uart_framer で区切る
+ *     - 区切れたらフレームキューに入れ、待っているHID送信タスクがすぐに取り出して送る
+ *
+ *   3つの周期（UARTタスク、app_main、接続イベント）と立ち上がりの位相は乱数で決める。
+ *   フレームが区切れない、または区切ったフレームが応答と違えば、ゼロ以外で終わる。
+ *
+ *   使い方: sim_uart_latency [応答までの時間(ms) ...]
+ *   省略すると、リクエストを受け取ってから応答を始めるまでの時間を0msと20msで試す。
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "my_term_match.h"
+#include "my_uart_framer.h"
+
+#define SIM_RUNS (100000)
+#define SIM_BAUD (4800)
+#define SIM_REQUEST "QX\r\n"
+#define SIM_REPLY "01A+00012.345\r\n"
+
+// 1バイト送る時間(us)。8N2は1バイト11ビット
+#define SIM_BYTE_US (11 * 1000000 / SIM_BAUD)
+
+// 以前のポーリング
+#define OLD_POLL_US (50000)        // UARTタスクとapp_mainの周期
+#define OLD_SEMAPHORE_US (10000)   // app_mainがセマフォを待つ時間
+#define OLD_READ_US (50000)        // uart_read_bytes の待ち時間
+#define OLD_READ_SLEEP_US (100000) // 読めなかったときの待ち
+#define OLD_READ_TRIES (3)
+#define OLD_FULL_THRESH (120)
+#define OLD_TOUT_SYMBOLS (10)
+
+// 今の割り込み・イベント駆動。my_if_uart.c と同じ値
+#define NEW_FULL_THRESH (16)
+#define NEW_TOUT_SYMBOLS (2)
+
+// ドライバがバイトをバッファに移す回数の上限
+#define SIM_CHUNKS_MAX (sizeof(SIM_REPLY))
+
+/**
+ * @brief 段
+ */
+enum {
+    STAGE_DETECT = 0,  // 立ち上がり -> リクエストを送る
+    STAGE_RECEIVE,     // リクエスト -> フレームが区切れる
+    STAGE_HANDOFF,     // 区切れる -> 送り手がフレームを取り出す
+    STAGE_REPORT,      // 取り出す -> 最初のレポートが送られる接続イベント
+    STAGE_TOTAL,
+    STAGES,
+};
+
+static const char *const stage_names[STAGES] = {
+    "edge->request", "request->frame", "frame->sender", "sender->report",
+    "total",
+};
+
+/**
+ * @brief ドライバがバッファに移したバイト
+ */
+typedef struct {
+    int64_t us;  // 移した時刻
+    int off;     // 応答の中の位置
+    int len;
+} sim_chunk_t;
+
+static int sim_reply_len;
+static uint32_t sim_seed = 1;
+
+static uint32_t sim_rand(void) {
+    sim_seed ^= sim_seed << 13;
+    sim_seed ^= sim_seed >> 17;
+    sim_seed ^= sim_seed << 5;
+    return sim_seed;
+}
+
+/**
+ * @brief リクエストを送った時刻から、ドライバが応答をバッファに移す時刻を求める
+ * @return 移す回数
+ */
+static int sim_driver(int64_t request_us, int64_t turnaround_us,
+                      int full_thresh, int tout_symbols, sim_chunk_t *chunks) {
+    int64_t start_us = request_us + (int64_t)strlen(SIM_REQUEST) * SIM_BYTE_US +
+                       turnaround_us;
+    int cnt = 0, fifo = 0;
+    for (int i = 0; i < sim_reply_len; i++) {
+        fifo++;
+        if (fifo == full_thresh) {
+            chunks[cnt++] = (sim_chunk_t){
+                start_us + (int64_t)(i + 1) * SIM_BYTE_US, i + 1 - fifo, fifo};
+            fifo = 0;
+        }
+    }
+    if (fifo > 0) {
+        chunks[cnt++] = (sim_chunk_t){
+            start_us + (int64_t)(sim_reply_len + tout_symbols) * SIM_BYTE_US,
+            sim_reply_len - fifo, fifo};
+    }
+    return cnt;
+}
+
+/**
+ * @brief 時刻より後の最初の接続イベント
+ */
+static int64_t sim_next_event(int64_t us, int64_t phase_us, int64_t itvl_us) {
+    if (us <= phase_us) return phase_us;
+    return phase_us + (us - phase_us + itvl_us - 1) / itvl_us * itvl_us;
+}
+
+/**
+ * @brief 以前のポーリング。立ち上がりは時刻ゼロ
+ * @param[out] t 段ごとの時刻。立ち上がり、リクエスト、区切れ、取り出し、接続イベント
+ * @return 1フレーム受信できたらtrue
+ */
+static bool sim_old(int64_t turnaround_us, int64_t itvl_us, int64_t *t) {
+    // UARTタスクは、立ち上がりの後の最初の周期でHを読む
+    int64_t request_us = 1 + (int64_t)(sim_rand() % OLD_POLL_US);
+    sim_chunk_t chunks[SIM_CHUNKS_MAX];
+    int cnt = sim_driver(request_us, turnaround_us, OLD_FULL_THRESH,
+                         OLD_TOUT_SYMBOLS, chunks);
+
+    // uart_read_bytes は受信バッファサイズだけ揃うか、待ち時間が過ぎたら戻る。
+    // 戻ったら、読んだ分に終端文字列があるかを見る
+    int64_t read_us = request_us;
+    int64_t done_us = -1;
+    for (int n = 0; n < OLD_READ_TRIES && done_us < 0; n++) {
+        int64_t ret_us = read_us + OLD_READ_US;
+        int got = 0;
+        for (int c = 0; c < cnt; c++) {
+            got += chunks[c].len;
+            if (got >= sim_reply_len) {
+                if (chunks[c].us > ret_us) got -= chunks[c].len;
+                else if (chunks[c].us > read_us) ret_us = chunks[c].us;
+                else ret_us = read_us;
+                break;
+            }
+            if (chunks[c].us > ret_us) {
+                got -= chunks[c].len;
+                break;
+            }
+        }
+        if (got >= sim_reply_len) {
+            done_us = ret_us;
+        } else {
+            read_us = ret_us + OLD_READ_SLEEP_US;
+        }
+    }
+    if (done_us < 0) return false;
+
+    // app_mainは、UARTタスクがセマフォを持っている間は10ms待ってから諦め、また50ms眠る
+    int64_t main_us = -2 * OLD_POLL_US + (int64_t)(sim_rand() % OLD_POLL_US);
+    int64_t sender_us;
+    while (1) {
+        if (main_us >= done_us) {
+            sender_us = main_us;
+            break;
+        }
+        if (main_us >= request_us) {
+            if (done_us <= main_us + OLD_SEMAPHORE_US) {
+                sender_us = done_us;
+                break;
+            }
+            main_us += OLD_SEMAPHORE_US;
+        }
+        main_us += OLD_POLL_US;
+    }
+    t[0] = 0;
+    t[1] = request_us;
+    t[2] = done_us;
+    t[3] = sender_us;
+    t[4] = sim_next_event(sender_us, (int64_t)(sim_rand() % itvl_us), itvl_us);
+    return true;
+}
+
+/**
+ * @brief 今の割り込み・イベント駆動。フレームは my_uart_framer で区切る
+ */
+static bool sim_new(int64_t turnaround_us, int64_t itvl_us, int64_t *t) {
+    static my_term_match_t match;
+    static my_uart_framer_t framer;
+    const uint8_t *seqs[1] = {(const uint8_t *)"\r\n"};
+    int lens[1] = {2};
+    my_term_match_compile(&match, seqs, lens, 1);
+    my_uart_framer_init(&framer, &match, 0);
+
+    // 割り込みで起きて、すぐにリクエストを送る
+    int64_t request_us = 0;
+    sim_chunk_t chunks[SIM_CHUNKS_MAX];
+    int cnt = sim_driver(request_us, turnaround_us, NEW_FULL_THRESH,
+                         NEW_TOUT_SYMBOLS, chunks);
+    int64_t done_us = -1;
+    int framed = 0;
+    for (int c = 0; c < cnt && done_us < 0; c++) {
+        my_uart_framer_end_t end;
+        const uint8_t *data = (const uint8_t *)SIM_REPLY + chunks[c].off;
+        int used = my_uart_framer_feed(&framer, data, chunks[c].len,
+                                       chunks[c].us, &end);
+        framed += used;
+        if (end == MY_UART_FRAMER_END_TERMINATOR) done_us = chunks[c].us;
+    }
+    if (done_us < 0 || framed != sim_reply_len) return false;
+
+    // フレームキューで待っているHID送信タスクが、すぐに取り出して送る
+    t[0] = 0;
+    t[1] = request_us;
+    t[2] = done_us;
+    t[3] = done_us;
+    t[4] = sim_next_event(done_us, (int64_t)(sim_rand() % itvl_us), itvl_us);
+    return true;
+}
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief 1つの方式を SIM_RUNS 回試し、段ごとの平均、中央値、95%、最大を出す
+ * @return 全て受信できたらtrue
+ */
+static bool sim_scheme(const char *name,
+                       bool (*run)(int64_t, int64_t, int64_t *),
+                       int64_t turnaround_us, int64_t itvl_us,
+                       double *mean_total) {
+    static int64_t samples[STAGES][SIM_RUNS];
+    for (int r = 0; r < SIM_RUNS; r++) {
+        int64_t t[5];
+        if (!run(turnaround_us, itvl_us, t)) {
+            printf("%s: frame not received\n", name);
+            return false;
+        }
+        for (int s = 0; s < STAGE_TOTAL; s++) samples[s][r] = t[s + 1] - t[s];
+        samples[STAGE_TOTAL][r] = t[4] - t[0];
+    }
+    printf("  %-9s", name);
+    for (int s = 0; s < STAGES; s++) {
+        double sum = 0;
+        for (int r = 0; r < SIM_RUNS; r++) sum += samples[s][r];
+        qsort(samples[s], SIM_RUNS, sizeof(int64_t), cmp_i64);
+        printf("  %6.1f/%6.1f/%6.1f", sum / SIM_RUNS / 1000.0,
+               samples[s][SIM_RUNS * 95 / 100] / 1000.0,
+               samples[s][SIM_RUNS - 1] / 1000.0);
+        if (s == STAGE_TOTAL) *mean_total = sum / SIM_RUNS / 1000.0;
+    }
+    printf("\n");
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    static const double turnarounds[] = {0, 20};
+    static const double itvls[] = {7.5, 15, 30};
+    sim_reply_len = (int)strlen(SIM_REPLY);
+    printf("mean/p95/max ms over %d runs, %d baud 8N2, %d-byte reply\n",
+           SIM_RUNS, SIM_BAUD, sim_reply_len);
+    int cnt = argc > 1 ? argc - 1
+                       : (int)(sizeof(turnarounds) / sizeof(turnarounds[0]));
+    for (int i = 0; i < cnt; i++) {
+        double turnaround_ms = argc > 1 ? atof(argv[i + 1]) : turnarounds[i];
+        int64_t turnaround_us = (int64_t)(turnaround_ms * 1000);
+        for (size_t j = 0; j < sizeof(itvls) / sizeof(itvls[0]); j++) {
+            int64_t itvl_us = (int64_t)(itvls[j] * 1000);
+            printf("reply after %.1f ms, interval %.1f ms\n", turnaround_ms,
+                   itvls[j]);
+            printf("  %-9s", "");
+            for (int s = 0; s < STAGES; s++) {
+                printf("  %-20s", stage_names[s]);
+            }
+            printf("\n");
+            double old_ms = 0, new_ms = 0;
+            CHECK(sim_scheme("polling", sim_old, turnaround_us, itvl_us,
+                             &old_ms));
+            CHECK(sim_scheme("event", sim_new, turnaround_us, itvl_us,
+                             &new_ms));
+            CHECK(new_ms < old_ms);
+        }
+    }
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,246 @@
+/**
+ * @file stress_ring_buffer_spsc.c
+ *   my_ring_buffer の SPSC モードのストレステストと、ロックする方法との速さ比べ。
+ *   生産者と消費者を別々のスレッドで動かし、消費者が取り出したバイトが
+ *   生産者の格納した順番どおりかを調べる。1つでも違えばゼロ以外で終わる。
+ *   比べる相手は、ファームウェアと同じく1つのリングバッファをロック（ここではmutex）で
+ *   守りながら my_ring_buffer_push/pop で出し入れする方法。
+ *   1バイトずつと、16バイトずつの、1秒あたりのバイト数を出す。
+ *
+ *   使い方: stress_ring_buffer_spsc [MB数]
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "host_test.h"
+#include "my_ring_buffer.h"
+
+// 格納できる数。受信バッファと同じくらいの小ささにして、満杯と空を頻繁に起こす
+#define RING_SIZE (100)
+#define CHUNK_LEN (16)
+
+/**
+ * @brief 測り方
+ */
+typedef enum {
+    MODE_SPSC = 0,    // SPSCモード。ロックしない
+    MODE_LOCKED,      // my_ring_buffer_t をmutexで守る
+} run_mode_t;
+
+/**
+ * @brief 1回の測定で、両方のスレッドが共有するもの
+ */
+typedef struct {
+    run_mode_t mode;
+    int chunk;      // 1ならpush/pop、それより大きければpush_n/pop_nで、最大この数ずつ
+    bool random;    // 1回ごとの数を1からchunkまでの乱数にする
+    uint64_t bytes; // 生産者が格納するバイト数
+    my_ring_buffer_spsc_t spsc;
+    my_ring_buffer_t locked;
+    pthread_mutex_t lock;
+    uint64_t errors;  // 順番が違ったバイト数
+    uint64_t full;    // 満杯で待った回数
+    uint64_t empty;   // 空で待った回数
+} run_t;
+
+/**
+ * @brief i番目に格納するバイト。256バイトずれても見分けられるよう、上位の桁も混ぜる
+ */
+static inline uint8_t byte_at(uint64_t i) {
+    return (uint8_t)(i ^ (i >> 8) ^ (i >> 16) ^ (i >> 24));
+}
+
+static uint32_t next_rand(uint32_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+    return *s;
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief ロックする方法で格納する。上書きさせないよう、空きの分だけ格納する
+ * @return 格納した数
+ */
+static int locked_push(run_t *r, const uint8_t *data, int len) {
+    pthread_mutex_lock(&r->lock);
+    int space = r->locked.size - my_ring_buffer_content_length(&r->locked);
+    if (len > space) len = space;
+    if (len == 1) {
+        my_ring_buffer_push(&r->locked, data[0]);
+    } else if (len > 1) {
+        my_ring_buffer_push_n(&r->locked, data, len);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return len;
+}
+
+static int locked_pop(run_t *r, uint8_t *data, int len) {
+    pthread_mutex_lock(&r->lock);
+    int n;
+    if (len == 1) {
+        n = my_ring_buffer_pop(&r->locked, data) ? 1 : 0;
+    } else {
+        n = my_ring_buffer_pop_n(&r->locked, data, len);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return n;
+}
+
+static void *producer(void *arg) {
+    run_t *r = (run_t *)arg;
+    uint32_t seed = 1;
+    uint8_t buf[CHUNK_LEN];
+    for (uint64_t i = 0; i < r->bytes;) {
+        int len = r->random ? 1 + next_rand(&seed) % r->chunk : r->chunk;
+        if ((uint64_t)len > r->bytes - i) len = (int)(r->bytes - i);
+        for (int j = 0; j < len; j++) buf[j] = byte_at(i + j);
+        int n;
+        if (r->mode == MODE_LOCKED) {
+            n = locked_push(r, buf, len);
+        } else if (len == 1) {
+            n = my_ring_buffer_spsc_push(&r->spsc, buf[0]) ? 1 : 0;
+        } else {
+            n = my_ring_buffer_spsc_push_n(&r->spsc, buf, len);
+        }
+        // 入りきらなかった分は次に回す
+        i += n;
+        if (n < len) {
+            r->full++;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    run_t *r = (run_t *)arg;
+    uint32_t seed = 2;
+    uint8_t buf[CHUNK_LEN];
+    for (uint64_t i = 0; i < r->bytes;) {
+        int len = r->random ? 1 + next_rand(&seed) % r->chunk : r->chunk;
+        int n;
+        if (r->mode == MODE_LOCKED) {
+            n = locked_pop(r, buf, len);
+        } else if (len == 1) {
+            n = my_ring_buffer_spsc_pop(&r->spsc, buf) ? 1 : 0;
+        } else {
+            n = my_ring_buffer_spsc_pop_n(&r->spsc, buf, len);
+        }
+        for (int j = 0; j < n; j++) {
+            if (buf[j] != byte_at(i + j)) r->errors++;
+        }
+        i += n;
+        if (n == 0) {
+            r->empty++;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 生産者と消費者のスレッドを動かし、終わるまでの時間を返す
+ */
+static int64_t run(run_t *r) {
+    CHECK(my_ring_buffer_spsc_init(&r->spsc, RING_SIZE));
+    CHECK(my_ring_buffer_init(&r->locked, RING_SIZE));
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_t prod, cons;
+    int64_t t0 = now_ns();
+    CHECK(pthread_create(&cons, NULL, consumer, r) == 0);
+    CHECK(pthread_create(&prod, NULL, producer, r) == 0);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+    int64_t ns = now_ns() - t0;
+    CHECK(r->errors == 0);
+    CHECK(my_ring_buffer_spsc_content_length(&r->spsc) == 0);
+    CHECK(my_ring_buffer_content_length(&r->locked) == 0);
+    pthread_mutex_destroy(&r->lock);
+    my_ring_buffer_spsc_deinit(&r->spsc);
+    my_ring_buffer_deinit(&r->locked);
+    r->locked.buffer = NULL;
+    return ns;
+}
+
+/**
+ * @brief 1つのスレッドで、満杯、空、折り返しを調べる
+ */
+static void check_single(void) {
+    my_ring_buffer_spsc_t rb = {0};
+    CHECK(my_ring_buffer_spsc_init(&rb, RING_SIZE));
+    // 容量は2のべき乗に切り上げる
+    CHECK(rb.size == 128 && rb.mask == 127);
+    uint8_t c;
+    CHECK(!my_ring_buffer_spsc_pop(&rb, &c));
+    uint8_t data[200], out[200];
+    for (int i = 0; i < 200; i++) data[i] = byte_at(i);
+    // 満杯なら入るだけ格納し、上書きしない
+    CHECK(my_ring_buffer_spsc_push_n(&rb, data, 200) == 128);
+    CHECK(!my_ring_buffer_spsc_push(&rb, 0xFF));
+    CHECK(my_ring_buffer_spsc_push_n(&rb, data, 1) == 0);
+    CHECK(my_ring_buffer_spsc_content_length(&rb) == 128);
+    CHECK(my_ring_buffer_spsc_pop_n(&rb, out, 100) == 100);
+    CHECK(memcmp(out, data, 100) == 0);
+    // 折り返して格納し、2つの範囲から取り出す
+    CHECK(my_ring_buffer_spsc_push_n(&rb, data + 128, 72) == 72);
+    CHECK(my_ring_buffer_spsc_pop(&rb, &c) && c == data[100]);
+    CHECK(my_ring_buffer_spsc_pop_n(&rb, out, 200) == 99);
+    CHECK(memcmp(out, data + 101, 99) == 0);
+    CHECK(my_ring_buffer_spsc_content_length(&rb) == 0);
+    // 空にすると、tailがheadに揃う
+    CHECK(my_ring_buffer_spsc_push_n(&rb, data, 10) == 10);
+    my_ring_buffer_spsc_reset(&rb);
+    CHECK(my_ring_buffer_spsc_content_length(&rb) == 0);
+    CHECK(my_ring_buffer_spsc_push_n(&rb, data, 128) == 128);
+    my_ring_buffer_spsc_deinit(&rb);
+}
+
+int main(int argc, char *argv[]) {
+    int mb = argc > 1 ? atoi(argv[1]) : 8;
+    if (mb <= 0) mb = 1;
+    uint64_t bytes = (uint64_t)mb * 1000 * 1000;
+    check_single();
+
+    // 1回ごとの数を乱数にして、満杯と空、折り返しの境目を様々に起こす
+    run_t stress = {.mode = MODE_SPSC, .chunk = CHUNK_LEN, .random = true,
+                    .bytes = bytes};
+    run(&stress);
+    printf("spsc stress: %llu bytes, %llu order errors, waited %llu full / "
+           "%llu empty\n",
+           (unsigned long long)bytes, (unsigned long long)stress.errors,
+           (unsigned long long)stress.full, (unsigned long long)stress.empty);
+    if (host_test_failed) return HOST_TEST_RESULT();
+
+    static const struct {
+        const char *name;
+        int chunk;
+    } benches[] = {
+        {"1-byte push/pop", 1},
+        {"16-byte push_n/pop_n", CHUNK_LEN},
+    };
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        run_t locked = {.mode = MODE_LOCKED, .chunk = benches[i].chunk,
+                        .bytes = bytes};
+        run_t spsc = {.mode = MODE_SPSC, .chunk = benches[i].chunk,
+                      .bytes = bytes};
+        int64_t locked_ns = run(&locked);
+        int64_t spsc_ns = run(&spsc);
+        printf("%-22s locked %7.1f MB/s  spsc %7.1f MB/s  x%.1f\n",
+               benches[i].name, bytes * 1e3 / locked_ns,
+               bytes * 1e3 / spsc_ns, (double)locked_ns / spsc_ns);
+    }
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,259 @@
+/**
+ * @file test_config_blob.c
+ *   my_config_blob のテスト。
+ *   乱数で作った設定値を書き出して読み戻し、同じになるかを調べる。
+ *   CRC、識別子、版数、長さのどれかが合わないバイト列は読めないこと、
+ *   新しい版で末尾に項目を足したバイト列は読めること、旧形式の文字列が読めることも調べる。
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "my_config_blob.h"
+
+static void random_seq(uint8_t *seq, uint8_t *len) {
+    *len = (uint8_t)(rand() % (MY_CONFIG_BLOB_SEQ_MAX + 1));
+    memset(seq, 0, MY_CONFIG_BLOB_SEQ_MAX);
+    for (int i = 0; i < *len; i++) seq[i] = (uint8_t)rand();
+}
+
+static void random_config(my_config_blob_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->baud_rate = (uint32_t)rand() << 16 ^ (uint32_t)rand();
+    cfg->receive_buffer_len = (uint16_t)rand();
+    random_seq(cfg->request_command, &cfg->request_command_len);
+    random_seq(cfg->terminator_sequence, &cfg->terminator_sequence_len);
+    random_seq(cfg->terminator_sequence_replace,
+               &cfg->terminator_sequence_replace_len);
+}
+
+/**
+ * @brief 版数以外が同じか
+ */
+static bool same_config(const my_config_blob_t *a, const my_config_blob_t *b) {
+    return a->baud_rate == b->baud_rate &&
+           a->receive_buffer_len == b->receive_buffer_len &&
+           a->request_command_len == b->request_command_len &&
+           a->terminator_sequence_len == b->terminator_sequence_len &&
+           a->terminator_sequence_replace_len ==
+               b->terminator_sequence_replace_len &&
+           memcmp(a->request_command, b->request_command,
+                  a->request_command_len) == 0 &&
+           memcmp(a->terminator_sequence, b->terminator_sequence,
+                  a->terminator_sequence_len) == 0 &&
+           memcmp(a->terminator_sequence_replace,
+                  b->terminator_sequence_replace,
+                  a->terminator_sequence_replace_len) == 0;
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+/**
+ * @brief 本体を書き換えた後に、CRCを付け直す
+ */
+static void fix_crc(uint8_t *buf, int len) {
+    uint32_t crc = my_config_blob_crc32(
+        0, buf, len - MY_CONFIG_BLOB_CRC_LEN);
+    for (int i = 0; i < 4; i++) {
+        buf[len - MY_CONFIG_BLOB_CRC_LEN + i] = (uint8_t)(crc >> (8 * i));
+    }
+}
+
+/**
+ * @brief 書き出して読み戻すと同じになる
+ */
+static void check_round_trip(void) {
+    // CRC-32の検査値
+    CHECK(my_config_blob_crc32(0, (const uint8_t *)"123456789", 9) ==
+          0xCBF43926);
+    uint8_t buf[MY_CONFIG_BLOB_READ_MAX];
+    int max_len = 0;
+    for (int t = 0; t < 100000; t++) {
+        my_config_blob_t a, b;
+        random_config(&a);
+        int len = my_config_blob_encode(&a, buf, MY_CONFIG_BLOB_MAX_LEN);
+        CHECK(len > 0 && len <= MY_CONFIG_BLOB_MAX_LEN);
+        if (len > max_len) max_len = len;
+        memset(&b, 0xAA, sizeof(b));
+        CHECK(my_config_blob_decode(buf, len, &b) == MY_CONFIG_BLOB_OK);
+        CHECK(same_config(&a, &b));
+        CHECK(b.version == MY_CONFIG_BLOB_VERSION);
+        if (host_test_failed) return;
+    }
+    CHECK(max_len == MY_CONFIG_BLOB_MAX_LEN);
+
+    // 長すぎるバイト列と、足りない書き込み先
+    my_config_blob_t a;
+    random_config(&a);
+    a.terminator_sequence_len = MY_CONFIG_BLOB_SEQ_MAX + 1;
+    CHECK(my_config_blob_encode(&a, buf, sizeof(buf)) == -1);
+    a.terminator_sequence_len = 0;
+    int len = my_config_blob_encode(&a, buf, sizeof(buf));
+    CHECK(len > 0);
+    CHECK(my_config_blob_encode(&a, buf, len - 1) == -1);
+}
+
+/**
+ * @brief 壊れたバイト列は読めない
+ */
+static void check_broken(void) {
+    uint8_t buf[MY_CONFIG_BLOB_READ_MAX];
+    my_config_blob_t a, b;
+    random_config(&a);
+    a.request_command_len = 3;
+    int len = my_config_blob_encode(&a, buf, sizeof(buf));
+
+    // どのビットが反転しても読めない
+    for (int i = 0; i < len * 8; i++) {
+        buf[i / 8] ^= (uint8_t)(1 << (i % 8));
+        CHECK(my_config_blob_decode(buf, len, &b) != MY_CONFIG_BLOB_OK);
+        buf[i / 8] ^= (uint8_t)(1 << (i % 8));
+    }
+    buf[len - 1] ^= 0x80;
+    CHECK(my_config_blob_decode(buf, len, &b) == MY_CONFIG_BLOB_ERR_CRC);
+    buf[len - 1] ^= 0x80;
+    buf[MY_CONFIG_BLOB_HEADER_LEN] ^= 0x01;
+    CHECK(my_config_blob_decode(buf, len, &b) == MY_CONFIG_BLOB_ERR_CRC);
+    buf[MY_CONFIG_BLOB_HEADER_LEN] ^= 0x01;
+    CHECK(my_config_blob_decode(buf, len, &b) == MY_CONFIG_BLOB_OK);
+
+    // 途中で切れている
+    for (int n = 0; n < len; n++) {
+        CHECK(my_config_blob_decode(buf, n, &b) == MY_CONFIG_BLOB_ERR_LENGTH);
+    }
+    CHECK(my_config_blob_decode(buf, len + 1, &b) ==
+          MY_CONFIG_BLOB_ERR_LENGTH);
+
+    // 識別子が違う
+    buf[0] ^= 0x20;
+    CHECK(my_config_blob_decode(buf, len, &b) == MY_CONFIG_BLOB_ERR_MAGIC);
+    buf[0] ^= 0x20;
+
+    // 版数がゼロ。CRCが合っていても読まない
+    put16(buf + 4, 0);
+    fix_crc(buf, len);
+    CHECK(my_config_blob_decode(buf, len, &b) == MY_CONFIG_BLOB_ERR_VERSION);
+
+    // 本体が版数1の最小長より短い
+    uint8_t small[MY_CONFIG_BLOB_HEADER_LEN + MY_CONFIG_BLOB_V1_MIN_LEN - 1 +
+                  MY_CONFIG_BLOB_CRC_LEN];
+    memcpy(small, buf, MY_CONFIG_BLOB_HEADER_LEN);
+    memset(small + MY_CONFIG_BLOB_HEADER_LEN, 0, MY_CONFIG_BLOB_V1_MIN_LEN - 1);
+    put16(small + 4, MY_CONFIG_BLOB_VERSION);
+    put16(small + 6, MY_CONFIG_BLOB_V1_MIN_LEN - 1);
+    fix_crc(small, sizeof(small));
+    CHECK(my_config_blob_decode(small, sizeof(small), &b) ==
+          MY_CONFIG_BLOB_ERR_FIELD);
+
+    // バイト列の長さが上限を超えている
+    random_config(&a);
+    a.request_command_len = MY_CONFIG_BLOB_SEQ_MAX;
+    len = my_config_blob_encode(&a, buf, sizeof(buf));
+    buf[MY_CONFIG_BLOB_HEADER_LEN + 6] = MY_CONFIG_BLOB_SEQ_MAX + 1;
+    fix_crc(buf, len);
+    CHECK(my_config_blob_decode(buf, len, &b) == MY_CONFIG_BLOB_ERR_FIELD);
+}
+
+/**
+ * @brief 末尾に項目を足したバイト列。版数1なら読まず、それより新しい版なら読み飛ばす
+ */
+static void check_versions(void) {
+    uint8_t buf[MY_CONFIG_BLOB_READ_MAX];
+    my_config_blob_t a, b;
+    random_config(&a);
+    int len = my_config_blob_encode(&a, buf, sizeof(buf));
+    int payload_len = len - MY_CONFIG_BLOB_HEADER_LEN - MY_CONFIG_BLOB_CRC_LEN;
+    static const uint8_t extra[] = {0x11, 0x22, 0x33};
+    memcpy(buf + MY_CONFIG_BLOB_HEADER_LEN + payload_len, extra,
+           sizeof(extra));
+    put16(buf + 6, (uint16_t)(payload_len + sizeof(extra)));
+    len += sizeof(extra);
+
+    fix_crc(buf, len);
+    CHECK(my_config_blob_decode(buf, len, &b) == MY_CONFIG_BLOB_ERR_FIELD);
+
+    put16(buf + 4, 2);
+    fix_crc(buf, len);
+    CHECK(my_config_blob_decode(buf, len, &b) == MY_CONFIG_BLOB_OK);
+    CHECK(b.version == 2);
+    CHECK(same_config(&a, &b));
+}
+
+/**
+ * @brief 旧形式の文字列
+ */
+static void check_legacy(void) {
+    my_config_blob_t cfg;
+    char s[256];
+
+    strcpy(s, "15,9600,52440d0a,0d0a,0a");
+    CHECK(my_config_blob_decode_legacy(s, &cfg) == MY_CONFIG_BLOB_OK);
+    CHECK(cfg.receive_buffer_len == 15 && cfg.baud_rate == 9600);
+    CHECK(cfg.request_command_len == 4 &&
+          memcmp(cfg.request_command, "RD\r\n", 4) == 0);
+    CHECK(cfg.terminator_sequence_len == 2 &&
+          memcmp(cfg.terminator_sequence, "\r\n", 2) == 0);
+    CHECK(cfg.terminator_sequence_replace_len == 1 &&
+          cfg.terminator_sequence_replace[0] == '\n');
+    CHECK(cfg.version == 0);
+
+    // 空のバイト列と、奇数文字の16進表記。最後のバイトは上位4ビットだけ
+    strcpy(s, "100,115200,,0D0A0,");
+    CHECK(my_config_blob_decode_legacy(s, &cfg) == MY_CONFIG_BLOB_OK);
+    CHECK(cfg.request_command_len == 0);
+    CHECK(cfg.terminator_sequence_len == 3);
+    CHECK(cfg.terminator_sequence[0] == 0x0D &&
+          cfg.terminator_sequence[1] == 0x0A &&
+          cfg.terminator_sequence[2] == 0x00);
+    CHECK(cfg.terminator_sequence_replace_len == 0);
+
+    // 書き出して読み戻すと同じになる
+    uint8_t buf[MY_CONFIG_BLOB_MAX_LEN];
+    my_config_blob_t back;
+    int len = my_config_blob_encode(&cfg, buf, sizeof(buf));
+    CHECK(len > 0);
+    CHECK(my_config_blob_decode(buf, len, &back) == MY_CONFIG_BLOB_OK);
+    CHECK(same_config(&cfg, &back));
+
+    // 項目が足りない
+    static const char *const bad[] = {
+        "", ",9600,0d0a,0d0a,0a", "15,,0d0a,0d0a,0a", "15,9600",
+        "15,9600,0d0a", "15,9600,0d0a,0d0a",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        strcpy(s, bad[i]);
+        CHECK(my_config_blob_decode_legacy(s, &cfg) ==
+              MY_CONFIG_BLOB_ERR_FIELD);
+    }
+
+    // バイト列の長さが上限ちょうどなら読め、超えたら読めない
+    for (int n = MY_CONFIG_BLOB_SEQ_MAX; n <= MY_CONFIG_BLOB_SEQ_MAX + 1; n++) {
+        int p = sprintf(s, "15,9600,");
+        for (int i = 0; i < n; i++) p += sprintf(s + p, "%02x", i);
+        strcpy(s + p, ",0d0a,0a");
+        int ret = my_config_blob_decode_legacy(s, &cfg);
+        if (n == MY_CONFIG_BLOB_SEQ_MAX) {
+            CHECK(ret == MY_CONFIG_BLOB_OK);
+            CHECK(cfg.request_command_len == n &&
+                  cfg.request_command[n - 1] == n - 1);
+        } else {
+            CHECK(ret == MY_CONFIG_BLOB_ERR_FIELD);
+        }
+    }
+}
+
+int main(void) {
+    srand(1);
+    check_round_trip();
+    check_broken();
+    check_versions();
+    check_legacy();
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,242 @@
+/**
+ * @file test_frame_log.c
+ *   my_frame_log のテスト。
+ *   NVSは shim/nvs_sim.c のメモリに、時刻は freertos_sim.c のtickに置き換える。
+ *   RAMだけでの順番と記録してからの時間、NVSへの書き出しと古いセグメントの破棄、
+ *   送り直しの途中で届いたフレーム、NVSへの書き込みの失敗、長すぎるフレームを調べる。
+ *   再起動は、子プロセスを前回の起動として記録させ、親プロセスで初めから読み直して調べる。
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_test.h"
+#include "my_frame_log.h"
+#include "nvs.h"
+
+// 1フレームのバイト数。"000000,12.345,OK\r\n"
+#define FRAME_LEN (18)
+
+// 1セグメントに入るレコード数
+#define FRAMES_PER_SEG \
+    ((MY_FRAME_LOG_SEG_SIZE - 1) / (MY_FRAME_LOG_REC_HEADER + FRAME_LEN))
+
+// 前回の起動（子プロセス）で記録したもの
+static struct {
+    int first;  // NVSにある最も古いフレームの番号
+    int last;   // 最後に記録したフレームの番号
+} *boot1;
+
+static int make_frame(int no, uint8_t *buf) {
+    return snprintf((char *)buf, FRAME_LEN + 1, "%06d,12.345,OK\r\n", no);
+}
+
+/**
+ * @brief 最も古いフレームが no番で、記録してからの時間が age_ms か
+ * @param age_ms 調べないならゼロ未満
+ */
+static bool peek_is(int no, int32_t age_ms) {
+    uint8_t want[FRAME_LEN + 1], got[MY_FRAME_LOG_FRAME_MAX];
+    int32_t age = 0;
+    int len = make_frame(no, want);
+    if (my_frame_log_peek(got, sizeof(got), &age) != len ||
+        memcmp(got, want, len) != 0) {
+        printf("frame %d is not the oldest\n", no);
+        return false;
+    }
+    return age_ms < 0 || age == age_ms;
+}
+
+/**
+ * @brief 溜まっているフレームを全て送り直し、first番から順に並んでいるか
+ * @param unknown_age trueなら、記録してからの時間が分からないこと
+ * @return 送り直したフレーム数
+ */
+static int drain(int first, bool unknown_age) {
+    uint8_t buf[MY_FRAME_LOG_FRAME_MAX];
+    int32_t age = 0;
+    int n = 0;
+    while (my_frame_log_peek(buf, sizeof(buf), &age) >= 0) {
+        CHECK(peek_is(first + n, -1));
+        CHECK(unknown_age ? age == MY_FRAME_LOG_AGE_UNKNOWN : age >= 0);
+        my_frame_log_pop();
+        n++;
+        if (host_test_failed) break;
+    }
+    return n;
+}
+
+static void append(int no) {
+    uint8_t buf[FRAME_LEN + 1];
+    CHECK(my_frame_log_append(buf, make_frame(no, buf)));
+}
+
+/**
+ * @brief RAMだけ。古い順に、記録した時刻からの時間付きで出てくる
+ */
+static void check_ram(void) {
+    uint32_t recorded = my_frame_log_recorded();
+    uint32_t replayed = my_frame_log_replayed();
+    for (int i = 0; i < 10; i++) {
+        append(i);
+        vTaskDelay(pdMS_TO_TICKS(1000));
+    }
+    CHECK(my_frame_log_count() == 10);
+    CHECK(my_frame_log_nvs_segments() == 0);
+    CHECK(peek_is(0, 10000));
+    my_frame_log_pop();
+    CHECK(peek_is(1, 9000));
+    CHECK(drain(1, false) == 9);
+    CHECK(my_frame_log_empty());
+    CHECK(my_frame_log_recorded() - recorded == 10);
+    CHECK(my_frame_log_replayed() - replayed == 10);
+    // 空なら何もしない
+    my_frame_log_pop();
+    CHECK(my_frame_log_peek(NULL, 0, NULL) == -1);
+}
+
+/**
+ * @brief RAMに入らなくなったらNVSに書き出し、NVSも一杯なら最も古いセグメントを捨てる。
+ *        送り直しの途中で届いたフレームは、後ろに並ぶ
+ */
+static void check_spill(void) {
+    const int total = 600, base = 1000;
+    uint32_t spilled = my_frame_log_spilled();
+    uint32_t dropped = my_frame_log_dropped();
+    for (int i = 0; i < total; i++) append(base + i);
+    int kept = my_frame_log_count();
+    int lost = (int)(my_frame_log_dropped() - dropped);
+    CHECK(my_frame_log_nvs_segments() == CONFIG_MY_FRAME_LOG_NVS_SEGMENTS);
+    CHECK(kept + lost == total);
+    // セグメントごと捨てる
+    CHECK(lost > 0 && lost % FRAMES_PER_SEG == 0);
+    CHECK((int)(my_frame_log_spilled() - spilled) ==
+          (CONFIG_MY_FRAME_LOG_NVS_SEGMENTS * FRAMES_PER_SEG) + lost);
+    printf("%d frames of %d bytes: %d kept (%d segments in nvs), %d dropped, "
+           "%lu nvs writes\n",
+           total, FRAME_LEN, kept, my_frame_log_nvs_segments(), lost,
+           (unsigned long)sim_nvs_writes);
+
+    // 半分送り直したところで、フレームが届く
+    int first = base + lost;
+    for (int i = 0; i < kept / 2; i++) {
+        CHECK(peek_is(first + i, -1));
+        my_frame_log_pop();
+    }
+    for (int i = 0; i < 5; i++) append(base + total + i);
+    CHECK(drain(first + kept / 2, false) == kept - kept / 2 + 5);
+    CHECK(my_frame_log_nvs_segments() == 0);
+    CHECK(my_frame_log_empty());
+}
+
+/**
+ * @brief NVSに書けなければ、書き出そうとしたレコードを捨てて数える
+ */
+static void check_nvs_fail(void) {
+    const int base = 3000;
+    uint32_t dropped = my_frame_log_dropped();
+    sim_nvs_fail_writes = true;
+    int n = 0;
+    while (my_frame_log_dropped() == dropped) append(base + n++);
+    sim_nvs_fail_writes = false;
+    int lost = (int)(my_frame_log_dropped() - dropped);
+    CHECK(lost > 0);
+    CHECK(my_frame_log_nvs_segments() == 0);
+    CHECK(my_frame_log_count() == n - lost);
+    CHECK(drain(base + lost, false) == n - lost);
+}
+
+/**
+ * @brief 長すぎるフレームは切り詰め、空のフレームも1つとして数える
+ */
+static void check_lengths(void) {
+    static uint8_t big[MY_FRAME_LOG_FRAME_MAX + 10];
+    memset(big, 'x', sizeof(big));
+    CHECK(my_frame_log_append(big, sizeof(big)));
+    CHECK(my_frame_log_append(big, 0));
+    uint8_t buf[MY_FRAME_LOG_FRAME_MAX];
+    CHECK(my_frame_log_peek(buf, sizeof(buf), NULL) == MY_FRAME_LOG_FRAME_MAX);
+    CHECK(memcmp(buf, big, MY_FRAME_LOG_FRAME_MAX) == 0);
+    // 読む側の領域が小さくても、長さはそのまま返す
+    CHECK(my_frame_log_peek(buf, 4, NULL) == MY_FRAME_LOG_FRAME_MAX);
+    my_frame_log_pop();
+    CHECK(my_frame_log_peek(buf, sizeof(buf), NULL) == 0);
+    my_frame_log_pop();
+    CHECK(my_frame_log_empty());
+}
+
+/**
+ * @brief 前回の起動。NVSとRAMにフレームを残し、NVSの最も古いセグメントは途中まで送り直しておく
+ */
+static int boot_first(void) {
+    CHECK(my_frame_log_init());
+    check_ram();
+    check_spill();
+    check_nvs_fail();
+    check_lengths();
+
+    const int base = 5000, total = 300;
+    for (int i = 0; i < total; i++) append(base + i);
+    boot1->last = base + total - 1;
+    boot1->first = base;
+    while (!peek_is(boot1->first, -1)) boot1->first++;
+    // 送り直したレコードも、セグメントを消すまでは残る
+    for (int i = 0; i < 3; i++) my_frame_log_pop();
+    printf("before reset: %d frames, %d segments in nvs\n",
+           my_frame_log_count(), my_frame_log_nvs_segments());
+    return host_test_failed != 0;
+}
+
+/**
+ * @brief 再起動後。NVSのフレームだけが、記録した時刻が分からないまま順に出てくる
+ */
+static void boot_second(void) {
+    vTaskDelay(pdMS_TO_TICKS(5000));
+    CHECK(my_frame_log_init());
+    int segments = my_frame_log_nvs_segments();
+    int count = my_frame_log_count();
+    CHECK(segments > 0);
+    CHECK(count == segments * FRAMES_PER_SEG);
+    // 途中まで送り直したセグメントは、初めから送り直す。RAMにあったフレームは消える
+    CHECK(drain(boot1->first, true) == count);
+    CHECK(boot1->first + count - 1 < boot1->last);
+    CHECK(my_frame_log_nvs_segments() == 0);
+    printf("after reset: %d frames from %d segments replayed\n", count,
+           segments);
+
+    // 再起動後に記録したものは時刻が分かる
+    append(9000);
+    vTaskDelay(pdMS_TO_TICKS(250));
+    CHECK(peek_is(9000, 250));
+    my_frame_log_pop();
+    CHECK(my_frame_log_empty());
+}
+
+int main(void) {
+    boot1 = mmap(NULL, sizeof(*boot1), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(boot1 != MAP_FAILED);
+    if (boot1 == MAP_FAILED) return HOST_TEST_RESULT();
+    sim_nvs_clear();
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int rc = boot_first();
+        fflush(stdout);
+        _exit(rc);
+    }
+    int status = 0;
+    CHECK(pid > 0 && waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    if (host_test_failed) return HOST_TEST_RESULT();
+    boot_second();
+    return HOST_TEST_RESULT();
+}
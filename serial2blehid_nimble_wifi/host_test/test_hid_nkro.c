@@ -0,0 +1,196 @@
+/**
+ * @file test_hid_nkro.c
+ *   my_hid_nkro のテスト。
+ *   ブート形式とNKRO形式を行き来しても押しているキーが変わらないかを調べる。
+ *   文字列を my_hid_planner でレポートにし、ブート形式のまま、またはNKRO形式に変換して、
+ *   ホストと同じように新しく押されたキーを文字に戻し、どちらの形式でも元の文字列になるかを調べる。
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "my_hid_key_map.h"
+#include "my_hid_nkro.h"
+#include "my_hid_planner.h"
+
+#define TEXT_MAX (256)
+
+typedef uint8_t report_t[MY_HID_PLANNER_REPORT_SIZE];
+
+// modifier << 8 | HIDコード -> 文字。同じキーになる文字は、先に現れた方
+static int16_t char_of_key[0x10000];
+
+static void make_char_of_key(void) {
+    memset(char_of_key, -1, sizeof(char_of_key));
+    for (int c = 127; c >= 0; c--) {
+        uint8_t k = KEYCODE_TO_HIDCODE(c);
+        if (k != 0) char_of_key[KEYCODE_TO_HIDMASK(c) << 8 | k] = (int16_t)c;
+    }
+}
+
+/**
+ * @brief ブート形式のレポートで押しているキーか
+ */
+static bool boot_has(const uint8_t *boot, uint8_t k) {
+    return memchr(boot + 2, k, MY_HID_NKRO_BOOT_SIZE - 2) != NULL;
+}
+
+/**
+ * @brief NKRO形式のレポートで押しているキーか
+ */
+static bool nkro_has(const uint8_t *nkro, int k) {
+    return (nkro[1 + k / 8] >> (k % 8)) & 1;
+}
+
+/**
+ * @brief ブート形式のレポートの並びを、ホストと同じように文字に戻す
+ * @return 文字数。1レポートで2つ以上新しく押されたら-1
+ */
+static int type_boot(const report_t *reports, int n, uint8_t *text) {
+    report_t prev = {0};
+    int cnt = 0;
+    for (int r = 0; r < n; r++) {
+        int pressed = 0;
+        for (int i = 2; i < MY_HID_NKRO_BOOT_SIZE; i++) {
+            uint8_t k = reports[r][i];
+            if (k == 0 || boot_has(prev, k)) continue;
+            text[cnt++] = (uint8_t)char_of_key[reports[r][0] << 8 | k];
+            pressed++;
+        }
+        if (pressed > 1) return -1;
+        memcpy(prev, reports[r], sizeof(prev));
+    }
+    return cnt;
+}
+
+/**
+ * @brief ブート形式のレポートの並びをNKRO形式に変換して送り、ホストと同じように文字に戻す
+ * @return 文字数。1レポートで2つ以上新しく押されたら-1
+ */
+static int type_nkro(const report_t *reports, int n, uint8_t *text) {
+    uint8_t prev[MY_HID_NKRO_REPORT_SIZE] = {0};
+    int cnt = 0;
+    for (int r = 0; r < n; r++) {
+        uint8_t nkro[MY_HID_NKRO_REPORT_SIZE];
+        my_hid_nkro_encode(reports[r], nkro);
+        int pressed = 0;
+        for (int k = 1; k <= MY_HID_NKRO_USAGE_MAX; k++) {
+            if (!nkro_has(nkro, k) || nkro_has(prev, k)) continue;
+            text[cnt++] = (uint8_t)char_of_key[nkro[0] << 8 | k];
+            pressed++;
+        }
+        if (pressed > 1) return -1;
+        memcpy(prev, nkro, sizeof(prev));
+    }
+    return cnt;
+}
+
+/**
+ * @brief 文字列が、どちらの形式でも元に戻るか。
+ *        送れない文字は除き、同じキーになる文字は先に現れた方にそろえて比べる
+ */
+static void check_text(const uint8_t *text, int len) {
+    static report_t reports[MY_HID_PLANNER_MAX_REPORTS(TEXT_MAX)];
+    uint8_t want[TEXT_MAX], got[TEXT_MAX * 2];
+    int want_len = 0;
+    for (int i = 0; i < len; i++) {
+        uint8_t k = KEYCODE_TO_HIDCODE(text[i]);
+        if (k != 0) {
+            want[want_len++] =
+                (uint8_t)char_of_key[KEYCODE_TO_HIDMASK(text[i]) << 8 | k];
+        }
+    }
+    int n = my_hid_planner_plan(text, len, reports,
+                                MY_HID_PLANNER_MAX_REPORTS(len));
+    CHECK(n >= 0);
+    if (n < 0) return;
+    int got_len = type_boot(reports, n, got);
+    CHECK(got_len == want_len && memcmp(got, want, want_len) == 0);
+    got_len = type_nkro(reports, n, got);
+    CHECK(got_len == want_len && memcmp(got, want, want_len) == 0);
+}
+
+/**
+ * @brief 変換して戻すと、modifierと押しているキーが同じになるか
+ */
+static void check_encode_decode(void) {
+    for (int t = 0; t < 100000; t++) {
+        uint8_t boot[MY_HID_NKRO_BOOT_SIZE] = {(uint8_t)rand(), (uint8_t)rand()};
+        for (int i = 2; i < MY_HID_NKRO_BOOT_SIZE; i++) {
+            int r = rand() % 8;
+            // 空き、modifierキー、ビットマップに無いHIDコードも混ぜる
+            boot[i] = r == 0   ? 0
+                      : r == 1 ? (uint8_t)(0xE0 + rand() % 8)
+                      : r == 2 ? (uint8_t)(MY_HID_NKRO_USAGE_MAX + 1 +
+                                           rand() % (0xE0 - MY_HID_NKRO_USAGE_MAX - 1))
+                               : (uint8_t)(1 + rand() % MY_HID_NKRO_USAGE_MAX);
+        }
+        uint8_t nkro[MY_HID_NKRO_REPORT_SIZE];
+        my_hid_nkro_encode(boot, nkro);
+
+        // 期待する値。配列のmodifierキーはmodifierのビットになり、他はHIDコードの小さい順
+        uint8_t modifier = boot[0];
+        bool keys[MY_HID_NKRO_KEY_BITS] = {false};
+        for (int i = 2; i < MY_HID_NKRO_BOOT_SIZE; i++) {
+            if (boot[i] >= 0xE0) {
+                modifier |= 1 << (boot[i] - 0xE0);
+            } else if (boot[i] != 0 && boot[i] <= MY_HID_NKRO_USAGE_MAX) {
+                keys[boot[i]] = true;
+            }
+        }
+        CHECK(nkro[0] == modifier);
+        uint8_t want[MY_HID_NKRO_BOOT_SIZE] = {modifier};
+        int cnt = 0;
+        for (int k = 0; k < MY_HID_NKRO_KEY_BITS; k++) {
+            CHECK(nkro_has(nkro, k) == keys[k]);
+            if (keys[k]) want[2 + cnt++] = (uint8_t)k;
+        }
+        uint8_t back[MY_HID_NKRO_BOOT_SIZE];
+        CHECK(my_hid_nkro_decode(nkro, back) == cnt);
+        CHECK(memcmp(back, want, sizeof(want)) == 0);
+        if (host_test_failed) return;
+    }
+
+    // 7個以上押していれば、数は全て返し、最初の6個だけを格納する
+    uint8_t nkro[MY_HID_NKRO_REPORT_SIZE] = {0x02};
+    static const uint8_t many[] = {0x04, 0x05, 0x1E, 0x28, 0x87, 0x88, 0x8A,
+                                   0x97};
+    for (size_t i = 0; i < sizeof(many); i++) {
+        nkro[1 + many[i] / 8] |= 1 << (many[i] % 8);
+    }
+    uint8_t back[MY_HID_NKRO_BOOT_SIZE];
+    CHECK(my_hid_nkro_decode(nkro, back) == (int)sizeof(many));
+    static const uint8_t first6[MY_HID_NKRO_BOOT_SIZE] = {
+        0x02, 0, 0x04, 0x05, 0x1E, 0x28, 0x87, 0x88};
+    CHECK(memcmp(back, first6, sizeof(first6)) == 0);
+    // 1つの通知(20バイト)に収まる
+    CHECK(MY_HID_NKRO_REPORT_SIZE <= 20);
+}
+
+int main(void) {
+    make_char_of_key();
+    srand(1);
+    check_encode_decode();
+
+    static const char *texts[] = {
+        "", "a", "aab", "AaA", "Mississippi", "01A+00012.345\r\n",
+        "The quick brown fox jumps over the lazy dog 1234567890 !\"#$%&'()",
+    };
+    for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+        check_text((const uint8_t *)texts[i], strlen(texts[i]));
+    }
+    uint8_t text[TEXT_MAX];
+    for (int c = 0; c < 128; c++) text[c] = (uint8_t)c;
+    check_text(text, 128);
+    for (int t = 0; t < 20000; t++) {
+        int len = rand() % TEXT_MAX;
+        for (int i = 0; i < len; i++) {
+            text[i] = (rand() & 1) ? "aA1!b"[rand() % 5] : rand() % 128;
+        }
+        check_text(text, len);
+    }
+    return HOST_TEST_RESULT();
+}
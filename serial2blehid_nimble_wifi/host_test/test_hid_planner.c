@@ -0,0 +1,118 @@
+/**
+ * @file test_hid_planner.c
+ *   my_hid_planner のテスト。
+ *   作ったレポートを、ホストと同じように「新しく現れたキーを押されたキー」として読み戻し、
+ *   元の文字列を変換表に通した並びと一致するか調べる。
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "my_hid_key_map.h"
+#include "my_hid_planner.h"
+
+#define TEXT_MAX (256)
+
+typedef uint8_t report_t[MY_HID_PLANNER_REPORT_SIZE];
+
+/**
+ * @brief レポートの並びを読み戻す
+ * @param keys 押されたキー（modifier << 8 | HIDコード）が格納される
+ * @return 押されたキーの数。1レポートで2つ以上新しく押されたら-1
+ */
+static int decode(const report_t *reports, int n, uint16_t *keys) {
+    report_t prev = {0};
+    int cnt = 0;
+    for (int r = 0; r < n; r++) {
+        int pressed = 0;
+        for (int i = 2; i < MY_HID_PLANNER_REPORT_SIZE; i++) {
+            uint8_t k = reports[r][i];
+            if (k == 0 || memchr(prev + 2, k, 6) != NULL) continue;
+            keys[cnt++] = (uint16_t)(reports[r][0] << 8 | k);
+            pressed++;
+        }
+        if (pressed > 1) return -1;
+        memcpy(prev, reports[r], sizeof(prev));
+    }
+    return cnt;
+}
+
+/**
+ * @brief 文字列を変換表に通した、押すべきキーの並び
+ * @return キーの数と、同じキーが続いた回数
+ */
+static int expect(const uint8_t *text, int len, uint16_t *keys,
+                  int *repeats) {
+    int cnt = 0;
+    *repeats = 0;
+    for (int i = 0; i < len; i++) {
+        uint8_t k = KEYCODE_TO_HIDCODE(text[i]);
+        if (k == 0) continue;
+        if (cnt > 0 && (keys[cnt - 1] & 0xff) == k) (*repeats)++;
+        keys[cnt++] = (uint16_t)(KEYCODE_TO_HIDMASK(text[i]) << 8 | k);
+    }
+    return cnt;
+}
+
+/**
+ * @brief 1つの文字列を変換して読み戻す
+ */
+static void check_text(const uint8_t *text, int len) {
+    static report_t reports[MY_HID_PLANNER_MAX_REPORTS(TEXT_MAX)];
+    static uint16_t got[TEXT_MAX * 2], want[TEXT_MAX];
+    int repeats;
+    int n = my_hid_planner_plan(text, len, reports,
+                                MY_HID_PLANNER_MAX_REPORTS(len));
+    int want_cnt = expect(text, len, want, &repeats);
+    CHECK(n >= 0);
+    if (n < 0) return;
+    // n文字は n + (同じキーが続いた回数) + 1 レポート。押すキーが無ければゼロ
+    CHECK(n == (want_cnt > 0 ? want_cnt + repeats + 1 : 0));
+    // 最後は何も押していない
+    if (n > 0) {
+        static const report_t none = {0};
+        CHECK(memcmp(reports[n - 1], none, sizeof(none)) == 0);
+    }
+    int got_cnt = decode(reports, n, got);
+    CHECK(got_cnt == want_cnt);
+    CHECK(got_cnt < 0 || memcmp(got, want, want_cnt * sizeof(want[0])) == 0);
+}
+
+int main(void) {
+    static const char *texts[] = {
+        "", "a", "abc", "aab", "1!", "AaA", "hello, world", "+00012.345\r\n",
+        "\x01\x02", "11111", "Mississippi",
+    };
+    for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+        check_text((const uint8_t *)texts[i], strlen(texts[i]));
+    }
+
+    // 全ての文字を1つずつと、2つ続けたもの
+    uint8_t all[TEXT_MAX];
+    int len = 0;
+    for (int c = 0; c < 128; c++) all[len++] = c;
+    check_text(all, len);
+    for (int c = 0; c < 128; c++) {
+        uint8_t two[2] = {c, c};
+        check_text(two, 2);
+    }
+
+    // レポートの置き場所が足りなければ-1
+    report_t small[3];
+    CHECK(my_hid_planner_plan((const uint8_t *)"abc", 3, small, 3) == -1);
+    CHECK(my_hid_planner_plan((const uint8_t *)"ab", 2, small, 3) == 3);
+
+    // ランダムな文字列
+    srand(1);
+    for (int t = 0; t < 100000; t++) {
+        len = rand() % TEXT_MAX;
+        for (int i = 0; i < len; i++) {
+            all[i] = (rand() & 1) ? "aA1!b"[rand() % 5] : rand() % 128;
+        }
+        check_text(all, len);
+    }
+    return HOST_TEST_RESULT();
+}
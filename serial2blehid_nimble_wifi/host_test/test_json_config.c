@@ -0,0 +1,172 @@
+/**
+ * @file test_json_config.c
+ *   my_json_config のテスト。
+ *   文書ごとに、結果、エラーの位置、書き込んだ設定値を調べる。
+ *   同じ文書を1-7バイトずつに分けて渡しても、同じ結果と位置になるかも調べる。
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "my_json_config.h"
+
+/**
+ * @brief 1つの文書と、期待する結果
+ */
+typedef struct {
+    const char *doc;
+    int result;
+    int pos;  // エラーの位置。成功なら-1で、文書の長さを期待する
+} json_case_t;
+
+static void base_config(my_config_blob_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->baud_rate = 4800;
+    cfg->receive_buffer_len = 15;
+}
+
+/**
+ * @brief 文書を chunk バイトずつに分けて読み込む
+ */
+static int parse(const char *doc, int chunk, my_config_blob_t *cfg,
+                 my_json_config_t *p) {
+    base_config(cfg);
+    my_json_config_init(p, cfg);
+    int n = (int)strlen(doc);
+    for (int i = 0; i < n; i += chunk) {
+        int len = n - i < chunk ? n - i : chunk;
+        if (my_json_config_feed(p, doc + i, len) != MY_JSON_CONFIG_OK) break;
+    }
+    return my_json_config_finish(p);
+}
+
+/**
+ * @brief 結果とエラーの位置。分けて渡しても同じか
+ */
+static void check_positions(void) {
+    static const json_case_t cases[] = {
+        {"{}", MY_JSON_CONFIG_OK, -1},
+        {" { \"version\" : 1 , \"baud_rate\" : 2400 }\n", MY_JSON_CONFIG_OK,
+         -1},
+        // 知らないキーの入れ子とエスケープ文字は読み飛ばす
+        {"{\"extra\":{\"a\":[1,{\"b\":\"}]\\\"\"}],\"c\":null},\"save\":true}",
+         MY_JSON_CONFIG_OK, -1},
+        {"{\"x\":[],\"y\":\"a\\\\\",\"z\":[[[]]]}", MY_JSON_CONFIG_OK, -1},
+        {"[1]", MY_JSON_CONFIG_ERR_SYNTAX, 0},
+        {"{\"baud_rate\" 9600}", MY_JSON_CONFIG_ERR_SYNTAX, 13},
+        {"{\"baud_rate\":1200,}", MY_JSON_CONFIG_ERR_SYNTAX, 18},
+        {"{\"baud_rate\":1200} x", MY_JSON_CONFIG_ERR_SYNTAX, 19},
+        {"{\"re\\\"q\":1}", MY_JSON_CONFIG_ERR_SYNTAX, 4},
+        {"{\"request_command\":\"0d\\n\"}", MY_JSON_CONFIG_ERR_SYNTAX, 22},
+        {"{\"x\":\"a\nb\"}", MY_JSON_CONFIG_ERR_SYNTAX, 7},
+        {"{\"x\":{\"a\":\"\x01\"}}", MY_JSON_CONFIG_ERR_SYNTAX, 11},
+        // 知っているキーのオブジェクトや配列
+        {"{\"baud_rate\":{\"v\":1}}", MY_JSON_CONFIG_ERR_TYPE, 13},
+        {"{\"save\":[true]}", MY_JSON_CONFIG_ERR_TYPE, 8},
+        {"{\"baud_rate\":\"9600\"}", MY_JSON_CONFIG_ERR_TYPE, 14},
+        {"{\"request_command\":12}", MY_JSON_CONFIG_ERR_TYPE, 21},
+        {"{\"save\":yes}", MY_JSON_CONFIG_ERR_TYPE, 11},
+        // 数値の値のエラーは、値の直後の文字の位置
+        {"{\"baud_rate\":-1}", MY_JSON_CONFIG_ERR_VALUE, 15},
+        {"{\"baud_rate\":96.0 }", MY_JSON_CONFIG_ERR_VALUE, 17},
+        {"{\"baud_rate\":99999999999}", MY_JSON_CONFIG_ERR_VALUE, 24},
+        {"{\"receive_buffer_len\":70000}", MY_JSON_CONFIG_ERR_VALUE, 27},
+        {"{\"request_command\":\"515\"}", MY_JSON_CONFIG_ERR_VALUE, 23},
+        {"{\"request_command\":\"0z\"}", MY_JSON_CONFIG_ERR_VALUE, 21},
+        {"{\"baud_rate\":1234567890123}", MY_JSON_CONFIG_ERR_TOO_LONG, 25},
+        {"{\"abcdefghijklmnopqrstuvwxyz0123456789\":1}",
+         MY_JSON_CONFIG_ERR_TOO_LONG, 34},
+        {"{\"baud_rate\":1200,\"baud_rate\":2400}",
+         MY_JSON_CONFIG_ERR_DUPLICATE, 28},
+        {"{\"baud_rate\":1200", MY_JSON_CONFIG_ERR_INCOMPLETE, 17},
+        {"{\"x\":{\"a\":[1,2]", MY_JSON_CONFIG_ERR_INCOMPLETE, 15},
+        {"{\"x\":\"a\\", MY_JSON_CONFIG_ERR_INCOMPLETE, 8},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const json_case_t *t = &cases[i];
+        int want_pos = t->pos >= 0 ? t->pos : (int)strlen(t->doc);
+        for (int chunk = 1; chunk <= 7; chunk++) {
+            my_config_blob_t cfg;
+            my_json_config_t p;
+            int ret = parse(t->doc, chunk, &cfg, &p);
+            if (ret != t->result || (int)p.pos != want_pos) {
+                printf("%s: %s at %u, want %s at %d (chunk %d)\n", t->doc,
+                       my_json_config_result_name(ret), p.pos,
+                       my_json_config_result_name(t->result), want_pos, chunk);
+                CHECK(false);
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief 書き込んだ設定値
+ */
+static void check_values(void) {
+    my_config_blob_t cfg;
+    my_json_config_t p;
+    CHECK(parse("{\"baud_rate\":9600,\"receive_buffer_len\":20,"
+                "\"request_command\":\"51580d0a\",\"terminator_sequence\":"
+                "\"0D0A\",\"terminator_sequence_replace\":\"09\",\"save\":true}",
+                3, &cfg, &p) == MY_JSON_CONFIG_OK);
+    CHECK(cfg.baud_rate == 9600 && cfg.receive_buffer_len == 20);
+    CHECK(cfg.request_command_len == 4 &&
+          memcmp(cfg.request_command, "QX\r\n", 4) == 0);
+    CHECK(cfg.terminator_sequence_len == 2 &&
+          memcmp(cfg.terminator_sequence, "\r\n", 2) == 0);
+    CHECK(cfg.terminator_sequence_replace_len == 1 &&
+          cfg.terminator_sequence_replace[0] == '\t');
+    CHECK(p.save);
+
+    // 書かなかったキーは元のまま。知らないキーの値は書き込まない
+    CHECK(parse("{\"extra\":{\"baud_rate\":1},\"request_command\":\"\","
+                "\"save\":false}",
+                1, &cfg, &p) == MY_JSON_CONFIG_OK);
+    CHECK(cfg.baud_rate == 4800 && cfg.receive_buffer_len == 15);
+    CHECK(cfg.request_command_len == 0);
+    CHECK(!p.save);
+
+    // バイト列の長さは上限ちょうどまで
+    char doc[128];
+    for (int n = MY_CONFIG_BLOB_SEQ_MAX; n <= MY_CONFIG_BLOB_SEQ_MAX + 1; n++) {
+        int len = sprintf(doc, "{\"request_command\":\"");
+        for (int i = 0; i < n; i++) len += sprintf(doc + len, "%02x", i);
+        strcpy(doc + len, "\"}");
+        int ret = parse(doc, 5, &cfg, &p);
+        if (n == MY_CONFIG_BLOB_SEQ_MAX) {
+            CHECK(ret == MY_JSON_CONFIG_OK);
+            CHECK(cfg.request_command_len == n &&
+                  cfg.request_command[n - 1] == n - 1);
+        } else {
+            CHECK(ret == MY_JSON_CONFIG_ERR_TOO_LONG);
+            CHECK((int)p.pos == 20 + 2 * MY_CONFIG_BLOB_SEQ_MAX);
+        }
+    }
+
+    // 入れ子の深さは上限まで
+    for (int depth = MY_JSON_CONFIG_DEPTH_MAX;
+         depth <= MY_JSON_CONFIG_DEPTH_MAX + 1; depth++) {
+        my_json_config_init(&p, &cfg);
+        my_json_config_feed(&p, "{\"x\":", 5);
+        for (int i = 0; i < depth; i++) my_json_config_feed(&p, "[", 1);
+        for (int i = 0; i < depth; i++) my_json_config_feed(&p, "]", 1);
+        my_json_config_feed(&p, "}", 1);
+        int ret = my_json_config_finish(&p);
+        if (depth == MY_JSON_CONFIG_DEPTH_MAX) {
+            CHECK(ret == MY_JSON_CONFIG_OK);
+        } else {
+            CHECK(ret == MY_JSON_CONFIG_ERR_TOO_LONG);
+            CHECK((int)p.pos == 5 + MY_JSON_CONFIG_DEPTH_MAX);
+        }
+    }
+}
+
+int main(void) {
+    check_positions();
+    check_values();
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,277 @@
+/**
+ * @file test_term_match.c
+ *   my_term_match のテスト。
+ *   乱数で作った終端文字列とデータを、単純に比べる方法と照合器の両方で調べ、結果を比べる。
+ *   設定できる最長の終端文字列が作れることと、上限を超えたら作れないことも調べる。
+ *   TC-101Aから記録したバイト列（余分なCRの後のCR+LF、LFとCR+LFの混在、
+ *   13文字＋CR+LFの連続したフレーム）で、区切る位置も調べる。
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "my_config_blob.h"
+#include "my_term_match.h"
+
+#define TEXT_LEN (300)
+
+/**
+ * @brief 単純に比べる方法。前に揃った後のデータが、どれかの終端文字列で終わっているか。
+ *        複数あれば長い方、同じ長さなら番号の小さい方
+ * @param hist 前に揃った後のデータ
+ * @param n hist の長さ
+ * @return 揃った終端文字列の番号。揃っていなければ-1
+ */
+static int naive_match(const uint8_t *hist, int n, const uint8_t *seqs[],
+                       const int lens[], int patterns) {
+    int best = -1;
+    for (int i = 0; i < patterns; i++) {
+        if (lens[i] <= n && memcmp(hist + n - lens[i], seqs[i], lens[i]) == 0 &&
+            (best < 0 || lens[i] > lens[best])) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief 1バイトずつ進めたときと、まとめて進めたときが、単純に比べる方法と同じか
+ */
+static void check_random(void) {
+    static const uint8_t alphabet[] = {'a', 'b', 'c', '\r', '\n'};
+    for (int round = 0; round < 20000; round++) {
+        uint8_t bufs[MY_TERM_MATCH_PATTERNS_MAX][6];
+        const uint8_t *seqs[MY_TERM_MATCH_PATTERNS_MAX];
+        int lens[MY_TERM_MATCH_PATTERNS_MAX];
+        int patterns = 1 + rand() % MY_TERM_MATCH_PATTERNS_MAX;
+        for (int i = 0; i < patterns; i++) {
+            lens[i] = 1 + rand() % 6;
+            for (int j = 0; j < lens[i]; j++) {
+                bufs[i][j] = alphabet[rand() % sizeof(alphabet)];
+            }
+            seqs[i] = bufs[i];
+        }
+        uint8_t text[TEXT_LEN];
+        for (int i = 0; i < TEXT_LEN; i++) {
+            text[i] = (rand() % 8 == 0) ? (uint8_t)rand()
+                                        : alphabet[rand() % sizeof(alphabet)];
+        }
+
+        // 単純に比べる方法で、揃う位置と番号を出しておく
+        int want_at[TEXT_LEN];
+        int start = 0;
+        for (int i = 0; i < TEXT_LEN; i++) {
+            want_at[i] = naive_match(text + start, i + 1 - start, seqs, lens,
+                                     patterns);
+            if (want_at[i] >= 0) start = i + 1;
+        }
+
+        static my_term_match_t m;
+        CHECK(my_term_match_compile(&m, seqs, lens, patterns) == 0);
+        for (int i = 0; i < TEXT_LEN; i++) {
+            CHECK(my_term_match_feed(&m, text[i]) == want_at[i]);
+        }
+
+        // まとめて進める。途中で切っても同じ
+        my_term_match_reset(&m);
+        int pos = 0;
+        while (pos < TEXT_LEN) {
+            int chunk = 1 + rand() % 40;
+            if (chunk > TEXT_LEN - pos) chunk = TEXT_LEN - pos;
+            int matched;
+            int used = my_term_match_scan(&m, text + pos, chunk, &matched);
+            CHECK(used >= 1 && used <= chunk);
+            for (int i = pos; i < pos + used - 1; i++) CHECK(want_at[i] < 0);
+            CHECK(matched == want_at[pos + used - 1]);
+            pos += used;
+        }
+        if (host_test_failed) return;
+    }
+}
+
+/**
+ * @brief 例で調べる
+ */
+static void check_examples(void) {
+    static my_term_match_t m;
+    const uint8_t *seqs[] = {(const uint8_t *)"\r\n", (const uint8_t *)"\n",
+                             (const uint8_t *)"\x03"};
+    const int lens[] = {2, 1, 1};
+    CHECK(my_term_match_compile(&m, seqs, lens, 3) == 0);
+    int matched;
+    // CR+LF と LF なら CR+LF
+    CHECK(my_term_match_scan(&m, (const uint8_t *)"12\r\r\nab", 7, &matched) == 5);
+    CHECK(matched == 0);
+    CHECK(my_term_match_scan(&m, (const uint8_t *)"ab\nx", 4, &matched) == 3);
+    CHECK(matched == 1);
+    CHECK(my_term_match_scan(&m, (const uint8_t *)"x\x03", 2, &matched) == 2);
+    CHECK(matched == 2);
+    CHECK(my_term_match_scan(&m, (const uint8_t *)"\r", 1, &matched) == 1);
+    CHECK(matched == -1);
+    CHECK(my_term_match_feed(&m, '\n') == 0);
+
+    // 終端文字列が無ければ何にも一致しない
+    CHECK(my_term_match_compile(&m, seqs, lens, 0) == 0);
+    CHECK(my_term_match_scan(&m, (const uint8_t *)"\r\n\x03", 3, &matched) == 3);
+    CHECK(matched == -1);
+}
+
+/**
+ * @brief 記録したバイト列を、1バイトずつと、全てのチャンクの大きさで照合し、
+ *        一致する位置と番号が期待どおりか調べる
+ * @param rec 記録したバイト列
+ * @param ends 一致する位置（その終端文字列の最後のバイトの次）
+ * @param want 一致する終端文字列の番号
+ * @param cnt 一致する数
+ */
+static void check_record(my_term_match_t *m, const char *rec, const int ends[],
+                         const int want[], int cnt) {
+    int len = (int)strlen(rec);
+    const uint8_t *data = (const uint8_t *)rec;
+    my_term_match_reset(m);
+    int k = 0;
+    for (int i = 0; i < len; i++) {
+        int matched = my_term_match_feed(m, data[i]);
+        if (k < cnt && ends[k] == i + 1) {
+            CHECK(matched == want[k]);
+            k++;
+        } else {
+            CHECK(matched == -1);
+        }
+    }
+    CHECK(k == cnt);
+    for (int chunk = 1; chunk <= len; chunk++) {
+        my_term_match_reset(m);
+        k = 0;
+        for (int pos = 0; pos < len;) {
+            int n = chunk < len - pos ? chunk : len - pos;
+            int end = pos + n;
+            // チャンクの途中で一致したら、そこで止まる
+            while (pos < end) {
+                int matched;
+                int used = my_term_match_scan(m, data + pos, end - pos, &matched);
+                pos += used;
+                if (matched >= 0) {
+                    CHECK(k < cnt && ends[k] == pos && want[k] == matched);
+                    k++;
+                } else {
+                    CHECK(pos == end);
+                }
+            }
+        }
+        CHECK(k == cnt);
+    }
+}
+
+/**
+ * @brief TC-101Aから記録したバイト列
+ */
+static void check_tc101a(void) {
+    static my_term_match_t m;
+    const uint8_t *seqs[] = {(const uint8_t *)"\r\n", (const uint8_t *)"\n"};
+    const int lens[] = {2, 1};
+
+    // 既定の設定。終端文字列はCR+LFだけ
+    CHECK(my_term_match_compile(&m, seqs, lens, 1) == 0);
+
+    // 13文字＋CR+LFのフレームが途切れずに続く
+    {
+        const char *rec = "01A+00012.345\r\n"
+                          "01A-00000.120\r\n"
+                          "01A+99999.999\r\n";
+        const int ends[] = {15, 30, 45};
+        const int want[] = {0, 0, 0};
+        check_record(&m, rec, ends, want, 3);
+    }
+    // 余分なCRの後のCR+LF。電源を入れた直後と、フレームの途中にCRが混じったとき
+    {
+        const char *rec = "\r"
+                          "01A+00012.345\r\r\n"
+                          "01A\r+00012.346\r\n"
+                          "01A+00012.347\r\r\r\n";
+        const int ends[] = {17, 33, 50};
+        const int want[] = {0, 0, 0};
+        check_record(&m, rec, ends, want, 3);
+    }
+    // LFとCR+LFの混在。CR+LFだけなら、LFだけのフレームは次のフレームとつながる
+    const char *mixed = "01A+00012.345\n"
+                        "01A+00012.346\r\n"
+                        "01A+00012.347\n"
+                        "\r\n"
+                        "01A+00012.348\r\n";
+    {
+        const int ends[] = {29, 45, 60};
+        const int want[] = {0, 0, 0};
+        check_record(&m, mixed, ends, want, 3);
+    }
+
+    // 終端文字列をCR+LFとLFにすると、CR+LFの方が長いので優先する
+    CHECK(my_term_match_compile(&m, seqs, lens, 2) == 0);
+    {
+        const int ends[] = {14, 29, 43, 45, 60};
+        const int want[] = {1, 0, 1, 0, 0};
+        check_record(&m, mixed, ends, want, 5);
+    }
+}
+
+/**
+ * @brief 上限
+ */
+static void check_limits(void) {
+    static my_term_match_t m;
+    // 設定できる最長の終端文字列が、全て違う文字でも作れる
+    uint8_t seq[MY_CONFIG_BLOB_SEQ_MAX];
+    for (int i = 0; i < MY_CONFIG_BLOB_SEQ_MAX; i++) seq[i] = (uint8_t)(0x80 + i);
+    const uint8_t *seqs[MY_TERM_MATCH_PATTERNS_MAX + 1] = {seq, seq, seq, seq,
+                                                            seq};
+    int lens[MY_TERM_MATCH_PATTERNS_MAX + 1] = {MY_CONFIG_BLOB_SEQ_MAX};
+    CHECK(my_term_match_compile(&m, seqs, lens, 1) == 0);
+    int matched;
+    CHECK(my_term_match_scan(&m, seq, MY_CONFIG_BLOB_SEQ_MAX - 1, &matched) ==
+          MY_CONFIG_BLOB_SEQ_MAX - 1);
+    CHECK(matched == -1);
+    CHECK(my_term_match_feed(&m, seq[MY_CONFIG_BLOB_SEQ_MAX - 1]) == 0);
+
+    // 数、長さ、状態数、文字の種類が上限を超えたら作れない
+    for (int i = 0; i <= MY_TERM_MATCH_PATTERNS_MAX; i++) lens[i] = 1;
+    CHECK(my_term_match_compile(&m, seqs, lens, MY_TERM_MATCH_PATTERNS_MAX) ==
+          0);
+    CHECK(my_term_match_compile(&m, seqs, lens,
+                                MY_TERM_MATCH_PATTERNS_MAX + 1) == -1);
+    lens[0] = 0;
+    CHECK(my_term_match_compile(&m, seqs, lens, 1) == -1);
+    static uint8_t longs[MY_TERM_MATCH_PATTERNS_MAX][MY_TERM_MATCH_STATES_MAX];
+    for (int i = 0; i < MY_TERM_MATCH_PATTERNS_MAX; i++) {
+        for (int j = 0; j < MY_TERM_MATCH_STATES_MAX; j++) {
+            longs[i][j] = (uint8_t)('a' + (i * 7 + j) % 20);
+        }
+        seqs[i] = longs[i];
+    }
+    lens[0] = MY_TERM_MATCH_STATES_MAX;
+    CHECK(my_term_match_compile(&m, seqs, lens, 1) == -1);
+    for (int i = 0; i < MY_TERM_MATCH_PATTERNS_MAX; i++) {
+        lens[i] = MY_TERM_MATCH_STATES_MAX / MY_TERM_MATCH_PATTERNS_MAX;
+    }
+    CHECK(my_term_match_compile(&m, seqs, lens, MY_TERM_MATCH_PATTERNS_MAX) ==
+          -1);
+    for (int i = 0; i < MY_TERM_MATCH_CLASSES_MAX; i++) {
+        longs[0][i] = (uint8_t)i;
+    }
+    seqs[0] = longs[0];
+    lens[0] = MY_TERM_MATCH_CLASSES_MAX;
+    CHECK(my_term_match_compile(&m, seqs, lens, 1) == -1);
+    lens[0] = MY_TERM_MATCH_CLASSES_MAX - 1;
+    CHECK(my_term_match_compile(&m, seqs, lens, 1) == 0);
+}
+
+int main(void) {
+    srand(1);
+    check_examples();
+    check_tc101a();
+    check_limits();
+    check_random();
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,136 @@
+/**
+ * @file test_uart_framer.c
+ *   my_uart_framer のテスト。
+ *   UARTドライバの代わりに、受信したバイト列と時刻をテストから渡す。
+ *   遅れて届く応答、途切れでの区切り、チャンクをまたぐ終端文字列、区切れた後ろのバイトを調べる。
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "my_term_match.h"
+#include "my_uart_framer.h"
+
+#define IDLE_US (20000)
+
+static my_term_match_t match;
+static my_uart_framer_t framer;
+
+/**
+ * @brief 終端文字列と途切れ時間で区切りを準備する
+ * @param term 終端文字列。NULLなら途切れだけで区切る
+ */
+static void setup(const char *term, uint32_t idle_us) {
+    const uint8_t *seqs[1] = {(const uint8_t *)term};
+    int lens[1] = {term != NULL ? (int)strlen(term) : 0};
+    CHECK(my_term_match_compile(&match, seqs, lens, term != NULL ? 1 : 0) == 0);
+    my_uart_framer_init(&framer, &match, idle_us);
+}
+
+/**
+ * @brief 文字列を1つのチャンクとして渡す
+ */
+static int feed(const char *s, int64_t now_us, my_uart_framer_end_t *end) {
+    return my_uart_framer_feed(&framer, (const uint8_t *)s, (int)strlen(s),
+                               now_us, end);
+}
+
+/**
+ * @brief 160ms遅れて届いた応答も、終端文字列までが1フレームになる
+ */
+static void check_late_answer(void) {
+    setup("\r\n", IDLE_US);
+    my_uart_framer_end_t end;
+    CHECK(my_uart_framer_wait_us(&framer, 0) == -1);
+    CHECK(my_uart_framer_poll(&framer, 160000) == MY_UART_FRAMER_END_NONE);
+    CHECK(feed("01A+000", 160000, &end) == 7);
+    CHECK(end == MY_UART_FRAMER_END_NONE);
+    CHECK(my_uart_framer_wait_us(&framer, 165000) == 15000);
+    CHECK(feed("12.345\r\n", 170000, &end) == 8);
+    CHECK(end == MY_UART_FRAMER_END_TERMINATOR);
+    CHECK(framer.term_len == 2);
+    CHECK(framer.terminated_cnt == 1 && framer.idle_cnt == 0);
+    // 区切れた後は、途切れを待たない
+    CHECK(my_uart_framer_wait_us(&framer, 170000) == -1);
+    CHECK(my_uart_framer_poll(&framer, 500000) == MY_UART_FRAMER_END_NONE);
+}
+
+/**
+ * @brief 終端文字列が来なければ、途切れで区切る
+ */
+static void check_idle(void) {
+    setup("\r\n", IDLE_US);
+    my_uart_framer_end_t end;
+    CHECK(feed("01A+00012.345\r", 1000, &end) == 14);
+    CHECK(end == MY_UART_FRAMER_END_NONE);
+    CHECK(my_uart_framer_wait_us(&framer, 1000 + IDLE_US - 1) == 1);
+    CHECK(my_uart_framer_poll(&framer, 1000 + IDLE_US - 1) ==
+          MY_UART_FRAMER_END_NONE);
+    CHECK(my_uart_framer_wait_us(&framer, 1000 + IDLE_US + 5) == 0);
+    CHECK(my_uart_framer_poll(&framer, 1000 + IDLE_US) ==
+          MY_UART_FRAMER_END_IDLE);
+    CHECK(framer.term_len == 0);
+    CHECK(framer.idle_cnt == 1);
+    // 途中まで揃っていたCRは持ち越さない。次のLFだけでは区切れない
+    CHECK(feed("\n", 100000, &end) == 1);
+    CHECK(end == MY_UART_FRAMER_END_NONE);
+
+    // 途切れた後に届いたバイトは、受け取る前に前のフレームを区切る
+    setup("\r\n", IDLE_US);
+    CHECK(feed("ABC", 0, &end) == 3);
+    CHECK(feed("DEF", IDLE_US, &end) == 0);
+    CHECK(end == MY_UART_FRAMER_END_IDLE);
+    CHECK(feed("DEF", IDLE_US, &end) == 3);
+    CHECK(end == MY_UART_FRAMER_END_NONE);
+    CHECK(framer.pending == 3);
+
+    // 途切れ時間がゼロなら、途切れでは区切らない
+    setup("\r\n", 0);
+    CHECK(feed("ABC", 0, &end) == 3);
+    CHECK(my_uart_framer_wait_us(&framer, 0) == -1);
+    CHECK(my_uart_framer_poll(&framer, 10000000) == MY_UART_FRAMER_END_NONE);
+
+    // 終端文字列が無ければ、途切れだけで区切る
+    setup(NULL, IDLE_US);
+    CHECK(framer.match == NULL);
+    CHECK(feed("AB\r\nCD", 0, &end) == 6);
+    CHECK(end == MY_UART_FRAMER_END_NONE);
+    CHECK(my_uart_framer_poll(&framer, IDLE_US) == MY_UART_FRAMER_END_IDLE);
+}
+
+/**
+ * @brief チャンクをまたぐ終端文字列と、区切れた後ろのバイト
+ */
+static void check_chunks(void) {
+    setup("\r\n", IDLE_US);
+    my_uart_framer_end_t end;
+    CHECK(feed("AB\r", 0, &end) == 3);
+    CHECK(end == MY_UART_FRAMER_END_NONE);
+    // LFで区切れ、残りの "CD\r\n" は次のフレームとして渡し直す
+    CHECK(feed("\nCD\r\n", 100, &end) == 1);
+    CHECK(end == MY_UART_FRAMER_END_TERMINATOR);
+    CHECK(feed("CD\r\n", 100, &end) == 4);
+    CHECK(end == MY_UART_FRAMER_END_TERMINATOR);
+    CHECK(framer.terminated_cnt == 2);
+    // フレームの前の余分なCR
+    CHECK(feed("\r\r\nX", 200, &end) == 3);
+    CHECK(end == MY_UART_FRAMER_END_TERMINATOR);
+    CHECK(feed("X", 200, &end) == 1);
+    CHECK(end == MY_UART_FRAMER_END_NONE);
+
+    // やり直すと、途中のフレームは捨てる
+    my_uart_framer_reset(&framer);
+    CHECK(framer.pending == 0);
+    CHECK(my_uart_framer_poll(&framer, 1000000) == MY_UART_FRAMER_END_NONE);
+    CHECK(feed("", 300, &end) == 0);
+    CHECK(end == MY_UART_FRAMER_END_NONE);
+}
+
+int main(void) {
+    check_late_answer();
+    check_idle();
+    check_chunks();
+    return HOST_TEST_RESULT();
+}
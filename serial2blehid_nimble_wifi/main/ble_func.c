@@ -8,15 +8,28 @@
 
 #include "gatt_svr.h"
 #include "hid_func.h"
+#include "my_conn_policy.h"
+#include "my_debug.h"
+#include "my_hid_sched.h"
+#include "my_latency.h"
+#include "my_reconnect.h"
 
 #define MAC2STR_REV(a) (a)[5], (a)[4], (a)[3], (a)[2], (a)[1], (a)[0]
 #define MACSTR "%02x:%02x:%02x:%02x:%02x:%02x"
 
 static const char *tag = "NimBLEKBD_BLEFUNC";
 
+/* Largest LL payload and the air time it needs on the 1M PHY (us). */
+#define BLEPRPH_DATA_LEN_OCTETS 251
+#define BLEPRPH_DATA_LEN_TIME 2120
+
 static int bleprph_gap_event(struct ble_gap_event *event, void *arg);
 static uint8_t own_addr_type;
 
+/* Identity address of the last bonded central that disconnected. */
+static ble_addr_t bleprph_last_peer;
+static bool bleprph_last_peer_valid;
+
 
 /**
  * Logs information about a connection to the console.
@@ -46,6 +59,54 @@ bleprph_print_conn_desc(struct ble_gap_conn_desc *desc)
                 desc->sec_state.bonded);
 }
 
+/**
+ * Logs the result of the ATT MTU exchange we started.  The central may
+ * already have started one, in which case this one fails harmlessly.
+ */
+static int
+bleprph_on_mtu(uint16_t conn_handle, const struct ble_gatt_error *error,
+               uint16_t mtu, void *arg)
+{
+    ESP_LOGI(tag, "mtu exchange; conn_handle=%d status=%d mtu=%d",
+                conn_handle, error->status, mtu);
+    return 0;
+}
+
+/**
+ * Asks the controller and the central for a faster link:
+ *     o 2M PHY in both directions, when the central supports it.
+ *     o The maximum LL data length (DLE).
+ *     o An ATT MTU of CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU.
+ * Each request is independent; a refused one only leaves that part of the
+ * link as it was.  The outcome arrives as PHY_UPDATE_COMPLETE,
+ * DATA_LEN_CHG and MTU events.
+ */
+static void
+bleprph_negotiate_link(uint16_t conn_handle)
+{
+    int rc;
+
+#if CONFIG_BT_NIMBLE_LL_CFG_FEAT_LE_2M_PHY
+    rc = ble_gap_set_prefered_le_phy(conn_handle, BLE_GAP_LE_PHY_2M_MASK,
+                                     BLE_GAP_LE_PHY_2M_MASK,
+                                     BLE_GAP_LE_PHY_CODED_ANY);
+    if (rc != 0) {
+        ESP_LOGW(tag, "failed to request 2M PHY; rc=%d", rc);
+    }
+#endif
+
+    rc = ble_gap_set_data_len(conn_handle, BLEPRPH_DATA_LEN_OCTETS,
+                              BLEPRPH_DATA_LEN_TIME);
+    if (rc != 0) {
+        ESP_LOGW(tag, "failed to set data length; rc=%d", rc);
+    }
+
+    rc = ble_gattc_exchange_mtu(conn_handle, bleprph_on_mtu, NULL);
+    if (rc != 0) {
+        ESP_LOGW(tag, "failed to start mtu exchange; rc=%d", rc);
+    }
+}
+
 int
 user_parse(const struct ble_hs_adv_field *data, void *arg)
 {
@@ -55,18 +116,130 @@ user_parse(const struct ble_hs_adv_field *data, void *arg)
 }
 
 /**
- * Enables advertising with the following parameters:
- *     o General discoverable mode.
- *     o Undirected connectable mode.
+ * Picks the peer for directed advertising: the last bonded central we were
+ * connected to, or else the newest bond in the store.  A peer that is
+ * still connected or no longer bonded is not used.
+ *
+ * @return                      true if a peer was written to *peer.
+ */
+static bool
+bleprph_directed_peer(ble_addr_t *peer)
+{
+    ble_addr_t peers[CONFIG_BT_NIMBLE_MAX_BONDS];
+    struct ble_gap_conn_desc desc;
+    int num_peers = 0;
+    int i;
+
+    if (ble_store_util_bonded_peers(peers, &num_peers,
+                                    CONFIG_BT_NIMBLE_MAX_BONDS) != 0 ||
+        num_peers == 0) {
+        return false;
+    }
+
+    for (i = 0; i < num_peers; i++) {
+        if (bleprph_last_peer_valid &&
+            ble_addr_cmp(&peers[i], &bleprph_last_peer) == 0) {
+            break;
+        }
+    }
+    if (i == num_peers) {
+        /* The store keeps bonds in the order they were made. */
+        bleprph_last_peer = peers[num_peers - 1];
+        bleprph_last_peer_valid = true;
+    }
+
+    if (ble_gap_conn_find_by_addr(&bleprph_last_peer, &desc) == 0) {
+        return false;
+    }
+    *peer = bleprph_last_peer;
+    return true;
+}
+
+/**
+ * Loads every bonded peer into the controller's white list.
+ *
+ * @return                      The number of peers loaded; 0 on failure.
+ */
+static int
+bleprph_set_white_list(void)
+{
+    ble_addr_t peers[CONFIG_BT_NIMBLE_MAX_BONDS];
+    int num_peers = 0;
+    int rc;
+
+    rc = ble_store_util_bonded_peers(peers, &num_peers,
+                                     CONFIG_BT_NIMBLE_MAX_BONDS);
+    if (rc != 0 || num_peers == 0) {
+        return 0;
+    }
+    rc = ble_gap_wl_set(peers, num_peers);
+    if (rc != 0) {
+        ESP_LOGE(tag, "error setting white list; rc=%d", rc);
+        return 0;
+    }
+    return num_peers;
+}
+
+/**
+ * Enables advertising for the current reconnect stage (see my_reconnect.c):
+ *     o Directed: high duty cycle to the last bonded central, 1.28 s.
+ *     o Fast: undirected, 20-30 ms, 30 s.  Only after a bonded central
+ *       disconnected are connections limited to bonded centrals; on boot
+ *       and while waiting for another central anyone may connect.
+ *     o Slow: undirected, 152.5-211.25 ms, anyone may connect, forever.
+ * Stages without a peer are skipped.  The next stage is started from the
+ * ADV_COMPLETE event when a stage times out.
  */
 static void
 bleprph_advertise(void)
 {
     struct ble_gap_adv_params adv_params;
     struct ble_hs_adv_fields fields;
+    my_reconnect_stage_t stage;
+    ble_addr_t peer;
+    bool white_list = false;
+    int32_t duration_ms;
     const char *name;
     int rc;
 
+    /* Choose the stage and its advertising parameters. */
+    memset(&adv_params, 0, sizeof adv_params);
+    stage = my_reconnect_stage();
+    if (stage == MY_RECONNECT_DIRECTED && !bleprph_directed_peer(&peer)) {
+        stage = MY_RECONNECT_FAST;
+    }
+    switch (stage) {
+    case MY_RECONNECT_DIRECTED:
+        adv_params.conn_mode = BLE_GAP_CONN_MODE_DIR;
+        adv_params.disc_mode = BLE_GAP_DISC_MODE_NON;
+        adv_params.high_duty_cycle = 1;
+        duration_ms = MY_RECONNECT_DIRECTED_MS;
+        break;
+
+    case MY_RECONNECT_FAST:
+        adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
+        adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
+        adv_params.itvl_min = MY_RECONNECT_FAST_ITVL_MIN;
+        adv_params.itvl_max = MY_RECONNECT_FAST_ITVL_MAX;
+        /* Still answer scans so the name shows up for new hosts. */
+        white_list = my_reconnect_whitelist_allowed() &&
+                     bleprph_set_white_list() > 0;
+        if (white_list) {
+            adv_params.filter_policy = BLE_HCI_ADV_FILT_CONN;
+        }
+        duration_ms = MY_RECONNECT_FAST_MS;
+        break;
+
+    default:
+        stage = MY_RECONNECT_SLOW;
+        adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
+        adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
+        adv_params.itvl_min = MY_RECONNECT_SLOW_ITVL_MIN;
+        adv_params.itvl_max = MY_RECONNECT_SLOW_ITVL_MAX;
+        duration_ms = BLE_HS_FOREVER;
+        break;
+    }
+
     /**
      *  Set the advertisement data included in our advertisements:
      *     o Flags (indicates advertisement type and other general info).
@@ -91,8 +264,9 @@ bleprph_advertise(void)
     fields.tx_pwr_lvl_is_present = 1;
     fields.tx_pwr_lvl = BLE_HS_ADV_TX_PWR_LVL_AUTO;
 
+    /* Directed advertising carries no data; 40 is the old default. */
     fields.adv_itvl_is_present = 1;
-    fields.adv_itvl = 40;
+    fields.adv_itvl = adv_params.itvl_min != 0 ? adv_params.itvl_min : 40;
 
     name = ble_svc_gap_device_name();
     fields.name = (uint8_t *)name;
@@ -128,15 +302,41 @@ bleprph_advertise(void)
     }
 
     /* Begin advertising. */
-    memset(&adv_params, 0, sizeof adv_params);
-    adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
-    adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
-    rc = ble_gap_adv_start(own_addr_type, NULL, BLE_HS_FOREVER,
-                           &adv_params, bleprph_gap_event, NULL);
+    rc = ble_gap_adv_start(own_addr_type,
+                           stage == MY_RECONNECT_DIRECTED ? &peer : NULL,
+                           duration_ms, &adv_params, bleprph_gap_event, NULL);
     if (rc != 0) {
-        ESP_LOGE(tag, "error enabling advertisement; rc=%d", rc);
+        ESP_LOGE(tag, "error enabling %s advertisement; rc=%d",
+                    my_reconnect_stage_name(stage), rc);
+        /* Fall back to the next stage; the slow one is the last resort. */
+        if (stage != MY_RECONNECT_SLOW) {
+            my_reconnect_enter(stage, white_list);
+            my_reconnect_timeout();
+            bleprph_advertise();
+        }
         return;
     }
+    my_reconnect_enter(stage, white_list);
+    ESP_LOGI(tag, "advertising %s%s", my_reconnect_stage_name(stage),
+                white_list ? " (white list)" : "");
+}
+
+/**
+ * Restarts the reconnect stages from the first one and advertises.
+ *
+ * @param cause                 Why advertising is restarted.
+ * @param bonded                Whether the central that disconnected was
+ *                                  bonded; the fast stage is white-listed
+ *                                  only then.
+ */
+static void
+bleprph_advertise_restart(my_reconnect_cause_t cause, bool bonded)
+{
+    if (ble_gap_adv_active()) {
+        ble_gap_adv_stop();
+    }
+    my_reconnect_begin(cause, bonded);
+    bleprph_advertise();
 }
 
 // default password for bonding, can be changed from sdkconfig var CONFIG_EXAMPLE_DISP_PASSWD
@@ -174,6 +374,17 @@ bleprph_gap_event(struct ble_gap_event *event, void *arg)
             bleprph_print_conn_desc(&desc);
 
             hid_clean_vars(&desc);
+            my_hid_sched_conn_open(desc.conn_handle, desc.conn_itvl);
+            my_conn_policy_open(desc.conn_handle, desc.conn_itvl,
+                                desc.conn_latency, desc.supervision_timeout);
+            bleprph_negotiate_link(desc.conn_handle);
+            my_reconnect_connected();
+
+            /* Advertising stops on connection; resume it while another
+             * central can connect. */
+            if (hid_conn_count() < CONFIG_BT_NIMBLE_MAX_CONNECTIONS) {
+                bleprph_advertise_restart(MY_RECONNECT_CAUSE_ANOTHER, false);
+            }
         } else {
             /* Connection failed; resume advertising. */
             bleprph_advertise();
@@ -182,10 +393,21 @@ bleprph_gap_event(struct ble_gap_event *event, void *arg)
 
     case BLE_GAP_EVENT_DISCONNECT:
         ESP_LOGI(tag, "disconnect; reason=%d ", event->disconnect.reason);
-        hid_set_disconnected();
+        hid_set_disconnected(event->disconnect.conn.conn_handle);
+        my_hid_sched_conn_close(event->disconnect.conn.conn_handle);
+        my_conn_policy_close(event->disconnect.conn.conn_handle);
+        my_latency_conn_close(event->disconnect.conn.conn_handle);
+
+        /* Remember a bonded central so that it is called back first. */
+        if (event->disconnect.conn.sec_state.bonded) {
+            bleprph_last_peer = event->disconnect.conn.peer_id_addr;
+            bleprph_last_peer_valid = true;
+        }
 
-        /* Connection terminated; resume advertising. */
-        bleprph_advertise();
+        /* Connection terminated; start over from directed advertising,
+         * even if advertising is already running for another central. */
+        bleprph_advertise_restart(MY_RECONNECT_CAUSE_DISCONNECT,
+                                  event->disconnect.conn.sec_state.bonded);
         return 0;
 
     case BLE_GAP_EVENT_CONN_UPDATE_REQ:
@@ -197,18 +419,39 @@ bleprph_gap_event(struct ble_gap_event *event, void *arg)
         /* The central has updated the connection parameters. */
         ESP_LOGI(tag, "connection updated; status=%d ",
                     event->conn_update.status);
+        if (ble_gap_conn_find(event->conn_update.conn_handle, &desc) == 0) {
+            if (event->conn_update.status == 0) {
+                my_hid_sched_set_conn_itvl(desc.conn_handle, desc.conn_itvl);
+            }
+            /* On failure desc still holds the parameters in use. */
+            my_conn_policy_updated(desc.conn_handle,
+                                   event->conn_update.status,
+                                   desc.conn_itvl, desc.conn_latency,
+                                   desc.supervision_timeout);
+        }
         return 0;
 
     case BLE_GAP_EVENT_ADV_COMPLETE:
         ESP_LOGI(tag, "advertise complete; reason=%d",
                     event->adv_complete.reason);
-        bleprph_advertise();
+        /* A stage ran out of time; go on to the next one. */
+        if (event->adv_complete.reason == BLE_HS_ETIMEOUT) {
+            my_reconnect_timeout();
+        }
+        if (!ble_gap_adv_active() &&
+            hid_conn_count() < CONFIG_BT_NIMBLE_MAX_CONNECTIONS) {
+            bleprph_advertise();
+        }
         return 0;
 
     case BLE_GAP_EVENT_ENC_CHANGE:
         /* Encryption has been enabled or disabled for this connection. */
         ESP_LOGI(tag, "encryption change event; status=%d ",
                     event->enc_change.status);
+        /* Ask for a short interval only after pairing has finished. */
+        if (event->enc_change.status == 0) {
+            my_conn_policy_encrypted(event->enc_change.conn_handle);
+        }
         return 0;
 
     case BLE_GAP_EVENT_SUBSCRIBE:
@@ -222,17 +465,25 @@ bleprph_gap_event(struct ble_gap_event *event, void *arg)
                     event->subscribe.prev_indicate,
                     event->subscribe.cur_indicate);
 
-        hid_set_notify(event->subscribe.attr_handle,
+        hid_set_notify(event->subscribe.conn_handle,
+            event->subscribe.attr_handle,
             event->subscribe.cur_notify,
             event->subscribe.cur_indicate);
         return 0;
 
     case BLE_GAP_EVENT_NOTIFY_TX:
-        ESP_LOGI(tag, "notify event; status=%d conn_handle=%d attr_handle=%04X type=%s",
+        MY_VLOGI(MY_VERBOSE_FRAME, tag,
+                    "notify event; status=%d conn_handle=%d attr_handle=%04X type=%s",
                     event->notify_tx.status,
                     event->notify_tx.conn_handle,
                     event->notify_tx.attr_handle,
                     event->notify_tx.indication?"indicate":"notify");
+        my_hid_sched_notify_tx(event->notify_tx.conn_handle,
+                    event->notify_tx.status,
+                    event->notify_tx.indication);
+        my_latency_notify_tx(event->notify_tx.conn_handle,
+                    event->notify_tx.status,
+                    event->notify_tx.indication);
         return 0;
 
     case BLE_GAP_EVENT_MTU:
@@ -242,6 +493,33 @@ bleprph_gap_event(struct ble_gap_event *event, void *arg)
                     event->mtu.value);
         return 0;
 
+    case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+        ESP_LOGI(tag, "phy update event; status=%d conn_handle=%d "
+                    "tx_phy=%d rx_phy=%d",
+                    event->phy_updated.status,
+                    event->phy_updated.conn_handle,
+                    event->phy_updated.tx_phy,
+                    event->phy_updated.rx_phy);
+        /* Shorter packets on 2M leave room for more reports per event. */
+        if (event->phy_updated.status == 0) {
+            my_hid_sched_set_conn_phy(event->phy_updated.conn_handle,
+                event->phy_updated.tx_phy == BLE_GAP_LE_PHY_2M);
+        }
+        return 0;
+
+#ifdef BLE_GAP_EVENT_DATA_LEN_CHG
+    case BLE_GAP_EVENT_DATA_LEN_CHG:
+        ESP_LOGI(tag, "data length change event; conn_handle=%d "
+                    "max_tx_octets=%d max_tx_time=%d "
+                    "max_rx_octets=%d max_rx_time=%d",
+                    event->data_len_chg.conn_handle,
+                    event->data_len_chg.max_tx_octets,
+                    event->data_len_chg.max_tx_time,
+                    event->data_len_chg.max_rx_octets,
+                    event->data_len_chg.max_rx_time);
+        return 0;
+#endif
+
     case BLE_GAP_EVENT_REPEAT_PAIRING:
         /* We already have a bond with the peer, but it is attempting to
          * establish a new secure link.  This app sacrifices security for
@@ -314,7 +592,7 @@ bleprph_on_sync(void)
     ESP_LOGI(tag, "Device Address: "MACSTR, MAC2STR_REV(addr_val));
 
     /* Begin advertising. */
-    bleprph_advertise();
+    bleprph_advertise_restart(MY_RECONNECT_CAUSE_BOOT, false);
 }
 
 void
@@ -80,7 +80,8 @@ hid_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
 
         rc = gatt_svr_chr_write(ctxt->om, 1, 1, &new_suspend_state, NULL);
         if (!rc) {
-            bool old_state = hid_set_suspend((bool) new_suspend_state);
+            bool old_state = hid_set_suspend(conn_handle,
+                                             (bool) new_suspend_state);
 
             ESP_LOGI(tag, "HID_CONTROL_POINT received new suspend state: %d, old state is: %d",
                 (int)new_suspend_state, (int)old_state);
@@ -113,8 +114,11 @@ hid_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
 
         if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
 
-            rc = os_mbuf_append(ctxt->om, &HidProtocolMode,
-                                sizeof(HidProtocolMode));
+            // protocol mode is kept for each central
+            uint8_t protocol_mode = hid_get_report_mode(conn_handle)
+                ? HID_PROTOCOL_MODE_BOOT : HID_PROTOCOL_MODE_REPORT;
+            rc = os_mbuf_append(ctxt->om, &protocol_mode,
+                                sizeof(protocol_mode));
             return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
 
         } else if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
@@ -124,9 +128,9 @@ hid_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
             rc = gatt_svr_chr_write(ctxt->om, 1, sizeof(new_protocol_mode),
                 &new_protocol_mode, NULL);
             if (!rc) {
-                HidProtocolMode = new_protocol_mode;
                 // send true if new mode is boot mode, else guess
-                hid_set_report_mode(HidProtocolMode == HID_PROTOCOL_MODE_BOOT);
+                hid_set_report_mode(conn_handle,
+                    new_protocol_mode == HID_PROTOCOL_MODE_BOOT);
 
                 ESP_LOGI(tag, "Received new protocol mode: %d",
                     (int)new_protocol_mode);
@@ -146,6 +150,10 @@ hid_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
     return BLE_ATT_ERR_UNLIKELY;
 }
 
+/* report reference descriptor value by HANDLE_* number,
+   built in gatt_svr_register_cb() */
+static const uint8_t *Report_ref_by_handle_num[HANDLE_HID_COUNT];
+
 /* Report access function for all reports */
 
 int
@@ -168,18 +176,13 @@ ble_svc_report_access(uint16_t conn_handle, uint16_t attr_handle,
                 ESP_LOGI(tag, "invalid op %d", ctxt->op);
                 break;
             }
-            int rpt_ind = -1;
+            const uint8_t *report_ref = NULL;
 
-            for (int i = 0; i < Hid_report_ref_data_count; ++i) {
-                if ((int)Hid_report_ref_data[i].id == handle_num) {
-                    rpt_ind = i;
-                    break;
-                }
+            if (handle_num >= 0 && handle_num < HANDLE_HID_COUNT) {
+                report_ref = Report_ref_by_handle_num[handle_num];
             }
-            if (rpt_ind != -1) {
-                rc = os_mbuf_append(ctxt->om,
-                    (uint8_t *)Hid_report_ref_data[rpt_ind].hidReportRef,
-                    HID_REPORT_REF_LEN);
+            if (report_ref != NULL) {
+                rc = os_mbuf_append(ctxt->om, report_ref, HID_REPORT_REF_LEN);
                 if (rc) {
                     rc = BLE_ATT_ERR_INSUFFICIENT_RES;
                 }
@@ -196,7 +199,7 @@ ble_svc_report_access(uint16_t conn_handle, uint16_t attr_handle,
                 (uuid16 == GATT_UUID_HID_BT_MOUSE_INPUT)    ||
                 (uuid16 == GATT_UUID_HID_BT_KB_INPUT)       ||
                 (uuid16 == GATT_UUID_HID_BT_KB_OUTPUT)      )) {
-            rc = hid_read_buffer(ctxt->om, handle_num);
+            rc = hid_read_buffer(conn_handle, ctxt->om, handle_num);
             if (rc) {
                 rc = BLE_ATT_ERR_INSUFFICIENT_RES;
             }
@@ -208,7 +211,7 @@ ble_svc_report_access(uint16_t conn_handle, uint16_t attr_handle,
             switch (handle_num) {
                 case HANDLE_HID_KB_OUT_REPORT:
                 case HANDLE_HID_FEATURE_REPORT:
-                    rc = hid_write_buffer(ctxt->om, handle_num);
+                    rc = hid_write_buffer(conn_handle, ctxt->om, handle_num);
                     if (rc) {
                         rc = BLE_ATT_ERR_INSUFFICIENT_RES;
                     }
@@ -241,7 +244,7 @@ ble_svc_battery_access(uint16_t conn_handle, uint16_t attr_handle,
     switch (uuid16) {
         case BLE_SVC_BAS_CHR_UUID16_BATTERY_LEVEL:
             if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
-                rc = hid_read_buffer(ctxt->om, (int) arg);
+                rc = hid_read_buffer(conn_handle, ctxt->om, (int) arg);
                 // rc = hid_battery_level_get(ctxt->om);
                 if (rc) {
                     ESP_LOGW(tag, "Error reading battery buffer, rc = %d", rc);
@@ -374,6 +377,9 @@ gatt_svr_register_cb(struct ble_gatt_register_ctxt *ctxt, void *arg)
                 (int)ctxt->chr.chr_def->arg,
                 ctxt->chr.def_handle, ctxt->chr.def_handle,
                 ctxt->chr.val_handle, ctxt->chr.val_handle);
+            // index report by attribute handle and HANDLE_* number
+            hid_index_report_chr((int)ctxt->chr.chr_def->arg,
+                ctxt->chr.val_handle);
             break;
 
         case BLE_GATT_REGISTER_OP_DSC:
@@ -381,6 +387,18 @@ gatt_svr_register_cb(struct ble_gatt_register_ctxt *ctxt, void *arg)
                 ble_uuid_to_str(ctxt->dsc.dsc_def->uuid, buf),
                 (int)ctxt->dsc.dsc_def->arg,
                 ctxt->dsc.handle, ctxt->dsc.handle);
+            // index report reference by HANDLE_* number
+            if (ble_uuid_u16(ctxt->dsc.dsc_def->uuid) == GATT_UUID_RPT_REF_DESCR) {
+                int handle_num = (int)ctxt->dsc.dsc_def->arg;
+                for (int i = 0; i < Hid_report_ref_data_count; ++i) {
+                    if ((int)Hid_report_ref_data[i].id == handle_num &&
+                        handle_num >= 0 && handle_num < HANDLE_HID_COUNT) {
+                        Report_ref_by_handle_num[handle_num] =
+                            Hid_report_ref_data[i].hidReportRef;
+                        break;
+                    }
+                }
+            }
             break;
     }
 }
@@ -282,7 +282,6 @@ extern const uint8_t HidInfo[];
 
 // HID External Report Reference Descriptor
 extern uint16_t HidExtReportRefDesc;
-extern uint8_t HidProtocolMode;
 
 extern struct report_reference_table Hid_report_ref_data[];
 extern size_t Hid_report_ref_data_count;
@@ -1,11 +1,14 @@
 #include <stdio.h>
 
 #include "gatt_svr.h"
+#include "my_hid_nkro.h"
 
 #define SUPPORT_REPORT_VENDOR false
 
 // HID Report Map characteristic value
 // Keyboard report descriptor (using format for Boot interface descriptor)
+// With CONFIG_MY_HID_NKRO, the keyboard input report of report protocol is
+// an N-key rollover bitmap instead. Boot protocol report is not changed.
 const uint8_t Hid_report_map[] = {
     /*** MOUSE REPORT ***/
     0x05, 0x01,  // Usage Page (Generic Desktop)
@@ -54,11 +57,13 @@ const uint8_t Hid_report_map[] = {
     0x95, 0x08,  //         Report Count (8)
     0x81, 0x02,  //         *Input: (Data, Variable, Absolute)
     //
+#if !CONFIG_MY_HID_NKRO
     //   Reserved byte
     0x95, 0x01,  //         Report Count (1)
     0x75, 0x08,  //         Report Size (8)
     0x81, 0x01,  //         *Input: (Constant)
     //
+#endif
     //   LED report
     0x95, 0x05,  //         Report Count (5)
     0x75, 0x01,  //         Report Size (1)
@@ -72,6 +77,17 @@ const uint8_t Hid_report_map[] = {
     0x75, 0x03,  //         Report Size (3)
     0x91, 0x01,  //         *Output: (Constant)
     //
+#if CONFIG_MY_HID_NKRO
+    //   Key bitmap (19 bytes, one bit per usage 0x00 to 0x97, no reserved byte)
+    0x95, MY_HID_NKRO_KEY_BITS,   //   Report Count (152)
+    0x75, 0x01,  //         Report Size (1)
+    0x15, 0x00,  //         Logical Min (0)
+    0x25, 0x01,  //         Logical Max (1)
+    0x05, 0x07,  //         Usage Pg (Key Codes)
+    0x19, 0x00,  //           Usage Min (0)
+    0x29, MY_HID_NKRO_USAGE_MAX,  //   Usage Max (0x97)
+    0x81, 0x02,  //           *Input: (Data, Variable, Absolute)
+#else
     //   Key arrays (6 bytes)
     0x95, 0x06,  //         Report Count (6)
     0x75, 0x08,  //         Report Size (8)
@@ -81,6 +97,7 @@ const uint8_t Hid_report_map[] = {
     0x19, 0x00,  //           Usage Min (0)
     0x29, 0xFF,  //           Usage Max (0x65=101, 0x00e7)
     0x81, 0x00,  //           *Input: (Data, Array)
+#endif
     //
     0xC0,        //   End Collection
     //
@@ -438,7 +455,6 @@ const uint8_t HidInfo[HID_INFORMATION_LEN] = {
 
 // HID External Report Reference Descriptor
 uint16_t HidExtReportRefDesc = BLE_SVC_BAS_CHR_UUID16_BATTERY_LEVEL;
-uint8_t  HidProtocolMode = HID_PROTOCOL_MODE_REPORT;
 
 /* Report reference table, byte 0 - report id from report map, byte 1 - report type (in,out,feature)*/
 struct report_reference_table Hid_report_ref_data[] = {
@@ -4,10 +4,16 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "gatt_svr.h"
+#include "hid_func.h"
 #include "nvs_flash.h"
 // #include "gpio_func.h"
 
+#include "my_debug.h"
+#include "my_hid_mbuf.h"
+#include "my_hid_nkro.h"
 #include "my_if_uart.h"
+#include "my_latency.h"
+#include "my_trace.h"
 
 static const char *tag = "NimBLEKBD_HIDFUNC";
 
@@ -50,100 +56,97 @@ static struct hid_notify_data {
     int handle_boot_num;  // handle num in boot mode
     uint8_t *buffer;      // data to send
     size_t buffer_size;
-    bool can_indicate;  // preffered method, because central will response to it
-    bool can_notify;
 } Notify_data_reports[] = {
     {.name = "mouse",
      .handle_num = HANDLE_HID_MOUSE_REPORT,
      .handle_boot_num = HANDLE_HID_BOOT_MOUSE_REPORT,
      .buffer = Mouse_buffer,
-     .buffer_size = HIDD_LE_REPORT_MOUSE_SIZE,
-     .can_indicate = false,
-     .can_notify = false},
+     .buffer_size = HIDD_LE_REPORT_MOUSE_SIZE},
     {.name = "keyboard",
      .handle_num = HANDLE_HID_KB_IN_REPORT,
      .handle_boot_num = HANDLE_HID_BOOT_KB_IN_REPORT,
      .buffer = Keyboard_buffer,
-     .buffer_size = HIDD_LE_REPORT_KB_IN_SIZE,
-     .can_indicate = false,
-     .can_notify = false},
+     .buffer_size = HIDD_LE_REPORT_KB_IN_SIZE},
     {.name = "leds",
      .handle_num = HANDLE_HID_KB_OUT_REPORT,
      .handle_boot_num = HANDLE_HID_BOOT_KB_OUT_REPORT,
      .buffer = Leds_buffer,
-     .buffer_size = HIDD_LE_REPORT_KB_OUT_SIZE,
-     .can_indicate = false,
-     .can_notify = false},
+     .buffer_size = HIDD_LE_REPORT_KB_OUT_SIZE},
     {.name = "consumer control",
      .handle_num = HANDLE_HID_CC_REPORT,
      .handle_boot_num = HANDLE_HID_CC_REPORT,
      .buffer = CC_buffer,
-     .buffer_size = HIDD_LE_REPORT_CC_SIZE,
-     .can_indicate = false,
-     .can_notify = false},
+     .buffer_size = HIDD_LE_REPORT_CC_SIZE},
     {.name = "battery level",
      .handle_num = HANDLE_BATTERY_LEVEL,
      .handle_boot_num = HANDLE_BATTERY_LEVEL,
      .buffer = Battery_level,
-     .buffer_size = HIDD_LE_BATTERY_LEVEL_SIZE,
-     .can_indicate = false,
-     .can_notify = false},
+     .buffer_size = HIDD_LE_BATTERY_LEVEL_SIZE},
     {.name = "feature",
      .handle_num = HANDLE_HID_FEATURE_REPORT,
      .handle_boot_num = HANDLE_HID_FEATURE_REPORT,
      .buffer = Feature_buffer,
-     .buffer_size = HIDD_LE_REPORT_FEATURE,
-     .can_indicate = false,
-     .can_notify = false},
+     .buffer_size = HIDD_LE_REPORT_FEATURE},
 };
 
-static struct hid_device_data {
-    /* Mutex semaphore for access to this struct */
-    SemaphoreHandle_t semaphore;
-    bool suspended_state;
-    bool report_mode_boot;
+#define NOTIFY_DATA_REPORTS_COUNT \
+    (sizeof(Notify_data_reports) / sizeof(Notify_data_reports[0]))
+
+/* keyboard input report, used directly by report program streaming */
+static struct hid_notify_data *const Keyboard_report = &Notify_data_reports[1];
+
+/* attribute handles above this are not indexed */
+#define HID_ATTR_HANDLE_MAX 128
+
+/* centrals connected at the same time */
+#define HID_CONN_MAX CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+
+/* subscription flags of a report characteristic */
+#define HID_SUB_NOTIFY 0x01
+#define HID_SUB_INDICATE 0x02 /* preffered, because central will response */
+
+/* report lookup by HANDLE_* index, both report mode and boot mode.
+   filled in hid_index_report_chr() called from gatt_svr_register_cb() */
+static struct hid_notify_data *Report_by_handle_num[HANDLE_HID_COUNT];
+
+/* report lookup by attribute handle, both report mode and boot mode.
+   Report_attr_boot tells which characteristic of the report it is */
+static struct hid_notify_data *Report_by_attr[HID_ATTR_HANDLE_MAX];
+static bool Report_attr_boot[HID_ATTR_HANDLE_MAX];
+
+/* state of one connected central. report values are shared by all centrals,
+   subscriptions, protocol mode, suspend state and LEDs are kept for each */
+struct hid_conn_data {
     bool connected;
     uint16_t conn_handle;
+    bool suspended_state;
+    bool report_mode_boot;
+    uint8_t leds;
+    /* HID_SUB_* flags of report mode [0] and boot mode [1] characteristic */
+    uint8_t subscribed[NOTIFY_DATA_REPORTS_COUNT][2];
+};
+
+static struct hid_device_data {
+    /* Mutex semaphore for access to report buffers */
+    SemaphoreHandle_t semaphore;
+    struct hid_conn_data conns[HID_CONN_MAX];
 } My_hid_dev = {
     .semaphore = 0,
-    .connected = false,
-    .suspended_state = false,
-    .report_mode_boot = false,
 };
 
-/* mark report for indicate/notify when central subscribes to service
- * charachetric with report */
-void hid_set_notify(uint16_t attr_handle, uint8_t cur_notify,
-                    uint8_t cur_indicate) {
-    int report_idx = -1;
-
-    /* find hid_notify_data struct index of reports array for given atribute
-     * handle */
-    for (int i = 0;
-         i < sizeof(Notify_data_reports) / sizeof(Notify_data_reports[0]);
-         ++i) {
-        uint16_t current_handle_idx =
-            My_hid_dev.report_mode_boot ? Notify_data_reports[i].handle_boot_num
-                                        : Notify_data_reports[i].handle_num;
-        if (attr_handle == Svc_char_handles[current_handle_idx]) {
-            report_idx = i;
-            break;
+/* find state of a connected central, NULL if not connected.
+ * the host task changes the states, other tasks call this with the lock held */
+static struct hid_conn_data *hid_conn_find(uint16_t conn_handle) {
+    for (int i = 0; i < HID_CONN_MAX; ++i) {
+        if (My_hid_dev.conns[i].connected &&
+            My_hid_dev.conns[i].conn_handle == conn_handle) {
+            return &My_hid_dev.conns[i];
         }
     }
-    if (report_idx == -1) {
-        ESP_LOGW(tag, "%s: attr_handle %04X not found in reports", __FUNCTION__,
-                 attr_handle);
-    } else {
-        Notify_data_reports[report_idx].can_indicate = cur_indicate;
-        Notify_data_reports[report_idx].can_notify = cur_notify;
-
-        ESP_LOGI(tag, "%s: service %s, attr_handle %d, notify %d, indicate %d",
-                 __FUNCTION__, Notify_data_reports[report_idx].name,
-                 attr_handle, cur_notify, cur_indicate);
-    }
+    return NULL;
 }
 
-/* lock report buffers with mutex semaphore */
+/* lock report buffers and connection states with mutex semaphore */
 static int lock_hid_data() {
     if (!My_hid_dev.semaphore) {
         ESP_LOGW(tag, "%s semaphore is NULL", __FUNCTION__);
@@ -159,7 +162,7 @@ static int lock_hid_data() {
     return 2;
 }
 
-/* unlock report buffers locked with mutex semaphore */
+/* unlock report buffers and connection states locked with mutex semaphore */
 static int unlock_hid_data() {
     if (!My_hid_dev.semaphore) {
         ESP_LOGW(tag, "%s semaphore is NULL", __FUNCTION__);
@@ -171,62 +174,237 @@ static int unlock_hid_data() {
     return 2;
 }
 
-/* zero all fields on new connection */
-void hid_clean_vars(struct ble_gap_conn_desc *desc) {
-    // save semaphore for new connection use
-    SemaphoreHandle_t semaphore_saved = My_hid_dev.semaphore;
-    int rc = -1;
-
-    if (semaphore_saved) {
-        rc = lock_hid_data();
-    }
-
-    memset(&My_hid_dev, 0, sizeof(struct hid_device_data));
-
-    for (int i = 0;
-         i < sizeof(Notify_data_reports) / sizeof(Notify_data_reports[0]);
-         ++i) {
-        Notify_data_reports[i].can_indicate = false;
-        Notify_data_reports[i].can_notify = false;
-        switch (Notify_data_reports[i].handle_num) {
-            case HANDLE_HID_MOUSE_REPORT:
-            case HANDLE_HID_KB_IN_REPORT:
-            case HANDLE_HID_KB_OUT_REPORT:
-            case HANDLE_HID_CC_REPORT:
-                memset(Notify_data_reports[i].buffer, 0,
-                       Notify_data_reports[i].buffer_size);
+/* copy state of a connected central under the lock. the sender task sends
+ * with the copy, so a slot reused by the host task while a report is sent is
+ * not seen. false if not connected */
+static bool hid_conn_copy(uint16_t conn_handle, struct hid_conn_data *copy) {
+    if (!My_hid_dev.semaphore) {
+        /* no central has connected yet */
+        return false;
+    }
+    int rc = lock_hid_data();
+    const struct hid_conn_data *conn = hid_conn_find(conn_handle);
+    if (conn != NULL) {
+        *copy = *conn;
+    }
+    if (!rc) {
+        unlock_hid_data();
+    }
+    return conn != NULL;
+}
+
+/* copy states of all centrals under the lock */
+static void hid_conns_copy(struct hid_conn_data conns[HID_CONN_MAX]) {
+    if (!My_hid_dev.semaphore) {
+        /* no central has connected yet */
+        memset(conns, 0, sizeof(My_hid_dev.conns));
+        return;
+    }
+    int rc = lock_hid_data();
+    memcpy(conns, My_hid_dev.conns, sizeof(My_hid_dev.conns));
+    if (!rc) {
+        unlock_hid_data();
+    }
+}
+
+/* characteristic of a report used by a central in its protocol mode */
+static bool hid_conn_uses_boot(const struct hid_conn_data *conn,
+                               const struct hid_notify_data *report) {
+    return conn->report_mode_boot &&
+           report->handle_boot_num != report->handle_num;
+}
+
+/* HID_SUB_* flags of a report for a central in its protocol mode */
+static uint8_t hid_conn_subscribed(const struct hid_conn_data *conn,
+                                   const struct hid_notify_data *report) {
+    return conn->subscribed[report - Notify_data_reports]
+                           [hid_conn_uses_boot(conn, report)];
+}
+
+/* attribute handle to send a report to a central in its protocol mode */
+static uint16_t hid_conn_send_handle(const struct hid_conn_data *conn,
+                                     const struct hid_notify_data *report) {
+    return Svc_char_handles[hid_conn_uses_boot(conn, report)
+                                ? report->handle_boot_num
+                                : report->handle_num];
+}
+
+/* register characteristic value handle of a report, called from
+ * gatt_svr_register_cb() for every characteristic */
+void hid_index_report_chr(int handle_num, uint16_t val_handle) {
+    if (handle_num < 0 || handle_num >= HANDLE_HID_COUNT ||
+        Svc_char_handles[handle_num] != val_handle) {
+        // not a characteristic in Svc_char_handles (arg is NULL)
+        return;
+    }
+    if (val_handle >= HID_ATTR_HANDLE_MAX) {
+        ESP_LOGW(tag, "%s: attr_handle %04X is too large to index",
+                 __FUNCTION__, val_handle);
+    }
+    for (int i = 0; i < NOTIFY_DATA_REPORTS_COUNT; ++i) {
+        struct hid_notify_data *report = &Notify_data_reports[i];
+        if (report->handle_num == handle_num ||
+            report->handle_boot_num == handle_num) {
+            Report_by_handle_num[handle_num] = report;
+            if (val_handle < HID_ATTR_HANDLE_MAX) {
+                Report_by_attr[val_handle] = report;
+                Report_attr_boot[val_handle] =
+                    report->handle_num != handle_num;
+            }
+            break;
         }
     }
+}
+
+/* find report by HANDLE_* index */
+static struct hid_notify_data *hid_report_by_handle_num(int handle_num) {
+    if (handle_num < 0 || handle_num >= HANDLE_HID_COUNT) {
+        return NULL;
+    }
+    return Report_by_handle_num[handle_num];
+}
+
+/* mark report for indicate/notify when central subscribes to service
+ * charachetric with report */
+void hid_set_notify(uint16_t conn_handle, uint16_t attr_handle,
+                    uint8_t cur_notify, uint8_t cur_indicate) {
+    struct hid_notify_data *report =
+        attr_handle < HID_ATTR_HANDLE_MAX ? Report_by_attr[attr_handle] : NULL;
+    int rc = lock_hid_data();
+    struct hid_conn_data *conn = hid_conn_find(conn_handle);
+    if (report != NULL && conn != NULL) {
+        conn->subscribed[report - Notify_data_reports]
+                        [Report_attr_boot[attr_handle]] =
+            (cur_notify ? HID_SUB_NOTIFY : 0) |
+            (cur_indicate ? HID_SUB_INDICATE : 0);
+    }
+    if (!rc) {
+        unlock_hid_data();
+    }
 
-    if (semaphore_saved) {
-        My_hid_dev.semaphore = semaphore_saved;
+    if (report == NULL || conn == NULL) {
+        ESP_LOGW(tag, "%s: conn_handle %d attr_handle %04X not found",
+                 __FUNCTION__, conn_handle, attr_handle);
     } else {
+        ESP_LOGI(tag,
+                 "%s: service %s, conn_handle %d, attr_handle %d, notify %d, "
+                 "indicate %d",
+                 __FUNCTION__, report->name, conn_handle, attr_handle,
+                 cur_notify, cur_indicate);
+    }
+}
+
+/* prepare state of a new connection. report values are cleared only when
+ * no other central is connected */
+void hid_clean_vars(struct ble_gap_conn_desc *desc) {
+    if (!My_hid_dev.semaphore) {
         My_hid_dev.semaphore = xSemaphoreCreateMutex();
         assert(My_hid_dev.semaphore != NULL);
     }
+    int rc = lock_hid_data();
+
+    struct hid_conn_data *conn = hid_conn_find(desc->conn_handle);
+    bool others = false;
+    for (int i = 0; i < HID_CONN_MAX; ++i) {
+        if (!My_hid_dev.conns[i].connected) {
+            if (conn == NULL) {
+                conn = &My_hid_dev.conns[i];
+            }
+        } else if (&My_hid_dev.conns[i] != conn) {
+            others = true;
+        }
+    }
+
+    if (!others) {
+        for (int i = 0; i < NOTIFY_DATA_REPORTS_COUNT; ++i) {
+            switch (Notify_data_reports[i].handle_num) {
+                case HANDLE_HID_MOUSE_REPORT:
+                case HANDLE_HID_KB_IN_REPORT:
+                case HANDLE_HID_KB_OUT_REPORT:
+                case HANDLE_HID_CC_REPORT:
+                    memset(Notify_data_reports[i].buffer, 0,
+                           Notify_data_reports[i].buffer_size);
+            }
+        }
+    }
 
-    My_hid_dev.conn_handle = desc->conn_handle;
-    My_hid_dev.connected = true;
+    if (conn == NULL) {
+        ESP_LOGW(tag, "%s: no room for conn_handle %d", __FUNCTION__,
+                 desc->conn_handle);
+    } else {
+        // report mode is reset to report protocol
+        memset(conn, 0, sizeof(*conn));
+        conn->conn_handle = desc->conn_handle;
+        conn->connected = true;
+    }
 
     if (!rc) {
         unlock_hid_data();
     }
 }
 
-void hid_set_disconnected() { My_hid_dev.connected = false; }
+void hid_set_disconnected(uint16_t conn_handle) {
+    int rc = lock_hid_data();
+    struct hid_conn_data *conn = hid_conn_find(conn_handle);
+    if (conn != NULL) {
+        conn->connected = false;
+    }
+    if (!rc) {
+        unlock_hid_data();
+    }
+}
 
-bool hid_set_suspend(bool need_suspend) {
-    bool last_state = My_hid_dev.suspended_state;
-    My_hid_dev.suspended_state = need_suspend;
+bool hid_set_suspend(uint16_t conn_handle, bool need_suspend) {
+    bool last_state = false;
+    int rc = lock_hid_data();
+    struct hid_conn_data *conn = hid_conn_find(conn_handle);
+    if (conn != NULL) {
+        last_state = conn->suspended_state;
+        conn->suspended_state = need_suspend;
+    }
+    if (!rc) {
+        unlock_hid_data();
+    }
     return last_state;
 }
 
-bool hid_set_report_mode(bool is_mode_boot) {
-    bool old_boot = My_hid_dev.report_mode_boot;
-    My_hid_dev.report_mode_boot = is_mode_boot;
+bool hid_set_report_mode(uint16_t conn_handle, bool is_mode_boot) {
+    bool old_boot = false;
+    int rc = lock_hid_data();
+    struct hid_conn_data *conn = hid_conn_find(conn_handle);
+    if (conn != NULL) {
+        old_boot = conn->report_mode_boot;
+        conn->report_mode_boot = is_mode_boot;
+    }
+    if (!rc) {
+        unlock_hid_data();
+    }
     return old_boot;
 }
 
+bool hid_get_report_mode(uint16_t conn_handle) {
+    struct hid_conn_data conn;
+    return hid_conn_copy(conn_handle, &conn) && conn.report_mode_boot;
+}
+
+/* number of connected centrals in copied states */
+static int hid_conns_connected(const struct hid_conn_data conns[HID_CONN_MAX]) {
+    int n = 0;
+    for (int i = 0; i < HID_CONN_MAX; ++i) {
+        if (conns[i].connected) {
+            n++;
+        }
+    }
+    return n;
+}
+
+/* number of connected centrals */
+int hid_conn_count(void) {
+    struct hid_conn_data conns[HID_CONN_MAX];
+    hid_conns_copy(conns);
+    return hid_conns_connected(conns);
+}
+
 char outbuf[100];
 
 char *print_buf(uint8_t *buf, int buf_size) {
@@ -237,30 +415,32 @@ char *print_buf(uint8_t *buf, int buf_size) {
     return outbuf;
 }
 
-int hid_read_buffer(struct os_mbuf *buf, int handle_num) {
+int hid_read_buffer(uint16_t conn_handle, struct os_mbuf *buf,
+                    int handle_num) {
     int rc = 0;
-    int rep_idx = -1;
-
-    for (int i = 0;
-         i < sizeof(Notify_data_reports) / sizeof(Notify_data_reports[0]);
-         ++i) {
-        if (Notify_data_reports[i].handle_num == handle_num ||
-            Notify_data_reports[i].handle_boot_num == handle_num) {
-            rep_idx = i;
-            break;
-        }
-    }
-
-    if (rep_idx != -1 && lock_hid_data() == 0) {
-        rc = os_mbuf_append(buf, Notify_data_reports[rep_idx].buffer,
-                            Notify_data_reports[rep_idx].buffer_size);
+    struct hid_notify_data *report = hid_report_by_handle_num(handle_num);
+
+    if (report != NULL && lock_hid_data() == 0) {
+        struct hid_conn_data *conn = hid_conn_find(conn_handle);
+        if (report->buffer == Leds_buffer && conn != NULL) {
+            /* LEDs are set by each central */
+            rc = os_mbuf_append(buf, &conn->leds, sizeof(conn->leds));
+        } else
+#if CONFIG_MY_HID_NKRO
+        if (handle_num == HANDLE_HID_KB_IN_REPORT) {
+            /* report protocol keyboard input is N-key rollover bitmap */
+            uint8_t nkro[MY_HID_NKRO_REPORT_SIZE];
+            my_hid_nkro_encode(report->buffer, nkro);
+            rc = os_mbuf_append(buf, nkro, sizeof(nkro));
+        } else
+#endif
+        rc = os_mbuf_append(buf, report->buffer, report->buffer_size);
         unlock_hid_data();
 
         // ESP_LOGI("", "%s read data: %s", __FUNCTION__,
-        //     print_buf(Notify_data_reports[rep_idx].buffer,
-        //         Notify_data_reports[rep_idx].buffer_size));
+        //     print_buf(report->buffer, report->buffer_size));
     } else {
-        if (rep_idx == -1)
+        if (report == NULL)
             ESP_LOGW(tag, "%s: handle_num %d not found", __FUNCTION__,
                      handle_num);
         return 2;
@@ -269,31 +449,28 @@ int hid_read_buffer(struct os_mbuf *buf, int handle_num) {
     return rc;
 }
 
-int hid_write_buffer(struct os_mbuf *buf, int handle_num) {
+int hid_write_buffer(uint16_t conn_handle, struct os_mbuf *buf,
+                     int handle_num) {
     int rc = 0;
 
-    int rep_idx = -1;
+    struct hid_notify_data *report = hid_report_by_handle_num(handle_num);
 
-    for (int i = 0;
-         i < sizeof(Notify_data_reports) / sizeof(Notify_data_reports[0]);
-         ++i) {
-        if (Notify_data_reports[i].handle_num == handle_num ||
-            Notify_data_reports[i].handle_boot_num == handle_num) {
-            rep_idx = i;
-            break;
-        }
-    }
-    if (rep_idx != -1 && lock_hid_data() == 0) {
-        if (OS_MBUF_PKTLEN(buf) == Notify_data_reports[rep_idx].buffer_size) {
-            rc = ble_hs_mbuf_to_flat(buf, Notify_data_reports[rep_idx].buffer,
-                                     OS_MBUF_PKTLEN(buf), NULL);
+    if (report != NULL && lock_hid_data() == 0) {
+        if (OS_MBUF_PKTLEN(buf) == report->buffer_size) {
+            rc = ble_hs_mbuf_to_flat(buf, report->buffer, OS_MBUF_PKTLEN(buf),
+                                     NULL);
         } else {
             rc = 4;
         }
+        struct hid_conn_data *conn = hid_conn_find(conn_handle);
+        if (rc == 0 && report->buffer == Leds_buffer && conn != NULL) {
+            conn->leds = Leds_buffer[0];
+        }
         unlock_hid_data();
         if (rc == 0) {
-            if (handle_num == HANDLE_HID_KB_OUT_REPORT) {
-                // change LEDs level when Keyboard out report received
+            if (report->buffer == Leds_buffer) {
+                // change LEDs level when Keyboard out report received,
+                // the central which wrote last wins
                 my_if_uart_set_leds(Leds_buffer[0]);
             }
         }
@@ -304,93 +481,195 @@ int hid_write_buffer(struct os_mbuf *buf, int handle_num) {
     return rc;
 }
 
-/*  send report to central using different ways
-    0 - using ble_gattc_indicate_custom     using custom buffer
-    1 - using ble_gattc_indicate            to only one connection
-    2 - using ble_gatts_chr_updated         to all connected centrals
+/*  send report to central using different ways, selected at runtime
+    0 - SEND_METHOD_CUSTOM  ble_gattc_*_custom, mbuf from the shared msys pool
+    1 - SEND_METHOD_STD     ble_gattc_*, NimBLE reads the value back through
+                            the access callback (hid_read_buffer)
+    2 - SEND_METHOD_ALL     ble_gatts_chr_updated to all connected centrals
+    3 - SEND_METHOD_POOL    ble_gattc_*_custom, mbuf from the dedicated pool
+                            (my_hid_mbuf), no access callback and no lock
 */
-#define SEND_METHOD_CUSTOM 0
-#define SEND_METHOD_STD 1
-#define SEND_METHOD_ALL 2
+static volatile int Notify_method = SEND_METHOD_POOL;
 
-#define NOTIFY_METHOD SEND_METHOD_STD
+static const char *const Notify_method_names[SEND_METHOD_COUNT] = {
+    "custom", "std", "all", "pool"};
 
-/* send report data to central using notify/indicate */
-int hid_send_report(int report_handle_num) {
-    /* check semaphore, connection and suspend state */
-    if (!My_hid_dev.semaphore || !My_hid_dev.connected ||
-        My_hid_dev.suspended_state) {
-        ESP_LOGI(tag, "%s semaphore %p %d %d", __FUNCTION__,
-                 My_hid_dev.semaphore, My_hid_dev.connected,
-                 My_hid_dev.suspended_state);
-        return 1;
+/* select send method, returns previous method or -1 if method is unknown */
+int hid_set_send_method(int method) {
+    if (method < 0 || method >= SEND_METHOD_COUNT) {
+        return -1;
     }
+    int old_method = Notify_method;
+    Notify_method = method;
+    return old_method;
+}
 
-    int report_idx = -1;
+int hid_get_send_method(void) { return Notify_method; }
 
-    for (int i = 0;
-         i < sizeof(Notify_data_reports) / sizeof(Notify_data_reports[0]);
-         ++i) {
-        if (report_handle_num == Notify_data_reports[i].handle_num) {
-            report_idx = i;
-            break;
+const char *hid_send_method_name(int method) {
+    if (method < 0 || method >= SEND_METHOD_COUNT) {
+        return "unknown";
+    }
+    return Notify_method_names[method];
+}
+
+/* build notification mbuf of a report value for CUSTOM and POOL methods.
+   keyboard input report of report protocol is N-key rollover bitmap */
+static struct os_mbuf *hid_report_mbuf(const struct hid_conn_data *conn,
+                                       const struct hid_notify_data *report,
+                                       const uint8_t *value) {
+    size_t size = report->buffer_size;
+#if CONFIG_MY_HID_NKRO
+    uint8_t nkro[MY_HID_NKRO_REPORT_SIZE];
+    if (!conn->report_mode_boot && report == Keyboard_report) {
+        my_hid_nkro_encode(value, nkro);
+        value = nkro;
+        size = sizeof(nkro);
+    }
+#endif
+    if (Notify_method == SEND_METHOD_POOL) {
+        return my_hid_mbuf_from_flat(value, size);
+    }
+    return ble_hs_mbuf_from_flat(value, size);
+}
+
+/* send notification mbuf to one central, om is always consumed */
+static int hid_notify_mbuf(const struct hid_conn_data *conn,
+                           const struct hid_notify_data *report,
+                           struct os_mbuf *om) {
+    if (om == NULL) {
+        return BLE_HS_ENOMEM;
+    }
+    uint8_t subscribed = hid_conn_subscribed(conn, report);
+    uint16_t send_handle = hid_conn_send_handle(conn, report);
+    if (subscribed & HID_SUB_INDICATE) {
+        my_latency_notify_sent(conn->conn_handle);
+        return ble_gattc_indicate_custom(conn->conn_handle, send_handle, om);
+    }
+    if (subscribed & HID_SUB_NOTIFY) {
+        my_latency_notify_sent(conn->conn_handle);
+        return ble_gattc_notify_custom(conn->conn_handle, send_handle, om);
+    }
+    os_mbuf_free_chain(om);
+    return 0;
+}
+
+/* send notification to one central for STD method, value is read from
+   report->buffer through the access callback */
+static int hid_notify_attr(const struct hid_conn_data *conn,
+                           const struct hid_notify_data *report) {
+    uint8_t subscribed = hid_conn_subscribed(conn, report);
+    uint16_t send_handle = hid_conn_send_handle(conn, report);
+    if (subscribed & HID_SUB_INDICATE) {
+        my_latency_notify_sent(conn->conn_handle);
+        return ble_gattc_indicate(conn->conn_handle, send_handle);
+    }
+    if (subscribed & HID_SUB_NOTIFY) {
+        my_latency_notify_sent(conn->conn_handle);
+        return ble_gattc_notify(conn->conn_handle, send_handle);
+    }
+    return 0;
+}
+
+/* ALL method: NimBLE notifies every subscribed central of the characteristic
+   in one call. the boot characteristic is updated only when a central uses it.
+   suspended centrals are not skipped by NimBLE */
+static void hid_notify_all(const struct hid_conn_data conns[HID_CONN_MAX],
+                           const struct hid_notify_data *report) {
+    bool report_used = false;
+    bool boot_used = false;
+    for (int i = 0; i < HID_CONN_MAX; ++i) {
+        const struct hid_conn_data *conn = &conns[i];
+        if (conn->connected) {
+            if (hid_conn_uses_boot(conn, report)) {
+                boot_used = true;
+            } else {
+                report_used = true;
+            }
         }
     }
+    if (report_used) {
+        ble_gatts_chr_updated(Svc_char_handles[report->handle_num]);
+    }
+    if (boot_used) {
+        ble_gatts_chr_updated(Svc_char_handles[report->handle_boot_num]);
+    }
+}
+
+/* central can receive a report now */
+static bool hid_conn_can_send(const struct hid_conn_data *conn,
+                              const struct hid_notify_data *report) {
+    return conn->connected && !conn->suspended_state &&
+           hid_conn_subscribed(conn, report) != 0;
+}
+
+/* send report data to all connected centrals using notify/indicate */
+int hid_send_report(int report_handle_num) {
+    /* check semaphore and connections. the states are copied, the host task
+       may change them while sending */
+    struct hid_conn_data conns[HID_CONN_MAX];
+    hid_conns_copy(conns);
+    if (!My_hid_dev.semaphore || hid_conns_connected(conns) == 0) {
+        ESP_LOGI(tag, "%s semaphore %p connections %d", __FUNCTION__,
+                 My_hid_dev.semaphore, hid_conns_connected(conns));
+        return 1;
+    }
+
+    struct hid_notify_data *report =
+        hid_report_by_handle_num(report_handle_num);
 
-    if (report_idx == -1) {
+    if (report == NULL || report->handle_num != report_handle_num) {
         ESP_LOGW(tag, "%s: Unknown report_handle_num %d", __FUNCTION__,
                  report_handle_num);
         return 2;
     }
 
-    uint16_t send_handle;
-    int rc = 0;
+    if (Notify_method == SEND_METHOD_ALL) {
+        hid_notify_all(conns, report);
+        return 0;
+    }
 
-    if (My_hid_dev.report_mode_boot) {
-        send_handle =
-            Svc_char_handles[Notify_data_reports[report_idx].handle_boot_num];
-    } else {
-        send_handle =
-            Svc_char_handles[Notify_data_reports[report_idx].handle_num];
-    }
-
-    switch (NOTIFY_METHOD) {
-        case SEND_METHOD_CUSTOM: {
-            if (lock_hid_data() == 0) {
-                struct os_mbuf *om = ble_hs_mbuf_from_flat(
-                    Notify_data_reports[report_idx].buffer,
-                    Notify_data_reports[report_idx].buffer_size);
-                unlock_hid_data();
-
-                if (Notify_data_reports[report_idx].can_indicate) {
-                    rc = ble_gattc_indicate_custom(My_hid_dev.conn_handle,
-                                                   send_handle, om);
-                } else if (Notify_data_reports[report_idx].can_notify) {
-                    rc = ble_gattc_notify_custom(My_hid_dev.conn_handle,
-                                                 send_handle, om);
-                }
-            }
-            break;
+    int rc = 0;
+    bool sent = false;
+    for (int i = 0; i < HID_CONN_MAX; ++i) {
+        const struct hid_conn_data *conn = &conns[i];
+        if (!conn->connected || conn->suspended_state) {
+            continue;
         }
-
-        case SEND_METHOD_STD:
-            if (Notify_data_reports[report_idx].can_indicate) {
-                rc = ble_gattc_indicate(My_hid_dev.conn_handle, send_handle);
-            } else if (Notify_data_reports[report_idx].can_notify) {
-                rc = ble_gattc_notify(My_hid_dev.conn_handle, send_handle);
+        int conn_rc = 0;
+        switch (Notify_method) {
+            case SEND_METHOD_CUSTOM:
+            case SEND_METHOD_POOL: {
+                if (hid_conn_subscribed(conn, report) == 0) {
+                    break;
+                }
+                if (lock_hid_data() == 0) {
+                    struct os_mbuf *om =
+                        hid_report_mbuf(conn, report, report->buffer);
+                    unlock_hid_data();
+                    conn_rc = hid_notify_mbuf(conn, report, om);
+                }
+                break;
             }
-            break;
 
-        case SEND_METHOD_ALL:
-            ble_gatts_chr_updated(send_handle);
-            rc = 0;
-            break;
+            default:
+                conn_rc = hid_notify_attr(conn, report);
+                break;
+        }
+        if (conn_rc) {
+            ESP_LOGE(tag, "%s: Notify error to conn_handle %d (%d)",
+                     __FUNCTION__, conn->conn_handle, conn_rc);
+            rc = conn_rc;
+        } else {
+            sent = true;
+        }
     }
-    if (rc) {
-        ESP_LOGE(tag, "%s: Notify error in function", __FUNCTION__);
+    if (!sent && rc == 0) {
+        /* all centrals are suspended */
+        return 1;
     }
 
-    return 0;
+    return rc;
 }
 
 uint8_t hid_battery_level_get(void) { return Battery_level[0]; }
@@ -608,16 +887,12 @@ int hid_keyboard_change_key(uint8_t key, bool pressed) {
         unlock_hid_data();
 
         if (rc == 0) {
-            // show report
-            char hex_string[HIDD_LE_REPORT_KB_IN_SIZE * 5 + 1];
-            int offset = 0;
-            for (int i = 0; i < HIDD_LE_REPORT_KB_IN_SIZE; i++) {
-                offset +=
-                    sprintf(hex_string + offset, "0x%02x ", Keyboard_buffer[i]);
-            }
-            ESP_LOGI(tag, "report -> %s", hex_string);
-            // send report
+            // send report, and record it in binary (no formatting here)
             rc = hid_send_report(HANDLE_HID_KB_IN_REPORT);
+            my_trace_report(Keyboard_buffer, rc);
+#if MY_VERBOSE_LOG_LEVEL >= MY_VERBOSE_FRAME
+            ESP_LOG_BUFFER_HEX(tag, Keyboard_buffer, HIDD_LE_REPORT_KB_IN_SIZE);
+#endif
         }
     } else {
         rc = 2;
@@ -663,16 +938,12 @@ int hid_keyboard_change_keycombination_multi(
         unlock_hid_data();
 
         if (rc == 0) {
-            // show report
-            char hex_string[HIDD_LE_REPORT_KB_IN_SIZE * 5 + 1];
-            int offset = 0;
-            for (int i = 0; i < HIDD_LE_REPORT_KB_IN_SIZE; i++) {
-                offset +=
-                    sprintf(hex_string + offset, "0x%02x ", Keyboard_buffer[i]);
-            }
-            ESP_LOGI(tag, "report -> %s", hex_string);
-            // send report
+            // send report, and record it in binary (no formatting here)
             rc = hid_send_report(HANDLE_HID_KB_IN_REPORT);
+            my_trace_report(Keyboard_buffer, rc);
+#if MY_VERBOSE_LOG_LEVEL >= MY_VERBOSE_FRAME
+            ESP_LOG_BUFFER_HEX(tag, Keyboard_buffer, HIDD_LE_REPORT_KB_IN_SIZE);
+#endif
         }
     } else {
         rc = 2;
@@ -699,3 +970,81 @@ int hid_keyboard_change_keycombination_single(uint8_t m, uint8_t key,
     return rc;
 }
 
+/**
+ * @brief list centrals to stream keyboard input reports to: connected, not
+ *        suspended and subscribed in their protocol mode. with ALL method only
+ *        the first one is listed, because one update reaches all of them.
+ * @param conn_handles connection handles are stored here
+ * @param max size of conn_handles
+ * @return number of connection handles
+ */
+int hid_keyboard_stream_conns(uint16_t *conn_handles, int max) {
+    struct hid_conn_data conns[HID_CONN_MAX];
+    hid_conns_copy(conns);
+    int n = 0;
+    for (int i = 0; i < HID_CONN_MAX && n < max; ++i) {
+        const struct hid_conn_data *conn = &conns[i];
+        if (hid_conn_can_send(conn, Keyboard_report)) {
+            conn_handles[n++] = conn->conn_handle;
+            if (Notify_method == SEND_METHOD_ALL) {
+                break;
+            }
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief send one keyboard input report of a report program to one central.
+ *        no report search and no formatting. with CUSTOM and POOL methods the
+ *        report is sent from the caller's buffer without lock, with STD and ALL
+ *        methods it is copied to the keyboard buffer and read back by NimBLE.
+ *        call hid_keyboard_stream_end() after the last one.
+ * @param conn_handle central from hid_keyboard_stream_conns()
+ * @param report modifier, reserved, key x 6
+ */
+int hid_keyboard_stream_report(
+    uint16_t conn_handle, const uint8_t report[HIDD_LE_REPORT_KB_IN_SIZE]) {
+    struct hid_conn_data copy;
+    if (!hid_conn_copy(conn_handle, &copy) || copy.suspended_state) {
+        return 1;
+    }
+    const struct hid_conn_data *conn = &copy;
+    int rc = 0;
+    if (hid_conn_subscribed(conn, Keyboard_report) != 0) {
+        switch (Notify_method) {
+            case SEND_METHOD_CUSTOM:
+            case SEND_METHOD_POOL:
+                rc = hid_notify_mbuf(
+                    conn, Keyboard_report,
+                    hid_report_mbuf(conn, Keyboard_report, report));
+                break;
+
+            case SEND_METHOD_ALL: {
+                struct hid_conn_data conns[HID_CONN_MAX];
+                hid_conns_copy(conns);
+                hid_keyboard_stream_end(report);
+                hid_notify_all(conns, Keyboard_report);
+                break;
+            }
+
+            default:
+                hid_keyboard_stream_end(report);
+                rc = hid_notify_attr(conn, Keyboard_report);
+                break;
+        }
+    }
+    my_trace_report(report, rc);
+    return rc;
+}
+
+/**
+ * @brief keep the last streamed report for GATT read of keyboard input report
+ * @param report last report of a report program
+ */
+void hid_keyboard_stream_end(const uint8_t report[HIDD_LE_REPORT_KB_IN_SIZE]) {
+    if (lock_hid_data() == 0) {
+        memcpy(Keyboard_buffer, report, HIDD_LE_REPORT_KB_IN_SIZE);
+        unlock_hid_data();
+    }
+}
@@ -5,11 +5,21 @@
 #include "host/ble_gap.h"
 #include "gatt_svr.h"
 
+/* send method of reports, see hid_send_report() */
+#define SEND_METHOD_CUSTOM 0
+#define SEND_METHOD_STD 1
+#define SEND_METHOD_ALL 2
+#define SEND_METHOD_POOL 3
+#define SEND_METHOD_COUNT 4
+
 extern void hid_clean_vars(struct ble_gap_conn_desc *desc);
-extern void hid_set_disconnected();
-extern void hid_set_notify(uint16_t attr_handle, uint8_t cur_notify, uint8_t cur_indicate);
-extern bool hid_set_suspend(bool need_suspend);
-extern bool hid_set_report_mode(bool boot_mode);
+extern void hid_set_disconnected(uint16_t conn_handle);
+extern void hid_index_report_chr(int handle_num, uint16_t val_handle);
+extern void hid_set_notify(uint16_t conn_handle, uint16_t attr_handle, uint8_t cur_notify, uint8_t cur_indicate);
+extern bool hid_set_suspend(uint16_t conn_handle, bool need_suspend);
+extern bool hid_set_report_mode(uint16_t conn_handle, bool boot_mode);
+extern bool hid_get_report_mode(uint16_t conn_handle);
+extern int hid_conn_count(void);
 
 extern uint8_t hid_battery_level_get(void);
 
@@ -17,13 +27,21 @@ extern int hid_battery_level_set(uint8_t level);
 extern int hid_keyboard_change_key(uint8_t key, bool pressed);
 extern int hid_keyboard_change_keycombination_multi(uint8_t m, uint8_t keys[HIDD_LE_REPORT_KB_IN_SIZE - 2], bool pressed);
 extern int hid_keyboard_change_keycombination_single(uint8_t m, uint8_t key, bool pressed);
+extern int hid_keyboard_stream_conns(uint16_t *conn_handles, int max);
+extern int hid_keyboard_stream_report(uint16_t conn_handle, const uint8_t report[HIDD_LE_REPORT_KB_IN_SIZE]);
+extern void hid_keyboard_stream_end(const uint8_t report[HIDD_LE_REPORT_KB_IN_SIZE]);
+
+extern int hid_set_send_method(int method);
+extern int hid_get_send_method(void);
+extern const char *hid_send_method_name(int method);
 
 extern int hid_cc_change_key(int key, bool pressed);
 extern int hid_mouse_change_key(int cmd, int8_t move_x, int8_t move_y, bool pressed);
 extern int hid_leds_write(struct os_mbuf *buf);
+extern int hid_send_report(int report_handle_num);
 
-extern int hid_write_buffer(struct os_mbuf *buf, int handle_num);
+extern int hid_write_buffer(uint16_t conn_handle, struct os_mbuf *buf, int handle_num);
 
-extern int hid_read_buffer(struct os_mbuf *buf, int handle_num);
+extern int hid_read_buffer(uint16_t conn_handle, struct os_mbuf *buf, int handle_num);
 
 #endif
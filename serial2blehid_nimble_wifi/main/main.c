@@ -17,11 +17,13 @@
  * under the License.
  */
 
+#include <stdio.h>
 #include <string.h>
 #include <sys/time.h>
 
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/semphr.h"
@@ -31,9 +33,18 @@
 #include "hid_func.h"
 // #include "gpio_func.h"
 
+#include "my_conn_policy.h"
 #include "my_hid_key_map.h"
+#include "my_frame_log.h"
+#include "my_frame_queue.h"
+#include "my_hid_mbuf.h"
+#include "my_hid_planner.h"
+#include "my_hid_program.h"
+#include "my_hid_sched.h"
 #include "my_httpd.h"
 #include "my_if_uart.h"
+#include "my_latency.h"
+#include "my_reconnect.h"
 #include "my_softap.h"
 
 /* for nvs_storage*/
@@ -50,14 +61,171 @@ nvs_handle_t Nvs_storage_handle = 0;
 /* from ble_func.c */
 extern void ble_init();
 
-// UARTで受信した値を格納するバッファを排他制御
-extern SemaphoreHandle_t my_if_uart_buffer_semaphore;
-// GPIO/UARTの共用バッファ
-extern uint8_t *my_if_uart_buffer;
-
 // 設定値をNVSから読み出して各変数に格納する
 extern int my_if_uart_get_config();
 
+// HID送信タスクのスタックサイズ
+#define HID_SENDER_TASK_STACK_SIZE (4096)
+
+/**
+ * @brief レポートの並びを、送れる全てのセントラルへ順に送る
+ * @param conns 送るセントラルの接続ハンドル
+ * @param conn_count 送るセントラルの数
+ * @param reports レポートの並び。MY_HID_PLANNER_REPORT_SIZEバイトずつ連続していること
+ * @param count レポート数
+ * @return 最初のレポートを送れた時刻。1つも送れなければ0
+ */
+static int64_t hid_sender_send(const uint16_t *conns, int conn_count,
+                               const uint8_t *reports, int count) {
+    int64_t first_report_us = 0;
+    bool dropped[MY_HID_SCHED_CONN_MAX] = {false};
+    for (int i = 0; i < count; i++) {
+        // 1レポートを接続ごとに送る。接続間隔とクレジットに合わせて待つのはスケジューラ
+        const uint8_t *report = reports + i * MY_HID_PLANNER_REPORT_SIZE;
+        for (int c = 0; c < conn_count; c++) {
+            if (my_hid_sched_send(hid_keyboard_stream_report, conns[c],
+                                  report) != 0) {
+                dropped[c] = true;
+                continue;
+            }
+            if (first_report_us == 0) {
+                first_report_us = esp_timer_get_time();
+            }
+        }
+    }
+    for (int c = 0; c < conn_count && count > 0; c++) {
+        if (dropped[c]) {
+            // 離すレポートが捨てられていると、ホスト側でキーが押されたままになるので、もう一度離す
+            static const uint8_t release[MY_HID_PLANNER_REPORT_SIZE] = {0};
+            my_hid_sched_send(hid_keyboard_stream_report, conns[c], release);
+        }
+    }
+    if (count > 0) {
+        hid_keyboard_stream_end(reports +
+                                (count - 1) * MY_HID_PLANNER_REPORT_SIZE);
+    }
+    return first_report_us;
+}
+
+// 送り直すフレームの先頭に付ける、記録してからの時間の最大長
+#define HID_SENDER_AGE_MAX (16)
+
+/**
+ * @brief 溜めておいたフレームを1つ、送れる全てのセントラルへ送り直す。
+ *        UARTタスクのプールは使わず、ここでレポートの並びに変換する。
+ * @param conns 送るセントラルの接続ハンドル
+ * @param conn_count 送るセントラルの数
+ * @return 1つも送れなかったらfalse
+ */
+static bool hid_sender_replay(const uint16_t *conns, int conn_count) {
+    static uint8_t text[HID_SENDER_AGE_MAX + MY_FRAME_LOG_FRAME_MAX];
+    static uint8_t reports[MY_HID_PLANNER_MAX_REPORTS(sizeof(text))]
+                          [MY_HID_PLANNER_REPORT_SIZE];
+    static uint8_t data[MY_FRAME_LOG_FRAME_MAX];
+    int32_t age_ms = 0;
+    int len = my_frame_log_peek(data, sizeof(data), &age_ms);
+    if (len < 0) return true;
+    // 送り直すあいだも短い接続間隔にしておく
+    my_conn_policy_activity();
+    int pos = 0;
+#if CONFIG_MY_FRAME_LOG_TIMESTAMP
+    // 記録してからの時間を1列目にする
+    if (age_ms == MY_FRAME_LOG_AGE_UNKNOWN) {
+        pos = snprintf((char *)text, HID_SENDER_AGE_MAX, "?\t");
+    } else {
+        pos = snprintf((char *)text, HID_SENDER_AGE_MAX, "-%ld.%03ld\t",
+                       (long)(age_ms / 1000), (long)(age_ms % 1000));
+    }
+#endif
+    memcpy(text + pos, data, len);
+    int count = my_hid_planner_plan(text, pos + len, reports,
+                                    MY_HID_PLANNER_MAX_REPORTS(sizeof(text)));
+    if (count < 0) {
+        count = 0;
+    }
+    if (hid_sender_send(conns, conn_count, reports[0], count) == 0 &&
+        count > 0) {
+        // 1つも送れなかった。切断されたなら、次に購読されたときに送り直す
+        return false;
+    }
+    my_frame_log_pop();
+    return true;
+}
+
+/**
+ * @brief HID送信タスク。フレームキューから1フレームずつ取り出してBLE-HID送信する。
+ *        UARTタスクとはキューでのみつながっているので、送信中もUART受信は止まらない。
+ *        送れるセントラルが無いときに受け取ったフレームは溜めておき、
+ *        セントラルが購読したら、新しいフレームより先に送り直す。
+ */
+static void hid_sender_task(void *arg) {
+    // フレームはキューの要素サイズと同じなのでスタックに置かず静的に確保
+    static my_frame_t frame;
+    uint16_t conns[MY_HID_SCHED_CONN_MAX];
+    // 送れるセントラルが現れた時刻。送り直しは、ホストの準備を待ってから始める
+    int64_t conns_since_us = 0;
+    while (1) {
+        int conn_count =
+            hid_keyboard_stream_conns(conns, MY_HID_SCHED_CONN_MAX);
+        int64_t now_us = esp_timer_get_time();
+        if (conn_count == 0) {
+            conns_since_us = 0;
+        } else if (conns_since_us == 0) {
+            conns_since_us = now_us;
+        }
+        bool backlog = !my_frame_log_empty();
+        if (backlog && conn_count > 0 &&
+            now_us - conns_since_us >= MY_FRAME_LOG_REPLAY_DELAY_MS * 1000) {
+            // 送り手になってから、その時点の送り方で送る相手を選び直す
+            my_hid_sched_lock(MY_HID_SCHED_WAIT_FOREVER);
+            conn_count =
+                hid_keyboard_stream_conns(conns, MY_HID_SCHED_CONN_MAX);
+            bool sent =
+                conn_count == 0 || hid_sender_replay(conns, conn_count);
+            my_hid_sched_unlock();
+            if (!sent) {
+                vTaskDelay(pdMS_TO_TICKS(100));
+            }
+            continue;
+        }
+        // 溜めたフレームがあるときは、送れるようになったかを時々確かめる
+        if (!my_frame_queue_pop(&frame, backlog ? pdMS_TO_TICKS(100)
+                                                : portMAX_DELAY)) {
+            continue;
+        }
+        int64_t dequeued_us = esp_timer_get_time();
+        // アイドルで長い接続間隔にしていたら、短い接続間隔に戻す
+        my_conn_policy_activity();
+        // フレームはUARTタスクでレポートの並び（レポートプログラム）に変換済み。
+        // ここでは、送れる全てのセントラルへ順に送るだけ
+        // ベンチマークや送り方の切り替えと重ならないよう、1フレームを送り終わるまで送り手になる
+        const my_hid_program_t *program = &frame.program;
+        my_hid_sched_lock(MY_HID_SCHED_WAIT_FOREVER);
+        conn_count = hid_keyboard_stream_conns(conns, MY_HID_SCHED_CONN_MAX);
+        if ((conn_count == 0 || !my_frame_log_empty()) &&
+            my_frame_log_append(frame.data, frame.len)) {
+            // 送れないか、先に送り直すフレームがあるので、後ろに溜める
+            my_hid_sched_unlock();
+            my_hid_program_free(program);
+            continue;
+        }
+        int64_t first_report_us = 0;
+        if (program->count > 0) {
+            my_latency_frame_begin(&frame.stamp);
+            first_report_us =
+                hid_sender_send(conns, conn_count,
+                                my_hid_program_report(program, 0),
+                                program->count);
+        }
+        my_hid_sched_unlock();
+        my_hid_program_free(program);
+        if (first_report_us != 0) {
+            my_latency_record_frame(&frame.stamp, dequeued_us,
+                                    first_report_us);
+        }
+    }
+}
+
 void app_main(void) {
     // どうさかくにん
     struct timeval tv_prev1;
@@ -94,6 +262,24 @@ void app_main(void) {
     // HTTPd の初期化と使用開始
     my_httpd_start_webserver();
 
+    // キーストロークのスケジューラ。BLEのイベントから使われるので先に用意する
+    my_hid_sched_init();
+
+    // レポートの通知専用のmbufプール
+    my_hid_mbuf_init();
+
+    // 接続パラメータの切り替え。BLEのイベントから使われるので先に用意する
+    my_conn_policy_init();
+
+    // 再接続のアドバタイズの段階と時間の記録
+    my_reconnect_init();
+
+    // 受信から送信完了までの時間のヒストグラム
+    my_latency_init();
+
+    // 送れないあいだのフレームを溜める。NVSに前回の分が残っていれば送り直す
+    my_frame_log_init();
+
     // BLE initialize
     ble_init();
     ESP_LOGI(tag, "BLE init ok");
@@ -108,41 +294,34 @@ void app_main(void) {
     // SoftAPとhttpdが起動していることを示すフラグ
     bool is_softap_live = true;
 
+#if CONFIG_MY_LATENCY_DUMP_SEC > 0
+    // 時間のヒストグラムを前回コンソールへ出してからの秒数
+    int latency_dump_sec = 0;
+#endif
+
     // 初期化が一通り終わった時点の時刻を記録しておく
     struct timeval tv_prev;
     gettimeofday(&tv_prev, NULL);
 
+    // HID送信タスク。受信したフレームはキュー経由で受け取る
+    xTaskCreate(hid_sender_task, "hid sender", HID_SENDER_TASK_STACK_SIZE, NULL,
+                5, NULL);
+
     while (1) {
-        vTaskDelay(50 / portTICK_PERIOD_MS);
-
-        // GPIO/UARTタスクの共用バッファを監視し、タスクの外からBLE-HID送信する
-        if (xSemaphoreTake(my_if_uart_buffer_semaphore, (TickType_t)10) ==
-            pdTRUE) {
-            int i = 0;
-            while (my_if_uart_buffer[i] != 0) {
-                uint8_t k, m;
-                uint8_t c = my_if_uart_buffer[i];
-                k = KEYCODE_TO_HIDCODE(c);
-                m = KEYCODE_TO_HIDMASK(c);
-                if (k != 0) {
-                    // press
-                    if (m > 0) {
-                        hid_keyboard_change_keycombination_single(HID_KEY_LEFT_SHIFT, k, true);
-                    } else {
-                        hid_keyboard_change_keycombination_single(0, k, true);
-                    }
-                    vTaskDelay(50 / portTICK_PERIOD_MS);
-                    // release
-                    hid_keyboard_change_keycombination_single(0, 0, false);
-                    vTaskDelay(50 / portTICK_PERIOD_MS);
-                }
-                i++;
-            }
-            // 処理済みとしてバッファをゼロにしておく
-            my_if_uart_buffer[0] = 0;
-            // セマフォを返却
-            xSemaphoreGive(my_if_uart_buffer_semaphore);
+        // HID送信は別タスクで行うので、ここはSoftAPの終了判定と
+        // 接続パラメータの見直しだけ。1秒ごとで十分
+        vTaskDelay(1000 / portTICK_PERIOD_MS);
+
+        // フレームが来なくなった接続は、長い接続間隔にする
+        my_conn_policy_poll();
+
+#if CONFIG_MY_LATENCY_DUMP_SEC > 0
+        // 時間のヒストグラムを定期的にコンソールへ出す
+        if (++latency_dump_sec >= CONFIG_MY_LATENCY_DUMP_SEC) {
+            latency_dump_sec = 0;
+            my_latency_dump();
         }
+#endif
 
         // 規定時間のhttpd通信無し状態などが続いたら、SoftAPとhttpdを終了する。
         // なお、解除するにはリセットが必要
@@ -0,0 +1,274 @@
+/**
+ * @file my_config_blob.c
+ *   UARTの設定をNVSに保存するための、版数とCRC付きのバイナリ形式
+ *
+ *   以前は設定をカンマ区切りの文字列（バイト列は16進表記）にしてnvs_set_strで保存し、
+ *   起動のたびにstrtolで2文字ずつ戻して、項目ごとにmalloc/freeしていた。
+ *   項目を足すと古い機器で読めなくなる形式でもあった。
+ *   ここでは、次の形のバイト列にしてnvs_set_blobで保存する。数値は全てリトルエンディアン。
+ *
+ *     +0  u32 識別子 MY_CONFIG_BLOB_MAGIC
+ *     +4  u16 版数
+ *     +6  u16 本体の長さ n
+ *     +8  本体 n バイト
+ *     +8+n u32 先頭から本体の終わりまでのCRC-32
+ *
+ *   版数1の本体は
+ *     u32 通信速度, u16 受信バッファサイズ,
+ *     u8 長さ＋送信コマンド, u8 長さ＋終端文字列, u8 長さ＋置換文字列
+ *   新しい項目は本体の末尾に足す。復号は知っている項目だけを読み、残りは読み飛ばすので、
+ *   新しい版で書いた設定も古い版で読める。
+ *
+ *   復号は呼び出し側の構造体に直接書き込み、ヒープは使わない。
+ *   旧形式の文字列を読み出す my_config_blob_decode_legacy() も置き、移行をホストで試せるようにする。
+ *   ESP-IDFに依存しないので、ホストでもそのままコンパイルして試せる。
+ */
+
+#include "my_config_blob.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief CRC-32（IEEE 802.3、反転多項式0xEDB88320）を計算する
+ * @param crc 続きから計算するときは前回の値。最初はゼロ
+ * @param buf データ
+ * @param len データの長さ
+ * @return CRC
+ */
+uint32_t my_config_blob_crc32(uint32_t crc, const uint8_t *buf, int len) {
+    crc = ~crc;
+    for (int i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static void my_config_blob_put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void my_config_blob_put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t my_config_blob_get16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t my_config_blob_get32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+/**
+ * @brief 長さ付きのバイト列を1つ書き込む
+ * @return 書き込んだ後の位置
+ */
+static uint8_t *my_config_blob_put_seq(uint8_t *p, const uint8_t *seq,
+                                       uint8_t len) {
+    *p++ = len;
+    memcpy(p, seq, len);
+    return p + len;
+}
+
+/**
+ * @brief 長さ付きのバイト列を1つ読み出す
+ * @param p 読み出す位置。読み出した後の位置に進める
+ * @param end 本体の終わり
+ * @param[out] seq 読み出し先。MY_CONFIG_BLOB_SEQ_MAXバイト
+ * @param[out] len 読み出した長さ
+ * @return 成功したらゼロ
+ */
+static int my_config_blob_get_seq(const uint8_t **p, const uint8_t *end,
+                                  uint8_t *seq, uint8_t *len) {
+    if (end - *p < 1) return -1;
+    uint8_t l = **p;
+    if (l > MY_CONFIG_BLOB_SEQ_MAX || end - (*p + 1) < l) return -1;
+    memcpy(seq, *p + 1, l);
+    *len = l;
+    *p += 1 + l;
+    return 0;
+}
+
+/**
+ * @brief 設定値をバイト列にする
+ * @param cfg 設定値
+ * @param[out] buf 書き込み先
+ * @param size 書き込み先の大きさ。MY_CONFIG_BLOB_MAX_LEN あれば足りる
+ * @return 書き込んだ長さ。バイト列の長さが上限を超えるか、書き込み先が足りなければ-1
+ */
+int my_config_blob_encode(const my_config_blob_t *cfg, uint8_t *buf,
+                          int size) {
+    if (cfg->request_command_len > MY_CONFIG_BLOB_SEQ_MAX ||
+        cfg->terminator_sequence_len > MY_CONFIG_BLOB_SEQ_MAX ||
+        cfg->terminator_sequence_replace_len > MY_CONFIG_BLOB_SEQ_MAX) {
+        return -1;
+    }
+    int payload_len = MY_CONFIG_BLOB_V1_MIN_LEN + cfg->request_command_len +
+                      cfg->terminator_sequence_len +
+                      cfg->terminator_sequence_replace_len;
+    int len =
+        MY_CONFIG_BLOB_HEADER_LEN + payload_len + MY_CONFIG_BLOB_CRC_LEN;
+    if (size < len) return -1;
+
+    uint8_t *p = buf;
+    my_config_blob_put32(p, MY_CONFIG_BLOB_MAGIC);
+    my_config_blob_put16(p + 4, MY_CONFIG_BLOB_VERSION);
+    my_config_blob_put16(p + 6, (uint16_t)payload_len);
+    p += MY_CONFIG_BLOB_HEADER_LEN;
+    my_config_blob_put32(p, cfg->baud_rate);
+    my_config_blob_put16(p + 4, cfg->receive_buffer_len);
+    p += 6;
+    p = my_config_blob_put_seq(p, cfg->request_command,
+                               cfg->request_command_len);
+    p = my_config_blob_put_seq(p, cfg->terminator_sequence,
+                               cfg->terminator_sequence_len);
+    p = my_config_blob_put_seq(p, cfg->terminator_sequence_replace,
+                               cfg->terminator_sequence_replace_len);
+    my_config_blob_put32(p, my_config_blob_crc32(0, buf, (int)(p - buf)));
+    return len;
+}
+
+/**
+ * @brief バイト列を設定値に戻す。値の範囲は調べないので、呼び出し側で調べること
+ * @param buf バイト列
+ * @param len バイト列の長さ
+ * @param[out] cfg 設定値。失敗したときは中身が途中まで書き換わっていることがある
+ * @return 成功したら MY_CONFIG_BLOB_OK。失敗したら my_config_blob_result_t の負の値
+ */
+int my_config_blob_decode(const uint8_t *buf, int len, my_config_blob_t *cfg) {
+    if (len < MY_CONFIG_BLOB_HEADER_LEN + MY_CONFIG_BLOB_CRC_LEN) {
+        return MY_CONFIG_BLOB_ERR_LENGTH;
+    }
+    if (my_config_blob_get32(buf) != MY_CONFIG_BLOB_MAGIC) {
+        return MY_CONFIG_BLOB_ERR_MAGIC;
+    }
+    uint16_t version = my_config_blob_get16(buf + 4);
+    int payload_len = my_config_blob_get16(buf + 6);
+    if (len !=
+        MY_CONFIG_BLOB_HEADER_LEN + payload_len + MY_CONFIG_BLOB_CRC_LEN) {
+        return MY_CONFIG_BLOB_ERR_LENGTH;
+    }
+    const uint8_t *end = buf + MY_CONFIG_BLOB_HEADER_LEN + payload_len;
+    if (my_config_blob_crc32(0, buf, (int)(end - buf)) !=
+        my_config_blob_get32(end)) {
+        return MY_CONFIG_BLOB_ERR_CRC;
+    }
+    if (version == 0) {
+        return MY_CONFIG_BLOB_ERR_VERSION;
+    }
+
+    // 版数1の項目
+    const uint8_t *p = buf + MY_CONFIG_BLOB_HEADER_LEN;
+    if (end - p < MY_CONFIG_BLOB_V1_MIN_LEN) {
+        return MY_CONFIG_BLOB_ERR_FIELD;
+    }
+    cfg->version = version;
+    cfg->baud_rate = my_config_blob_get32(p);
+    cfg->receive_buffer_len = my_config_blob_get16(p + 4);
+    p += 6;
+    if (my_config_blob_get_seq(&p, end, cfg->request_command,
+                               &cfg->request_command_len) != 0 ||
+        my_config_blob_get_seq(&p, end, cfg->terminator_sequence,
+                               &cfg->terminator_sequence_len) != 0 ||
+        my_config_blob_get_seq(&p, end, cfg->terminator_sequence_replace,
+                               &cfg->terminator_sequence_replace_len) != 0) {
+        return MY_CONFIG_BLOB_ERR_FIELD;
+    }
+    // 版数1では本体はここで終わる。新しい版で足された項目は読み飛ばす
+    if (version == 1 && p != end) {
+        return MY_CONFIG_BLOB_ERR_FIELD;
+    }
+    return MY_CONFIG_BLOB_OK;
+}
+
+/**
+ * @brief 旧形式の16進表記のバイト列を１つ読み出す。
+ *        文字数が奇数なら、最後のバイトは上位4ビットだけになる
+ * @param token 16進表記の文字列
+ * @param[out] seq 読み出し先。MY_CONFIG_BLOB_SEQ_MAXバイト
+ * @param[out] len 読み出した長さ
+ * @return 成功したらゼロ
+ */
+static int my_config_blob_get_hex(const char *token, uint8_t *seq,
+                                  uint8_t *len) {
+    int n = (int)strlen(token);
+    if ((n + 1) / 2 > MY_CONFIG_BLOB_SEQ_MAX) return -1;
+    for (int i = 0; 2 * i < n; i++) {
+        char hex[3] = {token[2 * i], 2 * i + 1 < n ? token[2 * i + 1] : 0, 0};
+        seq[i] = (uint8_t)(strtol(hex, NULL, 16) & 0xff);
+    }
+    *len = (uint8_t)((n + 1) / 2);
+    return 0;
+}
+
+/**
+ * @brief 旧形式（nvs_set_strで保存したカンマ区切りの文字列）を設定値に戻す。
+ *        "受信バッファサイズ,通信速度,送信コマンド,終端文字列,置換文字列" の順で、
+ *        バイト列は16進表記。値の範囲は調べないので、呼び出し側で調べること
+ * @param buf 旧形式の文字列。分解のため書き換える
+ * @param[out] cfg 設定値。版数はゼロにする
+ * @return 成功したら MY_CONFIG_BLOB_OK。項目が足りないか、バイト列が長すぎれば
+ *         MY_CONFIG_BLOB_ERR_FIELD
+ */
+int my_config_blob_decode_legacy(char buf[], my_config_blob_t *cfg) {
+    char *p = buf;
+    char *token;
+    memset(cfg, 0, sizeof(*cfg));
+    // 受信バッファサイズと通信速度は、空なら読めない
+    token = strsep(&p, ",");
+    if (token == NULL || *token == '\0') return MY_CONFIG_BLOB_ERR_FIELD;
+    cfg->receive_buffer_len = (uint16_t)strtol(token, NULL, 10);
+    token = strsep(&p, ",");
+    if (token == NULL || *token == '\0') return MY_CONFIG_BLOB_ERR_FIELD;
+    cfg->baud_rate = strtol(token, NULL, 10);
+    // バイト列は空でもよい
+    token = strsep(&p, ",");
+    if (token == NULL || my_config_blob_get_hex(token, cfg->request_command,
+                                                &cfg->request_command_len) != 0) {
+        return MY_CONFIG_BLOB_ERR_FIELD;
+    }
+    token = strsep(&p, ",");
+    if (token == NULL ||
+        my_config_blob_get_hex(token, cfg->terminator_sequence,
+                               &cfg->terminator_sequence_len) != 0) {
+        return MY_CONFIG_BLOB_ERR_FIELD;
+    }
+    token = strsep(&p, ",");
+    if (token == NULL ||
+        my_config_blob_get_hex(token, cfg->terminator_sequence_replace,
+                               &cfg->terminator_sequence_replace_len) != 0) {
+        return MY_CONFIG_BLOB_ERR_FIELD;
+    }
+    return MY_CONFIG_BLOB_OK;
+}
+
+/**
+ * @brief 復号の結果の名前
+ */
+const char *my_config_blob_result_name(int result) {
+    switch (result) {
+        case MY_CONFIG_BLOB_OK:
+            return "ok";
+        case MY_CONFIG_BLOB_ERR_LENGTH:
+            return "length";
+        case MY_CONFIG_BLOB_ERR_MAGIC:
+            return "magic";
+        case MY_CONFIG_BLOB_ERR_VERSION:
+            return "version";
+        case MY_CONFIG_BLOB_ERR_CRC:
+            return "crc";
+        case MY_CONFIG_BLOB_ERR_FIELD:
+            return "field";
+        default:
+            return "-";
+    }
+}
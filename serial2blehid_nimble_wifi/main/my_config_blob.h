@@ -0,0 +1,72 @@
+/**
+ * @file my_config_blob.h
+ *   UARTの設定をNVSに保存するための、版数とCRC付きのバイナリ形式
+ */
+
+#ifndef my_config_blob_h
+#define my_config_blob_h 1
+
+#include <stdint.h>
+
+// 先頭の識別子 "S2BH"
+#define MY_CONFIG_BLOB_MAGIC (0x48423253)
+
+// この実装が書き出す版数。項目は末尾に足すだけにして、古い版でも読めるようにする
+#define MY_CONFIG_BLOB_VERSION (1)
+
+// 送信コマンド、終端文字列、置換文字列それぞれの最大長
+#define MY_CONFIG_BLOB_SEQ_MAX (40)
+
+// 先頭（識別子、版数、本体の長さ）と末尾（CRC）の大きさ
+#define MY_CONFIG_BLOB_HEADER_LEN (8)
+#define MY_CONFIG_BLOB_CRC_LEN (4)
+
+// 版数1の本体の最小長と最大長
+#define MY_CONFIG_BLOB_V1_MIN_LEN (4 + 2 + 3)
+#define MY_CONFIG_BLOB_V1_MAX_LEN (4 + 2 + 3 * (1 + MY_CONFIG_BLOB_SEQ_MAX))
+
+// この実装が書き出す最大長
+#define MY_CONFIG_BLOB_MAX_LEN                                \
+    (MY_CONFIG_BLOB_HEADER_LEN + MY_CONFIG_BLOB_V1_MAX_LEN + \
+     MY_CONFIG_BLOB_CRC_LEN)
+
+// 読み出すときに受け付ける最大長。新しい版で項目が増えても読めるよう、余裕を持たせる
+#define MY_CONFIG_BLOB_READ_MAX (256)
+
+/**
+ * @brief 復号の結果
+ */
+typedef enum {
+    MY_CONFIG_BLOB_OK = 0,
+    MY_CONFIG_BLOB_ERR_LENGTH = -1,   // 全体の長さが合わない
+    MY_CONFIG_BLOB_ERR_MAGIC = -2,    // 識別子が違う
+    MY_CONFIG_BLOB_ERR_VERSION = -3,  // 版数がゼロ
+    MY_CONFIG_BLOB_ERR_CRC = -4,      // CRCが合わない
+    MY_CONFIG_BLOB_ERR_FIELD = -5,    // 本体の項目が足りない、または長すぎる
+} my_config_blob_result_t;
+
+/**
+ * @brief 保存する設定値
+ */
+typedef struct {
+    uint32_t baud_rate;
+    uint16_t receive_buffer_len;
+    uint8_t request_command_len;
+    uint8_t terminator_sequence_len;
+    uint8_t terminator_sequence_replace_len;
+    uint8_t request_command[MY_CONFIG_BLOB_SEQ_MAX];
+    uint8_t terminator_sequence[MY_CONFIG_BLOB_SEQ_MAX];
+    uint8_t terminator_sequence_replace[MY_CONFIG_BLOB_SEQ_MAX];
+    uint16_t version;  // 復号したときの版数。旧形式から読み出したときはゼロ
+} my_config_blob_t;
+
+extern uint32_t my_config_blob_crc32(uint32_t crc, const uint8_t *buf,
+                                     int len);
+extern int my_config_blob_encode(const my_config_blob_t *cfg, uint8_t *buf,
+                                 int size);
+extern int my_config_blob_decode(const uint8_t *buf, int len,
+                                 my_config_blob_t *cfg);
+extern int my_config_blob_decode_legacy(char buf[], my_config_blob_t *cfg);
+extern const char *my_config_blob_result_name(int result);
+
+#endif
@@ -0,0 +1,412 @@
+/**
+ * @file my_conn_policy.c
+ *   送るフレームの有無に合わせて、BLEの接続パラメータを切り替える
+ *
+ *   セントラルが最初に選ぶ接続間隔は30ms〜50ms程度のことが多く、キー入力の遅れが目立つ。
+ *   一方、常に短い接続間隔のままだと、何も送っていないあいだも電力を使う。
+ *   そこで、
+ *     1. 暗号化が終わったら、短い接続間隔(7.5ms〜15ms)・スレーブレイテンシ無しを要求する
+ *     2. CONFIG_MY_CONN_POLICY_IDLE_MS のあいだフレームが来なければ、
+ *        長い接続間隔・スレーブレイテンシ有りを要求する
+ *     3. またフレームが来たら、短い接続間隔を要求する
+ *   という方針で ble_gap_update_params() を呼ぶ。
+ *   暗号化の前に要求すると、ペアリング中に接続パラメータの更新が重なって断るセントラルがあるので、
+ *   暗号化が終わるまでは要求しない。
+ *
+ *   要求は応答(BLE_GAP_EVENT_CONN_UPDATE)が来るまで1つだけにする。
+ *   断られたら MY_CONN_POLICY_RETRY_MS 待ってから要求し直す。
+ *   セントラルが自分から接続パラメータを変えたときは、値を記録するだけで要求し直さない。
+ *
+ *   判断は my_conn_policy_poll() でまとめて行う。フレームを受け取るたびに呼ぶ
+ *   my_conn_policy_activity() は時刻を記録するだけで、BLEの処理はしない。
+ *   ただし、アイドルから戻ったときは、次のpollを待たずに短い接続間隔を要求する。
+ */
+
+#include "my_conn_policy.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "host/ble_hs.h"
+
+#define MY_CONN_POLICY_TAG "CONN_POLICY"
+
+// 接続ごとの状態
+static my_conn_policy_conn_t my_conn_policy_conns[MY_CONN_POLICY_CONN_MAX];
+
+// 判断の記録。リングバッファで、古いものから上書きする
+static my_conn_policy_decision_t my_conn_policy_log[MY_CONN_POLICY_DECISIONS];
+static int my_conn_policy_log_next = 0;
+static int my_conn_policy_log_count = 0;
+
+// 最後にフレームを受け取った時刻(ms)
+static volatile uint32_t my_conn_policy_activity_ms = 0;
+
+// 最後の判断でアイドルとみなしたか
+static volatile bool my_conn_policy_idle = true;
+
+// 状態を読み書きするときのロック
+static SemaphoreHandle_t my_conn_policy_mutex = NULL;
+
+/**
+ * @brief 起動からの時刻(ms)
+ */
+static uint32_t my_conn_policy_now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void my_conn_policy_lock(void) {
+    if (my_conn_policy_mutex != NULL) {
+        xSemaphoreTake(my_conn_policy_mutex, portMAX_DELAY);
+    }
+}
+
+static void my_conn_policy_unlock(void) {
+    if (my_conn_policy_mutex != NULL) {
+        xSemaphoreGive(my_conn_policy_mutex);
+    }
+}
+
+/**
+ * @brief 接続の状態を探す。ロックしてから呼ぶ
+ * @return 見つからなければNULL
+ */
+static my_conn_policy_conn_t *my_conn_policy_find(uint16_t conn_handle) {
+    for (int i = 0; i < MY_CONN_POLICY_CONN_MAX; i++) {
+        if (my_conn_policy_conns[i].used &&
+            my_conn_policy_conns[i].conn_handle == conn_handle) {
+            return &my_conn_policy_conns[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 判断を記録する。ロックしてから呼ぶ
+ */
+static void my_conn_policy_record(uint16_t conn_handle, int mode, int event,
+                                  int rc, uint16_t itvl, uint16_t latency) {
+    my_conn_policy_decision_t *d = &my_conn_policy_log[my_conn_policy_log_next];
+    d->time_ms = my_conn_policy_now_ms();
+    d->conn_handle = conn_handle;
+    d->mode = (uint8_t)mode;
+    d->event = (uint8_t)event;
+    d->rc = (int16_t)rc;
+    d->itvl = itvl;
+    d->latency = latency;
+    my_conn_policy_log_next =
+        (my_conn_policy_log_next + 1) % MY_CONN_POLICY_DECISIONS;
+    if (my_conn_policy_log_count < MY_CONN_POLICY_DECISIONS) {
+        my_conn_policy_log_count++;
+    }
+}
+
+#if CONFIG_MY_CONN_POLICY_ENABLE
+/**
+ * @brief 接続パラメータが、要求した範囲に入っているか
+ */
+static bool my_conn_policy_matches(int mode, uint16_t itvl, uint16_t latency) {
+    if (mode == MY_CONN_POLICY_FAST) {
+        return itvl >= MY_CONN_POLICY_FAST_ITVL_MIN &&
+               itvl <= MY_CONN_POLICY_FAST_ITVL_MAX &&
+               latency == MY_CONN_POLICY_FAST_LATENCY;
+    }
+    if (mode == MY_CONN_POLICY_SLOW) {
+        return itvl >= MY_CONN_POLICY_SLOW_ITVL_MIN &&
+               itvl <= MY_CONN_POLICY_SLOW_ITVL_MAX;
+    }
+    return false;
+}
+
+/**
+ * @brief 1つの接続について、要求すべき接続パラメータを決める。ロックしてから呼ぶ
+ * @return 要求しないときはMY_CONN_POLICY_NONE
+ */
+static my_conn_policy_mode_t my_conn_policy_decide(my_conn_policy_conn_t *c,
+                                                   uint32_t now, bool idle) {
+    if (!c->used || !c->encrypted) {
+        return MY_CONN_POLICY_NONE;
+    }
+    if (c->pending) {
+        if ((int32_t)(now - c->requested_ms) < MY_CONN_POLICY_PENDING_MS) {
+            return MY_CONN_POLICY_NONE;
+        }
+        // 応答が来なかったので、要求し直してよいことにする
+        c->pending = false;
+        c->requested = MY_CONN_POLICY_NONE;
+    }
+    if (c->retry_ms != 0 && (int32_t)(now - c->retry_ms) < 0) {
+        return MY_CONN_POLICY_NONE;
+    }
+    c->retry_ms = 0;
+
+    my_conn_policy_mode_t target =
+        idle ? MY_CONN_POLICY_SLOW : MY_CONN_POLICY_FAST;
+    if (target == c->requested) {
+        return MY_CONN_POLICY_NONE;
+    }
+    if (my_conn_policy_matches(target, c->itvl, c->latency)) {
+        // セントラルが既にその接続パラメータにしている
+        c->requested = target;
+        return MY_CONN_POLICY_NONE;
+    }
+    c->requested = target;
+    c->requested_ms = now;
+    c->pending = true;
+    if (target == MY_CONN_POLICY_FAST) {
+        c->fast_requests++;
+    } else {
+        c->slow_requests++;
+    }
+    return target;
+}
+
+/**
+ * @brief 接続パラメータの更新を要求する。ロックせずに呼ぶ
+ */
+static void my_conn_policy_request(uint16_t conn_handle,
+                                   my_conn_policy_mode_t mode) {
+    struct ble_gap_upd_params params;
+    memset(&params, 0, sizeof(params));
+    if (mode == MY_CONN_POLICY_FAST) {
+        params.itvl_min = MY_CONN_POLICY_FAST_ITVL_MIN;
+        params.itvl_max = MY_CONN_POLICY_FAST_ITVL_MAX;
+        params.latency = MY_CONN_POLICY_FAST_LATENCY;
+        params.supervision_timeout = MY_CONN_POLICY_FAST_TIMEOUT;
+    } else {
+        params.itvl_min = MY_CONN_POLICY_SLOW_ITVL_MIN;
+        params.itvl_max = MY_CONN_POLICY_SLOW_ITVL_MAX;
+        params.latency = MY_CONN_POLICY_SLOW_LATENCY;
+        params.supervision_timeout = MY_CONN_POLICY_SLOW_TIMEOUT;
+    }
+
+    int rc = ble_gap_update_params(conn_handle, &params);
+    ESP_LOGI(MY_CONN_POLICY_TAG, "conn=%d request %s rc=%d", conn_handle,
+             my_conn_policy_mode_name(mode), rc);
+
+    my_conn_policy_lock();
+    my_conn_policy_record(conn_handle, mode, 0, rc, params.itvl_min,
+                          params.latency);
+    if (rc != 0) {
+        my_conn_policy_conn_t *c = my_conn_policy_find(conn_handle);
+        if (c != NULL) {
+            c->pending = false;
+            c->requested = MY_CONN_POLICY_NONE;
+            c->retry_ms = my_conn_policy_now_ms() + MY_CONN_POLICY_RETRY_MS;
+            c->rejected++;
+        }
+    }
+    my_conn_policy_unlock();
+}
+#endif
+
+/**
+ * @brief 全接続について判断し、必要なら要求する
+ */
+static void my_conn_policy_evaluate(void) {
+#if CONFIG_MY_CONN_POLICY_ENABLE
+    uint16_t handles[MY_CONN_POLICY_CONN_MAX];
+    my_conn_policy_mode_t modes[MY_CONN_POLICY_CONN_MAX];
+    int n = 0;
+
+    uint32_t now = my_conn_policy_now_ms();
+    bool idle = (now - my_conn_policy_activity_ms) >=
+                (uint32_t)CONFIG_MY_CONN_POLICY_IDLE_MS;
+    my_conn_policy_idle = idle;
+
+    my_conn_policy_lock();
+    for (int i = 0; i < MY_CONN_POLICY_CONN_MAX; i++) {
+        my_conn_policy_mode_t mode =
+            my_conn_policy_decide(&my_conn_policy_conns[i], now, idle);
+        if (mode != MY_CONN_POLICY_NONE) {
+            handles[n] = my_conn_policy_conns[i].conn_handle;
+            modes[n] = mode;
+            n++;
+        }
+    }
+    my_conn_policy_unlock();
+
+    // NimBLEのロックを取るので、自分のロックを外してから呼ぶ
+    for (int i = 0; i < n; i++) {
+        my_conn_policy_request(handles[i], modes[i]);
+    }
+#endif
+}
+
+/**
+ * @brief 初期化
+ */
+void my_conn_policy_init(void) {
+    if (my_conn_policy_mutex == NULL) {
+        my_conn_policy_mutex = xSemaphoreCreateMutex();
+        if (my_conn_policy_mutex == NULL) {
+            ESP_LOGE(MY_CONN_POLICY_TAG, "Can not create mutex!");
+        }
+    }
+    my_conn_policy_lock();
+    memset(my_conn_policy_conns, 0, sizeof(my_conn_policy_conns));
+    memset(my_conn_policy_log, 0, sizeof(my_conn_policy_log));
+    my_conn_policy_log_next = 0;
+    my_conn_policy_log_count = 0;
+    my_conn_policy_unlock();
+    my_conn_policy_activity_ms = my_conn_policy_now_ms();
+    my_conn_policy_idle = false;
+}
+
+/**
+ * @brief 接続したときに呼ぶ
+ * @param[in] itvl 接続間隔（1.25ms単位）
+ * @param[in] latency スレーブレイテンシ
+ * @param[in] timeout 監視タイムアウト（10ms単位）
+ */
+void my_conn_policy_open(uint16_t conn_handle, uint16_t itvl,
+                         uint16_t latency, uint16_t timeout) {
+    my_conn_policy_lock();
+    my_conn_policy_conn_t *c = my_conn_policy_find(conn_handle);
+    if (c == NULL) {
+        for (int i = 0; i < MY_CONN_POLICY_CONN_MAX; i++) {
+            if (!my_conn_policy_conns[i].used) {
+                c = &my_conn_policy_conns[i];
+                break;
+            }
+        }
+    }
+    if (c != NULL) {
+        memset(c, 0, sizeof(*c));
+        c->used = true;
+        c->conn_handle = conn_handle;
+        c->itvl = itvl;
+        c->latency = latency;
+        c->timeout = timeout;
+    } else {
+        ESP_LOGW(MY_CONN_POLICY_TAG, "no slot for conn=%d", conn_handle);
+    }
+    my_conn_policy_unlock();
+}
+
+/**
+ * @brief 切断したときに呼ぶ
+ */
+void my_conn_policy_close(uint16_t conn_handle) {
+    my_conn_policy_lock();
+    my_conn_policy_conn_t *c = my_conn_policy_find(conn_handle);
+    if (c != NULL) {
+        c->used = false;
+    }
+    my_conn_policy_unlock();
+}
+
+/**
+ * @brief 暗号化が終わったときに呼ぶ。ここから接続パラメータを要求し始める
+ *
+ * ペアリング直後はキー入力が続くことが多いので、フレームを受け取ったものとして扱う。
+ */
+void my_conn_policy_encrypted(uint16_t conn_handle) {
+    my_conn_policy_lock();
+    my_conn_policy_conn_t *c = my_conn_policy_find(conn_handle);
+    if (c != NULL) {
+        c->encrypted = true;
+    }
+    my_conn_policy_unlock();
+    my_conn_policy_activity_ms = my_conn_policy_now_ms();
+    my_conn_policy_evaluate();
+}
+
+/**
+ * @brief 接続パラメータが更新されたとき(BLE_GAP_EVENT_CONN_UPDATE)に呼ぶ
+ * @param[in] status 0なら成功。失敗したときは、他の引数は更新前の値
+ */
+void my_conn_policy_updated(uint16_t conn_handle, int status, uint16_t itvl,
+                            uint16_t latency, uint16_t timeout) {
+    my_conn_policy_lock();
+    my_conn_policy_conn_t *c = my_conn_policy_find(conn_handle);
+    if (c != NULL) {
+        int mode = c->requested;
+        bool requested = c->pending;
+        c->pending = false;
+        c->itvl = itvl;
+        c->latency = latency;
+        c->timeout = timeout;
+        if (status != 0 && requested) {
+            // 断られた。しばらく要求しない
+            c->requested = MY_CONN_POLICY_NONE;
+            c->retry_ms = my_conn_policy_now_ms() + MY_CONN_POLICY_RETRY_MS;
+            c->rejected++;
+        }
+        my_conn_policy_record(conn_handle, requested ? mode : MY_CONN_POLICY_NONE,
+                              1, status, itvl, latency);
+    }
+    my_conn_policy_unlock();
+}
+
+/**
+ * @brief 送るフレームを受け取ったときに呼ぶ
+ */
+void my_conn_policy_activity(void) {
+    my_conn_policy_activity_ms = my_conn_policy_now_ms();
+    if (my_conn_policy_idle) {
+        // アイドルから戻ったので、すぐに短い接続間隔を要求する
+        my_conn_policy_evaluate();
+    }
+}
+
+/**
+ * @brief 定期的に呼んで、アイドルになった接続に長い接続間隔を要求する
+ */
+void my_conn_policy_poll(void) { my_conn_policy_evaluate(); }
+
+/**
+ * @brief 接続ごとの状態を取り出す
+ * @param[out] conns 取り出し先
+ * @param[in] max connsの要素数
+ * @return 取り出した接続数
+ */
+int my_conn_policy_snapshot(my_conn_policy_conn_t *conns, int max) {
+    int n = 0;
+    my_conn_policy_lock();
+    for (int i = 0; i < MY_CONN_POLICY_CONN_MAX && n < max; i++) {
+        if (my_conn_policy_conns[i].used) {
+            conns[n++] = my_conn_policy_conns[i];
+        }
+    }
+    my_conn_policy_unlock();
+    return n;
+}
+
+/**
+ * @brief 判断の記録を古い順に取り出す
+ * @param[out] out 取り出し先
+ * @param[in] max outの要素数
+ * @return 取り出した数
+ */
+int my_conn_policy_decisions(my_conn_policy_decision_t *out, int max) {
+    my_conn_policy_lock();
+    int count = my_conn_policy_log_count;
+    if (count > max) {
+        count = max;
+    }
+    int start = (my_conn_policy_log_next - count + MY_CONN_POLICY_DECISIONS) %
+                MY_CONN_POLICY_DECISIONS;
+    for (int i = 0; i < count; i++) {
+        out[i] = my_conn_policy_log[(start + i) % MY_CONN_POLICY_DECISIONS];
+    }
+    my_conn_policy_unlock();
+    return count;
+}
+
+/**
+ * @brief 接続パラメータの名前
+ */
+const char *my_conn_policy_mode_name(int mode) {
+    switch (mode) {
+        case MY_CONN_POLICY_FAST:
+            return "fast";
+        case MY_CONN_POLICY_SLOW:
+            return "slow";
+        default:
+            return "-";
+    }
+}
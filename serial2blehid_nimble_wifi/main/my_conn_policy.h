@@ -0,0 +1,93 @@
+/**
+ * @file my_conn_policy.h
+ *   送るフレームの有無に合わせて、BLEの接続パラメータを切り替える
+ */
+
+#ifndef my_conn_policy_h
+#define my_conn_policy_h 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+// 同時に接続するセントラルの数
+#define MY_CONN_POLICY_CONN_MAX CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+
+// 送るフレームがあるときの接続パラメータ。接続間隔は1.25ms単位、タイムアウトは10ms単位
+#define MY_CONN_POLICY_FAST_ITVL_MIN (6)    // 7.5ms
+#define MY_CONN_POLICY_FAST_ITVL_MAX (12)   // 15ms
+#define MY_CONN_POLICY_FAST_LATENCY (0)
+#define MY_CONN_POLICY_FAST_TIMEOUT (300)   // 3s
+
+// 送るフレームが無いときの接続パラメータ
+#define MY_CONN_POLICY_SLOW_ITVL_MIN (48)   // 60ms
+#define MY_CONN_POLICY_SLOW_ITVL_MAX (72)   // 90ms
+#define MY_CONN_POLICY_SLOW_LATENCY (4)
+#define MY_CONN_POLICY_SLOW_TIMEOUT (600)   // 6s
+
+// 要求に応答(BLE_GAP_EVENT_CONN_UPDATE)が来なかったとみなすまでの時間(ms)
+#define MY_CONN_POLICY_PENDING_MS (10000)
+
+// 要求を断られてから、もう一度要求するまでの時間(ms)
+#define MY_CONN_POLICY_RETRY_MS (30000)
+
+// 記録しておく判断の数
+#define MY_CONN_POLICY_DECISIONS (16)
+
+/**
+ * @brief 要求した接続パラメータ
+ */
+typedef enum {
+    MY_CONN_POLICY_NONE = 0,  // まだ要求していない
+    MY_CONN_POLICY_FAST,      // 短い接続間隔、スレーブレイテンシ無し
+    MY_CONN_POLICY_SLOW,      // 長い接続間隔、スレーブレイテンシ有り
+} my_conn_policy_mode_t;
+
+/**
+ * @brief 1つの接続の状態
+ */
+typedef struct {
+    bool used;
+    bool encrypted;
+    bool pending;                 // 要求への応答を待っている
+    uint16_t conn_handle;
+    uint16_t itvl;                // 現在の接続間隔（1.25ms単位）
+    uint16_t latency;             // 現在のスレーブレイテンシ
+    uint16_t timeout;             // 現在の監視タイムアウト（10ms単位）
+    my_conn_policy_mode_t requested;  // 最後に要求した接続パラメータ
+    uint32_t requested_ms;        // 最後に要求した時刻
+    uint32_t retry_ms;            // 断られたときに、次に要求してよい時刻。0なら制限無し
+    uint32_t fast_requests;       // 短い接続間隔を要求した回数
+    uint32_t slow_requests;       // 長い接続間隔を要求した回数
+    uint32_t rejected;            // 断られた、または要求できなかった回数
+} my_conn_policy_conn_t;
+
+/**
+ * @brief 1つの判断の記録
+ */
+typedef struct {
+    uint32_t time_ms;      // 起動からの時刻
+    uint16_t conn_handle;
+    uint8_t mode;          // my_conn_policy_mode_t
+    uint8_t event;         // 0:要求した, 1:応答が来た
+    int16_t rc;            // 要求したときはble_gap_update_params()の返り値、応答はstatus
+    uint16_t itvl;         // 応答の接続間隔
+    uint16_t latency;      // 応答のスレーブレイテンシ
+} my_conn_policy_decision_t;
+
+extern void my_conn_policy_init(void);
+extern void my_conn_policy_open(uint16_t conn_handle, uint16_t itvl,
+                                uint16_t latency, uint16_t timeout);
+extern void my_conn_policy_close(uint16_t conn_handle);
+extern void my_conn_policy_encrypted(uint16_t conn_handle);
+extern void my_conn_policy_updated(uint16_t conn_handle, int status,
+                                   uint16_t itvl, uint16_t latency,
+                                   uint16_t timeout);
+extern void my_conn_policy_activity(void);
+extern void my_conn_policy_poll(void);
+extern int my_conn_policy_snapshot(my_conn_policy_conn_t *conns, int max);
+extern int my_conn_policy_decisions(my_conn_policy_decision_t *out, int max);
+extern const char *my_conn_policy_mode_name(int mode);
+
+#endif
@@ -16,6 +16,20 @@
 #define DEBUGPRINT(...) (void)0
 #endif  // ifdef MYDEBUG
 
+// 詳細ログの量。Kconfigで選ぶ。0:出さない 1:フレームごと 2:受信したバイトごと
+// 0のときは、ログの書式化も含めてコンパイルされない
+#ifdef CONFIG_MY_VERBOSE_LOG_LEVEL
+#define MY_VERBOSE_LOG_LEVEL CONFIG_MY_VERBOSE_LOG_LEVEL
+#else
+#define MY_VERBOSE_LOG_LEVEL 0
+#endif
+#define MY_VERBOSE_FRAME 1
+#define MY_VERBOSE_BYTE 2
+#define MY_VLOGI(level, tag, ...)                                  \
+  do {                                                             \
+    if (MY_VERBOSE_LOG_LEVEL >= (level)) ESP_LOGI(tag, __VA_ARGS__); \
+  } while (0)
+
 
 #endif
 
@@ -0,0 +1,459 @@
+/**
+ * @file my_frame_log.c
+ *   BLEで送れないあいだに受信したフレームを溜めておき、接続後に送り直す
+ *
+ *   PCがスリープしている、電波が届かないなどで、キーボード入力レポートを送れるセントラルが無いとき、
+ *   HID送信タスクは受け取ったフレームを捨てずに、ここに記録する。
+ *   セントラルが接続して購読したら、古い順に取り出して、通常のフレームと同じ速さで送り直す。
+ *
+ *   1つのフレームは、ヘッダ（フレーム長1バイト、記録した時刻(ms)4バイト、リトルエンディアン）と
+ *   フレームの内容を並べた1レコードにする。
+ *   レコードは、まずRAMのリングバッファに追記する。リングバッファに入らなくなったら、
+ *   古いレコードをまとめて1セグメントにし、NVSに追記する（CONFIG_MY_FRAME_LOG_NVS_SEGMENTS）。
+ *   セグメントは、先頭のレコード数1バイトとレコードの並びで、キー "s00" .. に順に書く。
+ *   書いたセグメントの範囲は、キー "head" と "tail" の通し番号で表す。
+ *   セグメントが上限に達したら、最も古いセグメントを捨てる。NVSを使わないときは、最も古いレコードを捨てる。
+ *   NVSのセグメントはRAMのレコードより必ず古いので、送り直しはNVS、RAMの順に取り出す。
+ *
+ *   NVSのセグメントは再起動しても残り、起動後に接続したセントラルへ送り直す。
+ *   前回の起動で記録したレコードは、記録した時刻が分からない。
+ *   セグメントは、全てのレコードを送り直してから消すので、途中で再起動すると、そのセグメントの
+ *   送り直し済みのレコードをもう一度送る。
+ *   RAMのレコードは再起動すると消える。
+ *
+ *   追記も取り出しもHID送信タスクだけから呼ぶので、ロックは使わない。
+ */
+
+#include "my_frame_log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "my_ring_buffer.h"
+#include "nvs.h"
+
+#define MY_FRAME_LOG_TAG "FRAME_LOG"
+
+// NVSの名前空間
+#define MY_FRAME_LOG_NVS_NAME "frame_log"
+
+#ifdef CONFIG_MY_FRAME_LOG_NVS_SEGMENTS
+#define MY_FRAME_LOG_NVS_SEGMENTS CONFIG_MY_FRAME_LOG_NVS_SEGMENTS
+#else
+#define MY_FRAME_LOG_NVS_SEGMENTS 0
+#endif
+
+// 最新のレコードを入れるRAMのリングバッファ
+static my_ring_buffer_t my_frame_log_ram = {0};
+
+// RAMにあるレコード数
+static int my_frame_log_ram_frames = 0;
+
+static bool my_frame_log_ready = false;
+
+// 記録したフレーム数
+static volatile uint32_t my_frame_log_recorded_cnt = 0;
+
+// 送り直したフレーム数
+static volatile uint32_t my_frame_log_replayed_cnt = 0;
+
+// NVSに書き出したフレーム数
+static volatile uint32_t my_frame_log_spilled_cnt = 0;
+
+// 溜めきれずに捨てたフレーム数
+static volatile uint32_t my_frame_log_dropped_cnt = 0;
+
+#if MY_FRAME_LOG_NVS_SEGMENTS > 0
+static nvs_handle_t my_frame_log_nvs = 0;
+
+// 次に書くセグメントと、最も古いセグメントの通し番号
+static uint32_t my_frame_log_seg_head = 0;
+static uint32_t my_frame_log_seg_tail = 0;
+
+// 起動時のhead。これより前のセグメントは前回の起動で書いた
+static uint32_t my_frame_log_seg_boot = 0;
+
+// NVSにあるレコード数
+static int my_frame_log_nvs_frames = 0;
+
+// 書き出すセグメントを作る領域
+static uint8_t my_frame_log_spill_buf[MY_FRAME_LOG_SEG_SIZE];
+
+// 送り直し中のセグメント。最も古いセグメントを読み込んでおく
+static uint8_t my_frame_log_replay_buf[MY_FRAME_LOG_SEG_SIZE];
+static int my_frame_log_replay_len = 0;
+static int my_frame_log_replay_off = 0;
+static bool my_frame_log_replay_loaded = false;
+#endif
+
+/**
+ * @brief 現在の時刻(ms)。起動からの経過時間
+ */
+static uint32_t my_frame_log_now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+/**
+ * @brief レコードのヘッダを作る
+ */
+static void my_frame_log_put_header(uint8_t *h, int len, uint32_t stamp_ms) {
+    h[0] = (uint8_t)len;
+    for (int i = 0; i < 4; i++) {
+        h[1 + i] = (uint8_t)(stamp_ms >> (i * 8));
+    }
+}
+
+/**
+ * @brief レコードのヘッダから記録した時刻を取り出す
+ */
+static uint32_t my_frame_log_get_stamp(const uint8_t *h) {
+    return (uint32_t)h[1] | (uint32_t)h[2] << 8 | (uint32_t)h[3] << 16 |
+           (uint32_t)h[4] << 24;
+}
+
+/**
+ * @brief RAMのリングバッファの先頭からoffsetの位置をlenバイト読む。リングバッファは変更されない
+ */
+static void my_frame_log_ram_read(int offset, uint8_t *data, int len) {
+    for (int i = 0; i < len; i++) {
+        my_ring_buffer_at(&my_frame_log_ram, offset + i, &data[i]);
+    }
+}
+
+/**
+ * @brief RAMの最も古いレコードの長さ（ヘッダを含む）
+ */
+static int my_frame_log_ram_rec_len(void) {
+    uint8_t len = 0;
+    my_ring_buffer_at(&my_frame_log_ram, 0, &len);
+    return MY_FRAME_LOG_REC_HEADER + len;
+}
+
+#if MY_FRAME_LOG_NVS_SEGMENTS > 0
+/**
+ * @brief セグメントのキー
+ */
+static void my_frame_log_seg_key(uint32_t seq, char *key, int size) {
+    snprintf(key, size, "s%02lu",
+             (unsigned long)(seq % MY_FRAME_LOG_NVS_SEGMENTS));
+}
+
+/**
+ * @brief セグメントの範囲をNVSに保存する
+ */
+static void my_frame_log_save_index(void) {
+    nvs_set_u32(my_frame_log_nvs, "head", my_frame_log_seg_head);
+    nvs_set_u32(my_frame_log_nvs, "tail", my_frame_log_seg_tail);
+    nvs_commit(my_frame_log_nvs);
+}
+
+/**
+ * @brief セグメントを読み込む
+ * @return セグメントの長さ。読めなければ0
+ */
+static int my_frame_log_seg_load(uint32_t seq, uint8_t *buf) {
+    char key[8];
+    my_frame_log_seg_key(seq, key, sizeof(key));
+    size_t len = MY_FRAME_LOG_SEG_SIZE;
+    if (nvs_get_blob(my_frame_log_nvs, key, buf, &len) != ESP_OK || len < 1) {
+        return 0;
+    }
+    return (int)len;
+}
+
+/**
+ * @brief セグメントのoffsetから後ろにあるレコード数
+ */
+static int my_frame_log_seg_frames(const uint8_t *buf, int len, int offset) {
+    int n = 0;
+    while (offset + MY_FRAME_LOG_REC_HEADER <= len) {
+        offset += MY_FRAME_LOG_REC_HEADER + buf[offset];
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief 最も古いセグメントを消す
+ * @param frames 消すセグメントに残っていたレコード数
+ */
+static void my_frame_log_seg_remove(int frames) {
+    char key[8];
+    my_frame_log_seg_key(my_frame_log_seg_tail, key, sizeof(key));
+    nvs_erase_key(my_frame_log_nvs, key);
+    my_frame_log_seg_tail++;
+    my_frame_log_save_index();
+    my_frame_log_nvs_frames -= frames;
+    if (my_frame_log_nvs_frames < 0) my_frame_log_nvs_frames = 0;
+    my_frame_log_replay_loaded = false;
+}
+
+/**
+ * @brief 最も古いセグメントを捨てる
+ */
+static void my_frame_log_seg_drop(void) {
+    int frames;
+    if (my_frame_log_replay_loaded) {
+        frames = my_frame_log_seg_frames(my_frame_log_replay_buf,
+                                         my_frame_log_replay_len,
+                                         my_frame_log_replay_off);
+    } else {
+        int len = my_frame_log_seg_load(my_frame_log_seg_tail,
+                                        my_frame_log_spill_buf);
+        frames = len > 0 ? my_frame_log_spill_buf[0] : 0;
+    }
+    my_frame_log_seg_remove(frames);
+    my_frame_log_dropped_cnt += frames;
+    ESP_LOGW(MY_FRAME_LOG_TAG, "nvs full, %d frames dropped", frames);
+}
+
+/**
+ * @brief RAMの古いレコードを1セグメントにまとめて、NVSに追記する
+ * @return 書き出したらtrue
+ */
+static bool my_frame_log_spill(void) {
+    if (my_frame_log_ram_frames == 0) return false;
+    if (my_frame_log_seg_head - my_frame_log_seg_tail >=
+        MY_FRAME_LOG_NVS_SEGMENTS) {
+        my_frame_log_seg_drop();
+    }
+    uint8_t *buf = my_frame_log_spill_buf;
+    int pos = 1;
+    int frames = 0;
+    while (my_frame_log_ram_frames > 0) {
+        int rec_len = my_frame_log_ram_rec_len();
+        if (pos + rec_len > MY_FRAME_LOG_SEG_SIZE) break;
+        my_ring_buffer_pop_n(&my_frame_log_ram, &buf[pos], rec_len);
+        my_frame_log_ram_frames--;
+        pos += rec_len;
+        frames++;
+    }
+    if (frames == 0) return false;
+    buf[0] = (uint8_t)frames;
+    char key[8];
+    my_frame_log_seg_key(my_frame_log_seg_head, key, sizeof(key));
+    if (nvs_set_blob(my_frame_log_nvs, key, buf, pos) != ESP_OK) {
+        ESP_LOGW(MY_FRAME_LOG_TAG, "nvs write failed, %d frames dropped",
+                 frames);
+        my_frame_log_dropped_cnt += frames;
+        return true;
+    }
+    my_frame_log_seg_head++;
+    my_frame_log_save_index();
+    my_frame_log_nvs_frames += frames;
+    my_frame_log_spilled_cnt += frames;
+    return true;
+}
+#endif
+
+/**
+ * @brief 記録を始める。NVSに前回の記録が残っていれば、送り直す対象にする。
+ *        nvs_flash_init()の後に呼ぶこと。
+ * @return 使えるようになったらtrue
+ */
+bool my_frame_log_init(void) {
+#if CONFIG_MY_FRAME_LOG_ENABLE
+    if (my_frame_log_ready) return true;
+    if (!my_ring_buffer_init(&my_frame_log_ram, MY_FRAME_LOG_RAM_SIZE)) {
+        ESP_LOGE(MY_FRAME_LOG_TAG, "Can not allocate buffer!");
+        return false;
+    }
+    my_frame_log_ram_frames = 0;
+#if MY_FRAME_LOG_NVS_SEGMENTS > 0
+    if (nvs_open(MY_FRAME_LOG_NVS_NAME, NVS_READWRITE, &my_frame_log_nvs) ==
+        ESP_OK) {
+        uint32_t head = 0, tail = 0;
+        nvs_get_u32(my_frame_log_nvs, "head", &head);
+        nvs_get_u32(my_frame_log_nvs, "tail", &tail);
+        if (head - tail > MY_FRAME_LOG_NVS_SEGMENTS) {
+            ESP_LOGW(MY_FRAME_LOG_TAG, "broken index, segments discarded");
+            nvs_erase_all(my_frame_log_nvs);
+            head = tail = 0;
+        }
+        my_frame_log_seg_head = head;
+        my_frame_log_seg_tail = tail;
+        my_frame_log_seg_boot = head;
+        my_frame_log_nvs_frames = 0;
+        for (uint32_t seq = tail; seq != head; seq++) {
+            if (my_frame_log_seg_load(seq, my_frame_log_spill_buf) > 0) {
+                my_frame_log_nvs_frames += my_frame_log_spill_buf[0];
+            }
+        }
+        if (my_frame_log_nvs_frames > 0) {
+            ESP_LOGI(MY_FRAME_LOG_TAG, "%d frames left in nvs",
+                     my_frame_log_nvs_frames);
+        }
+    } else {
+        my_frame_log_nvs = 0;
+        ESP_LOGW(MY_FRAME_LOG_TAG, "Can not open nvs, RAM only");
+    }
+#endif
+    my_frame_log_ready = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief フレームを記録する。満杯なら古いレコードをNVSに書き出すか、捨てる
+ * @param data フレームの内容
+ * @param len フレームの長さ。MY_FRAME_LOG_FRAME_MAXを超えた分は切り捨てる
+ * @return 記録したらtrue。記録を使っていなければfalse
+ */
+bool my_frame_log_append(const uint8_t *data, int len) {
+    if (!my_frame_log_ready) return false;
+    if (len < 0) len = 0;
+    if (len > MY_FRAME_LOG_FRAME_MAX) len = MY_FRAME_LOG_FRAME_MAX;
+    int rec_len = MY_FRAME_LOG_REC_HEADER + len;
+    while (my_ring_buffer_content_length(&my_frame_log_ram) + rec_len >
+           MY_FRAME_LOG_RAM_SIZE) {
+#if MY_FRAME_LOG_NVS_SEGMENTS > 0
+        if (my_frame_log_nvs != 0 && my_frame_log_spill()) {
+            continue;
+        }
+#endif
+        // 最も古いレコードを捨てる
+        my_ring_buffer_consume(&my_frame_log_ram, my_frame_log_ram_rec_len());
+        my_frame_log_ram_frames--;
+        my_frame_log_dropped_cnt++;
+    }
+    uint8_t header[MY_FRAME_LOG_REC_HEADER];
+    my_frame_log_put_header(header, len, my_frame_log_now_ms());
+    my_ring_buffer_push_n(&my_frame_log_ram, header, sizeof(header));
+    my_ring_buffer_push_n(&my_frame_log_ram, data, len);
+    my_frame_log_ram_frames++;
+    my_frame_log_recorded_cnt++;
+    return true;
+}
+
+/**
+ * @brief 最も古いフレームを、取り出さずに読む
+ * @param data フレームの内容が格納される
+ * @param size dataの大きさ。超えた分は切り捨てる
+ * @param age_ms 記録してからの時間(ms)が格納される。分からなければ MY_FRAME_LOG_AGE_UNKNOWN
+ * @return フレームの長さ。空なら-1
+ */
+int my_frame_log_peek(uint8_t *data, int size, int32_t *age_ms) {
+    if (!my_frame_log_ready) return -1;
+    uint8_t header[MY_FRAME_LOG_REC_HEADER];
+    int len;
+#if MY_FRAME_LOG_NVS_SEGMENTS > 0
+    while (my_frame_log_nvs != 0 &&
+           my_frame_log_seg_tail != my_frame_log_seg_head) {
+        if (!my_frame_log_replay_loaded) {
+            my_frame_log_replay_len = my_frame_log_seg_load(
+                my_frame_log_seg_tail, my_frame_log_replay_buf);
+            my_frame_log_replay_off = 1;
+            my_frame_log_replay_loaded = true;
+        }
+        const uint8_t *p = &my_frame_log_replay_buf[my_frame_log_replay_off];
+        if (my_frame_log_replay_off + MY_FRAME_LOG_REC_HEADER >
+                my_frame_log_replay_len ||
+            my_frame_log_replay_off + MY_FRAME_LOG_REC_HEADER + p[0] >
+                my_frame_log_replay_len) {
+            // 読めない、または壊れたセグメントは飛ばす
+            ESP_LOGW(MY_FRAME_LOG_TAG, "segment %lu skipped",
+                     (unsigned long)my_frame_log_seg_tail);
+            my_frame_log_seg_remove(my_frame_log_seg_frames(
+                my_frame_log_replay_buf, my_frame_log_replay_len,
+                my_frame_log_replay_off));
+            continue;
+        }
+        len = p[0];
+        memcpy(data, p + MY_FRAME_LOG_REC_HEADER, len < size ? len : size);
+        if (age_ms != NULL) {
+            *age_ms = (int32_t)(my_frame_log_seg_tail -
+                                my_frame_log_seg_boot) >= 0
+                          ? (int32_t)(my_frame_log_now_ms() -
+                                      my_frame_log_get_stamp(p))
+                          : MY_FRAME_LOG_AGE_UNKNOWN;
+        }
+        return len;
+    }
+#endif
+    if (my_frame_log_ram_frames == 0) return -1;
+    my_frame_log_ram_read(0, header, sizeof(header));
+    len = header[0];
+    my_frame_log_ram_read(MY_FRAME_LOG_REC_HEADER, data,
+                          len < size ? len : size);
+    if (age_ms != NULL) {
+        *age_ms =
+            (int32_t)(my_frame_log_now_ms() - my_frame_log_get_stamp(header));
+    }
+    return len;
+}
+
+/**
+ * @brief my_frame_log_peek()で読んだフレームを捨てる。送り直した後に呼ぶ
+ */
+void my_frame_log_pop(void) {
+    if (!my_frame_log_ready) return;
+#if MY_FRAME_LOG_NVS_SEGMENTS > 0
+    if (my_frame_log_replay_loaded) {
+        my_frame_log_replay_off +=
+            MY_FRAME_LOG_REC_HEADER +
+            my_frame_log_replay_buf[my_frame_log_replay_off];
+        my_frame_log_nvs_frames--;
+        my_frame_log_replayed_cnt++;
+        if (my_frame_log_replay_off >= my_frame_log_replay_len) {
+            // 全て送り直したセグメントを消す
+            my_frame_log_seg_remove(0);
+        }
+        return;
+    }
+#endif
+    if (my_frame_log_ram_frames == 0) return;
+    my_ring_buffer_consume(&my_frame_log_ram, my_frame_log_ram_rec_len());
+    my_frame_log_ram_frames--;
+    my_frame_log_replayed_cnt++;
+}
+
+/**
+ * @brief 送り直すフレームが無ければtrue
+ */
+bool my_frame_log_empty(void) { return my_frame_log_count() == 0; }
+
+/**
+ * @brief 溜まっているフレーム数（RAMとNVSの合計）
+ */
+int my_frame_log_count(void) {
+#if MY_FRAME_LOG_NVS_SEGMENTS > 0
+    return my_frame_log_ram_frames + my_frame_log_nvs_frames;
+#else
+    return my_frame_log_ram_frames;
+#endif
+}
+
+/**
+ * @brief NVSにあるセグメント数
+ */
+int my_frame_log_nvs_segments(void) {
+#if MY_FRAME_LOG_NVS_SEGMENTS > 0
+    return (int)(my_frame_log_seg_head - my_frame_log_seg_tail);
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief これまでに記録したフレーム数
+ */
+uint32_t my_frame_log_recorded(void) { return my_frame_log_recorded_cnt; }
+
+/**
+ * @brief これまでに送り直したフレーム数
+ */
+uint32_t my_frame_log_replayed(void) { return my_frame_log_replayed_cnt; }
+
+/**
+ * @brief これまでにNVSに書き出したフレーム数
+ */
+uint32_t my_frame_log_spilled(void) { return my_frame_log_spilled_cnt; }
+
+/**
+ * @brief これまでに溜めきれずに捨てたフレーム数
+ */
+uint32_t my_frame_log_dropped(void) { return my_frame_log_dropped_cnt; }
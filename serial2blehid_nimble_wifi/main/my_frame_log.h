@@ -0,0 +1,44 @@
+/**
+ * @file my_frame_log.h
+ *   BLEで送れないあいだに受信したフレームを溜めておき、接続後に送り直す
+ */
+
+#ifndef my_frame_log_h
+#define my_frame_log_h 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+// RAMに溜めておけるバイト数（レコードのヘッダを含む）
+#define MY_FRAME_LOG_RAM_SIZE (4096)
+
+// NVSの1セグメントのバイト数。セグメントの先頭にレコード数が1バイト付く
+#define MY_FRAME_LOG_SEG_SIZE (1024)
+
+// レコードのヘッダのバイト数。フレーム長(1)＋記録した時刻(4)
+#define MY_FRAME_LOG_REC_HEADER (5)
+
+// 1レコードに入れられるフレームの最大長
+#define MY_FRAME_LOG_FRAME_MAX (255)
+
+// セントラルが購読してから送り直しを始めるまでの時間(ms)
+#define MY_FRAME_LOG_REPLAY_DELAY_MS (1000)
+
+// 記録した時刻が分からない（前回の起動で記録した）ときのage_ms
+#define MY_FRAME_LOG_AGE_UNKNOWN (-1)
+
+extern bool my_frame_log_init(void);
+extern bool my_frame_log_append(const uint8_t *data, int len);
+extern int my_frame_log_peek(uint8_t *data, int size, int32_t *age_ms);
+extern void my_frame_log_pop(void);
+extern bool my_frame_log_empty(void);
+extern int my_frame_log_count(void);
+extern int my_frame_log_nvs_segments(void);
+extern uint32_t my_frame_log_recorded(void);
+extern uint32_t my_frame_log_replayed(void);
+extern uint32_t my_frame_log_spilled(void);
+extern uint32_t my_frame_log_dropped(void);
+
+#endif
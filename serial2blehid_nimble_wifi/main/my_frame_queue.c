@@ -0,0 +1,119 @@
+/**
+ * @file my_frame_queue.c
+ *   UARTタスクからHID送信タスクへ、受信したフレームを渡すキュー
+ *
+ *   UARTタスクは受信したフレームを入れたらすぐに戻り、次のトリガーを待つ。
+ *   HID送信タスクはキューから1フレームずつ取り出して送る。
+ *   キューが満杯のときは入れようとしたフレームを捨て、捨てた数を数える。
+ *   （キュー内のフレームを上書きすることはない）
+ */
+
+#include "my_frame_queue.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/queue.h"
+
+#define MY_FRAME_QUEUE_TAG "FRAME_QUEUE"
+
+static QueueHandle_t my_frame_queue = NULL;
+
+// キューに入れたフレーム数
+static volatile uint32_t my_frame_queue_pushed_cnt = 0;
+
+// キューが満杯で捨てたフレーム数
+static volatile uint32_t my_frame_queue_dropped_cnt = 0;
+
+// キューに溜まったフレーム数の最大値
+static volatile int my_frame_queue_max_depth_cnt = 0;
+
+/**
+ * @brief キューを作る
+ * @return 成功したらtrue
+ */
+bool my_frame_queue_init(void) {
+    if (my_frame_queue == NULL) {
+        my_frame_queue = xQueueCreate(MY_FRAME_QUEUE_DEPTH, sizeof(my_frame_t));
+        if (my_frame_queue == NULL) {
+            ESP_LOGE(MY_FRAME_QUEUE_TAG, "Can not create queue!");
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief フレームをキューに入れる。待たずに戻る。1つのタスクからだけ呼ぶこと
+ * @param data フレームの内容
+ * @param len フレームの長さ。MY_FRAME_QUEUE_FRAME_MAXを超えた分は切り捨てる
+ * @param stamp 各段の通過時刻。NULLなら全て0。queued_usはここで記録する
+ * @param program フレームを変換したレポートプログラム
+ * @return 入れられたらtrue。満杯で捨てたらfalse
+ */
+bool my_frame_queue_push(const uint8_t *data, int len,
+                         const my_frame_stamp_t *stamp,
+                         const my_hid_program_t *program) {
+    if (my_frame_queue == NULL) return false;
+    if (len < 0) len = 0;
+    if (len > MY_FRAME_QUEUE_FRAME_MAX) len = MY_FRAME_QUEUE_FRAME_MAX;
+    // 入れるのはGPIO/UART監視タスクだけなので、スタックを使わないよう静的に置く
+    static my_frame_t frame;
+    if (stamp != NULL) {
+        frame.stamp = *stamp;
+    } else {
+        memset(&frame.stamp, 0, sizeof(frame.stamp));
+    }
+    frame.stamp.queued_us = esp_timer_get_time();
+    frame.program = *program;
+    frame.len = len;
+    memcpy(frame.data, data, len);
+    frame.data[len] = 0;
+    if (xQueueSend(my_frame_queue, &frame, 0) != pdTRUE) {
+        my_frame_queue_dropped_cnt++;
+        ESP_LOGW(MY_FRAME_QUEUE_TAG, "queue full, frame dropped (%lu)",
+                 my_frame_queue_dropped_cnt);
+        return false;
+    }
+    my_frame_queue_pushed_cnt++;
+    int depth = uxQueueMessagesWaiting(my_frame_queue);
+    if (depth > my_frame_queue_max_depth_cnt) {
+        my_frame_queue_max_depth_cnt = depth;
+    }
+    return true;
+}
+
+/**
+ * @brief キューからフレームを1つ取り出す
+ * @param frame 取り出したフレームが格納される
+ * @param wait 空のときに待つ時間
+ * @return 取り出せたらtrue
+ */
+bool my_frame_queue_pop(my_frame_t *frame, TickType_t wait) {
+    if (my_frame_queue == NULL) return false;
+    return xQueueReceive(my_frame_queue, frame, wait) == pdTRUE;
+}
+
+/**
+ * @brief 現在キューに溜まっているフレーム数
+ */
+int my_frame_queue_depth(void) {
+    if (my_frame_queue == NULL) return 0;
+    return uxQueueMessagesWaiting(my_frame_queue);
+}
+
+/**
+ * @brief これまでにキューに溜まったフレーム数の最大値
+ */
+int my_frame_queue_max_depth(void) { return my_frame_queue_max_depth_cnt; }
+
+/**
+ * @brief これまでにキューに入れたフレーム数
+ */
+uint32_t my_frame_queue_pushed(void) { return my_frame_queue_pushed_cnt; }
+
+/**
+ * @brief これまでにキューが満杯で捨てたフレーム数
+ */
+uint32_t my_frame_queue_dropped(void) { return my_frame_queue_dropped_cnt; }
@@ -0,0 +1,52 @@
+/**
+ * @file my_frame_queue.h
+ *   UARTタスクからHID送信タスクへ、受信したフレームを渡すキュー
+ */
+
+#ifndef my_frame_queue_h
+#define my_frame_queue_h 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "my_hid_program.h"
+
+// キューに溜めておけるフレーム数
+#define MY_FRAME_QUEUE_DEPTH (16)
+
+// 1フレームの最大長。受信バッファ最大長＋置換文字列最大長
+#define MY_FRAME_QUEUE_FRAME_MAX (99 + 40)
+
+/**
+ * @brief フレームが各段を通過した時刻（esp_timer_get_time()、us）。分からないものは0
+ */
+typedef struct {
+    int64_t trigger_us;   // トリガの立ち上がり（トグル動作で受信を続けているときは受信サイクルの開始）
+    int64_t request_us;   // リクエストコマンドを送った（ポーリングでは、trigger_usが送る予定の時刻）
+    int64_t rx_first_us;  // 最初の1バイトを受け取った
+    int64_t rx_done_us;   // 終端文字列まで受け取った
+    int64_t queued_us;    // キューに入れた
+} my_frame_stamp_t;
+
+/**
+ * @brief キューに入れるフレーム
+ */
+typedef struct {
+    my_frame_stamp_t stamp;
+    my_hid_program_t program;  // 送信するレポートの並び
+    uint16_t len;
+    uint8_t data[MY_FRAME_QUEUE_FRAME_MAX + 1];  // 末尾に'\0'を付ける
+} my_frame_t;
+
+extern bool my_frame_queue_init(void);
+extern bool my_frame_queue_push(const uint8_t *data, int len,
+                                const my_frame_stamp_t *stamp,
+                                const my_hid_program_t *program);
+extern bool my_frame_queue_pop(my_frame_t *frame, TickType_t wait);
+extern int my_frame_queue_depth(void);
+extern int my_frame_queue_max_depth(void);
+extern uint32_t my_frame_queue_pushed(void);
+extern uint32_t my_frame_queue_dropped(void);
+
+#endif
@@ -0,0 +1,104 @@
+/**
+ * @file my_hid_bench.c
+ *   レポートの送り方ごとに、送信速度とバッファの使用量を測る
+ *
+ *   何も押していないキーボード入力レポートを、指定した送り方でcount個、スケジューラ経由で送る。
+ *   複数のセントラルに接続しているときは、1レポートを全ての接続へ送り、送った数を数える。
+ *   ホストには何も入力されない。
+ *   送り終わるまでの時間から1秒あたりのレポート数を出し、送るたびに
+ *   共用msysプールと専用プールの空きを調べて最小を記録する。
+ *   CUSTOMは1レポートごとにmsysからmbufを取り、STDとALLはNimBLEが値を読み直すときにmsysから取る。
+ *   POOLはmsysを使わない。
+ *
+ *   httpdのタスクから呼ぶ。測るあいだは my_hid_sched_lock() で送り手になり、
+ *   HID送信タスクが同時にスケジューラを使ったり、切り替えた送り方でフレームを送ったりしないようにする。
+ *   HID送信タスクが送っている途中なら、そのフレームを送り終わるまで待つ。
+ *   送るのを待っているフレームがあるときは、入力を遅らせないよう測らない。
+ */
+
+#include "my_hid_bench.h"
+
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "hid_func.h"
+#include "my_frame_queue.h"
+#include "my_hid_mbuf.h"
+#include "my_hid_planner.h"
+#include "my_hid_sched.h"
+
+// HID送信タスクが1フレームを送り終わるのを待つ時間(ms)
+#define MY_HID_BENCH_SENDER_WAIT_MS (1000)
+
+// 送り方ごとの直近の測定結果
+static my_hid_bench_result_t my_hid_bench_results[SEND_METHOD_COUNT];
+
+/**
+ * @brief 指定した送り方でレポートを送り、測定結果を記録する。送り方は元に戻す
+ * @param method 送り方。SEND_METHOD_*
+ * @param count 1つの接続へ送るレポート数。MY_HID_BENCH_REPORTS_MAX まで
+ * @return 送れるセントラルが無いなど、測定できなかったらfalse
+ */
+bool my_hid_bench_run(int method, int count) {
+    static const uint8_t release[MY_HID_PLANNER_REPORT_SIZE] = {0};
+    if (method < 0 || method >= SEND_METHOD_COUNT || count <= 0 ||
+        count > MY_HID_BENCH_REPORTS_MAX) {
+        return false;
+    }
+    if (!my_hid_sched_lock(MY_HID_BENCH_SENDER_WAIT_MS)) {
+        return false;
+    }
+    if (my_frame_queue_depth() > 0) {
+        my_hid_sched_unlock();
+        return false;
+    }
+    uint16_t conns[MY_HID_SCHED_CONN_MAX];
+    int old_method = hid_set_send_method(method);
+    int conn_count = hid_keyboard_stream_conns(conns, MY_HID_SCHED_CONN_MAX);
+    if (conn_count == 0) {
+        hid_set_send_method(old_method);
+        my_hid_sched_unlock();
+        return false;
+    }
+    my_hid_bench_result_t *res = &my_hid_bench_results[method];
+    res->reports = count * conn_count;
+    res->failed = 0;
+    res->msys_free_before = os_msys_num_free();
+    res->msys_min_free = res->msys_free_before;
+    res->pool_min_free = my_hid_mbuf_free_cnt();
+    uint32_t heap_before = esp_get_free_heap_size();
+
+    int64_t start_us = esp_timer_get_time();
+    for (int i = 0; i < count; i++) {
+        for (int c = 0; c < conn_count; c++) {
+            if (my_hid_sched_send(hid_keyboard_stream_report, conns[c],
+                                  release) != 0) {
+                res->failed++;
+            }
+        }
+        int msys_free = os_msys_num_free();
+        if (msys_free < res->msys_min_free) res->msys_min_free = msys_free;
+        int pool_free = my_hid_mbuf_free_cnt();
+        if (pool_free < res->pool_min_free) res->pool_min_free = pool_free;
+    }
+    res->elapsed_us = (uint32_t)(esp_timer_get_time() - start_us);
+    hid_set_send_method(old_method);
+    my_hid_sched_unlock();
+
+    res->heap_delta = (int32_t)(esp_get_free_heap_size() - heap_before);
+    res->reports_per_sec =
+        res->elapsed_us > 0
+            ? (uint32_t)((uint64_t)(res->reports - res->failed) * 1000000 /
+                         res->elapsed_us)
+            : 0;
+    return true;
+}
+
+/**
+ * @brief 送り方の直近の測定結果
+ * @param method 送り方。SEND_METHOD_*
+ * @return 測定結果。reportsがゼロなら未測定。送り方が範囲外ならNULL
+ */
+const my_hid_bench_result_t *my_hid_bench_result(int method) {
+    if (method < 0 || method >= SEND_METHOD_COUNT) return NULL;
+    return &my_hid_bench_results[method];
+}
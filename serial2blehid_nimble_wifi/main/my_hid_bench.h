@@ -0,0 +1,32 @@
+/**
+ * @file my_hid_bench.h
+ *   レポートの送り方ごとに、送信速度とバッファの使用量を測る
+ */
+
+#ifndef my_hid_bench_h
+#define my_hid_bench_h 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// 1回の測定で送るレポート数の上限
+#define MY_HID_BENCH_REPORTS_MAX (2000)
+
+/**
+ * @brief 1つの送り方の測定結果
+ */
+typedef struct {
+    int reports;               // 送ろうとしたレポート数（全接続の合計）。ゼロなら未測定
+    int failed;                // 送れなかったレポート数
+    uint32_t elapsed_us;       // 全て送り終わるまでの時間
+    uint32_t reports_per_sec;  // 1秒あたりに送れたレポート数
+    int msys_free_before;      // 共用msysプールの空きmbuf数（測定前）
+    int msys_min_free;         // 共用msysプールの空きmbuf数の最小
+    int pool_min_free;         // 専用プールの空きmbuf数の最小
+    int32_t heap_delta;        // ヒープの空きの増減（測定後 - 測定前）
+} my_hid_bench_result_t;
+
+extern bool my_hid_bench_run(int method, int count);
+extern const my_hid_bench_result_t *my_hid_bench_result(int method);
+
+#endif
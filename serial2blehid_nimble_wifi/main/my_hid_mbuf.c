@@ -0,0 +1,87 @@
+/**
+ * @file my_hid_mbuf.c
+ *   HIDレポートの通知専用のmbufプール
+ *
+ *   ble_hs_mbuf_from_flat() は、NimBLE全体で共用しているmsysプールからmbufを取る。
+ *   キーストロークごとに共用プールを使うと、ATTの応答やL2CAPの受信と取り合いになる。
+ *   ここでは、レポートの通知だけに使う小さなプールを起動時に確保しておき、
+ *   送るレポートのバイト列を、そこから取ったmbufに直接書き込む。
+ *   mbufは送信後にNimBLEが解放し、自動的にこのプールに戻る。
+ */
+
+#include "my_hid_mbuf.h"
+
+#include "esp_log.h"
+
+#define MY_HID_MBUF_TAG "HID_MBUF"
+
+// HCI ACLヘッダ(4) + L2CAPヘッダ(4) + ATTヘッダの余白(5)。ble_hs_mbuf_att_pkt() と同じ
+#define MY_HID_MBUF_LEADING_SPACE (4 + 4 + 5)
+
+// 1ブロックの大きさ。mbuf構造体とデータ
+#define MY_HID_MBUF_BLOCK_SIZE (sizeof(struct os_mbuf) + MY_HID_MBUF_DATA_SIZE)
+
+// プールの領域
+static os_membuf_t my_hid_mbuf_mem[OS_MEMPOOL_SIZE(MY_HID_MBUF_COUNT,
+                                                   MY_HID_MBUF_BLOCK_SIZE)];
+static struct os_mempool my_hid_mbuf_mempool;
+static struct os_mbuf_pool my_hid_mbuf_pool;
+static bool my_hid_mbuf_ready = false;
+
+// プールが空で取れなかった回数
+static volatile uint32_t my_hid_mbuf_failed_cnt = 0;
+
+/**
+ * @brief プールを用意する。BLE初期化前に呼ぶこと。
+ */
+void my_hid_mbuf_init(void) {
+    if (my_hid_mbuf_ready) return;
+    int rc = os_mempool_init(&my_hid_mbuf_mempool, MY_HID_MBUF_COUNT,
+                             MY_HID_MBUF_BLOCK_SIZE, my_hid_mbuf_mem,
+                             "hid_mbuf");
+    if (rc == 0) {
+        rc = os_mbuf_pool_init(&my_hid_mbuf_pool, &my_hid_mbuf_mempool,
+                               MY_HID_MBUF_BLOCK_SIZE, MY_HID_MBUF_COUNT);
+    }
+    if (rc != 0) {
+        ESP_LOGE(MY_HID_MBUF_TAG, "Can not create mbuf pool (%d)", rc);
+        return;
+    }
+    my_hid_mbuf_ready = true;
+}
+
+/**
+ * @brief プールからmbufを取り、バイト列を書き込む
+ * @param buf 送るレポート
+ * @param len レポートの長さ
+ * @return mbuf。プールが空ならNULL
+ */
+struct os_mbuf *my_hid_mbuf_from_flat(const void *buf, uint16_t len) {
+    if (!my_hid_mbuf_ready) return NULL;
+    struct os_mbuf *om =
+        os_mbuf_get_pkthdr(&my_hid_mbuf_pool, sizeof(struct ble_mbuf_hdr));
+    if (om == NULL) {
+        my_hid_mbuf_failed_cnt++;
+        return NULL;
+    }
+    // NimBLEがヘッダを前に付けられるよう、先頭に余白を空けておく
+    om->om_data += MY_HID_MBUF_LEADING_SPACE;
+    if (os_mbuf_append(om, buf, len) != 0) {
+        os_mbuf_free_chain(om);
+        my_hid_mbuf_failed_cnt++;
+        return NULL;
+    }
+    return om;
+}
+
+/**
+ * @brief プールの空きmbuf数
+ */
+int my_hid_mbuf_free_cnt(void) {
+    return my_hid_mbuf_ready ? my_hid_mbuf_mempool.mp_num_free : 0;
+}
+
+/**
+ * @brief これまでにプールが空で取れなかった回数
+ */
+uint32_t my_hid_mbuf_failed(void) { return my_hid_mbuf_failed_cnt; }
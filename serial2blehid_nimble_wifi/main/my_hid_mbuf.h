@@ -0,0 +1,24 @@
+/**
+ * @file my_hid_mbuf.h
+ *   HIDレポートの通知専用のmbufプール
+ */
+
+#ifndef my_hid_mbuf_h
+#define my_hid_mbuf_h 1
+
+#include <stdint.h>
+
+#include "host/ble_hs.h"
+
+// プールのmbuf数。クレジット(8)と、NimBLEの送信待ちに残る分を合わせた数
+#define MY_HID_MBUF_COUNT (16)
+
+// 1つのmbufに置けるデータ長。パケットヘッダ、HCI/L2CAP/ATTヘッダ分の余白、レポート(最大20バイト)が入ること
+#define MY_HID_MBUF_DATA_SIZE (80)
+
+extern void my_hid_mbuf_init(void);
+extern struct os_mbuf *my_hid_mbuf_from_flat(const void *buf, uint16_t len);
+extern int my_hid_mbuf_free_cnt(void);
+extern uint32_t my_hid_mbuf_failed(void);
+
+#endif
@@ -0,0 +1,66 @@
+/**
+ * @file my_hid_nkro.c
+ *   キーボード入力レポートを、Nキーロールオーバー(NKRO)のビットマップ形式に変換する
+ *
+ *   ブート形式のレポートは、押しているキーのHIDコードを6個まで並べる配列になっている。
+ *   NKRO形式では、HIDコード0x00-0x97の1つ1つに1ビットを割り当て、押しているキーのビットを1にする。
+ *   同時に押せるキーの数に上限が無く、キーを押す・離すはビットを1つ立てる・消すだけになる。
+ *
+ *   プランナーやレポートプログラム、トレースはブート形式のままにしておき、
+ *   レポートプロトコルで送るときだけ、ここでNKRO形式に変換する。
+ *   変換は毎回ブート形式のレポートから作り直すので、途中のレポートを捨てても古いビットが残らない。
+ *   ブートプロトコル(report_mode_boot)のときは、ブート形式のまま送る。
+ */
+
+#include "my_hid_nkro.h"
+
+#include <string.h>
+
+// modifierキーのHIDコード（左Ctrl）。ここから8個がmodifierのビットになる
+#define MY_HID_NKRO_MODIFIER_FIRST (0xE0)
+
+/**
+ * @brief ブート形式のレポートを、NKRO形式に変換する
+ * @param boot ブート形式のレポート。modifier, reserved, key x 6
+ * @param nkro 変換したレポートが格納される。modifier, ビットマップ x 19
+ */
+void my_hid_nkro_encode(const uint8_t boot[MY_HID_NKRO_BOOT_SIZE],
+                        uint8_t nkro[MY_HID_NKRO_REPORT_SIZE]) {
+    memset(nkro, 0, MY_HID_NKRO_REPORT_SIZE);
+    nkro[0] = boot[0];
+    for (int i = 2; i < MY_HID_NKRO_BOOT_SIZE; i++) {
+        uint8_t k = boot[i];
+        if (k >= MY_HID_NKRO_MODIFIER_FIRST &&
+            k < MY_HID_NKRO_MODIFIER_FIRST + 8) {
+            // 配列に入れられたmodifierキーは、modifierのビットにする
+            nkro[0] |= 1 << (k - MY_HID_NKRO_MODIFIER_FIRST);
+        } else if (k != 0 && k <= MY_HID_NKRO_USAGE_MAX) {
+            // ビットマップに無いHIDコードは送れないので捨てる
+            nkro[1 + k / 8] |= 1 << (k % 8);
+        }
+    }
+}
+
+/**
+ * @brief NKRO形式のレポートを、ブート形式に戻す。押しているキーはHIDコードの小さい順に並べる
+ * @param nkro NKRO形式のレポート
+ * @param boot 戻したレポートが格納される
+ * @return 押しているキーの数。6個を超えるときは、最初の6個だけを格納する
+ */
+int my_hid_nkro_decode(const uint8_t nkro[MY_HID_NKRO_REPORT_SIZE],
+                       uint8_t boot[MY_HID_NKRO_BOOT_SIZE]) {
+    memset(boot, 0, MY_HID_NKRO_BOOT_SIZE);
+    boot[0] = nkro[0];
+    int n = 0;
+    for (int i = 0; i < MY_HID_NKRO_KEY_BYTES; i++) {
+        uint8_t bits = nkro[1 + i];
+        for (int b = 0; bits != 0; b++, bits >>= 1) {
+            if ((bits & 1) == 0) continue;
+            if (n < MY_HID_NKRO_BOOT_SIZE - 2) {
+                boot[2 + n] = i * 8 + b;
+            }
+            n++;
+        }
+    }
+    return n;
+}
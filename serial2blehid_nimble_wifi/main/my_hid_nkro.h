@@ -0,0 +1,30 @@
+/**
+ * @file my_hid_nkro.h
+ *   キーボード入力レポートを、Nキーロールオーバー(NKRO)のビットマップ形式に変換する
+ */
+
+#ifndef my_hid_nkro_h
+#define my_hid_nkro_h 1
+
+#include <stdint.h>
+
+// ビットマップで表せるHIDコードの上限。JISキーボードのINTERNATIONAL1-9とLANG1-8を含む
+#define MY_HID_NKRO_USAGE_MAX (0x97)
+
+// ビットマップのビット数とバイト数
+#define MY_HID_NKRO_KEY_BITS (MY_HID_NKRO_USAGE_MAX + 1)
+#define MY_HID_NKRO_KEY_BYTES (MY_HID_NKRO_KEY_BITS / 8)
+
+// NKRO形式のレポートの長さ。modifier, ビットマップ x 19。
+// ATT_MTUが初期値(23)でも、1つの通知(20バイト)に収まる
+#define MY_HID_NKRO_REPORT_SIZE (1 + MY_HID_NKRO_KEY_BYTES)
+
+// ブート形式のレポートの長さ。modifier, reserved, key x 6
+#define MY_HID_NKRO_BOOT_SIZE (8)
+
+extern void my_hid_nkro_encode(const uint8_t boot[MY_HID_NKRO_BOOT_SIZE],
+                               uint8_t nkro[MY_HID_NKRO_REPORT_SIZE]);
+extern int my_hid_nkro_decode(const uint8_t nkro[MY_HID_NKRO_REPORT_SIZE],
+                              uint8_t boot[MY_HID_NKRO_BOOT_SIZE]);
+
+#endif
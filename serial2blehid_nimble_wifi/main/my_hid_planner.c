@@ -0,0 +1,66 @@
+/**
+ * @file my_hid_planner.c
+ *   文字列を、キーボード入力レポートの並びに変換する
+ *
+ *   以前は1文字ごとに「押す」「離す」の2レポートを送っていた。
+ *   ホストは、レポートに新しく現れたキーを押されたキーとして扱い、消えたキーは離されたキーとして扱う。
+ *   そこで、前の文字のキーを離すのと、次の文字のキーを押すのを1つのレポートにまとめる。
+ *     "abc"  -> [a] [b] [c] []      4レポート（以前は6レポート）
+ *   1つのレポートで新しく押すキーは必ず1つだけにする。
+ *   1レポートに複数の新しいキーを入れると、ホストがどの順に入力するかはホスト次第になり、文字の順番が保証できないため。
+ *   同じキーが続く場合（"aa" や "1!" のようにシフトだけが違う場合も含む）は、
+ *   間に何も押していないレポートを挟んで、いったん離したことをホストに伝える。
+ *     "aab"  -> [a] [] [a] [b] []
+ *   文字列の最後には必ず何も押していないレポートを置き、キーが押されたままにならないようにする。
+ *   n文字の文字列は、n + (同じキーが続いた回数) + 1 レポートになる。
+ */
+
+#include "my_hid_planner.h"
+
+#include <string.h>
+
+#include "my_hid_key_map.h"
+
+/**
+ * @brief 文字列をキーボード入力レポートの並びに変換する
+ * @param text 文字列。変換表に無い文字は読み飛ばす
+ * @param len 文字列の長さ
+ * @param reports 変換したレポートが格納される。MY_HID_PLANNER_MAX_REPORTS(len) 個あれば足りる
+ * @param max_reports reportsに格納できるレポート数
+ * @return 作ったレポート数。reportsが足りなければ-1
+ */
+int my_hid_planner_plan(
+    const uint8_t *text, int len,
+    uint8_t (*reports)[MY_HID_PLANNER_REPORT_SIZE], int max_reports) {
+    int n = 0;
+    // 直前のレポートで押しているキー。0なら何も押していない
+    uint8_t held = 0;
+    for (int i = 0; i < len; i++) {
+        uint8_t c = text[i];
+        uint8_t k = KEYCODE_TO_HIDCODE(c);
+        uint8_t m = KEYCODE_TO_HIDMASK(c);
+        if (k == 0) {
+            continue;
+        }
+        if (k == held) {
+            // 同じキーが続くので、いったん離す
+            if (n >= max_reports) return -1;
+            memset(reports[n], 0, MY_HID_PLANNER_REPORT_SIZE);
+            n++;
+        }
+        // 前のキーを離し、このキーを押す
+        if (n >= max_reports) return -1;
+        memset(reports[n], 0, MY_HID_PLANNER_REPORT_SIZE);
+        reports[n][0] = m;
+        reports[n][2] = k;
+        n++;
+        held = k;
+    }
+    if (held != 0) {
+        // 最後に全て離す
+        if (n >= max_reports) return -1;
+        memset(reports[n], 0, MY_HID_PLANNER_REPORT_SIZE);
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file my_hid_planner.h
+ *   文字列を、キーボード入力レポートの並びに変換する
+ */
+
+#ifndef my_hid_planner_h
+#define my_hid_planner_h 1
+
+#include <stdint.h>
+
+// キーボード入力レポートの長さ。modifier, reserved, key x 6
+#define MY_HID_PLANNER_REPORT_SIZE (8)
+
+// len文字の文字列から作られるレポート数の上限。同じキーが続くと1文字2レポートになる
+#define MY_HID_PLANNER_MAX_REPORTS(len) ((len) * 2)
+
+extern int my_hid_planner_plan(
+    const uint8_t *text, int len,
+    uint8_t (*reports)[MY_HID_PLANNER_REPORT_SIZE], int max_reports);
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * @file my_hid_program.c
+ *   1フレーム分のキーボード入力レポートの並び（レポートプログラム）を、プールに作って渡す
+ *
+ *   UARTタスクは、受信したフレーム（末尾文字列の置換後）をその場でレポートの並びに変換し、
+ *   プールに置いたままHID送信タスクへ渡す。
+ *   HID送信タスクは、プールのレポートを順に送るだけで、文字の変換表を引いたりはしない。
+ *
+ *   プールは、UARTタスクが確保しHID送信タスクが解放する、単一生産者・単一消費者のFIFOになっている。
+ *   headは確保する側だけが、tailは解放する側だけが書き換えるので、ロックは要らない。
+ *   1つのプログラムはプール内で連続させる。末尾に収まらないときは、末尾の残りを飛ばして先頭から使う。
+ */
+
+#include "my_hid_program.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+// レポートを置くプール
+static uint8_t my_hid_program_pool[MY_HID_PROGRAM_POOL_REPORTS]
+                                  [MY_HID_PLANNER_REPORT_SIZE];
+
+// 次に確保する位置と、まだ解放されていない最も古い位置。どちらも添字ではなく通し番号
+static _Atomic uint32_t my_hid_program_head = 0;
+static _Atomic uint32_t my_hid_program_tail = 0;
+
+#define MY_HID_PROGRAM_POOL_MASK (MY_HID_PROGRAM_POOL_REPORTS - 1)
+
+/**
+ * @brief 文字列をレポートプログラムに変換し、プールに置く。UARTタスクから呼ぶ。
+ * @param text 文字列
+ * @param len 文字列の長さ
+ * @param prog 作ったプログラムが格納される
+ * @return プールに空きが無ければfalse
+ */
+bool my_hid_program_compile(const uint8_t *text, int len,
+                            my_hid_program_t *prog) {
+    uint32_t head =
+        atomic_load_explicit(&my_hid_program_head, memory_order_relaxed);
+    uint32_t tail =
+        atomic_load_explicit(&my_hid_program_tail, memory_order_acquire);
+    // 最大の大きさで確保してから変換し、実際の大きさに縮める
+    uint32_t need = MY_HID_PLANNER_MAX_REPORTS(len);
+    if (need == 0) need = 1;
+    uint32_t pos = head & MY_HID_PROGRAM_POOL_MASK;
+    uint32_t pad = (pos + need > MY_HID_PROGRAM_POOL_REPORTS)
+                       ? MY_HID_PROGRAM_POOL_REPORTS - pos
+                       : 0;
+    if ((head - tail) + pad + need > MY_HID_PROGRAM_POOL_REPORTS) {
+        return false;
+    }
+    prog->begin = head;
+    prog->start = (head + pad) & MY_HID_PROGRAM_POOL_MASK;
+    int cnt = my_hid_planner_plan(text, len,
+                                  &my_hid_program_pool[prog->start], need);
+    if (cnt < 0) {
+        return false;
+    }
+    prog->count = cnt;
+    prog->end = head + pad + cnt;
+    atomic_store_explicit(&my_hid_program_head, prog->end,
+                          memory_order_release);
+    return true;
+}
+
+/**
+ * @brief 直前に作ったプログラムを取り消す。HID送信タスクに渡せなかったときにUARTタスクから呼ぶ。
+ */
+void my_hid_program_cancel(const my_hid_program_t *prog) {
+    atomic_store_explicit(&my_hid_program_head, prog->begin,
+                          memory_order_release);
+}
+
+/**
+ * @brief プログラムのi番目のレポートを返す
+ */
+const uint8_t *my_hid_program_report(const my_hid_program_t *prog, int i) {
+    return my_hid_program_pool[prog->start + i];
+}
+
+/**
+ * @brief 送り終わったプログラムを解放する。HID送信タスクから、受け取った順に呼ぶ。
+ */
+void my_hid_program_free(const my_hid_program_t *prog) {
+    atomic_store_explicit(&my_hid_program_tail, prog->end,
+                          memory_order_release);
+}
+
+/**
+ * @brief プールで使用中のレポート数（飛ばした末尾を含む）
+ */
+int my_hid_program_pool_used(void) {
+    return atomic_load_explicit(&my_hid_program_head, memory_order_acquire) -
+           atomic_load_explicit(&my_hid_program_tail, memory_order_acquire);
+}
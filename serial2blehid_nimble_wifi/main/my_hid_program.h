@@ -0,0 +1,36 @@
+/**
+ * @file my_hid_program.h
+ *   1フレーム分のキーボード入力レポートの並び（レポートプログラム）を、プールに作って渡す
+ */
+
+#ifndef my_hid_program_h
+#define my_hid_program_h 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "my_hid_planner.h"
+
+// プールに置けるレポート数。2のべき乗にすること。
+// 15文字のフレームはおよそ17レポートなので、フレームキューが満杯でも足りる
+#define MY_HID_PROGRAM_POOL_REPORTS (1024)
+
+/**
+ * @brief プール内のレポートプログラム。プールはFIFOで使うので、作った順に解放すること
+ */
+typedef struct {
+    uint32_t begin;  // 確保前のプールの先頭位置
+    uint32_t end;    // 確保後のプールの先頭位置
+    uint16_t start;  // 最初のレポートの添字
+    uint16_t count;  // レポート数
+} my_hid_program_t;
+
+extern bool my_hid_program_compile(const uint8_t *text, int len,
+                                   my_hid_program_t *prog);
+extern void my_hid_program_cancel(const my_hid_program_t *prog);
+extern const uint8_t *my_hid_program_report(const my_hid_program_t *prog,
+                                            int i);
+extern void my_hid_program_free(const my_hid_program_t *prog);
+extern int my_hid_program_pool_used(void);
+
+#endif
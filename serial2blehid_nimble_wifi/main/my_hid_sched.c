@@ -0,0 +1,554 @@
+/**
+ * @file my_hid_sched.c
+ *   キーストロークのスケジューラ
+ *
+ *   以前は1レポートごとに50ms待っていたため、接続間隔に関係なく毎秒10文字程度が上限だった。
+ *   ここでは、
+ *     1. 送信完了(BLE_GAP_EVENT_NOTIFY_TX)を待たずに送れるレポート数をクレジットとして数え、
+ *        クレジットが無くなったら、送信完了でクレジットが戻るまで待つ
+ *     2. NimBLEのバッファが足りない(BLE_HS_ENOMEM)ときは、接続間隔1回分待って同じレポートを送り直す
+ *     3. 1接続イベントあたり MY_HID_SCHED_REPORTS_PER_EVENT 個まで送ったら、次の接続イベントまで待つ
+ *        2M PHYに切り替わった接続は MY_HID_SCHED_REPORTS_PER_EVENT_2M 個まで送る
+ *   という方法で送信間隔を決める。
+ *   接続間隔 7.5ms なら、15文字（30レポート）は8接続イベント、おおよそ60msで送り終わる。
+ *
+ *   複数のセントラルに接続しているときは、接続ごとに接続間隔と接続イベント内の送信数を持つ。
+ *   呼び出し側は、1レポートを接続ごとに順に送る。ある接続が1接続イベントぶん送り終わっても、
+ *   すぐには待たずに他の接続へ送り、その接続へ次に送るときに、接続イベントの残り時間だけ待つ。
+ *   こうすると、各接続の接続イベントの間に他の接続へ送れるので、待ち時間が重ならない。
+ *   クレジットは、コントローラのバッファを全接続で共用しているので、全接続で1つにまとめる。
+ *
+ *   notifyは、NimBLEがパケットを送信待ちに入れた時点でNOTIFY_TXが来るので、クレジットはすぐに戻る。
+ *   notifyで送れなくなるのはバッファ不足のときで、これは2.の再送で待つ。
+ *   indicateは、相手からの応答でNOTIFY_TXが来るまでクレジットが戻らない。
+ *   NOTIFY_TXは送信した関数の中から来ることがあるので、クレジットは送る前に接続へ貸す。
+ *   送信に失敗したときも、送信した関数の中から(status!=0)で来る。これは送っている最中の
+ *   接続への知らせとして見分け、my_hid_sched_send() が自分でクレジットを戻す。
+ *   切断された接続に貸していたクレジットは、切断時に戻す。
+ *   接続と切断はNimBLEのホストタスクから来るので、接続ごとの送信状態はミューテックスで守る。
+ *   送り手は待つ間と送る間はミューテックスを離し、その後に接続ハンドルで探し直す。
+ *   再送しても送れなかったレポートは捨てて数える。再送は同じ接続にだけ行う。
+ *
+ *   スケジューラを使って送る側（HID送信タスクとベンチマーク）は、送る前に my_hid_sched_lock() で
+ *   送り手を1つにする。ベンチマークは送り方(Notify_method)を切り替えるので、HID送信タスクは
+ *   1フレームを送り終わるまで、ベンチマークは測り終わるまで持つ。
+ */
+
+#include "my_hid_sched.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "host/ble_hs.h"
+#include "my_trace.h"
+
+#define MY_HID_SCHED_TAG "HID_SCHED"
+
+// 送信完了が来なかったとみなすまでの余裕(ms)
+#define MY_HID_SCHED_TX_MARGIN_MS (10)
+
+/**
+ * @brief 1つの接続の送信状態
+ */
+typedef struct {
+    bool used;
+    uint16_t conn_handle;
+    uint32_t id;              // 接続ごとに変わる番号。同じハンドルで接続し直したものと見分ける
+    uint16_t itvl;            // 接続間隔（1.25ms単位）
+    int sent_in_event;        // 現在の接続イベント内で送ったレポート数
+    int per_event;            // 1回の接続イベントで送ってよいレポート数
+    TickType_t event_end;     // 現在の接続イベントが終わるtick
+    int outstanding;          // 送信完了を待っているクレジット数
+    bool sending;             // 送信する関数を呼んでいる最中
+} my_hid_sched_conn_t;
+
+// 送信完了を待たずに送れる残り数。NOTIFY_TXを受け取るたびにGiveされる
+static SemaphoreHandle_t my_hid_sched_credits = NULL;
+
+// 送り手の排他。HID送信タスクとベンチマークが同時に送らないようにする
+static SemaphoreHandle_t my_hid_sched_sender = NULL;
+
+// 接続ごとの送信状態の排他。NimBLEのホストタスクが接続と切断で書き換え、送り手が読み書きする。
+// 持ったまま待ったり送ったりしない
+static SemaphoreHandle_t my_hid_sched_conns_mutex = NULL;
+
+// 接続ごとの送信状態
+static my_hid_sched_conn_t my_hid_sched_conns[MY_HID_SCHED_CONN_MAX];
+
+// 最後に用意した接続の番号
+static uint32_t my_hid_sched_last_id = 0;
+
+// クレジットが無く、送信完了を待ったレポート数
+static volatile uint32_t my_hid_sched_queued_cnt = 0;
+
+// バッファ不足で送り直した回数
+static volatile uint32_t my_hid_sched_retried_cnt = 0;
+
+// 送れずに捨てたレポート数
+static volatile uint32_t my_hid_sched_dropped_cnt = 0;
+
+/**
+ * @brief 接続ごとの送信状態を使う前に呼ぶ
+ */
+static void my_hid_sched_conns_lock(void) {
+    if (my_hid_sched_conns_mutex != NULL) {
+        xSemaphoreTake(my_hid_sched_conns_mutex, portMAX_DELAY);
+    }
+}
+
+/**
+ * @brief 接続ごとの送信状態を使い終わったら呼ぶ
+ */
+static void my_hid_sched_conns_unlock(void) {
+    if (my_hid_sched_conns_mutex != NULL) {
+        xSemaphoreGive(my_hid_sched_conns_mutex);
+    }
+}
+
+/**
+ * @brief 接続の送信状態を探す。my_hid_sched_conns_lock() してから呼ぶ
+ * @return 見つからなければNULL
+ */
+static my_hid_sched_conn_t *my_hid_sched_conn_find(uint16_t conn_handle) {
+    for (int i = 0; i < MY_HID_SCHED_CONN_MAX; i++) {
+        if (my_hid_sched_conns[i].used &&
+            my_hid_sched_conns[i].conn_handle == conn_handle) {
+            return &my_hid_sched_conns[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 待った後に、送っている接続の送信状態を探し直す。my_hid_sched_conns_lock() してから呼ぶ
+ * @param id 送り始めたときの接続の番号
+ * @return 待っている間に切断されていればNULL
+ */
+static my_hid_sched_conn_t *my_hid_sched_conn_refind(uint16_t conn_handle,
+                                                     uint32_t id) {
+    my_hid_sched_conn_t *c = my_hid_sched_conn_find(conn_handle);
+    return c != NULL && c->id == id ? c : NULL;
+}
+
+/**
+ * @brief 接続間隔（1.25ms単位）をmsにする。切り上げ。
+ */
+static uint32_t my_hid_sched_itvl_ms(uint16_t itvl) {
+    return ((uint32_t)itvl * 5 + 3) / 4;
+}
+
+/**
+ * @brief 接続間隔をmsで返す。切り上げ。
+ */
+static uint32_t my_hid_sched_conn_itvl_ms(const my_hid_sched_conn_t *c) {
+    return my_hid_sched_itvl_ms(c->itvl);
+}
+
+/**
+ * @brief 接続間隔をtickで返す。最低1tick
+ */
+static TickType_t my_hid_sched_conn_itvl_ticks(const my_hid_sched_conn_t *c) {
+    TickType_t ticks = pdMS_TO_TICKS(my_hid_sched_conn_itvl_ms(c));
+    return ticks > 0 ? ticks : 1;
+}
+
+/**
+ * @brief 接続間隔1回分待つ
+ */
+static void my_hid_sched_wait_conn_itvl(uint16_t conn_handle, uint32_t id) {
+    my_hid_sched_conns_lock();
+    my_hid_sched_conn_t *c = my_hid_sched_conn_refind(conn_handle, id);
+    TickType_t ticks = c != NULL ? my_hid_sched_conn_itvl_ticks(c) : 0;
+    my_hid_sched_conns_unlock();
+    if (ticks > 0) {
+        vTaskDelay(ticks);
+    }
+}
+
+/**
+ * @brief 接続イベント内で送ってよい数を使い切っていたら、その接続イベントが終わるまで待つ。
+ *        他の接続へ送っている間に過ぎた時間は待たない。
+ * @return 待っている間に切断されたらfalse
+ */
+static bool my_hid_sched_wait_event(uint16_t conn_handle, uint32_t id) {
+    my_hid_sched_conns_lock();
+    my_hid_sched_conn_t *c = my_hid_sched_conn_refind(conn_handle, id);
+    if (c == NULL) {
+        my_hid_sched_conns_unlock();
+        return false;
+    }
+    TickType_t now = xTaskGetTickCount();
+    TickType_t wait = 0;
+    if (c->sent_in_event > 0 && (int32_t)(now - c->event_end) < 0) {
+        if (c->sent_in_event < c->per_event) {
+            my_hid_sched_conns_unlock();
+            return true;
+        }
+        wait = c->event_end - now;
+    }
+    if (wait > 0) {
+        my_hid_sched_conns_unlock();
+        vTaskDelay(wait);
+        my_hid_sched_conns_lock();
+        c = my_hid_sched_conn_refind(conn_handle, id);
+        if (c == NULL) {
+            my_hid_sched_conns_unlock();
+            return false;
+        }
+        now = xTaskGetTickCount();
+    }
+    // 新しい接続イベント
+    c->sent_in_event = 0;
+    c->event_end = now + my_hid_sched_conn_itvl_ticks(c);
+    my_hid_sched_conns_unlock();
+    return true;
+}
+
+/**
+ * @brief 接続の貸しているクレジットを全て戻す。my_hid_sched_conns_lock() してから呼ぶ
+ */
+static void my_hid_sched_give_back(my_hid_sched_conn_t *c) {
+    if (my_hid_sched_credits != NULL) {
+        for (; c->outstanding > 0; c->outstanding--) {
+            xSemaphoreGive(my_hid_sched_credits);
+        }
+    }
+    c->outstanding = 0;
+}
+
+/**
+ * @brief 送れなかったレポートを数える
+ * @return rc
+ */
+static int my_hid_sched_drop(uint16_t conn_handle, int rc) {
+    my_hid_sched_dropped_cnt++;
+    my_trace_rec(MY_TRACE_REPORT_DROP, 0, (uint16_t)rc, conn_handle);
+    return rc;
+}
+
+/**
+ * @brief スケジューラを準備する。BLE初期化前に呼ぶこと。
+ */
+void my_hid_sched_init(void) {
+    if (my_hid_sched_credits == NULL) {
+        my_hid_sched_credits = xSemaphoreCreateCounting(
+            MY_HID_SCHED_CREDITS, MY_HID_SCHED_CREDITS);
+        if (my_hid_sched_credits == NULL) {
+            ESP_LOGE(MY_HID_SCHED_TAG, "Can not create semaphore!");
+        }
+    }
+    if (my_hid_sched_sender == NULL) {
+        my_hid_sched_sender = xSemaphoreCreateMutex();
+        if (my_hid_sched_sender == NULL) {
+            ESP_LOGE(MY_HID_SCHED_TAG, "Can not create mutex!");
+        }
+    }
+    if (my_hid_sched_conns_mutex == NULL) {
+        my_hid_sched_conns_mutex = xSemaphoreCreateMutex();
+        if (my_hid_sched_conns_mutex == NULL) {
+            ESP_LOGE(MY_HID_SCHED_TAG, "Can not create mutex!");
+        }
+    }
+    my_hid_sched_reset();
+}
+
+/**
+ * @brief 全ての接続の状態を消す。クレジットは全て戻す。
+ */
+void my_hid_sched_reset(void) {
+    my_hid_sched_conns_lock();
+    memset(my_hid_sched_conns, 0, sizeof(my_hid_sched_conns));
+    if (my_hid_sched_credits != NULL) {
+        // 上限まで戻すとGiveが失敗する
+        while (xSemaphoreGive(my_hid_sched_credits) == pdTRUE) {
+        }
+    }
+    my_hid_sched_conns_unlock();
+}
+
+/**
+ * @brief 接続間隔を設定する。my_hid_sched_conns_lock() してから呼ぶ
+ * @return 設定した接続間隔
+ */
+static uint16_t my_hid_sched_conn_set_itvl(my_hid_sched_conn_t *c,
+                                           uint16_t itvl) {
+    if (itvl == 0) itvl = MY_HID_SCHED_DEFAULT_CONN_ITVL;
+    c->itvl = itvl;
+    return itvl;
+}
+
+/**
+ * @brief 接続時に呼ぶ。接続の送信状態を用意する。
+ * @param conn_handle 接続ハンドル
+ * @param itvl 接続間隔（1.25ms単位）
+ */
+void my_hid_sched_conn_open(uint16_t conn_handle, uint16_t itvl) {
+    my_hid_sched_conns_lock();
+    my_hid_sched_conn_t *c = my_hid_sched_conn_find(conn_handle);
+    for (int i = 0; c == NULL && i < MY_HID_SCHED_CONN_MAX; i++) {
+        if (!my_hid_sched_conns[i].used) {
+            c = &my_hid_sched_conns[i];
+        }
+    }
+    if (c == NULL) {
+        my_hid_sched_conns_unlock();
+        ESP_LOGE(MY_HID_SCHED_TAG, "no room for connection %u", conn_handle);
+        return;
+    }
+    my_hid_sched_give_back(c);
+    memset(c, 0, sizeof(*c));
+    c->conn_handle = conn_handle;
+    c->id = ++my_hid_sched_last_id;
+    c->used = true;
+    c->per_event = MY_HID_SCHED_REPORTS_PER_EVENT;
+    itvl = my_hid_sched_conn_set_itvl(c, itvl);
+    my_hid_sched_conns_unlock();
+    ESP_LOGI(MY_HID_SCHED_TAG, "connection %u interval %u (%lu ms)",
+             conn_handle, itvl, my_hid_sched_itvl_ms(itvl));
+}
+
+/**
+ * @brief 切断時に呼ぶ。接続に貸していたクレジットを戻す。
+ *        送っている最中の接続なら、送り手は待った後に探し直して、切断されたことを知る。
+ * @param conn_handle 接続ハンドル
+ */
+void my_hid_sched_conn_close(uint16_t conn_handle) {
+    my_hid_sched_conns_lock();
+    my_hid_sched_conn_t *c = my_hid_sched_conn_find(conn_handle);
+    if (c != NULL) {
+        my_hid_sched_give_back(c);
+        c->used = false;
+    }
+    my_hid_sched_conns_unlock();
+}
+
+/**
+ * @brief 接続間隔を設定する。接続時と接続パラメータ更新時に呼ぶ。
+ * @param conn_handle 接続ハンドル
+ * @param itvl 接続間隔（1.25ms単位）
+ */
+void my_hid_sched_set_conn_itvl(uint16_t conn_handle, uint16_t itvl) {
+    my_hid_sched_conns_lock();
+    my_hid_sched_conn_t *c = my_hid_sched_conn_find(conn_handle);
+    if (c != NULL) {
+        itvl = my_hid_sched_conn_set_itvl(c, itvl);
+    }
+    my_hid_sched_conns_unlock();
+    if (c == NULL) return;
+    ESP_LOGI(MY_HID_SCHED_TAG, "connection %u interval %u (%lu ms)",
+             conn_handle, itvl, my_hid_sched_itvl_ms(itvl));
+}
+
+/**
+ * @brief 接続の接続間隔（1.25ms単位）を返す。接続していなければゼロ
+ */
+uint16_t my_hid_sched_get_conn_itvl(uint16_t conn_handle) {
+    my_hid_sched_conns_lock();
+    my_hid_sched_conn_t *c = my_hid_sched_conn_find(conn_handle);
+    uint16_t itvl = c != NULL ? c->itvl : 0;
+    my_hid_sched_conns_unlock();
+    return itvl;
+}
+
+/**
+ * @brief PHYを設定する。接続直後は1M PHYとみなし、PHYの更新完了時に呼ぶ。
+ * @param conn_handle 接続ハンドル
+ * @param phy_2m 送信が2M PHYならtrue
+ */
+void my_hid_sched_set_conn_phy(uint16_t conn_handle, bool phy_2m) {
+    int per_event = phy_2m ? MY_HID_SCHED_REPORTS_PER_EVENT_2M
+                           : MY_HID_SCHED_REPORTS_PER_EVENT;
+    my_hid_sched_conns_lock();
+    my_hid_sched_conn_t *c = my_hid_sched_conn_find(conn_handle);
+    if (c != NULL) {
+        c->per_event = per_event;
+    }
+    my_hid_sched_conns_unlock();
+    if (c == NULL) return;
+    ESP_LOGI(MY_HID_SCHED_TAG, "connection %u %s PHY, %d reports per event",
+             conn_handle, phy_2m ? "2M" : "1M", per_event);
+}
+
+/**
+ * @brief 接続の1回の接続イベントで送ってよいレポート数を返す。接続していなければゼロ
+ */
+int my_hid_sched_get_reports_per_event(uint16_t conn_handle) {
+    my_hid_sched_conns_lock();
+    my_hid_sched_conn_t *c = my_hid_sched_conn_find(conn_handle);
+    int per_event = c != NULL ? c->per_event : 0;
+    my_hid_sched_conns_unlock();
+    return per_event;
+}
+
+/**
+ * @brief BLE_GAP_EVENT_NOTIFY_TX で呼ぶ。接続に貸したクレジットを1つ戻す。
+ *        indicateは送信直後(status=0)にも呼ばれるので、応答(status!=0)のときだけ戻す。
+ *        送信に失敗したときは、送信した関数の中から(status!=0)で呼ばれる。
+ *        これはmy_hid_sched_send()が自分で戻すので、ここでは何もしない。
+ *        貸していない接続の知らせでは戻さない。
+ * @param conn_handle 送信した接続
+ */
+void my_hid_sched_notify_tx(uint16_t conn_handle, int status,
+                            bool indication) {
+    if (indication && status == 0) return;
+    my_hid_sched_conns_lock();
+    my_hid_sched_conn_t *c = my_hid_sched_conn_find(conn_handle);
+    if (c != NULL && c->outstanding > 0 && !(status != 0 && c->sending)) {
+        c->outstanding--;
+        if (my_hid_sched_credits != NULL) {
+            xSemaphoreGive(my_hid_sched_credits);
+        }
+    }
+    my_hid_sched_conns_unlock();
+}
+
+/**
+ * @brief 送っている接続が送信する関数を呼んでいる最中かを設定する
+ * @return 待っている間に切断されていたらfalse
+ */
+static bool my_hid_sched_set_sending(uint16_t conn_handle, uint32_t id,
+                                     bool sending) {
+    my_hid_sched_conns_lock();
+    my_hid_sched_conn_t *c = my_hid_sched_conn_refind(conn_handle, id);
+    if (c != NULL) {
+        c->sending = sending;
+    }
+    my_hid_sched_conns_unlock();
+    return c != NULL;
+}
+
+/**
+ * @brief レポートを1つの接続へ送る。クレジットが無ければ戻るまで待ち、バッファ不足なら送り直す。
+ *        その接続の接続イベントで送ってよい数を使い切っていたら、次の接続イベントまで待ってから送る。
+ *        接続の送信状態は待つたびに探し直し、待っている間に切断されたら捨てる。
+ *        そのとき貸していたクレジットは、切断時に戻っている。
+ * @param send レポートを送る関数。NimBLEのエラーコードを返すこと
+ * @param conn_handle 送る接続
+ * @param report 送るレポート
+ * @return 送れたらゼロ。送れずに捨てたらsendの返した値。接続していなければBLE_HS_ENOTCONN
+ */
+int my_hid_sched_send(my_hid_sched_send_fn_t send, uint16_t conn_handle,
+                      const uint8_t *report) {
+    my_hid_sched_conns_lock();
+    my_hid_sched_conn_t *c = my_hid_sched_conn_find(conn_handle);
+    uint32_t id = c != NULL ? c->id : 0;
+    my_hid_sched_conns_unlock();
+    if (c == NULL || !my_hid_sched_wait_event(conn_handle, id)) {
+        return my_hid_sched_drop(conn_handle, BLE_HS_ENOTCONN);
+    }
+    // クレジットを1つ使う。無ければ送信完了を待つ。
+    // 来なければ接続間隔2回分＋余裕で、送信完了を取りこぼしたとみなして進む
+    bool has_credit = false;
+    if (my_hid_sched_credits != NULL) {
+        has_credit = xSemaphoreTake(my_hid_sched_credits, 0) == pdTRUE;
+        if (!has_credit) {
+            my_hid_sched_queued_cnt++;
+            my_hid_sched_conns_lock();
+            c = my_hid_sched_conn_refind(conn_handle, id);
+            uint32_t itvl_ms =
+                c != NULL ? my_hid_sched_conn_itvl_ms(c) : 0;
+            my_hid_sched_conns_unlock();
+            TickType_t wait =
+                pdMS_TO_TICKS(itvl_ms * 2 + MY_HID_SCHED_TX_MARGIN_MS);
+            has_credit = xSemaphoreTake(my_hid_sched_credits,
+                                        wait > 0 ? wait : 1) == pdTRUE;
+            if (!has_credit) {
+                ESP_LOGW(MY_HID_SCHED_TAG, "notify tx timeout");
+            }
+        }
+    }
+    // 送信完了は送信した関数の中から来ることがあるので、送る前に貸しておく。
+    // クレジットを待っている間に切断されたら、貸す前なので自分で戻す
+    my_hid_sched_conns_lock();
+    c = my_hid_sched_conn_refind(conn_handle, id);
+    if (c != NULL && has_credit) {
+        c->outstanding++;
+    }
+    my_hid_sched_conns_unlock();
+    if (c == NULL) {
+        if (has_credit) {
+            xSemaphoreGive(my_hid_sched_credits);
+        }
+        return my_hid_sched_drop(conn_handle, BLE_HS_ENOTCONN);
+    }
+    // 送る。バッファ不足なら、接続イベントでバッファが空くのを待って送り直す
+    int rc = BLE_HS_ENOTCONN;
+    for (int retry = 0;; retry++) {
+        if (!my_hid_sched_set_sending(conn_handle, id, true)) {
+            rc = BLE_HS_ENOTCONN;
+            break;
+        }
+        rc = send(conn_handle, report);
+        if (!my_hid_sched_set_sending(conn_handle, id, false) ||
+            rc != BLE_HS_ENOMEM || retry >= MY_HID_SCHED_RETRY_MAX) {
+            break;
+        }
+        my_hid_sched_retried_cnt++;
+        my_trace_rec(MY_TRACE_REPORT_RETRY, 0, (uint16_t)rc, conn_handle);
+        my_hid_sched_wait_conn_itvl(conn_handle, id);
+        // 待っている間に接続イベントが変わった
+        my_hid_sched_wait_event(conn_handle, id);
+    }
+    my_hid_sched_conns_lock();
+    c = my_hid_sched_conn_refind(conn_handle, id);
+    if (c == NULL) {
+        // 切断された。貸したクレジットは切断時に戻っている
+        my_hid_sched_conns_unlock();
+        return rc == 0 ? 0 : my_hid_sched_drop(conn_handle, rc);
+    }
+    if (rc != 0) {
+        // 送れなかったのでクレジットを戻す
+        if (has_credit && c->outstanding > 0) {
+            c->outstanding--;
+            xSemaphoreGive(my_hid_sched_credits);
+        }
+        my_hid_sched_conns_unlock();
+        return my_hid_sched_drop(conn_handle, rc);
+    }
+    c->sent_in_event++;
+    my_hid_sched_conns_unlock();
+    return 0;
+}
+
+/**
+ * @brief 送り手になる。送り終わったら my_hid_sched_unlock() を呼ぶこと。
+ *        送り方を切り替えるときも、送り手になってから切り替える。
+ * @param wait_ms 他の送り手が終わるのを待つ時間。MY_HID_SCHED_WAIT_FOREVER なら取れるまで待つ
+ * @return 送り手になれたらtrue
+ */
+bool my_hid_sched_lock(uint32_t wait_ms) {
+    if (my_hid_sched_sender == NULL) {
+        return true;
+    }
+    TickType_t wait = wait_ms == MY_HID_SCHED_WAIT_FOREVER
+                          ? portMAX_DELAY
+                          : pdMS_TO_TICKS(wait_ms);
+    return xSemaphoreTake(my_hid_sched_sender, wait) == pdTRUE;
+}
+
+/**
+ * @brief my_hid_sched_lock() で取った送り手をやめる
+ */
+void my_hid_sched_unlock(void) {
+    if (my_hid_sched_sender != NULL) {
+        xSemaphoreGive(my_hid_sched_sender);
+    }
+}
+
+/**
+ * @brief これまでにクレジットが無く、送信完了を待ったレポート数
+ */
+uint32_t my_hid_sched_queued(void) { return my_hid_sched_queued_cnt; }
+
+/**
+ * @brief これまでにバッファ不足で送り直した回数
+ */
+uint32_t my_hid_sched_retried(void) { return my_hid_sched_retried_cnt; }
+
+/**
+ * @brief これまでに送れずに捨てたレポート数
+ */
+uint32_t my_hid_sched_dropped(void) { return my_hid_sched_dropped_cnt; }
@@ -0,0 +1,58 @@
+/**
+ * @file my_hid_sched.h
+ *   BLE-HIDのキーストローク送信間隔を、接続間隔と送信完了イベントから決める
+ */
+
+#ifndef my_hid_sched_h
+#define my_hid_sched_h 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+// 同時に接続するセントラルの数
+#define MY_HID_SCHED_CONN_MAX CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+
+// 接続間隔が分からないときに仮定する値（1.25ms単位。24 = 30ms）
+#define MY_HID_SCHED_DEFAULT_CONN_ITVL (24)
+
+// 1回の接続イベントで送ってよいレポート数
+#define MY_HID_SCHED_REPORTS_PER_EVENT (4)
+
+// 2M PHYのときに1回の接続イベントで送ってよいレポート数。
+// 1パケットの送信時間がおおよそ3/4になるので、同じ時間で1.5倍送れる
+#define MY_HID_SCHED_REPORTS_PER_EVENT_2M (6)
+
+// 送信完了を待たずに送ってよいレポート数（クレジット）
+#define MY_HID_SCHED_CREDITS (8)
+
+// NimBLEのバッファが足りない(BLE_HS_ENOMEM)ときに再送する回数
+#define MY_HID_SCHED_RETRY_MAX (10)
+
+// my_hid_sched_lock() で、取れるまで待つときの待ち時間
+#define MY_HID_SCHED_WAIT_FOREVER UINT32_MAX
+
+// レポートを1つの接続へ送る関数
+typedef int (*my_hid_sched_send_fn_t)(uint16_t conn_handle,
+                                      const uint8_t *report);
+
+extern void my_hid_sched_init(void);
+extern void my_hid_sched_reset(void);
+extern void my_hid_sched_conn_open(uint16_t conn_handle, uint16_t itvl);
+extern void my_hid_sched_conn_close(uint16_t conn_handle);
+extern void my_hid_sched_set_conn_itvl(uint16_t conn_handle, uint16_t itvl);
+extern uint16_t my_hid_sched_get_conn_itvl(uint16_t conn_handle);
+extern void my_hid_sched_set_conn_phy(uint16_t conn_handle, bool phy_2m);
+extern int my_hid_sched_get_reports_per_event(uint16_t conn_handle);
+extern void my_hid_sched_notify_tx(uint16_t conn_handle, int status,
+                                   bool indication);
+extern int my_hid_sched_send(my_hid_sched_send_fn_t send,
+                             uint16_t conn_handle, const uint8_t *report);
+extern bool my_hid_sched_lock(uint32_t wait_ms);
+extern void my_hid_sched_unlock(void);
+extern uint32_t my_hid_sched_queued(void);
+extern uint32_t my_hid_sched_retried(void);
+extern uint32_t my_hid_sched_dropped(void);
+
+#endif
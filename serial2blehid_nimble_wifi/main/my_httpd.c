@@ -48,14 +48,24 @@
 #endif  // !CONFIG_IDF_TARGET_LINUX
 
 #include "my_debug.h"
+#include "hid_func.h"
+#include "my_conn_policy.h"
+#include "my_frame_log.h"
+#include "my_frame_queue.h"
+#include "my_hid_bench.h"
+#include "my_hid_mbuf.h"
+#include "my_hid_program.h"
+#include "my_hid_sched.h"
 #include "my_httpd.h"
+#include "my_if_uart.h"
+#include "my_json_config.h"
+#include "my_latency.h"
+#include "my_reconnect.h"
 #include "my_ring_buffer.h"
+#include "my_trace.h"
 
-// リングバッファ
-extern my_ring_buffer_t rb;
-
-// リングバッファを初期化する
-extern bool my_ring_buffer_init(my_ring_buffer_t *rb, int size);
+// トレースの取り出し先。httpdのスタックに置くには大きいので静的に持つ
+static my_trace_record_t my_httpd_trace_buf[MY_TRACE_RECORDS];
 
 // 通信速度
 extern uint32_t my_if_uart_baud_rate;
@@ -68,7 +78,7 @@ extern const int my_if_uart_receive_buffer_len_min;
 extern const int my_if_uart_receive_buffer_len_max;
 
 // 受信開始のために送出するコマンド文字列
-extern char *my_if_uart_request_command;
+extern char my_if_uart_request_command[];
 
 // 送出するコマンド文字列の長さ
 extern int my_if_uart_request_command_len;
@@ -76,7 +86,7 @@ extern const int my_if_uart_request_command_len_min;
 extern const int my_if_uart_request_command_len_max;
 
 // 受信する末尾文字列
-extern char *my_if_uart_terminator_sequence;
+extern char my_if_uart_terminator_sequence[];
 
 // 受信する末尾文字列の長さ
 extern int my_if_uart_terminator_sequence_len;
@@ -84,7 +94,7 @@ extern const int my_if_uart_terminator_sequence_len_min;
 extern const int my_if_uart_terminator_sequence_len_max;
 
 // 受信した末尾文字列を、送信するときにこの内容に置換する
-extern char *my_if_uart_terminator_sequence_replace;
+extern char my_if_uart_terminator_sequence_replace[];
 
 // 置換文字列の長さ
 extern int my_if_uart_terminator_sequence_replace_len;
@@ -107,6 +117,12 @@ extern int my_softap_connected_cnt;
 
 #define EXAMPLE_HTTP_QUERY_KEY_MAX_LEN (64)
 
+// PUT /api/config で受け付ける本文の最大長
+#define MY_HTTPD_API_BODY_MAX (1024)
+
+// 送り方を切り替えるとき、HID送信タスクが1フレームを送り終わるのを待つ時間(ms)
+#define MY_HTTPD_SENDER_WAIT_MS (1000)
+
 static httpd_handle_t httpd_server = NULL;
 static const char *TAG_HTTPD = "httpd";
 
@@ -184,6 +200,10 @@ void my_httpd_show_config(httpd_req_t *req) {
     // 通信速度
     sprintf(buf, "Baud-Rate: %ld <br>\n", my_if_uart_baud_rate);
     httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    // 再起動せずに反映した回数
+    sprintf(buf, "Applied without restart: %lu <br>\n",
+            my_if_uart_config_applies());
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
     // 送信コマンド（１６進文字列で表示）
     httpd_resp_send_chunk(req, "TX-Command: ", HTTPD_RESP_USE_STRLEN);
     for (int i = 0; i < my_if_uart_request_command_len; i++) {
@@ -212,6 +232,33 @@ void my_httpd_show_config(httpd_req_t *req) {
     httpd_resp_send_chunk(req, "<br>\n ", HTTPD_RESP_USE_STRLEN);
 }
 
+/**
+ * @brief 変えた設定値を、GPIO/UART監視タスクに反映させる。再起動は要らない。
+ *        受信中のフレームがあれば、その後で反映される
+ * @param cfg 設定値
+ * @return 範囲外か、反映できず元の設定値に戻したらESP_FAIL
+ */
+static esp_err_t my_httpd_request_config(httpd_req_t *req,
+                                         const my_config_blob_t *cfg) {
+    int ret = my_if_uart_request_config(cfg, pdMS_TO_TICKS(1000));
+    if (ret == 1) {
+        httpd_resp_send_chunk(req, "out of range.\n", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+    if (ret == 3) {
+        httpd_resp_send_chunk(req,
+                              "can not apply. the previous config is kept.\n",
+                              HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+    if (ret == 2) {
+        httpd_resp_send_chunk(req,
+                              "will be applied after the current frame.\n",
+                              HTTPD_RESP_USE_STRLEN);
+    }
+    return ESP_OK;
+}
+
 //
 // URI アクセス時のハンドラ /////////////////////////////////////
 //
@@ -246,6 +293,96 @@ static esp_err_t my_httpd_home_get_handler(httpd_req_t *req) {
     sprintf(buf, "current connection count is %d <br>\n", con_cnt);
     httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
 
+    // UART受信の状態
+    sprintf(buf,
+            "uart rx: frames by terminator %lu, by idle %lu, timeout %lu, "
+            "fifo overflow %lu, buffer full %lu <br>\n",
+            my_if_uart_frames_terminated(), my_if_uart_frames_idle(),
+            my_if_uart_rx_timeouts(), my_if_uart_fifo_overflows(),
+            my_if_uart_buffer_overflows());
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+
+    // ポーリングの状態
+    const my_uart_poll_t *poll = my_if_uart_poll_state();
+    sprintf(buf,
+            "uart poll: period %lu ms (actual %lu ms), requests %lu, "
+            "responses %lu, rtt min/avg/max %lu / %lu / %lu us, retried %lu, "
+            "timeout %lu, late %lu <br>\n",
+            poll->period_us / 1000, my_uart_poll_period_us(poll) / 1000,
+            poll->requests, poll->responses, poll->rtt_min_us,
+            my_uart_poll_rtt_avg_us(poll), poll->rtt_max_us, poll->retries,
+            poll->timeouts, poll->late);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+
+    // HID送信待ちのフレームキューの状態
+    sprintf(buf,
+            "frame queue: depth %d / %d, max depth %d, pushed %lu, dropped "
+            "%lu <br>\n",
+            my_frame_queue_depth(), MY_FRAME_QUEUE_DEPTH,
+            my_frame_queue_max_depth(), my_frame_queue_pushed(),
+            my_frame_queue_dropped());
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+
+    // 送れないあいだに溜めたフレーム
+    sprintf(buf,
+            "offline backlog: frames %d, nvs segments %d, recorded %lu, "
+            "replayed %lu, spilled to nvs %lu, dropped %lu <br>\n",
+            my_frame_log_count(), my_frame_log_nvs_segments(),
+            my_frame_log_recorded(), my_frame_log_replayed(),
+            my_frame_log_spilled(), my_frame_log_dropped());
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+
+    // 変換済みレポートのプールの使用量
+    sprintf(buf, "report pool: used %d / %d <br>\n", my_hid_program_pool_used(),
+            MY_HID_PROGRAM_POOL_REPORTS);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+
+    // レポート送信の状態
+    sprintf(buf,
+            "report send: waited for credit %lu, retried %lu, dropped %lu "
+            "<br>\n",
+            my_hid_sched_queued(), my_hid_sched_retried(),
+            my_hid_sched_dropped());
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+
+    // 接続しているセントラルの数
+    sprintf(buf, "BLE centrals: connected %d / %d <br>\n", hid_conn_count(),
+            CONFIG_BT_NIMBLE_MAX_CONNECTIONS);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+
+    // レポートの送り方と専用mbufプール
+    sprintf(buf,
+            "report method: %s, mbuf pool free %d / %d, pool empty %lu "
+            "<br>\n",
+            hid_send_method_name(hid_get_send_method()), my_hid_mbuf_free_cnt(),
+            MY_HID_MBUF_COUNT, my_hid_mbuf_failed());
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+
+    // 接続パラメータの切り替えと再接続
+    httpd_resp_send_chunk(req,
+                          "connections: <a href='/conn'>parameters and "
+                          "reconnect</a> <br>\n",
+                          HTTPD_RESP_USE_STRLEN);
+
+    // 受信から送信完了までの時間
+    httpd_resp_send_chunk(req,
+                          "latency: <a href='/latency.json'>histograms</a> / "
+                          "<a href='/latency.json?reset=1'>read and reset</a> "
+                          "<br>\n",
+                          HTTPD_RESP_USE_STRLEN);
+
+    // まとめて読み書きするためのJSON API
+    httpd_resp_send_chunk(req,
+                          "api: <a href='/api/config'>config</a> (GET/PUT) / "
+                          "<a href='/api/stats'>stats</a> <br>\n",
+                          HTTPD_RESP_USE_STRLEN);
+
+    // トレース
+    httpd_resp_send_chunk(req,
+                          "trace: <a href='/trace'>text</a> / "
+                          "<a href='/trace.bin'>binary</a> <br>\n",
+                          HTTPD_RESP_USE_STRLEN);
+
     // serparator
     httpd_resp_send_chunk(req, "<br><hr><br>\n", HTTPD_RESP_USE_STRLEN);
 
@@ -355,6 +492,37 @@ static esp_err_t my_httpd_home_get_handler(httpd_req_t *req) {
     httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
     httpd_resp_send_chunk(req, "<br>\n", HTTPD_RESP_USE_STRLEN);
 
+    // レポートの送り方。再起動すると既定値(pool)に戻る
+    httpd_resp_send_chunk(req,
+                          "<form action='/sendmethod' method='post'>\n"
+                          "Report Send Method : \n"
+                          "<select name='sendmethod'>\n",
+                          HTTPD_RESP_USE_STRLEN);
+    for (int i = 0; i < SEND_METHOD_COUNT; i++) {
+        sprintf(buf, "<option value='%d'%s>%s</option>\n", i,
+                i == hid_get_send_method() ? " selected" : "",
+                hid_send_method_name(i));
+        httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    }
+    httpd_resp_send_chunk(req,
+                          "</select>\n"
+                          "<input type='submit'>\n"
+                          "</form>\n",
+                          HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, "<br>\n", HTTPD_RESP_USE_STRLEN);
+
+    // 送り方ごとの送信速度の測定
+    sprintf(buf,
+            "<form action='/hidbench' method='post'>\n"
+            "Report Send Benchmark (all methods, empty reports) : \n"
+            "<input type='text' name='count' value='200' size=10> reports "
+            "(max %d)\n"
+            "<input type='submit'>\n"
+            "</form>\n",
+            MY_HID_BENCH_REPORTS_MAX);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, "<br>\n", HTTPD_RESP_USE_STRLEN);
+
     // その他情報を変更するためのフォームを出力
 
     // serparator
@@ -459,14 +627,14 @@ static esp_err_t my_httpd_receive_buffer_length_post_handler(httpd_req_t *req) {
                 httpd_resp_send_chunk(req, buf3, HTTPD_RESP_USE_STRLEN);
                 err = ESP_FAIL;
             } else {
-                my_if_uart_receive_buffer_len = tmp;
+                my_config_blob_t cfg;
+                my_if_uart_collect_config(&cfg);
+                cfg.receive_buffer_len = tmp;
+                err = my_httpd_request_config(req, &cfg);
             }
         }
     }
 
-    // リングバッファのサイズを変更
-    my_ring_buffer_init(&rb, my_if_uart_receive_buffer_len);
-
     // 終了
     if (err == ESP_OK) {
         httpd_resp_send_chunk(req, "OK\n", HTTPD_RESP_USE_STRLEN);
@@ -554,16 +722,17 @@ static esp_err_t my_httpd_baud_rate_post_handler(httpd_req_t *req) {
                 httpd_resp_send_chunk(req, buf3, HTTPD_RESP_USE_STRLEN);
                 err = ESP_FAIL;
             } else {
-                my_if_uart_baud_rate = tmp;
+                my_config_blob_t cfg;
+                my_if_uart_collect_config(&cfg);
+                cfg.baud_rate = tmp;
+                err = my_httpd_request_config(req, &cfg);
             }
         }
     }
 
     // 終了
     if (err == ESP_OK) {
-        httpd_resp_send_chunk(
-            req, "OK. Please 'save' and restart to use new Baud-Rate.\n",
-            HTTPD_RESP_USE_STRLEN);
+        httpd_resp_send_chunk(req, "OK\n", HTTPD_RESP_USE_STRLEN);
     } else {
         httpd_resp_send_chunk(req, "NG\n", HTTPD_RESP_USE_STRLEN);
     }
@@ -628,12 +797,10 @@ static esp_err_t my_httpd_request_command_post_handler(httpd_req_t *req) {
         DEBUGPRINT("config decode query: %s\n", buf2);
         // 文字長がゼロなら空文字を作る
         if (strlen(buf2) == 0) {
-            my_if_uart_request_command_len = 0;
-            if ((my_if_uart_request_command = malloc(1)) == NULL) {
-                err = ESP_FAIL;
-            } else {
-                my_if_uart_request_command[0] = 0;
-            }
+            my_config_blob_t cfg;
+            my_if_uart_collect_config(&cfg);
+            cfg.request_command_len = 0;
+            err = my_httpd_request_config(req, &cfg);
         } else {
             int tmp = strlen(buf2);
             char buf3[100];
@@ -651,16 +818,15 @@ static esp_err_t my_httpd_request_command_post_handler(httpd_req_t *req) {
                 err = ESP_FAIL;
             } else {
                 // 16進文字列をchar配列に変換
-                my_if_uart_request_command_len = (int)((strlen(buf2) + 1) / 2);
-                if ((my_if_uart_request_command =
-                         malloc(my_if_uart_request_command_len)) == NULL) {
+                my_config_blob_t cfg;
+                my_if_uart_collect_config(&cfg);
+                cfg.request_command_len = (uint8_t)((strlen(buf2) + 1) / 2);
+                if (my_if_uart_str16_to_arr8(buf2, strlen(buf2),
+                                             (char *)cfg.request_command) !=
+                    0) {
                     err = ESP_FAIL;
                 } else {
-                    if (my_if_uart_str16_to_arr8(buf2, strlen(buf2),
-                                                 my_if_uart_request_command) !=
-                        0) {
-                        err = ESP_FAIL;
-                    }
+                    err = my_httpd_request_config(req, &cfg);
                 }
             }
         }
@@ -733,12 +899,10 @@ static esp_err_t my_httpd_terminator_sequence_post_handler(httpd_req_t *req) {
         DEBUGPRINT("config decode query: %s\n", buf2);
         // 文字長がゼロなら空文字を作る
         if (strlen(buf2) == 0) {
-            my_if_uart_terminator_sequence_len = 0;
-            if ((my_if_uart_terminator_sequence = malloc(1)) == NULL) {
-                err = ESP_FAIL;
-            } else {
-                my_if_uart_terminator_sequence[0] = 0;
-            }
+            my_config_blob_t cfg;
+            my_if_uart_collect_config(&cfg);
+            cfg.terminator_sequence_len = 0;
+            err = my_httpd_request_config(req, &cfg);
         } else {
             int tmp = strlen(buf2);
             char buf3[100];
@@ -758,17 +922,15 @@ static esp_err_t my_httpd_terminator_sequence_post_handler(httpd_req_t *req) {
                 err = ESP_FAIL;
             } else {
                 // 16進文字列をchar配列に変換
-                my_if_uart_terminator_sequence_len =
-                    (int)((strlen(buf2) + 1) / 2);
-                if ((my_if_uart_terminator_sequence =
-                         malloc(my_if_uart_terminator_sequence_len)) == NULL) {
+                my_config_blob_t cfg;
+                my_if_uart_collect_config(&cfg);
+                cfg.terminator_sequence_len = (uint8_t)((strlen(buf2) + 1) / 2);
+                if (my_if_uart_str16_to_arr8(buf2, strlen(buf2),
+                                             (char *)cfg.terminator_sequence) !=
+                    0) {
                     err = ESP_FAIL;
                 } else {
-                    if (my_if_uart_str16_to_arr8(
-                            buf2, strlen(buf2),
-                            my_if_uart_terminator_sequence) != 0) {
-                        err = ESP_FAIL;
-                    }
+                    err = my_httpd_request_config(req, &cfg);
                 }
             }
         }
@@ -842,12 +1004,10 @@ static esp_err_t my_httpd_terminator_sequence_replace_post_handler(
         DEBUGPRINT("config decode query: %s\n", buf2);
         // 文字長がゼロなら空文字を作る
         if (strlen(buf2) == 0) {
-            my_if_uart_terminator_sequence_replace_len = 0;
-            if ((my_if_uart_terminator_sequence_replace = malloc(1)) == NULL) {
-                err = ESP_FAIL;
-            } else {
-                my_if_uart_terminator_sequence_replace[0] = 0;
-            }
+            my_config_blob_t cfg;
+            my_if_uart_collect_config(&cfg);
+            cfg.terminator_sequence_replace_len = 0;
+            err = my_httpd_request_config(req, &cfg);
         } else {
             int tmp = strlen(buf2);
             char buf3[100];
@@ -867,17 +1027,16 @@ static esp_err_t my_httpd_terminator_sequence_replace_post_handler(
                 err = ESP_FAIL;
             } else {
                 // 16進文字列をchar配列に変換
-                my_if_uart_terminator_sequence_replace_len =
-                    (int)((strlen(buf2) + 1) / 2);
-                if ((my_if_uart_terminator_sequence_replace = malloc(
-                         my_if_uart_terminator_sequence_replace_len)) == NULL) {
+                my_config_blob_t cfg;
+                my_if_uart_collect_config(&cfg);
+                cfg.terminator_sequence_replace_len =
+                    (uint8_t)((strlen(buf2) + 1) / 2);
+                if (my_if_uart_str16_to_arr8(
+                        buf2, strlen(buf2),
+                        (char *)cfg.terminator_sequence_replace) != 0) {
                     err = ESP_FAIL;
                 } else {
-                    if (my_if_uart_str16_to_arr8(
-                            buf2, strlen(buf2),
-                            my_if_uart_terminator_sequence_replace) != 0) {
-                        err = ESP_FAIL;
-                    }
+                    err = my_httpd_request_config(req, &cfg);
                 }
             }
         }
@@ -992,6 +1151,528 @@ static esp_err_t my_httpd_shutdown_server_post_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+/**
+ * @brief POSTされたフォームの値を1つ取り出す
+ * @param req リクエスト
+ * @param key inputのname
+ * @param val 値が格納される。URLデコード済み
+ * @param val_size valの大きさ
+ * @return 取り出せなければESP_FAIL
+ */
+static esp_err_t my_httpd_recv_form_value(httpd_req_t *req, const char *key,
+                                          char *val, size_t val_size) {
+    char buf[100];
+    int ret;
+    int remaining = req->content_len;
+    while (remaining > 0) {
+        if ((ret = httpd_req_recv(req, buf,
+                                  MIN(remaining, sizeof(buf) - 1))) <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                continue;
+            }
+            return ESP_FAIL;
+        }
+        buf[ret] = '\0';
+        break;
+    }
+    if (remaining <= 0 ||
+        httpd_query_key_value(buf, key, val, val_size) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    my_httpd_url_decode_inner(val);
+    return ESP_OK;
+}
+
+/**
+ * @brief uriにより起動。レポートの送り方を切り替える
+ */
+static esp_err_t my_httpd_send_method_post_handler(httpd_req_t *req) {
+    // httpd通信の最終実行時刻を更新する
+    gettimeofday(&my_httpd_last_com_tv, NULL);
+
+    ESP_LOGI(TAG_HTTPD, "-> command: report send method");
+
+    esp_err_t err = ESP_OK;
+    char val[16];
+    char buf[100];
+
+    httpd_resp_send_chunk(req, "<!doctype html><html><body>\n",
+                          HTTPD_RESP_USE_STRLEN);
+    // フレームを送っている途中で送り方が変わらないよう、送り手になってから切り替える
+    if (my_httpd_recv_form_value(req, "sendmethod", val, sizeof(val)) !=
+            ESP_OK ||
+        !my_hid_sched_lock(MY_HTTPD_SENDER_WAIT_MS)) {
+        err = ESP_FAIL;
+    } else {
+        if (hid_set_send_method(atoi(val)) < 0) {
+            err = ESP_FAIL;
+        }
+        my_hid_sched_unlock();
+    }
+    if (err == ESP_OK) {
+        sprintf(buf, "OK. report send method is %s.\n",
+                hid_send_method_name(hid_get_send_method()));
+        httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    } else {
+        httpd_resp_send_chunk(req, "NG\n", HTTPD_RESP_USE_STRLEN);
+    }
+
+    // フッタを出力
+    httpd_resp_send_chunk(req, "<hr>\n", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, "<a href='/'>go to home</a>\n",
+                          HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, "</body></html>\n", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, NULL, 0);
+
+    return err;
+}
+
+/**
+ * @brief uriにより起動。全ての送り方で送信速度を測り、結果を表にする。
+ * BLE接続中で、UARTからの入力が無いときに使う
+ */
+static esp_err_t my_httpd_hid_bench_post_handler(httpd_req_t *req) {
+    // httpd通信の最終実行時刻を更新する
+    gettimeofday(&my_httpd_last_com_tv, NULL);
+
+    ESP_LOGI(TAG_HTTPD, "-> command: report send benchmark");
+
+    esp_err_t err = ESP_OK;
+    char val[16];
+    char buf[250];
+
+    httpd_resp_send_chunk(req, "<!doctype html><html><body>\n",
+                          HTTPD_RESP_USE_STRLEN);
+    int count = 0;
+    if (my_httpd_recv_form_value(req, "count", val, sizeof(val)) == ESP_OK) {
+        count = atoi(val);
+    }
+    for (int i = 0; i < SEND_METHOD_COUNT && err == ESP_OK; i++) {
+        if (!my_hid_bench_run(i, count)) {
+            err = ESP_FAIL;
+        }
+    }
+    if (err == ESP_OK) {
+        httpd_resp_send_chunk(
+            req,
+            "<table border=1>\n"
+            "<tr><th>method</th><th>reports</th><th>failed</th>"
+            "<th>time (ms)</th><th>reports/s</th><th>msys free before</th>"
+            "<th>msys free min</th><th>pool free min</th>"
+            "<th>heap delta (bytes)</th></tr>\n",
+            HTTPD_RESP_USE_STRLEN);
+        for (int i = 0; i < SEND_METHOD_COUNT; i++) {
+            const my_hid_bench_result_t *r = my_hid_bench_result(i);
+            sprintf(buf,
+                    "<tr><td>%s</td><td>%d</td><td>%d</td><td>%lu</td>"
+                    "<td>%lu</td><td>%d</td><td>%d</td><td>%d</td>"
+                    "<td>%ld</td></tr>\n",
+                    hid_send_method_name(i), r->reports, r->failed,
+                    r->elapsed_us / 1000, r->reports_per_sec,
+                    r->msys_free_before, r->msys_min_free, r->pool_min_free,
+                    r->heap_delta);
+            httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+        }
+        httpd_resp_send_chunk(req, "</table>\n", HTTPD_RESP_USE_STRLEN);
+    } else {
+        sprintf(buf,
+                "NG. count needs 1 to %d, and frames must not be waiting "
+                "to be sent.\n",
+                MY_HID_BENCH_REPORTS_MAX);
+        httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    }
+
+    // フッタを出力
+    httpd_resp_send_chunk(req, "<hr>\n", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, "<a href='/'>go to home</a>\n",
+                          HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, "</body></html>\n", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, NULL, 0);
+
+    return err;
+}
+
+/**
+ * @brief uriにより起動。トレースを古い順に1行ずつ文字列にして返す
+ */
+static esp_err_t my_httpd_trace_get_handler(httpd_req_t *req) {
+    // httpd通信の最終実行時刻を更新する
+    gettimeofday(&my_httpd_last_com_tv, NULL);
+
+    char buf[80];
+    int n = my_trace_snapshot(my_httpd_trace_buf, MY_TRACE_RECORDS);
+
+    httpd_resp_set_type(req, "text/plain");
+    sprintf(buf, "%d records, time_us seq event\n", n);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    for (int i = 0; i < n; i++) {
+        if (my_trace_format(&my_httpd_trace_buf[i], buf, sizeof(buf)) > 0) {
+            httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+        }
+    }
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+/**
+ * @brief uriにより起動。トレースを古い順にそのまま返す。
+ * 1件16バイト、リトルエンディアンの my_trace_record_t の並び
+ */
+static esp_err_t my_httpd_trace_bin_get_handler(httpd_req_t *req) {
+    // httpd通信の最終実行時刻を更新する
+    gettimeofday(&my_httpd_last_com_tv, NULL);
+
+    int n = my_trace_snapshot(my_httpd_trace_buf, MY_TRACE_RECORDS);
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    return httpd_resp_send(req, (const char *)my_httpd_trace_buf,
+                           n * sizeof(my_trace_record_t));
+}
+
+/**
+ * @brief 再接続にかかった時間を文字列にして送る
+ */
+static void my_httpd_send_reconnect(httpd_req_t *req) {
+    char buf[128];
+    my_reconnect_stats_t st;
+    my_reconnect_snapshot(&st);
+
+    sprintf(buf, "reconnect: %s after %s, stage %s%s, advertised %lu, "
+            "timeouts %lu\n",
+            st.active ? "waiting" : "connected",
+            my_reconnect_cause_name(st.cause),
+            my_reconnect_stage_name(st.stage),
+            st.whitelist ? " (white list)" : "", st.started, st.timeouts);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+
+    // 最後のきっかけからの時間の流れ
+    sprintf(buf, "timeline ms: directed %ld, fast %ld, slow %ld, "
+            "connected %ld\n",
+            (long)st.stage_at_ms[MY_RECONNECT_DIRECTED],
+            (long)st.stage_at_ms[MY_RECONNECT_FAST],
+            (long)st.stage_at_ms[MY_RECONNECT_SLOW], (long)st.connected_ms);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+
+    httpd_resp_send_chunk(req, "stage count min_ms avg_ms max_ms\n",
+                          HTTPD_RESP_USE_STRLEN);
+    for (int i = 0; i < MY_RECONNECT_STAGES; i++) {
+        const my_reconnect_stage_stats_t *s = &st.stages[i];
+        sprintf(buf, "%s %lu %lu %lu %lu\n", my_reconnect_stage_name(i),
+                s->count, s->min_ms, s->count ? s->sum_ms / s->count : 0,
+                s->max_ms);
+        httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    }
+}
+
+/**
+ * @brief uriにより起動。接続ごとの接続パラメータと、切り替えの判断、
+ *        再接続にかかった時間を文字列にして返す
+ */
+static esp_err_t my_httpd_conn_get_handler(httpd_req_t *req) {
+    // httpd通信の最終実行時刻を更新する
+    gettimeofday(&my_httpd_last_com_tv, NULL);
+
+    char buf[128];
+    my_conn_policy_conn_t conns[MY_CONN_POLICY_CONN_MAX];
+    my_conn_policy_decision_t decisions[MY_CONN_POLICY_DECISIONS];
+    int n = my_conn_policy_snapshot(conns, MY_CONN_POLICY_CONN_MAX);
+    int m = my_conn_policy_decisions(decisions, MY_CONN_POLICY_DECISIONS);
+
+    httpd_resp_set_type(req, "text/plain");
+#if CONFIG_MY_CONN_POLICY_ENABLE
+    sprintf(buf, "policy on, idle after %d ms, fast %d-%d lat %d, slow %d-%d "
+            "lat %d (1.25ms units)\n",
+            CONFIG_MY_CONN_POLICY_IDLE_MS, MY_CONN_POLICY_FAST_ITVL_MIN,
+            MY_CONN_POLICY_FAST_ITVL_MAX, MY_CONN_POLICY_FAST_LATENCY,
+            MY_CONN_POLICY_SLOW_ITVL_MIN, MY_CONN_POLICY_SLOW_ITVL_MAX,
+            MY_CONN_POLICY_SLOW_LATENCY);
+#else
+    sprintf(buf, "policy off, parameters are only recorded\n");
+#endif
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+
+    sprintf(buf, "%d connections, conn enc itvl latency timeout requested "
+            "pending fast slow rejected reports/event\n", n);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    for (int i = 0; i < n; i++) {
+        sprintf(buf, "%d %d %d %d %d %s %d %lu %lu %lu %d\n",
+                conns[i].conn_handle, conns[i].encrypted, conns[i].itvl,
+                conns[i].latency, conns[i].timeout,
+                my_conn_policy_mode_name(conns[i].requested), conns[i].pending,
+                conns[i].fast_requests, conns[i].slow_requests,
+                conns[i].rejected,
+                my_hid_sched_get_reports_per_event(conns[i].conn_handle));
+        httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    }
+
+    sprintf(buf, "%d decisions, time_ms conn event mode rc itvl latency\n", m);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    for (int i = 0; i < m; i++) {
+        sprintf(buf, "%lu %d %s %s %d %d %d\n", decisions[i].time_ms,
+                decisions[i].conn_handle,
+                decisions[i].event ? "updated" : "request",
+                my_conn_policy_mode_name(decisions[i].mode), decisions[i].rc,
+                decisions[i].itvl, decisions[i].latency);
+        httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    }
+
+    my_httpd_send_reconnect(req);
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+/**
+ * @brief uriにより起動。段ごとの時間のヒストグラムをJSONで返す。
+ * "?reset=1" を付けると、返した後にヒストグラムを空にする
+ */
+static esp_err_t my_httpd_latency_get_handler(httpd_req_t *req) {
+    // httpd通信の最終実行時刻を更新する
+    gettimeofday(&my_httpd_last_com_tv, NULL);
+
+    static my_latency_hist_t hists[MY_LATENCY_STAGES];
+    char buf[96];
+    char query[32];
+    char val[8];
+    bool reset = false;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "reset", val, sizeof(val)) == ESP_OK) {
+        reset = strcmp(val, "1") == 0;
+    }
+    my_latency_snapshot(hists);
+    if (reset) {
+        my_latency_reset();
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send_chunk(req, "{\"bounds_us\":[", HTTPD_RESP_USE_STRLEN);
+    for (int b = 0; b < MY_LATENCY_BUCKETS - 1; b++) {
+        sprintf(buf, "%s%lu", b ? "," : "", my_latency_bucket_bound(b));
+        httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    }
+    httpd_resp_send_chunk(req, "],\"stages\":[", HTTPD_RESP_USE_STRLEN);
+    for (int s = 0; s < MY_LATENCY_STAGES; s++) {
+        const my_latency_hist_t *h = &hists[s];
+        sprintf(buf,
+                "%s{\"name\":\"%s\",\"count\":%lu,\"min_us\":%lu,"
+                "\"avg_us\":%lu,",
+                s ? "," : "", my_latency_stage_name(s), h->count, h->min_us,
+                h->count ? (uint32_t)(h->sum_us / h->count) : 0);
+        httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+        sprintf(buf, "\"max_us\":%lu,\"buckets\":[", h->max_us);
+        httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+        for (int b = 0; b < MY_LATENCY_BUCKETS; b++) {
+            sprintf(buf, "%s%lu", b ? "," : "", h->buckets[b]);
+            httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+        }
+        httpd_resp_send_chunk(req, "]}", HTTPD_RESP_USE_STRLEN);
+    }
+    httpd_resp_send_chunk(req, "]}\n", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+/**
+ * @brief /api/ のエラーをJSONで返す
+ * @param error エラーの名前
+ * @param at 本文の何バイト目で見つけたか
+ */
+static esp_err_t my_httpd_api_error(httpd_req_t *req, const char *error,
+                                    uint32_t at) {
+    char buf[80];
+    httpd_resp_set_status(req, HTTPD_400);
+    httpd_resp_set_type(req, "application/json");
+    sprintf(buf, "{\"error\":\"%s\",\"at\":%lu}\n", error, at);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+/**
+ * @brief バイト列を16進文字列のJSONの値にして送る
+ */
+static void my_httpd_send_json_hex(httpd_req_t *req, const char *key,
+                                   const uint8_t *seq, int len) {
+    char buf[MY_CONFIG_BLOB_SEQ_MAX * 2 + 40];
+    char *p = buf + sprintf(buf, ",\"%s\":\"", key);
+    for (int i = 0; i < len; i++) {
+        p += sprintf(p, "%02x", seq[i]);
+    }
+    strcpy(p, "\"");
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+}
+
+/**
+ * @brief 設定値をJSONのオブジェクトにして送る。PUT /api/config にそのまま送り返せる
+ */
+static void my_httpd_send_config_json(httpd_req_t *req,
+                                      const my_config_blob_t *cfg) {
+    char buf[96];
+    sprintf(buf,
+            "{\"version\":%d,\"baud_rate\":%lu,\"receive_buffer_len\":%u",
+            MY_CONFIG_BLOB_VERSION, cfg->baud_rate, cfg->receive_buffer_len);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    my_httpd_send_json_hex(req, "request_command", cfg->request_command,
+                           cfg->request_command_len);
+    my_httpd_send_json_hex(req, "terminator_sequence", cfg->terminator_sequence,
+                           cfg->terminator_sequence_len);
+    my_httpd_send_json_hex(req, "terminator_sequence_replace",
+                           cfg->terminator_sequence_replace,
+                           cfg->terminator_sequence_replace_len);
+    httpd_resp_send_chunk(req, "}", HTTPD_RESP_USE_STRLEN);
+}
+
+/**
+ * @brief uriにより起動。設定値をまとめてJSONで返す
+ */
+static esp_err_t my_httpd_api_config_get_handler(httpd_req_t *req) {
+    // httpd通信の最終実行時刻を更新する
+    gettimeofday(&my_httpd_last_com_tv, NULL);
+
+    my_config_blob_t cfg;
+    my_if_uart_collect_config(&cfg);
+    httpd_resp_set_type(req, "application/json");
+    my_httpd_send_config_json(req, &cfg);
+    httpd_resp_send_chunk(req, "\n", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+/**
+ * @brief uriにより起動。JSONで受け取った設定値をまとめて反映する。
+ *        本文は届いた分ずつ読み、全てのキーが読めて範囲内のときだけ、1度に反映する。
+ *        書かなかったキーは今の値のまま。"save": true ならNVSにも保存する
+ */
+static esp_err_t my_httpd_api_config_put_handler(httpd_req_t *req) {
+    // httpd通信の最終実行時刻を更新する
+    gettimeofday(&my_httpd_last_com_tv, NULL);
+
+    char buf[64];
+    my_config_blob_t cfg;
+    my_json_config_t parser;
+    my_if_uart_collect_config(&cfg);
+    my_json_config_init(&parser, &cfg);
+
+    if (req->content_len > MY_HTTPD_API_BODY_MAX) {
+        return my_httpd_api_error(req, "too large", 0);
+    }
+    int remaining = req->content_len;
+    while (remaining > 0) {
+        int ret = httpd_req_recv(req, buf, MIN(remaining, sizeof(buf)));
+        if (ret <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                /* Retry receiving if timeout occurred */
+                continue;
+            }
+            return ESP_FAIL;
+        }
+        remaining -= ret;
+        // エラーが見つかったら、残りは読まない
+        if (my_json_config_feed(&parser, buf, ret) != MY_JSON_CONFIG_OK) {
+            break;
+        }
+    }
+    int result = my_json_config_finish(&parser);
+    if (result != MY_JSON_CONFIG_OK) {
+        ESP_LOGI(TAG_HTTPD, "api config: %s at %lu",
+                 my_json_config_result_name(result), parser.pos);
+        return my_httpd_api_error(req, my_json_config_result_name(result),
+                                  parser.pos);
+    }
+    int applied = my_if_uart_request_config(&cfg, pdMS_TO_TICKS(1000));
+    if (applied == 1) {
+        return my_httpd_api_error(req, "out of range", parser.pos);
+    }
+    // 反映できず元の設定値に戻したときは、保存もしない
+    if (applied == 3) {
+        return my_httpd_api_error(req, "can not apply", parser.pos);
+    }
+    bool saved = false;
+    if (parser.save) {
+        saved = my_if_uart_store_config(&cfg) == 0;
+    }
+    ESP_LOGI(TAG_HTTPD, "api config: applied %d, saved %d", applied == 0,
+             saved);
+
+    httpd_resp_set_type(req, "application/json");
+    sprintf(buf, "{\"applied\":%s,\"saved\":%s,\"config\":",
+            applied == 0 ? "true" : "false", saved ? "true" : "false");
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    my_httpd_send_config_json(req, &cfg);
+    httpd_resp_send_chunk(req, "}\n", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+/**
+ * @brief uriにより起動。動作中の数値をまとめてJSONで返す
+ */
+static esp_err_t my_httpd_api_stats_get_handler(httpd_req_t *req) {
+    // httpd通信の最終実行時刻を更新する
+    gettimeofday(&my_httpd_last_com_tv, NULL);
+
+    static my_latency_hist_t hists[MY_LATENCY_STAGES];
+    char buf[192];
+    my_latency_snapshot(hists);
+    const my_latency_hist_t *total = &hists[MY_LATENCY_TOTAL];
+    const my_uart_poll_t *poll = my_if_uart_poll_state();
+    my_reconnect_stats_t reconnect;
+    my_reconnect_snapshot(&reconnect);
+
+    httpd_resp_set_type(req, "application/json");
+    sprintf(buf,
+            "{\"uart\":{\"frames_terminated\":%lu,\"frames_idle\":%lu,"
+            "\"rx_timeouts\":%lu,\"fifo_overflows\":%lu,"
+            "\"buffer_overflows\":%lu,\"config_applies\":%lu,"
+            "\"stack_free\":%lu},",
+            my_if_uart_frames_terminated(), my_if_uart_frames_idle(),
+            my_if_uart_rx_timeouts(), my_if_uart_fifo_overflows(),
+            my_if_uart_buffer_overflows(), my_if_uart_config_applies(),
+            my_if_uart_stack_free());
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    sprintf(buf,
+            "\"poll\":{\"requests\":%lu,\"responses\":%lu,\"retries\":%lu,"
+            "\"timeouts\":%lu,\"late\":%lu,\"rtt_min_us\":%lu,"
+            "\"rtt_avg_us\":%lu,\"rtt_max_us\":%lu},",
+            poll->requests, poll->responses, poll->retries, poll->timeouts,
+            poll->late, poll->rtt_min_us, my_uart_poll_rtt_avg_us(poll),
+            poll->rtt_max_us);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    sprintf(buf,
+            "\"frame_queue\":{\"depth\":%d,\"max_depth\":%d,\"pushed\":%lu,"
+            "\"dropped\":%lu},",
+            my_frame_queue_depth(), my_frame_queue_max_depth(),
+            my_frame_queue_pushed(), my_frame_queue_dropped());
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    sprintf(buf,
+            "\"backlog\":{\"frames\":%d,\"recorded\":%lu,\"replayed\":%lu,"
+            "\"spilled\":%lu,\"dropped\":%lu},",
+            my_frame_log_count(), my_frame_log_recorded(),
+            my_frame_log_replayed(), my_frame_log_spilled(),
+            my_frame_log_dropped());
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    sprintf(buf,
+            "\"report\":{\"pool_used\":%d,\"queued\":%lu,\"retried\":%lu,"
+            "\"dropped\":%lu,\"mbuf_free\":%d,\"mbuf_failed\":%lu},",
+            my_hid_program_pool_used(), my_hid_sched_queued(),
+            my_hid_sched_retried(), my_hid_sched_dropped(),
+            my_hid_mbuf_free_cnt(), my_hid_mbuf_failed());
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    sprintf(buf,
+            "\"ble\":{\"connected\":%d,\"max\":%d,\"reconnect_ms\":%ld},",
+            hid_conn_count(), CONFIG_BT_NIMBLE_MAX_CONNECTIONS,
+            reconnect.connected_ms);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    sprintf(buf,
+            "\"latency\":{\"count\":%lu,\"min_us\":%lu,\"avg_us\":%lu,"
+            "\"max_us\":%lu}}\n",
+            total->count, total->min_us,
+            total->count ? (uint32_t)(total->sum_us / total->count) : 0,
+            total->max_us);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
 // uriごとの挙動
 static const httpd_uri_t my_httpd_uri_home_get = {
     .uri = "/",
@@ -1038,6 +1719,51 @@ static const httpd_uri_t my_httpd_uri_shutdown_server_post = {
     .method = HTTP_POST,
     .handler = my_httpd_shutdown_server_post_handler,
     .user_ctx = NULL};
+static const httpd_uri_t my_httpd_uri_send_method_post = {
+    .uri = "/sendmethod",
+    .method = HTTP_POST,
+    .handler = my_httpd_send_method_post_handler,
+    .user_ctx = NULL};
+static const httpd_uri_t my_httpd_uri_hid_bench_post = {
+    .uri = "/hidbench",
+    .method = HTTP_POST,
+    .handler = my_httpd_hid_bench_post_handler,
+    .user_ctx = NULL};
+static const httpd_uri_t my_httpd_uri_trace_get = {
+    .uri = "/trace",
+    .method = HTTP_GET,
+    .handler = my_httpd_trace_get_handler,
+    .user_ctx = NULL};
+static const httpd_uri_t my_httpd_uri_trace_bin_get = {
+    .uri = "/trace.bin",
+    .method = HTTP_GET,
+    .handler = my_httpd_trace_bin_get_handler,
+    .user_ctx = NULL};
+static const httpd_uri_t my_httpd_uri_latency_get = {
+    .uri = "/latency.json",
+    .method = HTTP_GET,
+    .handler = my_httpd_latency_get_handler,
+    .user_ctx = NULL};
+static const httpd_uri_t my_httpd_uri_api_config_get = {
+    .uri = "/api/config",
+    .method = HTTP_GET,
+    .handler = my_httpd_api_config_get_handler,
+    .user_ctx = NULL};
+static const httpd_uri_t my_httpd_uri_api_config_put = {
+    .uri = "/api/config",
+    .method = HTTP_PUT,
+    .handler = my_httpd_api_config_put_handler,
+    .user_ctx = NULL};
+static const httpd_uri_t my_httpd_uri_api_stats_get = {
+    .uri = "/api/stats",
+    .method = HTTP_GET,
+    .handler = my_httpd_api_stats_get_handler,
+    .user_ctx = NULL};
+static const httpd_uri_t my_httpd_uri_conn_get = {
+    .uri = "/conn",
+    .method = HTTP_GET,
+    .handler = my_httpd_conn_get_handler,
+    .user_ctx = NULL};
 
 /**
  * @brief httpサーバーを開始する
@@ -1048,7 +1774,7 @@ esp_err_t my_httpd_start_webserver(void) {
 
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.max_uri_handlers =
-        12;  // http_register_uri_handlerに登録できるURIの上限
+        20;  // http_register_uri_handlerに登録できるURIの上限
 #if CONFIG_IDF_TARGET_LINUX
     config.server_port = 8001;
 #else
@@ -1075,6 +1801,16 @@ esp_err_t my_httpd_start_webserver(void) {
         httpd_register_uri_handler(httpd_server, &my_httpd_uri_soft_reset_post);
         httpd_register_uri_handler(httpd_server,
                                    &my_httpd_uri_shutdown_server_post);
+        httpd_register_uri_handler(httpd_server,
+                                   &my_httpd_uri_send_method_post);
+        httpd_register_uri_handler(httpd_server, &my_httpd_uri_hid_bench_post);
+        httpd_register_uri_handler(httpd_server, &my_httpd_uri_trace_get);
+        httpd_register_uri_handler(httpd_server, &my_httpd_uri_trace_bin_get);
+        httpd_register_uri_handler(httpd_server, &my_httpd_uri_conn_get);
+        httpd_register_uri_handler(httpd_server, &my_httpd_uri_latency_get);
+        httpd_register_uri_handler(httpd_server, &my_httpd_uri_api_config_get);
+        httpd_register_uri_handler(httpd_server, &my_httpd_uri_api_config_put);
+        httpd_register_uri_handler(httpd_server, &my_httpd_uri_api_stats_get);
         return ESP_OK;
     }
 
@@ -2,8 +2,6 @@
  * @file my_if_uart.c
  */
 
-#define MYDEBUG 1
-
 #ifndef my_if_uart_c
 #define my_if_uart_c 1
 
@@ -13,17 +11,29 @@
 
 #include "driver/gpio.h"
 #include "driver/uart.h"
+#include "esp_attr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
+#include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "hid_codes.h"
+#include "my_config_blob.h"
 #include "my_debug.h"
+#include "my_frame_queue.h"
 #include "my_hid_key_map.h"
+#include "my_hid_program.h"
 #include "my_ring_buffer.h"
+#include "my_trace.h"
+#include "my_term_match.h"
+#include "my_uart_framer.h"
+#include "my_uart_poll.h"
 
 #define MY_IF_UART_NVS_NAME "A"
+// 設定をバイナリ形式で保存するキー。名前空間は MY_IF_UART_NVS_NAME
+#define MY_IF_UART_NVS_BLOB_KEY "cfg"
 // take care of strapping pins for rx, tx and trigger.
 #define MY_IF_UART_LED_NUMLOCK_PIN_GPIO (-1)
 #define MY_IF_UART_LED_CAPSLOCK_PIN_GPIO (-1)
@@ -40,10 +50,33 @@
 uint32_t my_if_uart_baud_rate = 4800;  // 1200, 2400, 4800, 9600 を選択可能
 const uint32_t my_if_uart_baud_rate_min = 1200;
 const uint32_t my_if_uart_baud_rate_max = 9600;
-#define MY_IF_UART_TASK_STACK_SIZE (2048)
+// GPIO/UART監視タスクのスタック。フレームと設定値のバッファは静的に置き、
+// 残りはESP_LOGxの書式化とUARTドライバの呼び出しに使う。
+// 実際の余裕は my_if_uart_stack_free() で見られる
+#define MY_IF_UART_TASK_STACK_SIZE (3072)
+// スタックの残りがこれより少なくなったら警告する(bytes)
+#define MY_IF_UART_TASK_STACK_MARGIN (512)
 #define MY_IF_UART_BUF_SIZE (1024)
+#define MY_IF_UART_EVENT_QUEUE_LEN (20)
 #define MY_IF_UART_TAG "IF_UART"
 
+// トリガーピンのチャタリングとみなす時間(ms)。この間の立ち上がりは無視する
+#define MY_IF_UART_TRIGGER_DEBOUNCE_MS (30)
+
+// リクエスト後、終端文字列まで受信するのを待つ時間(ms)。
+// 以前の「50ms受信＋100ms待ち」を3回、と同じ長さ
+#define MY_IF_UART_RESPONSE_TIMEOUT_MS (450)
+
+// 受信が途切れてから、ドライバがUART_DATAを知らせるまでの時間（1バイト送る時間単位）。
+// 既定の10だと、4800bpsでは最後のバイトから23ms遅れる
+#define MY_IF_UART_RX_TOUT_SYMBOLS (2)
+
+// この数だけFIFOに溜まったら、途切れを待たずにUART_DATAを知らせる
+#define MY_IF_UART_RX_FULL_THRESH (16)
+
+// UARTドライバから一度に読み出す最大バイト数。受信バッファサイズの上限以上にすること
+#define MY_IF_UART_READ_LEN (128)
+
 // リングバッファ
 my_ring_buffer_t rb;
 
@@ -53,35 +86,110 @@ const int my_if_uart_receive_buffer_len_min = 15;
 const int my_if_uart_receive_buffer_len_max = 99;
 
 // 受信開始のために送出するコマンド文字列
-char *my_if_uart_request_command;
+char my_if_uart_request_command[MY_CONFIG_BLOB_SEQ_MAX];
 
 // 送出するコマンドの長さ
 int my_if_uart_request_command_len = 0;
 const int my_if_uart_request_command_len_min = 0;
-const int my_if_uart_request_command_len_max = 40;
+const int my_if_uart_request_command_len_max = MY_CONFIG_BLOB_SEQ_MAX;
 
 // 受信する末尾文字列
-char *my_if_uart_terminator_sequence;
+char my_if_uart_terminator_sequence[MY_CONFIG_BLOB_SEQ_MAX];
 
 // 受信する末尾文字列の長さ
 int my_if_uart_terminator_sequence_len = 0;
 const int my_if_uart_terminator_sequence_len_min = 0;
-const int my_if_uart_terminator_sequence_len_max = 40;
+const int my_if_uart_terminator_sequence_len_max = MY_CONFIG_BLOB_SEQ_MAX;
 
 // 受信した末尾文字列を、送信するときにこの内容に置換する
-char *my_if_uart_terminator_sequence_replace;
+char my_if_uart_terminator_sequence_replace[MY_CONFIG_BLOB_SEQ_MAX];
 
 // 置換文字列の長さ
 int my_if_uart_terminator_sequence_replace_len = 0;
 const int my_if_uart_terminator_sequence_replace_len_min = 0;
-const int my_if_uart_terminator_sequence_replace_len_max = 40;
+const int my_if_uart_terminator_sequence_replace_len_max = MY_CONFIG_BLOB_SEQ_MAX;
+
+// 受信がこの時間(ms)途切れたら、フレームの終わりとみなす。ゼロなら途切れでは区切らない
+uint32_t my_if_uart_rx_idle_ms = CONFIG_MY_IF_UART_RX_IDLE_MS;
+const uint32_t my_if_uart_rx_idle_ms_min = 0;
+const uint32_t my_if_uart_rx_idle_ms_max = 1000;
+
+// リクエストコマンドを送る周期(ms)。ゼロならトリガー1回につき1回送る。
+// ゼロでなければ、トリガーでポーリングの開始・停止を切り替える
+uint32_t my_if_uart_poll_period_ms = CONFIG_MY_IF_UART_POLL_PERIOD_MS;
+const uint32_t my_if_uart_poll_period_ms_min = 0;
+const uint32_t my_if_uart_poll_period_ms_max = 60000;
+
+// 連続受信モード。trueなら、トリガーを待たずに受信し続ける。起動時に決まる
+#ifdef CONFIG_MY_IF_UART_STREAMING
+bool my_if_uart_streaming = true;
+#else
+bool my_if_uart_streaming = false;
+#endif
 
 // UARTで受信した値を格納するバッファを排他制御する
 SemaphoreHandle_t my_if_uart_buffer_semaphore = NULL;
 
-// main.cで参照するための、リングバッファのコピー。末端置換を行うので少し大きめに確保
+// HID送信タスクに渡す前の、リングバッファのコピー。末端置換を行うので少し大きめに確保
 uint8_t *my_if_uart_buffer = NULL;
 
+// GPIO/UART監視タスク。トリガーピンの割り込みから通知する
+static TaskHandle_t my_if_uart_task_handle = NULL;
+
+// UARTドライバのイベントキュー。受信があるとUART_DATAが届く
+static QueueHandle_t my_if_uart_event_queue = NULL;
+
+// 最後にトリガーピンが立ち上がった時刻(us)
+static volatile int64_t my_if_uart_trigger_edge_us = 0;
+
+// Webから変えた設定値を、GPIO/UART監視タスクへ渡すキュー。長さ1で、新しい方で上書きする
+static QueueHandle_t my_if_uart_config_queue = NULL;
+
+// GPIO/UART監視タスクが設定値を反映し終えたことを、依頼した側へ知らせる
+static SemaphoreHandle_t my_if_uart_config_applied = NULL;
+
+// 最後に反映した結果。ゼロなら成功、それ以外は反映できず元の設定値に戻した。
+// my_if_uart_config_applied を渡す前に書く
+static volatile int my_if_uart_config_result = 0;
+
+// 連続受信モードで、UARTのイベントと設定値の両方を待つキューセット。
+// セットに入れたキューは、セットから選ばれた後でだけ読む
+static QueueSetHandle_t my_if_uart_queue_set = NULL;
+
+// 連続受信モードで、設定値のキューがセットから選ばれ、まだ読んでいない
+static bool my_if_uart_config_selected = false;
+
+// 設定値を反映した回数
+static volatile uint32_t my_if_uart_config_apply_cnt = 0;
+
+// 受信データから終端文字列を見つける照合器。受信サイクルごとに設定値から作り直す
+static my_term_match_t my_if_uart_term_match;
+// 設定できる終端文字列は、どんな文字の並びでも照合器にできる
+_Static_assert(MY_TERM_MATCH_STATES_MAX > MY_CONFIG_BLOB_SEQ_MAX &&
+                   MY_TERM_MATCH_CLASSES_MAX > MY_CONFIG_BLOB_SEQ_MAX,
+               "terminator of MY_CONFIG_BLOB_SEQ_MAX bytes must compile");
+
+// 受信データをフレームに区切る
+static my_uart_framer_t my_if_uart_framer;
+
+// ポーリングの予定と応答時間の統計
+static my_uart_poll_t my_if_uart_poll;
+
+// UARTのハードウェアFIFOが溢れた回数
+static volatile uint32_t my_if_uart_fifo_ovf_cnt = 0;
+
+// UARTドライバの受信バッファが溢れた回数
+static volatile uint32_t my_if_uart_buffer_full_cnt = 0;
+
+// 応答を待つ時間内にフレームが区切れなかった回数
+static volatile uint32_t my_if_uart_rx_timeout_cnt = 0;
+
+// UARTドライバから読み出すバッファ。GPIO/UART監視タスクだけが使う
+static uint8_t my_if_uart_read_buf[MY_IF_UART_READ_LEN];
+
+// これまでのGPIO/UART監視タスクのスタックの残りの最小値(bytes)。まだ測っていなければゼロ
+static volatile uint32_t my_if_uart_stack_free_min = 0;
+
 // テスト等でUART接続先が無い場合、受信したことにするダミーコードへ分岐するフラグ。1:ダミーコード。0:本番
 #define MY_IF_UART_NO_UART 0
 
@@ -91,15 +199,15 @@ uint8_t *my_if_uart_buffer = NULL;
  * @param buf[]
  * 16進表記の文字列。文字数が奇数の場合、一番右の8ビット値は上位４ビットのみが保障される。
  * @param buf_len 16進表記文字列の長さ
- * @param out_arr[] 8ビットずつの配列
+ * @param out_arr[] 8ビットずつの配列。(buf_len + 1) / 2 バイト書き込む
  * @return 成功したらゼロ
  */
 int my_if_uart_str16_to_arr8(char buf[], int buf_len, char out_arr[]) {
     char *lastp;
     char buf2[3] = {0, 0, 0};
     int idx = 0;
-    for (int i = 0; i < buf_len; i++) {
-        if (i + 1 < buf_len) {
+    for (int i = 0; 2 * i < buf_len; i++) {
+        if (2 * i + 1 < buf_len) {
             buf2[0] = buf[2 * i];
             buf2[1] = buf[2 * i + 1];
         } else {
@@ -114,189 +222,87 @@ int my_if_uart_str16_to_arr8(char buf[], int buf_len, char out_arr[]) {
 
 /**
  * @brief
- * １つの文字列を分解して各設定に格納する
- * @param buf[]
- * 設定がパックされている文字列。処理によりこの文字列は破壊されるため、困る場合はコピーを渡すこと。
- * @return 成功したらゼロ
+ * 設定値の範囲を調べる
+ * @param cfg 設定値
+ * @return 全て範囲内ならゼロ
  */
-int my_if_uart_unpack_config(char buf[]) {
-    char *p, *p2, *token;
-    uint32_t tmp;
-    // 分解開始
-    p = buf;
-    // 受信バッファサイズ
-    token = strsep(&p, ",");
-    if (*token == '\0') {
-        // 長さゼロ
+int my_if_uart_check_config(const my_config_blob_t *cfg) {
+    if (cfg->receive_buffer_len < my_if_uart_receive_buffer_len_min ||
+        cfg->receive_buffer_len > my_if_uart_receive_buffer_len_max) {
         ESP_LOGI(MY_IF_UART_TAG,
-                 "Receive Buffer Size : < none >, Not available");
+                 "Receive Buffer Size : %u is out of %d .. %d. Not available",
+                 cfg->receive_buffer_len, my_if_uart_receive_buffer_len_min,
+                 my_if_uart_receive_buffer_len_max);
         return 1;
-    } else {
-        tmp = strtol(token, &p2, 10);
-        if (tmp < my_if_uart_receive_buffer_len_min) {
-            // 規定サイズ未満
-            ESP_LOGI(MY_IF_UART_TAG,
-                     "Receive Buffer Size : %lu is less than %d. Not available",
-                     tmp, my_if_uart_receive_buffer_len_min);
-            return 1;
-        } else if (tmp > my_if_uart_receive_buffer_len_max) {
-            // 規定サイズ越え
-            ESP_LOGI(
-                MY_IF_UART_TAG,
-                "Receive Buffer Size : %lu is greater than %d. Not available",
-                tmp, my_if_uart_receive_buffer_len_max);
-            return 1;
-        } else {
-            my_if_uart_receive_buffer_len = tmp;
-            ESP_LOGI(MY_IF_UART_TAG, "Receive Buffer Size : %s -> %d", token,
-                     my_if_uart_receive_buffer_len);
-        }
     }
-    // 通信速度
-    token = strsep(&p, ",");
-    if (*token == '\0') {
-        // 長さゼロ
-        ESP_LOGI(MY_IF_UART_TAG, "Baud Rate : < none >, Not available");
+    if (cfg->baud_rate < my_if_uart_baud_rate_min ||
+        cfg->baud_rate > my_if_uart_baud_rate_max) {
+        ESP_LOGI(MY_IF_UART_TAG,
+                 "Baud Rate : %lu is out of %lu .. %lu. Not available",
+                 cfg->baud_rate, my_if_uart_baud_rate_min,
+                 my_if_uart_baud_rate_max);
         return 1;
-    } else {
-        tmp = strtol(token, &p2, 10);
-        if (tmp < my_if_uart_baud_rate_min) {
-            // 規定速度未満
-            ESP_LOGI(MY_IF_UART_TAG,
-                     "Baud Rate : %lu is less than %lu. Not available", tmp,
-                     my_if_uart_baud_rate_min);
-            return 1;
-        } else if (tmp > my_if_uart_baud_rate_max) {
-            // 規定速度超え
-            ESP_LOGI(MY_IF_UART_TAG,
-                     "Baud Rate : %lu is greater than %lu. Not available", tmp,
-                     my_if_uart_baud_rate_max);
-            return 1;
-        } else {
-            my_if_uart_baud_rate = tmp;
-            ESP_LOGI(MY_IF_UART_TAG, "Baud Rate: %s -> %lu", token,
-                     my_if_uart_baud_rate);
-        }
-    }
-    // 送信コマンド。16進文字列になっているものを、8ビット配列にする
-    char *buf8;
-    token = strsep(&p, ",");
-    if (*token == '\0') {
-        // 長さゼロ
-        ESP_LOGI(MY_IF_UART_TAG, "Request Command : < none >");
-        my_if_uart_request_command_len = 0;
-        free(my_if_uart_request_command);
-        my_if_uart_request_command = malloc(1);
-        my_if_uart_request_command[0] = 0;  // 空文字
-    } else {
-        tmp = (int)((strlen(token) + 1) / 2);
-        if (tmp < my_if_uart_request_command_len_min) {
-            // 規定サイズ未満
-            ESP_LOGI(MY_IF_UART_TAG,
-                     "Receive Buffer Size : %lu is less than %d. Not available",
-                     tmp, my_if_uart_request_command_len_min);
-            return 1;
-        } else if (tmp > my_if_uart_request_command_len_max) {
-            // 規定サイズ越え
-            ESP_LOGI(
-                MY_IF_UART_TAG,
-                "Receive Buffer Size : %lu is greater than %d. Not available",
-                tmp, my_if_uart_request_command_len_max);
-            return 1;
-        } else {
-            if ((buf8 = malloc(tmp)) == NULL) return 1;
-            if (my_if_uart_str16_to_arr8(token, strlen(token), buf8) != 0) {
-                free(buf8);
-                return 1;
-            }
-            free(my_if_uart_request_command);
-            my_if_uart_request_command = buf8;
-            my_if_uart_request_command_len = tmp;
-            ESP_LOGI(MY_IF_UART_TAG, "Request Command : %s -> %s(%d)", token,
-                     my_if_uart_request_command,
-                     my_if_uart_request_command_len);
-        }
     }
-    // 受信ターミネータ。16進文字列になっているものを、8ビット配列にする
-    token = strsep(&p, ",");
-    if (*token == '\0') {
-        // 長さゼロ
-        ESP_LOGI(MY_IF_UART_TAG, "Receive Terminator : < none >");
-        my_if_uart_terminator_sequence_len = 0;
-        free(my_if_uart_terminator_sequence);
-        my_if_uart_terminator_sequence = malloc(1);
-        my_if_uart_terminator_sequence[0] = 0;  // 空文字
-    } else {
-        tmp = (int)((strlen(token) + 1) / 2);
-        if (tmp < my_if_uart_terminator_sequence_len_min) {
-            // 規定サイズ未満
-            ESP_LOGI(MY_IF_UART_TAG,
-                     "Terminator Size : %lu is less than %d. Not available",
-                     tmp, my_if_uart_terminator_sequence_len_min);
-            return 1;
-        } else if (tmp > my_if_uart_terminator_sequence_len_max) {
-            // 規定サイズ超え
-            ESP_LOGI(MY_IF_UART_TAG,
-                     "Terminator Size : %lu is greater than %d. Not available",
-                     tmp, my_if_uart_terminator_sequence_len_max);
-            return 1;
-        } else {
-            if ((buf8 = malloc(tmp)) == NULL) return 1;
-            if (my_if_uart_str16_to_arr8(token, strlen(token), buf8) != 0) {
-                free(buf8);
-                return 1;
-            }
-            free(my_if_uart_terminator_sequence);
-            my_if_uart_terminator_sequence = buf8;
-            my_if_uart_terminator_sequence_len = tmp;
-            ESP_LOGI(MY_IF_UART_TAG, "Receive Terminator : %s -> %s(%d)", token,
-                     my_if_uart_terminator_sequence,
-                     my_if_uart_terminator_sequence_len);
-        }
+    if (cfg->request_command_len > my_if_uart_request_command_len_max ||
+        cfg->terminator_sequence_len > my_if_uart_terminator_sequence_len_max ||
+        cfg->terminator_sequence_replace_len >
+            my_if_uart_terminator_sequence_replace_len_max) {
+        ESP_LOGI(MY_IF_UART_TAG, "Sequence Size : greater than %d. Not available",
+                 MY_CONFIG_BLOB_SEQ_MAX);
+        return 1;
     }
-    // 受信ターミネータの変換先。16進文字列になっているものを、8ビット配列にする
-    token = strsep(&p, ",");
-    if (*token == '\0') {
-        // 長さゼロ
-        ESP_LOGI(MY_IF_UART_TAG, "Receive Terminator Replace : < none >");
-        my_if_uart_terminator_sequence_replace_len = 0;
-        free(my_if_uart_terminator_sequence_replace);
-        my_if_uart_terminator_sequence_replace = malloc(1);
-        my_if_uart_terminator_sequence_replace[0] = 0;  // 空文字
-    } else {
-        tmp = (int)((strlen(token) + 1) / 2);
-        if (tmp < my_if_uart_terminator_sequence_replace_len_min) {
-            // 規定サイズ未満
-            ESP_LOGI(
-                MY_IF_UART_TAG,
-                "Terminator Replace Size : %lu is less than %d. Not available",
-                tmp, my_if_uart_terminator_sequence_replace_len_min);
-            return 1;
-        } else if (tmp > my_if_uart_terminator_sequence_replace_len_max) {
-            // 規定サイズ超え
-            ESP_LOGI(MY_IF_UART_TAG,
-                     "Terminator Replace Size : %lu is greater than %d. Not "
-                     "available",
-                     tmp, my_if_uart_terminator_sequence_replace_len_min);
-            return 1;
-        } else {
-            if ((buf8 = malloc(tmp)) == NULL) return 1;
-            if (my_if_uart_str16_to_arr8(token, strlen(token), buf8) != 0) {
-                free(buf8);
-                return 1;
-            }
-            free(my_if_uart_terminator_sequence_replace);
-            my_if_uart_terminator_sequence_replace = buf8;
-            my_if_uart_terminator_sequence_replace_len = tmp;
-            ESP_LOGI(MY_IF_UART_TAG,
-                     "Receive Terminator Replace : %s -> %s(%d)", token,
-                     my_if_uart_terminator_sequence_replace,
-                     my_if_uart_terminator_sequence_replace_len);
-        }
+    return 0;
+}
+
+/**
+ * @brief
+ * 設定値の範囲を調べ、全て範囲内なら各変数に格納する。１つでも範囲外なら何も変えない
+ * @param cfg 設定値
+ * @return 成功したらゼロ
+ */
+int my_if_uart_apply_config(const my_config_blob_t *cfg) {
+    if (my_if_uart_check_config(cfg) != 0) {
+        return 1;
     }
+    my_if_uart_receive_buffer_len = cfg->receive_buffer_len;
+    my_if_uart_baud_rate = cfg->baud_rate;
+    memcpy(my_if_uart_request_command, cfg->request_command,
+           cfg->request_command_len);
+    my_if_uart_request_command_len = cfg->request_command_len;
+    memcpy(my_if_uart_terminator_sequence, cfg->terminator_sequence,
+           cfg->terminator_sequence_len);
+    my_if_uart_terminator_sequence_len = cfg->terminator_sequence_len;
+    memcpy(my_if_uart_terminator_sequence_replace,
+           cfg->terminator_sequence_replace,
+           cfg->terminator_sequence_replace_len);
+    my_if_uart_terminator_sequence_replace_len =
+        cfg->terminator_sequence_replace_len;
     return 0;
 }
 
+/**
+ * @brief
+ * 各変数の現在値を設定値にまとめる
+ * @param[out] cfg 設定値
+ */
+void my_if_uart_collect_config(my_config_blob_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->version = MY_CONFIG_BLOB_VERSION;
+    cfg->baud_rate = my_if_uart_baud_rate;
+    cfg->receive_buffer_len = (uint16_t)my_if_uart_receive_buffer_len;
+    cfg->request_command_len = (uint8_t)my_if_uart_request_command_len;
+    memcpy(cfg->request_command, my_if_uart_request_command,
+           cfg->request_command_len);
+    cfg->terminator_sequence_len = (uint8_t)my_if_uart_terminator_sequence_len;
+    memcpy(cfg->terminator_sequence, my_if_uart_terminator_sequence,
+           cfg->terminator_sequence_len);
+    cfg->terminator_sequence_replace_len =
+        (uint8_t)my_if_uart_terminator_sequence_replace_len;
+    memcpy(cfg->terminator_sequence_replace,
+           my_if_uart_terminator_sequence_replace,
+           cfg->terminator_sequence_replace_len);
+}
+
 /**
  * @brief
  * 各設定のパック後の文字列長の最大値
@@ -393,78 +399,136 @@ int my_if_uart_pack_config(char buf[]) {
 
 /**
  * @brief
- * 設定値をNVSから読み出して各変数に格納する
+ * 渡した設定値をバイナリ形式にまとめて保存する。各変数は変えない
+ * @param cfg 設定値
  * @return 成功したらゼロ
  */
-int my_if_uart_get_config() {
-    size_t len;
+int my_if_uart_store_config(const my_config_blob_t *cfg) {
+    uint8_t buf[MY_CONFIG_BLOB_MAX_LEN];
+    int len = my_config_blob_encode(cfg, buf, sizeof(buf));
+    if (len < 0) {
+        return 1;
+    }
+    // まとめたバイト列を保存
     esp_err_t err;
     nvs_handle_t handle;
     // open
     err = nvs_open(MY_IF_UART_NVS_NAME, NVS_READWRITE, &handle);
-    if (err != ESP_OK) return err;
+    if (err != ESP_OK) return 1;
+    // store
+    DEBUGPRINT("NVS STORE CONFIG: %s, %d byte\n", MY_IF_UART_NVS_BLOB_KEY, len);
+    err = nvs_set_blob(handle, MY_IF_UART_NVS_BLOB_KEY, buf, len);
+    if (err != ESP_OK) {
+        nvs_close(handle);
+        return 1;
+    }
+    // commit
+    err = nvs_commit(handle);
+    if (err != ESP_OK) {
+        nvs_close(handle);
+        return 1;
+    }
+    // close
+    nvs_close(handle);
+    return 0;
+}
+
+/**
+ * @brief
+ * 設定値をバイナリ形式にまとめて保存する
+ * @return 成功したらゼロ
+ */
+int my_if_uart_set_config() {
+    my_config_blob_t cfg;
+    my_if_uart_collect_config(&cfg);
+    return my_if_uart_store_config(&cfg);
+}
+
+/**
+ * @brief
+ * 旧形式（カンマ区切りの文字列）で保存された設定を読み出し、新しい形式で保存しなおす。
+ * 保存しなおせたら旧形式は消す
+ * @param handle 開いているNVSのハンドル
+ * @return 成功したらゼロ
+ */
+static int my_if_uart_migrate_config(nvs_handle_t handle) {
+    size_t len;
+    esp_err_t err;
+    my_config_blob_t cfg;
     // get size, include the '\0' terminator.
     err = nvs_get_str(handle, MY_IF_UART_NVS_NAME, 0, &len);
     if (err != ESP_OK) {
-        ESP_LOGI(MY_IF_UART_TAG, "read nvs: fail to open");
-        nvs_close(handle);
+        ESP_LOGI(MY_IF_UART_TAG, "read nvs: no config");
         return err;
     }
     char buf[len];
     // load
-    DEBUGPRINT("NVS LOAD CONFIG: %s, %d byte\n", MY_IF_UART_NVS_NAME, len);
+    DEBUGPRINT("NVS LOAD LEGACY CONFIG: %s, %d byte\n", MY_IF_UART_NVS_NAME,
+               len);
     err = nvs_get_str(handle, MY_IF_UART_NVS_NAME, buf, &len);
     if (err != ESP_OK) {
         ESP_LOGI(MY_IF_UART_TAG, "read nvs: fail to read string");
-        nvs_close(handle);
         return err;
     }
-    // close
-    nvs_close(handle);
-    ESP_LOGI(MY_IF_UART_TAG, "data has read : %s", buf);
+    ESP_LOGI(MY_IF_UART_TAG, "legacy data has read : %s", buf);
     // アンパックする
-    if (my_if_uart_unpack_config(buf) != 0) {
-        ESP_LOGI(MY_IF_UART_TAG, "read nvs: unpack fail");
+    int ret = my_config_blob_decode_legacy(buf, &cfg);
+    if (ret != MY_CONFIG_BLOB_OK || my_if_uart_apply_config(&cfg) != 0) {
+        ESP_LOGI(MY_IF_UART_TAG, "read nvs: unpack fail (%s)",
+                 my_config_blob_result_name(ret));
         return 1;
     }
+    // 新しい形式で保存しなおし、旧形式を消す
+    if (my_if_uart_set_config() == 0) {
+        nvs_erase_key(handle, MY_IF_UART_NVS_NAME);
+        nvs_commit(handle);
+        ESP_LOGI(MY_IF_UART_TAG, "legacy config migrated");
+    }
     return 0;
 }
 
 /**
  * @brief
- * 設定値を１行の文字列にまとめて保存する
+ * 設定値をNVSから読み出して各変数に格納する。
+ * 新しい形式が無く、旧形式があれば、旧形式を読み出して新しい形式に移す
  * @return 成功したらゼロ
  */
-int my_if_uart_set_config() {
-    int len = my_if_uart_get_pack_config_len();
-    char buf[len];
-    // パックした文字列を取得
-    if (my_if_uart_pack_config(buf) != 0) {
-        return 1;
-    }
-    ESP_LOGI(MY_IF_UART_TAG, "data to write : %s", buf);
-    // パックした文字列を保存
+int my_if_uart_get_config() {
+    size_t len = MY_CONFIG_BLOB_READ_MAX;
+    uint8_t buf[MY_CONFIG_BLOB_READ_MAX];
+    my_config_blob_t cfg;
     esp_err_t err;
     nvs_handle_t handle;
     // open
     err = nvs_open(MY_IF_UART_NVS_NAME, NVS_READWRITE, &handle);
-    if (err != ESP_OK) return 1;
-    // store
-    DEBUGPRINT("NVS STORE CONFIG: %s, %d byte\n", MY_IF_UART_NVS_NAME,
-               strlen(buf));
-    err = nvs_set_str(handle, MY_IF_UART_NVS_NAME, buf);
-    if (err != ESP_OK) {
+    if (err != ESP_OK) return err;
+    // load
+    err = nvs_get_blob(handle, MY_IF_UART_NVS_BLOB_KEY, buf, &len);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        err = my_if_uart_migrate_config(handle);
         nvs_close(handle);
-        return 1;
+        return err;
     }
-    // commit
-    nvs_commit(handle);
+    // close
+    nvs_close(handle);
     if (err != ESP_OK) {
-        nvs_close(handle);
+        ESP_LOGI(MY_IF_UART_TAG, "read nvs: fail to read blob %d", err);
+        return err;
+    }
+    DEBUGPRINT("NVS LOAD CONFIG: %s, %d byte\n", MY_IF_UART_NVS_BLOB_KEY, len);
+    // 復号する
+    int ret = my_config_blob_decode(buf, (int)len, &cfg);
+    if (ret != MY_CONFIG_BLOB_OK) {
+        ESP_LOGI(MY_IF_UART_TAG, "read nvs: decode fail (%s)",
+                 my_config_blob_result_name(ret));
         return 1;
     }
-    // close
-    nvs_close(handle);
+    if (my_if_uart_apply_config(&cfg) != 0) {
+        ESP_LOGI(MY_IF_UART_TAG, "read nvs: config out of range");
+        return 1;
+    }
+    ESP_LOGI(MY_IF_UART_TAG, "data has read : version %u, %d byte",
+             cfg.version, len);
     return 0;
 }
 
@@ -491,6 +555,149 @@ int my_if_uart_reset_buffer() {
     }
 }
 
+/**
+ * @brief GPIO/UART監視タスクのスタックの残りを測り、最小値を記録する。
+ *        余裕が MY_IF_UART_TASK_STACK_MARGIN を下回ったら警告する。
+ *        スタックを最も使うフレームの受け渡しと設定値の反映の後に呼ぶ
+ */
+static void my_if_uart_check_stack(void) {
+    uint32_t free_bytes = (uint32_t)uxTaskGetStackHighWaterMark(NULL);
+    if (my_if_uart_stack_free_min != 0 &&
+        free_bytes >= my_if_uart_stack_free_min) {
+        return;
+    }
+    my_if_uart_stack_free_min = free_bytes;
+    if (free_bytes < MY_IF_UART_TASK_STACK_MARGIN) {
+        ESP_LOGW(MY_IF_UART_TAG, "stack low: %lu of %d bytes free", free_bytes,
+                 MY_IF_UART_TASK_STACK_SIZE);
+    }
+}
+
+/**
+ * @brief UARTのイベントキューに溜まったイベントを捨てる。
+ *        連続受信モードでは、キューセットとずれないよう、セットから選んで読み捨てる
+ */
+static void my_if_uart_drop_events(void) {
+    if (my_if_uart_queue_set == NULL) {
+        xQueueReset(my_if_uart_event_queue);
+        return;
+    }
+    QueueSetMemberHandle_t member;
+    while ((member = xQueueSelectFromSet(my_if_uart_queue_set, 0)) != NULL) {
+        if (member == my_if_uart_event_queue) {
+            uart_event_t event;
+            xQueueReceive(my_if_uart_event_queue, &event, 0);
+        } else {
+            // 設定値は捨てずに、あとで反映する
+            my_if_uart_config_selected = true;
+        }
+    }
+}
+
+/**
+ * @brief
+ * 設定値を各変数に格納し、通信速度、リングバッファ、共用バッファをそれに合わせる。
+ * GPIO/UART監視タスクから、フレームとフレームの間に呼ぶ
+ * @param cfg 設定値
+ * @return 成功したらゼロ。失敗したら元の設定値に戻す
+ */
+static int my_if_uart_apply_live(const my_config_blob_t *cfg) {
+    // GPIO/UART監視タスクだけが使うので、スタックを使わないよう静的に置く
+    static my_config_blob_t old;
+    my_if_uart_collect_config(&old);
+    if (my_if_uart_apply_config(cfg) != 0) {
+        return 1;
+    }
+    // 通信速度。途中まで受信したバイトは、古い速度のものなので捨てる
+    if (my_if_uart_baud_rate != old.baud_rate) {
+        if (uart_set_baudrate(MY_IF_UART_PORT_NUM, my_if_uart_baud_rate) !=
+            ESP_OK) {
+            ESP_LOGW(MY_IF_UART_TAG, "can not set baud rate %lu",
+                     my_if_uart_baud_rate);
+            my_if_uart_apply_config(&old);
+            return 1;
+        }
+        uart_flush_input(MY_IF_UART_PORT_NUM);
+        my_if_uart_drop_events();
+    }
+    // 受信バッファサイズと置換文字列の長さが変わったら、バッファを確保しなおす
+    if (my_if_uart_receive_buffer_len != old.receive_buffer_len ||
+        my_if_uart_terminator_sequence_replace_len !=
+            old.terminator_sequence_replace_len) {
+        if (!my_ring_buffer_init(&rb, my_if_uart_receive_buffer_len) ||
+            my_if_uart_reset_buffer() != 0) {
+            ESP_LOGW(MY_IF_UART_TAG, "can not resize buffer to %d",
+                     my_if_uart_receive_buffer_len);
+            my_if_uart_apply_config(&old);
+            uart_set_baudrate(MY_IF_UART_PORT_NUM, my_if_uart_baud_rate);
+            my_ring_buffer_init(&rb, my_if_uart_receive_buffer_len);
+            my_if_uart_reset_buffer();
+            return 1;
+        }
+    }
+    my_if_uart_config_apply_cnt++;
+    ESP_LOGI(MY_IF_UART_TAG, "config applied: %lu bps, buffer %d",
+             my_if_uart_baud_rate, my_if_uart_receive_buffer_len);
+    return 0;
+}
+
+/**
+ * @brief
+ * Webから変えた設定値が届いていれば反映し、結果を依頼した側へ渡す。
+ * GPIO/UART監視タスクから、フレームとフレームの間に呼ぶ
+ * @return 届いていたらtrue
+ */
+static bool my_if_uart_apply_pending(void) {
+    static my_config_blob_t cfg;
+    // 連続受信モードでは、キューセットから選ばれるまで読まない
+    if (my_if_uart_queue_set != NULL && !my_if_uart_config_selected) {
+        return false;
+    }
+    my_if_uart_config_selected = false;
+    if (xQueueReceive(my_if_uart_config_queue, &cfg, 0) != pdTRUE) {
+        return false;
+    }
+    my_if_uart_config_result = my_if_uart_apply_live(&cfg);
+    xSemaphoreGive(my_if_uart_config_applied);
+    my_if_uart_check_stack();
+    return true;
+}
+
+/**
+ * @brief
+ * 設定値の変更を依頼する。範囲を調べてから、GPIO/UART監視タスクに渡し、
+ * 受信中のフレームが終わった後で、通信速度とバッファの大きさも含めてまとめて反映させる。
+ * 再起動しないので、BLEの接続は切れない。
+ * GPIO/UART監視タスクがまだ動いていなければ、ここで各変数に格納する
+ * @param cfg 設定値
+ * @param wait 反映されるまで待つ時間
+ * @return 反映されたらゼロ。範囲外なら1。時間内に反映されなかったら2（あとで反映される）。
+ *         反映できず元の設定値に戻したら3
+ */
+int my_if_uart_request_config(const my_config_blob_t *cfg, TickType_t wait) {
+    if (my_if_uart_check_config(cfg) != 0) {
+        return 1;
+    }
+    if (my_if_uart_task_handle == NULL || my_if_uart_config_queue == NULL) {
+        my_if_uart_apply_config(cfg);
+        if (my_if_uart_buffer_semaphore != NULL) {
+            my_if_uart_reset_buffer();
+        }
+        return 0;
+    }
+    // 前回の依頼が時間切れで残した知らせを捨てる
+    xSemaphoreTake(my_if_uart_config_applied, 0);
+    xQueueOverwrite(my_if_uart_config_queue, cfg);
+    // タスクを起こす。連続受信モードでは、キューセットで設定値のキューも待っているので要らない
+    if (my_if_uart_queue_set == NULL) {
+        xTaskNotifyGive(my_if_uart_task_handle);
+    }
+    if (xSemaphoreTake(my_if_uart_config_applied, wait) != pdTRUE) {
+        return 2;
+    }
+    return my_if_uart_config_result == 0 ? 0 : 3;
+}
+
 /**
  * @brief
  * キーボードのLEDを点灯させるよう通信があった場合、GPIOピンを操作することで疑似的に対応する
@@ -517,6 +724,347 @@ int my_if_uart_set_leds(uint8_t hid_leds) {
     return 0;
 }
 
+/**
+ * @brief 設定されている終端文字列と途切れ時間から、フレーム区切りを準備する。
+ *        設定はWebから変わることがあるので、受信サイクルの初めに呼ぶ。
+ * @return 終端文字列か途切れ時間が設定されていて、フレームを区切れるならtrue
+ */
+static bool my_if_uart_prepare_framer(void) {
+    const uint8_t *seqs[1] = {(const uint8_t *)my_if_uart_terminator_sequence};
+    int lens[1] = {my_if_uart_terminator_sequence_len};
+    int n = (my_if_uart_terminator_sequence_len > 0) ? 1 : 0;
+    uint32_t terminated_cnt = my_if_uart_framer.terminated_cnt;
+    uint32_t idle_cnt = my_if_uart_framer.idle_cnt;
+    if (my_term_match_compile(&my_if_uart_term_match, seqs, lens, n) != 0) {
+        ESP_LOGW(MY_IF_UART_TAG, "terminator too long or too complex");
+        my_term_match_compile(&my_if_uart_term_match, seqs, lens, 0);
+    }
+    my_uart_framer_init(&my_if_uart_framer, &my_if_uart_term_match,
+                        my_if_uart_rx_idle_ms * 1000);
+    // 数は作り直しても引き継ぐ
+    my_if_uart_framer.terminated_cnt = terminated_cnt;
+    my_if_uart_framer.idle_cnt = idle_cnt;
+    return my_if_uart_framer.match != NULL || my_if_uart_framer.idle_us > 0;
+}
+
+/**
+ * @brief リングバッファに溜まった1フレームを取り出し、末尾の終端文字列を置換して、
+ *        レポートの並びに変換してからHID送信タスクに渡す。
+ *        キューに入れたらすぐ戻るので、呼び出し側はすぐ次の受信に移れる。
+ * @param terminator_len フレーム末尾の終端文字列の長さ。これを置換文字列に置き換える
+ * @param stamp フレームが各段を通過した時刻
+ */
+static void my_if_uart_forward_frame(int terminator_len,
+                                     const my_frame_stamp_t *stamp) {
+    // 共用バッファを確保しなおしている最中に書き込まないよう、セマフォを取得する
+    if (xSemaphoreTake(my_if_uart_buffer_semaphore, (TickType_t)10) != pdTRUE) {
+        ESP_LOGI(MY_IF_UART_TAG, "can not take semaphore");
+        return;
+    }
+    // リングバッファから共用バッファにまとめて取り出す
+    int ring_buffer_cnt = my_ring_buffer_pop_n(
+        &rb, my_if_uart_buffer, my_ring_buffer_content_length(&rb));
+    // 末尾に\0を付与しておく
+    my_if_uart_buffer[ring_buffer_cnt] = 0;
+#if MY_VERBOSE_LOG_LEVEL >= MY_VERBOSE_FRAME
+    // 16進表示用のバッファを準備
+    char buf_str[(my_if_uart_receive_buffer_len +
+                  my_if_uart_terminator_sequence_replace_len + 1) *
+                 4];
+    // リングバッファの内容を表示
+    char *buf_ptr = buf_str;
+    for (int i = 0; i < ring_buffer_cnt; i++) {
+        buf_ptr +=
+            sprintf(buf_ptr, " %02X", (unsigned char)my_if_uart_buffer[i]);
+    }
+    ESP_LOGI(MY_IF_UART_TAG, "Received. Ring-Buffer is %s", my_if_uart_buffer);
+    ESP_LOGI(MY_IF_UART_TAG, "  -> %s", buf_str);
+#endif
+    // 末尾のターミネーター文字列を別の文字列に変換する
+    int base_len = 0;
+    if (ring_buffer_cnt > terminator_len) {
+        base_len = ring_buffer_cnt - terminator_len;
+    } else {
+        base_len = 0;
+    }
+    memcpy(&my_if_uart_buffer[base_len], my_if_uart_terminator_sequence_replace,
+           my_if_uart_terminator_sequence_replace_len);
+    // 末尾に\0を付与しておく
+    my_if_uart_buffer[base_len + my_if_uart_terminator_sequence_replace_len] =
+        0;
+#if MY_VERBOSE_LOG_LEVEL >= MY_VERBOSE_FRAME
+    // 変換後のバッファの内容を表示
+    buf_ptr = buf_str;
+    for (int i = 0; i < base_len + my_if_uart_terminator_sequence_replace_len;
+         i++) {
+        buf_ptr +=
+            sprintf(buf_ptr, " %02X", (unsigned char)my_if_uart_buffer[i]);
+    }
+    ESP_LOGI(MY_IF_UART_TAG, "Translated. Send-Buffer is %s",
+             my_if_uart_buffer);
+    ESP_LOGI(MY_IF_UART_TAG, "  -> %s", buf_str);
+#endif
+    // レポートの並びに変換してから、HID送信タスクに渡す
+    int send_len = base_len + my_if_uart_terminator_sequence_replace_len;
+    my_hid_program_t program;
+    if (!my_hid_program_compile(my_if_uart_buffer, send_len, &program)) {
+        ESP_LOGW(MY_IF_UART_TAG, "report pool full, frame dropped");
+        my_trace_rec(MY_TRACE_FRAME_DROP, 0, send_len, 0);
+    } else if (!my_frame_queue_push(my_if_uart_buffer, send_len, stamp,
+                                    &program)) {
+        my_hid_program_cancel(&program);
+        my_trace_rec(MY_TRACE_FRAME_DROP, 0, send_len, 0);
+    } else {
+        my_trace_rec(MY_TRACE_FRAME, terminator_len, send_len, program.count);
+    }
+    // セマフォを返却する
+    xSemaphoreGive(my_if_uart_buffer_semaphore);
+    my_if_uart_check_stack();
+}
+
+/**
+ * @brief リクエストコマンドがあれば送り、1フレーム受信してリングバッファに溜める。
+ *        終端文字列が来るか受信が途切れるまで受信する。
+ *        一定時間内に区切れなければ受信失敗とする。
+ *        UARTドライバからのイベントで起きるので、受信した分はすぐに処理される
+ * @param stamp リクエストを送った時刻と受信した時刻が格納される
+ * @param timeout_us 応答を待つ時間(us)
+ * @param terminator_len 受信した終端文字列の長さが格納される。置換で取り除く
+ * @return 1フレーム受信できたらtrue
+ */
+static bool my_if_uart_request_response(my_frame_stamp_t *stamp,
+                                        int64_t timeout_us,
+                                        int *terminator_len) {
+    // リングバッファをクリアしておく
+    my_ring_buffer_reset(&rb);
+    // フレームの区切りを最初から始める
+    bool use_framer = my_if_uart_prepare_framer();
+    *terminator_len = 0;
+    stamp->rx_first_us = 0;
+    stamp->rx_done_us = 0;
+    // 送信前にreadバッファを空にしておく
+    uart_flush_input(MY_IF_UART_PORT_NUM);
+    xQueueReset(my_if_uart_event_queue);
+    MY_VLOGI(MY_VERBOSE_FRAME, MY_IF_UART_TAG, "Process UART");
+    // データリクエストコマンドがあればここで送信。
+    stamp->request_us = esp_timer_get_time();
+    if (my_if_uart_request_command_len > 0) {
+        uart_write_bytes(MY_IF_UART_PORT_NUM, my_if_uart_request_command,
+                         my_if_uart_request_command_len);
+    }
+    bool receive_completed = false;
+    int64_t deadline_us = stamp->request_us + timeout_us;
+    while (!receive_completed) {
+        int64_t now_us = esp_timer_get_time();
+        int64_t remain_us = deadline_us - now_us;
+        if (remain_us <= 0) {
+            my_if_uart_rx_timeout_cnt++;
+            break;
+        }
+        // 受信が途切れて区切れるのが先なら、それまで待つ
+        int64_t idle_us = my_uart_framer_wait_us(&my_if_uart_framer, now_us);
+        if (idle_us >= 0 && idle_us < remain_us) {
+            remain_us = idle_us;
+        }
+        uart_event_t event;
+        if (xQueueReceive(my_if_uart_event_queue, &event,
+                          pdMS_TO_TICKS(remain_us / 1000) + 1) != pdTRUE) {
+            if (my_uart_framer_poll(&my_if_uart_framer, esp_timer_get_time()) ==
+                MY_UART_FRAMER_END_IDLE) {
+                *terminator_len = 0;
+                receive_completed = true;
+            }
+            continue;
+        }
+        if (event.type == UART_FIFO_OVF || event.type == UART_BUFFER_FULL) {
+            // 溢れた場合は読み捨てて数え、この回は失敗とする
+            if (event.type == UART_FIFO_OVF) {
+                my_if_uart_fifo_ovf_cnt++;
+            } else {
+                my_if_uart_buffer_full_cnt++;
+            }
+            ESP_LOGW(MY_IF_UART_TAG, "UART overflow (%d)", event.type);
+            my_trace_rec(MY_TRACE_RX_OVERFLOW, event.type, 0, 0);
+            uart_flush_input(MY_IF_UART_PORT_NUM);
+            xQueueReset(my_if_uart_event_queue);
+            break;
+        }
+        if (event.type != UART_DATA && event.type != UART_PATTERN_DET) {
+            continue;
+        }
+        // データの総量はリングバッファにより制限される(my_if_uart_receive_buffer_lenバイト)
+        uint8_t *tmp_buf = my_if_uart_read_buf;
+        int read_len;
+        // 届いている分を待たずに全て読む
+        while (!receive_completed &&
+               (read_len = uart_read_bytes(MY_IF_UART_PORT_NUM, tmp_buf,
+                                           my_if_uart_receive_buffer_len, 0)) >
+                   0) {
+            if (stamp->rx_first_us == 0) {
+                stamp->rx_first_us = esp_timer_get_time();
+            }
+            if (!use_framer) {
+                // ターミネーター文字列も途切れ時間も指定されていない場合は、
+                // 読み込めた分を格納して受信完了とする。
+                my_trace_bytes(tmp_buf, read_len);
+                my_ring_buffer_push_n(&rb, tmp_buf, read_len);
+                receive_completed = true;
+                break;
+            }
+            // 区切れるところまでをリングバッファに格納する。
+            // 区切れた後ろのバイトは読み捨てる
+            my_uart_framer_end_t end;
+            int used =
+                my_uart_framer_feed(&my_if_uart_framer, tmp_buf, read_len,
+                                    esp_timer_get_time(), &end);
+#if MY_VERBOSE_LOG_LEVEL >= MY_VERBOSE_BYTE
+            for (int i = 0; i < used; i++) {
+                ESP_LOGI(MY_IF_UART_TAG, "Receive 1 byte: %c(0x%02x)",
+                         tmp_buf[i], tmp_buf[i]);
+            }
+#endif
+            my_trace_bytes(tmp_buf, used);
+            my_ring_buffer_push_n(&rb, tmp_buf, used);
+            if (end != MY_UART_FRAMER_END_NONE) {
+                *terminator_len = my_if_uart_framer.term_len;
+                receive_completed = true;
+            }
+        }
+    }  // while(!receive_completed)
+    if (receive_completed) {
+        stamp->rx_done_us = esp_timer_get_time();
+    } else {
+        ESP_LOGI(MY_IF_UART_TAG, "Failed receive UART");
+    }
+    return receive_completed;
+}
+
+/**
+ * @brief 連続受信モード。トリガーピンもリクエストコマンドも使わず、届いたバイトを読み続ける。
+ *        終端文字列か受信の途切れで区切ったフレームを、順にHID送信タスクに渡す。
+ *        フレームの間に届いたバイトも捨てずに次のフレームにする。戻らない。
+ */
+static void my_if_uart_stream(void) {
+    uint8_t *tmp_buf = my_if_uart_read_buf;
+    my_frame_stamp_t stamp;
+    memset(&stamp, 0, sizeof(stamp));
+    my_ring_buffer_reset(&rb);
+    // UARTのイベントと設定値をキューセットで待つ。セットに入れるキューは空でなければならないので、
+    // 始める前に届いていたバイトは捨てる
+    uart_flush_input(MY_IF_UART_PORT_NUM);
+    xQueueReset(my_if_uart_event_queue);
+    if (xQueueAddToSet(my_if_uart_event_queue, my_if_uart_queue_set) !=
+        pdPASS) {
+        ESP_LOGE(MY_IF_UART_TAG, "Can not add event queue to queue set");
+        vTaskDelay(30000 / portTICK_PERIOD_MS);
+        esp_restart();
+    }
+    bool use_framer = my_if_uart_prepare_framer();
+    while (1) {
+        // 区切れていないフレームがあれば途切れるまで、無ければ次の受信か設定値まで待つ
+        int64_t idle_us =
+            my_uart_framer_wait_us(&my_if_uart_framer, esp_timer_get_time());
+        TickType_t wait = (idle_us < 0) ? portMAX_DELAY
+                                        : pdMS_TO_TICKS(idle_us / 1000) + 1;
+        QueueSetMemberHandle_t member =
+            xQueueSelectFromSet(my_if_uart_queue_set, wait);
+        if (member == my_if_uart_config_queue) {
+            my_if_uart_config_selected = true;
+        }
+        uart_event_t event;
+        if (member != my_if_uart_event_queue ||
+            xQueueReceive(my_if_uart_event_queue, &event, 0) != pdTRUE) {
+            if (my_uart_framer_poll(&my_if_uart_framer, esp_timer_get_time()) ==
+                MY_UART_FRAMER_END_IDLE) {
+                stamp.rx_done_us = esp_timer_get_time();
+                my_if_uart_forward_frame(0, &stamp);
+                memset(&stamp, 0, sizeof(stamp));
+                my_if_uart_apply_pending();
+                use_framer = my_if_uart_prepare_framer();
+            } else if (my_ring_buffer_content_length(&rb) == 0 &&
+                       my_if_uart_apply_pending()) {
+                // 設定値の変更は、受信途中のフレームが無いときだけ反映する。
+                // 途中なら、そのフレームが区切れたところで反映する
+                use_framer = my_if_uart_prepare_framer();
+            }
+            continue;
+        }
+        // 設定値の変更は、受信途中のフレームが無いときだけ反映する。
+        // 途中なら、そのフレームが区切れたところで反映する
+        if (my_ring_buffer_content_length(&rb) == 0 &&
+            my_if_uart_apply_pending()) {
+            use_framer = my_if_uart_prepare_framer();
+        }
+        if (event.type == UART_FIFO_OVF || event.type == UART_BUFFER_FULL) {
+            // 溢れた場合は数えて、途中のフレームごと読み捨てる
+            if (event.type == UART_FIFO_OVF) {
+                my_if_uart_fifo_ovf_cnt++;
+            } else {
+                my_if_uart_buffer_full_cnt++;
+            }
+            ESP_LOGW(MY_IF_UART_TAG, "UART overflow (%d)", event.type);
+            my_trace_rec(MY_TRACE_RX_OVERFLOW, event.type, 0, 0);
+            uart_flush_input(MY_IF_UART_PORT_NUM);
+            my_if_uart_drop_events();
+            my_ring_buffer_reset(&rb);
+            my_uart_framer_reset(&my_if_uart_framer);
+            memset(&stamp, 0, sizeof(stamp));
+            continue;
+        }
+        if (event.type != UART_DATA && event.type != UART_PATTERN_DET) {
+            continue;
+        }
+        // 届いている分を待たずに全て読み、区切れるごとにフレームを渡す
+        int read_len;
+        while ((read_len = uart_read_bytes(MY_IF_UART_PORT_NUM, tmp_buf,
+                                           MY_IF_UART_READ_LEN, 0)) > 0) {
+            int64_t now_us = esp_timer_get_time();
+            int off = 0;
+            while (off < read_len) {
+                if (stamp.rx_first_us == 0) {
+                    // トリガーが無いので、最初の1バイトを受け取った時刻を起点にする
+                    stamp.trigger_us = stamp.rx_first_us = now_us;
+                }
+                int used = read_len - off;
+                int terminator_len = 0;
+                my_uart_framer_end_t end = MY_UART_FRAMER_END_TERMINATOR;
+                if (use_framer) {
+                    used = my_uart_framer_feed(&my_if_uart_framer,
+                                               tmp_buf + off, used, now_us,
+                                               &end);
+                    terminator_len = my_if_uart_framer.term_len;
+                }
+                my_trace_bytes(tmp_buf + off, used);
+                my_ring_buffer_push_n(&rb, tmp_buf + off, used);
+                off += used;
+                if (end != MY_UART_FRAMER_END_NONE) {
+                    // 区切り方が無い場合は、読み出せた分を1フレームにする
+                    stamp.rx_done_us = now_us;
+                    my_if_uart_forward_frame(terminator_len, &stamp);
+                    memset(&stamp, 0, sizeof(stamp));
+                    // 設定はWebから変わることがあるので、フレームの切れ目で作り直す
+                    my_if_uart_apply_pending();
+                    use_framer = my_if_uart_prepare_framer();
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief トリガーピンの立ち上がりで呼ばれる割り込みハンドラ。
+ *        時刻を記録して、GPIO/UART監視タスクを起こすだけ。
+ */
+static void IRAM_ATTR my_if_uart_trigger_isr(void *arg) {
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    my_if_uart_trigger_edge_us = esp_timer_get_time();
+    if (my_if_uart_task_handle != NULL) {
+        vTaskNotifyGiveFromISR(my_if_uart_task_handle,
+                               &higher_priority_task_woken);
+    }
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
 /**
  * @brief process uart, send command and wait response. called by xCreateTask()
  *        Nicon TC-101A RS-232C interface
@@ -533,6 +1081,7 @@ int my_if_uart_set_leds(uint8_t hid_leds) {
  */
 void my_if_uart_task(void *arg) {
     ESP_LOGI(MY_IF_UART_TAG, "starting");
+    my_if_uart_task_handle = xTaskGetCurrentTaskHandle();
 
     // GPIO
     DEBUGPRINT("GPIO init");
@@ -541,6 +1090,15 @@ void my_if_uart_task(void *arg) {
     gpio_reset_pin(MY_IF_UART_TRIGGER_PIN_GPIO);
     gpio_set_direction(MY_IF_UART_TRIGGER_PIN_GPIO, GPIO_MODE_INPUT);
     gpio_pullup_en(MY_IF_UART_TRIGGER_PIN_GPIO);
+    //   L->H で割り込み。ポーリングはしない
+    gpio_set_intr_type(MY_IF_UART_TRIGGER_PIN_GPIO, GPIO_INTR_POSEDGE);
+    esp_err_t isr_ret = gpio_install_isr_service(0);
+    if (isr_ret != ESP_OK && isr_ret != ESP_ERR_INVALID_STATE) {
+        // ESP_ERR_INVALID_STATE は他でインストール済み
+        ESP_ERROR_CHECK(isr_ret);
+    }
+    ESP_ERROR_CHECK(gpio_isr_handler_add(MY_IF_UART_TRIGGER_PIN_GPIO,
+                                         my_if_uart_trigger_isr, NULL));
     // GPIO output
     //   キーボードのインジケーター
     int out_pins[5] = {
@@ -571,216 +1129,231 @@ void my_if_uart_task(void *arg) {
     intr_alloc_flags = ESP_INTR_FLAG_IRAM;
 #endif
 
-    ESP_ERROR_CHECK(
-        uart_driver_install(MY_IF_UART_PORT_NUM, MY_IF_UART_BUF_SIZE,
-                            MY_IF_UART_BUF_SIZE, 0, NULL, intr_alloc_flags));
+    // 受信はイベントキューで待つ
+    ESP_ERROR_CHECK(uart_driver_install(
+        MY_IF_UART_PORT_NUM, MY_IF_UART_BUF_SIZE, MY_IF_UART_BUF_SIZE,
+        MY_IF_UART_EVENT_QUEUE_LEN, &my_if_uart_event_queue, intr_alloc_flags));
     ESP_ERROR_CHECK(uart_param_config(MY_IF_UART_PORT_NUM, &uart_config));
     ESP_ERROR_CHECK(uart_set_pin(
         MY_IF_UART_PORT_NUM, MY_IF_UART_TXD_PIN_GPIO, MY_IF_UART_RXD_PIN_GPIO,
         MY_IF_UART_RTS_PIN_GPIO, MY_IF_UART_CTS_PIN_GPIO));
+    // 受信したバイトがすぐにイベントで届くようにする
+    ESP_ERROR_CHECK(
+        uart_set_rx_timeout(MY_IF_UART_PORT_NUM, MY_IF_UART_RX_TOUT_SYMBOLS));
+    ESP_ERROR_CHECK(uart_set_rx_full_threshold(MY_IF_UART_PORT_NUM,
+                                               MY_IF_UART_RX_FULL_THRESH));
     DEBUGPRINT("UART inited");
 
     // UART受信のためにリングバッファを用意する
     my_ring_buffer_init(&rb, my_if_uart_receive_buffer_len);
     DEBUGPRINT("ring buffer inited");
 
+#if MY_IF_UART_NO_UART == 0
+    if (my_if_uart_streaming) {
+        // トリガーは使わない
+        ESP_LOGI(MY_IF_UART_TAG, "streaming mode");
+        my_if_uart_stream();
+    }
+#endif
+
     DEBUGPRINT("Trigger waiting...");
 
     // UART通信状態。trueで通信。
     bool on_communication = false;
-    // トリガーピンの、1回前の電圧
-    int lvl0 = 1;
-    // トリガーピンのL->Hを確認する
+    // 最後に受け付けたトリガの時刻(us)。チャタリング除去に使う
+    int64_t accepted_edge_us = -(MY_IF_UART_TRIGGER_DEBOUNCE_MS * 1000LL);
+    // 最後に見たトリガの時刻(us)。同じ立ち上がりを2度見ないようにする
+    int64_t seen_edge_us = 0;
+    // 受信したフレームが各段を通過した時刻
+    my_frame_stamp_t stamp;
+    // ポーリングの予定と応答時間の統計
+    my_uart_poll_init(&my_if_uart_poll, my_if_uart_poll_period_ms * 1000,
+                      MY_IF_UART_RESPONSE_TIMEOUT_MS * 1000,
+                      CONFIG_MY_IF_UART_POLL_RETRY_MAX);
+    // トリガーピンのL->Hを割り込みで待つ
+    gpio_intr_enable(MY_IF_UART_TRIGGER_PIN_GPIO);
     while (1) {
-        vTaskDelay(50 / portTICK_PERIOD_MS);
-        // vTaskDelay(1000 / portTICK_PERIOD_MS);
-        //  トリガーピンの電圧
-        int lvl1 = gpio_get_level(MY_IF_UART_TRIGGER_PIN_GPIO);
-        if (lvl0 != lvl1) {
-            DEBUGPRINT("Trigger Level Changed = %d -> %d", lvl0, lvl1);
+        // Webから変えた設定値は、フレームとフレームの間のここで反映する
+        my_if_uart_apply_pending();
+        // リクエストコマンドを一定周期で送るか
+        bool polling =
+            my_if_uart_poll_period_ms > 0 && my_if_uart_request_command_len > 0;
+        // 通信中でなければ、トリガーピンの割り込みから通知が来るまで眠る。
+        // 通信中なら、ポーリングでは次にリクエストを送る予定の時刻まで眠り、
+        // トグル動作では通知が来ているかだけ見る
+        TickType_t wait = portMAX_DELAY;
+        if (on_communication) {
+            wait = 0;
+            if (polling) {
+                int64_t remain_us = my_uart_poll_next_us(&my_if_uart_poll) -
+                                    esp_timer_get_time();
+                if (remain_us > 0) {
+                    wait = pdMS_TO_TICKS((remain_us + 999) / 1000);
+                }
+            }
         }
+        bool triggered = false;
+        if (ulTaskNotifyTake(pdTRUE, wait) > 0) {
+            int64_t edge_us = my_if_uart_trigger_edge_us;
+            // 設定値の変更でも起こされるので、新しい立ち上がりがあったときだけ見る。
+            // チャタリングを除き、立ち上がった後Hのままであるものだけを受け付ける
+            if (edge_us != seen_edge_us &&
+                edge_us - accepted_edge_us >=
+                    MY_IF_UART_TRIGGER_DEBOUNCE_MS * 1000LL &&
+                gpio_get_level(MY_IF_UART_TRIGGER_PIN_GPIO) == 1) {
+                accepted_edge_us = edge_us;
+                triggered = true;
+                DEBUGPRINT("Trigger Level Changed = 0 -> 1");
+            }
+            seen_edge_us = edge_us;
+        }
+        memset(&stamp, 0, sizeof(stamp));
+        stamp.trigger_us = triggered ? accepted_edge_us : esp_timer_get_time();
         // トリガを解釈して通信を行う
-        // BLE-HID送信中にトリガを解釈しないよう、セマフォを取得してから解釈する
-        if (xSemaphoreTake(my_if_uart_buffer_semaphore, (TickType_t)10) ==
-            pdTRUE) {
-            if (lvl0 == 0 && lvl1 == 1) {
-                if (my_if_uart_request_command_len > 0) {
-                    // リクエストコマンドがある場合はここでonし、通信終了時にoffする。
-                    on_communication = true;
-                } else {
-                    // リクエストコマンドがない場合は、通信状態を切り替える
-                    on_communication = !on_communication;
+        // BLE-HID送信はキューを介して別タスクで行うので、送信中でもトリガを取りこぼさない
+        if (triggered) {
+            if (polling) {
+                // ポーリングでは、トリガーで開始・停止を切り替える
+                on_communication = !on_communication;
+                if (on_communication) {
+                    my_uart_poll_set_period(&my_if_uart_poll,
+                                            my_if_uart_poll_period_ms * 1000);
+                    my_uart_poll_start(&my_if_uart_poll, esp_timer_get_time());
                 }
+            } else if (my_if_uart_request_command_len > 0) {
+                // リクエストコマンドがある場合はここでonし、通信終了時にoffする。
+                on_communication = true;
+            } else {
+                // リクエストコマンドがない場合は、通信状態を切り替える
+                on_communication = !on_communication;
             }
-            if (on_communication) {
-                ESP_LOGI(MY_IF_UART_TAG, "Triggered L->H");
-                // リングバッファをクリアしておく
-                my_ring_buffer_reset(&rb);
-                // 送信前にreadバッファを空にしておく
-                uart_flush(MY_IF_UART_PORT_NUM);
-#if MY_IF_UART_NO_UART == 0  // UART接続部分
-                ESP_LOGI(MY_IF_UART_TAG, "Process UART");
-                // データリクエストコマンドがあればここで送信。
-                if (my_if_uart_request_command_len > 0) {
-                    // 返り値は送信サイズと等しい・・はず
-                    int wrote_size = uart_write_bytes(
-                        MY_IF_UART_PORT_NUM, my_if_uart_request_command,
-                        my_if_uart_request_command_len);
+        }
+        if (on_communication) {
+            if (polling) {
+                // 予定の時刻より前に起きたら、もう一度眠る
+                int64_t next_us = my_uart_poll_next_us(&my_if_uart_poll);
+                if (esp_timer_get_time() < next_us) {
+                    continue;
                 }
-                // 終端文字列が来るまで何回か受信する。終端文字列が来なければ受信失敗とみなして何もしない。
-                bool receive_completed = false;
-                int cnt = 3;
-                while (cnt-- > 0) {
-                    // 終端文字列で終わるデータを受信する
-                    // データの総量はリングバッファにより制限される(my_if_uart_receive_buffer_lenバイト)
-                    uint8_t tmp_buf[my_if_uart_receive_buffer_len];
-                    int read_len = uart_read_bytes(
-                        MY_IF_UART_PORT_NUM, tmp_buf,
-                        my_if_uart_receive_buffer_len, 50 / portTICK_PERIOD_MS);
-                    for (int i = 0; i < read_len; i++) {
-                        ESP_LOGI(MY_IF_UART_TAG, "Receive 1 byte: %c(0x%02x)",
-                                 tmp_buf[i], tmp_buf[i]);
-                        // リングバッファに1文字格納
-                        my_ring_buffer_push(&rb, tmp_buf[i]);
-                        if (my_if_uart_terminator_sequence_len <= 0) {
-                            // ターミネーター文字列が指定されていない場合は、
-                            // １文字でも読み込めたら受信完了フラグを立てておく。
-                            receive_completed = true;
-                        } else {
-                            // ターミネーター末尾の文字と一致していたら、
-                            // ターミネーター文字列全てが合致しているかリングバッファをチェック
-                            if (tmp_buf[i] ==
-                                my_if_uart_terminator_sequence
-                                    [my_if_uart_terminator_sequence_len - 1]) {
-                                bool terminated = true;
-                                uint8_t d;
-                                for (int j = 0;
-                                     j < my_if_uart_terminator_sequence_len;
-                                     j++) {
-                                    my_ring_buffer_at(
-                                        &rb,
-                                        j - my_if_uart_terminator_sequence_len,
-                                        &d);
-                                    if (my_if_uart_terminator_sequence[j] !=
-                                        d) {
-                                        terminated = false;
-                                        break;
-                                    }
-                                }
-                                if (terminated) {
-                                    receive_completed = true;
-                                    break;
-                                }
-                            }
-                        }
-                    }
+                // 予定の時刻を起点にすると、送った時刻とのずれがジッタとして分かる
+                stamp.trigger_us = next_us;
+            }
+            MY_VLOGI(MY_VERBOSE_FRAME, MY_IF_UART_TAG, "Triggered L->H");
+            // 受信した終端文字列の長さ。置換で取り除く
+            int terminator_len = 0;
+            bool receive_completed = false;
+#if MY_IF_UART_NO_UART == 0  // UART接続部分
+            if (polling) {
+                // 応答が無ければ送り直し、それでも無ければ次の予定に進む
+                while (1) {
+                    my_uart_poll_sent(&my_if_uart_poll);
+                    receive_completed = my_if_uart_request_response(
+                        &stamp, my_uart_poll_timeout_us(&my_if_uart_poll),
+                        &terminator_len);
+                    int64_t now_us = esp_timer_get_time();
                     if (receive_completed) {
+                        my_uart_poll_response(
+                            &my_if_uart_poll,
+                            (uint32_t)(stamp.rx_done_us - stamp.request_us),
+                            now_us);
+                        break;
+                    }
+                    if (!my_uart_poll_timeout(&my_if_uart_poll, now_us)) {
                         break;
                     }
-                    vTaskDelay(100 / portTICK_PERIOD_MS);
-                }  // while(cnt...)
-                if (!receive_completed) {
-                    ESP_LOGI(MY_IF_UART_TAG, "Failed receive UART");
+                    ESP_LOGI(MY_IF_UART_TAG, "no response, retry");
                 }
-                // 一定期間中に受信しきれなかった場合は受信できていないとみなし、なにもせずにトリガ待ちに移行する。
-                // 次回受信時にリングバッファをクリアして再受信。
-                // 受信しきれた場合は、処理を進める
+            } else {
+                receive_completed = my_if_uart_request_response(
+                    &stamp, MY_IF_UART_RESPONSE_TIMEOUT_MS * 1000LL,
+                    &terminator_len);
+            }
+            // 一定期間中に受信しきれなかった場合は受信できていないとみなし、なにもせずにトリガ待ちに移行する。
+            // 次回受信時にリングバッファをクリアして再受信。
+            // 受信しきれた場合は、処理を進める
 #else  // MY_IF_UART_NO_UART //
        // UART接続先が居ないテスト環境の時などに、受信したふりをする
-                ESP_LOGI(MY_IF_UART_TAG, "Dummy UART");
-                my_ring_buffer_push(&rb, '0');
-                my_ring_buffer_push(&rb, '1');
-                my_ring_buffer_push(&rb, '2');
-                my_ring_buffer_push(&rb, '!');
-                my_ring_buffer_push(&rb, '#');
-                my_ring_buffer_push(&rb, '$');
-                my_ring_buffer_push(&rb, '%');
-                my_ring_buffer_push(&rb, '@');
-                my_ring_buffer_push(&rb, ';');
-                my_ring_buffer_push(&rb, '9');
-                my_ring_buffer_push(&rb, '\x0d');
-                my_ring_buffer_push(&rb, '\x0a');
-                bool receive_completed = true;
+            ESP_LOGI(MY_IF_UART_TAG, "Dummy UART");
+            my_ring_buffer_reset(&rb);
+            my_ring_buffer_push(&rb, '0');
+            my_ring_buffer_push(&rb, '1');
+            my_ring_buffer_push(&rb, '2');
+            my_ring_buffer_push(&rb, '!');
+            my_ring_buffer_push(&rb, '#');
+            my_ring_buffer_push(&rb, '$');
+            my_ring_buffer_push(&rb, '%');
+            my_ring_buffer_push(&rb, '@');
+            my_ring_buffer_push(&rb, ';');
+            my_ring_buffer_push(&rb, '9');
+            my_ring_buffer_push(&rb, '\x0d');
+            my_ring_buffer_push(&rb, '\x0a');
+            receive_completed = true;
+            terminator_len = my_if_uart_terminator_sequence_len;
+            stamp.request_us = esp_timer_get_time();
+            stamp.rx_first_us = stamp.rx_done_us = stamp.request_us;
+            if (polling) {
+                my_uart_poll_sent(&my_if_uart_poll);
+                my_uart_poll_response(&my_if_uart_poll, 0, stamp.rx_done_us);
+            }
 #endif  // MY_IF_UART_NO_UART
-                if (receive_completed) {
-                    // 16進表示用のバッファを準備
-                    char buf_str[(my_if_uart_receive_buffer_len +
-                                  my_if_uart_terminator_sequence_replace_len +
-                                  1) *
-                                 4];
-                    char *buf_ptr;
-                    // リングバッファから共用バッファに取り出す
-                    int ring_buffer_cnt = my_ring_buffer_content_length(&rb);
-                    for (int i = 0; i < ring_buffer_cnt; i++) {
-                        if (!my_ring_buffer_pop(&rb, &(my_if_uart_buffer[i]))) {
-                            break;
-                        }
-                    }
-                    // 末尾に\0を付与しておく
-                    my_if_uart_buffer[ring_buffer_cnt] = 0;
-#ifdef MYDEBUG
-                    // リングバッファの内容を表示
-                    buf_ptr = buf_str;
-                    for (int i = 0; i < ring_buffer_cnt; i++) {
-                        buf_ptr += sprintf(buf_ptr, " %02X",
-                                           (unsigned char)my_if_uart_buffer[i]);
-                    }
-                    ESP_LOGI(MY_IF_UART_TAG, "Received. Ring-Buffer is %s",
-                             my_if_uart_buffer);
-                    ESP_LOGI(MY_IF_UART_TAG, "  -> %s", buf_str);
-#endif
-                    // 末尾のターミネーター文字列を別の文字列に変換する
-                    int base_len = 0;
-                    if (ring_buffer_cnt > my_if_uart_terminator_sequence_len) {
-                        base_len = ring_buffer_cnt -
-                                   my_if_uart_terminator_sequence_len;
-                    } else {
-                        base_len = 0;
-                    }
-                    for (int i = 0;
-                         i < my_if_uart_terminator_sequence_replace_len; i++) {
-                        my_if_uart_buffer[base_len + i] =
-                            my_if_uart_terminator_sequence_replace[i];
-                    }
-                    // 末尾に\0を付与しておく
-                    my_if_uart_buffer
-                        [base_len +
-                         my_if_uart_terminator_sequence_replace_len] = 0;
-#ifdef MYDEBUG
-                    // 変換後のバッファの内容を表示
-                    buf_ptr = buf_str;
-                    for (int i = 0;
-                         i <
-                         base_len + my_if_uart_terminator_sequence_replace_len;
-                         i++) {
-                        buf_ptr += sprintf(buf_ptr, " %02X",
-                                           (unsigned char)my_if_uart_buffer[i]);
-                    }
-                    ESP_LOGI(MY_IF_UART_TAG, "Translated. Send-Buffer is %s",
-                             my_if_uart_buffer);
-                    ESP_LOGI(MY_IF_UART_TAG, "  -> %s", buf_str);
-#endif
-                }  // receive completed
-                // セマフォを返却する
-                xSemaphoreGive(my_if_uart_buffer_semaphore);
-                // リクエストコマンド送信後は、ちょっと多めに待機し、通信状態をOFFにする
-                // リクエストコマンドが無い場合はONのまま
-                if (my_if_uart_request_command_len > 0) {
-                    vTaskDelay(300 / portTICK_PERIOD_MS);
-                    on_communication = false;
-                }
-            } else {
-                // セマフォを返却する
-                xSemaphoreGive(my_if_uart_buffer_semaphore);
-            }  // on communication
-        } else {
-            ESP_LOGI(MY_IF_UART_TAG, "can not take semaphore");
-        }  // xSemaphoreTake
-        // トリガーピンの履歴を更新する
-        lvl0 = lvl1;
+            if (receive_completed) {
+                my_if_uart_forward_frame(terminator_len, &stamp);
+            }  // receive completed
+            // トリガー1回につきリクエストを1回送る場合は、通信状態をOFFにする。
+            // 以前はここで300ms待っていたが、トリガーはチャタリングを除いてあるので待たない。
+            // リクエストコマンドが無い場合と、ポーリングではONのまま
+            if (!polling && my_if_uart_request_command_len > 0) {
+                on_communication = false;
+            }
+        }  // on communication
     }  // while(1)
 }
 
+/**
+ * @brief これまでにUARTのハードウェアFIFOが溢れた回数
+ */
+uint32_t my_if_uart_fifo_overflows(void) { return my_if_uart_fifo_ovf_cnt; }
+
+/**
+ * @brief これまでにUARTドライバの受信バッファが溢れた回数
+ */
+uint32_t my_if_uart_buffer_overflows(void) {
+    return my_if_uart_buffer_full_cnt;
+}
+
+/**
+ * @brief これまでに応答を待つ時間内にフレームが区切れなかった回数
+ */
+uint32_t my_if_uart_rx_timeouts(void) { return my_if_uart_rx_timeout_cnt; }
+
+/**
+ * @brief ポーリングの状態と応答時間の統計
+ */
+const my_uart_poll_t *my_if_uart_poll_state(void) { return &my_if_uart_poll; }
+
+/**
+ * @brief これまでに終端文字列で区切ったフレーム数
+ */
+uint32_t my_if_uart_frames_terminated(void) {
+    return my_if_uart_framer.terminated_cnt;
+}
+
+/**
+ * @brief これまでに受信の途切れで区切ったフレーム数
+ */
+uint32_t my_if_uart_frames_idle(void) { return my_if_uart_framer.idle_cnt; }
+
+/**
+ * @brief これまでにWebから変えた設定値を、再起動せずに反映した回数
+ */
+uint32_t my_if_uart_config_applies(void) { return my_if_uart_config_apply_cnt; }
+
+/**
+ * @brief これまでのGPIO/UART監視タスクのスタックの残りの最小値(bytes)。
+ *        まだフレームを受け渡していなければゼロ
+ */
+uint32_t my_if_uart_stack_free(void) { return my_if_uart_stack_free_min; }
+
 /**
  * @brief touch point for user defined interface
  * 共用バッファ用のセマフォと共用バッファを準備する。
@@ -814,10 +1387,6 @@ void my_if_uart_begin(int priority) {
         my_if_uart_request_command_len = 0;
         my_if_uart_terminator_sequence_len = 0;
         my_if_uart_terminator_sequence_replace_len = 0;
-        my_if_uart_request_command = (char *)calloc(1, sizeof(char));
-        my_if_uart_terminator_sequence = (char *)calloc(1, sizeof(char));
-        my_if_uart_terminator_sequence_replace =
-            (char *)calloc(1, sizeof(char));
 
         if (0) {
             // 初期値を使う場合
@@ -826,22 +1395,16 @@ void my_if_uart_begin(int priority) {
 
             my_if_uart_receive_buffer_len = 15;
 
-            free(my_if_uart_request_command);
-            my_if_uart_request_command = malloc(4);
             my_if_uart_request_command[0] = 'Q';
             my_if_uart_request_command[1] = 'X';
             my_if_uart_request_command[2] = '\x0d';
             my_if_uart_request_command[3] = '\x0a';
             my_if_uart_request_command_len = 4;
 
-            free(my_if_uart_terminator_sequence);
-            my_if_uart_terminator_sequence = malloc(2);
             my_if_uart_terminator_sequence[0] = '\x0d';
             my_if_uart_terminator_sequence[1] = '\x0a';
             my_if_uart_terminator_sequence_len = 2;
 
-            free(my_if_uart_terminator_sequence_replace);
-            my_if_uart_terminator_sequence_replace = malloc(1);
             my_if_uart_terminator_sequence_replace[0] = '\x09';
             my_if_uart_terminator_sequence_replace_len = 1;
         }
@@ -855,6 +1418,35 @@ void my_if_uart_begin(int priority) {
         }
     }
 
+    // HID送信タスクへフレームを渡すキュー
+    if (!my_frame_queue_init()) {
+        ESP_LOGE(MY_IF_UART_TAG, "Can not create frame queue");
+        vTaskDelay(30000 / portTICK_PERIOD_MS);
+        esp_restart();
+    }
+
+    // Webから変えた設定値を、GPIO/UART監視タスクへ渡すキュー
+    my_if_uart_config_queue = xQueueCreate(1, sizeof(my_config_blob_t));
+    my_if_uart_config_applied = xSemaphoreCreateBinary();
+    if (my_if_uart_config_queue == NULL || my_if_uart_config_applied == NULL) {
+        ESP_LOGE(MY_IF_UART_TAG, "Can not create config queue");
+        vTaskDelay(30000 / portTICK_PERIOD_MS);
+        esp_restart();
+    }
+    // 連続受信モードでは、UARTのイベントと設定値をキューセットで待つ。
+    // UARTのイベントキューは、GPIO/UART監視タスクがドライバを入れた後で加える
+    if (my_if_uart_streaming && MY_IF_UART_NO_UART == 0) {
+        my_if_uart_queue_set =
+            xQueueCreateSet(MY_IF_UART_EVENT_QUEUE_LEN + 1);
+        if (my_if_uart_queue_set == NULL ||
+            xQueueAddToSet(my_if_uart_config_queue, my_if_uart_queue_set) !=
+                pdPASS) {
+            ESP_LOGE(MY_IF_UART_TAG, "Can not create queue set");
+            vTaskDelay(30000 / portTICK_PERIOD_MS);
+            esp_restart();
+        }
+    }
+
     // GPIO/UART監視タスク
     xTaskCreate(my_if_uart_task, "i/f task uart", MY_IF_UART_TASK_STACK_SIZE,
                 NULL, priority, NULL);
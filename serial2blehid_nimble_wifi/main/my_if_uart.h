@@ -5,8 +5,28 @@
 #ifndef my_if_uart_h
 #define my_if_uart_h 1
 
+#include "freertos/FreeRTOS.h"
+#include "my_config_blob.h"
+#include "my_uart_poll.h"
+
 extern int my_if_uart_set_leds(uint8_t hid_leds);
 extern void my_if_uart_begin(int priority);
+extern int my_if_uart_get_config();
+extern int my_if_uart_set_config();
+extern int my_if_uart_store_config(const my_config_blob_t *cfg);
+extern int my_if_uart_check_config(const my_config_blob_t *cfg);
+extern int my_if_uart_apply_config(const my_config_blob_t *cfg);
+extern void my_if_uart_collect_config(my_config_blob_t *cfg);
+extern int my_if_uart_request_config(const my_config_blob_t *cfg,
+                                     TickType_t wait);
+extern uint32_t my_if_uart_fifo_overflows(void);
+extern uint32_t my_if_uart_buffer_overflows(void);
+extern uint32_t my_if_uart_rx_timeouts(void);
+extern const my_uart_poll_t *my_if_uart_poll_state(void);
+extern uint32_t my_if_uart_frames_terminated(void);
+extern uint32_t my_if_uart_frames_idle(void);
+extern uint32_t my_if_uart_config_applies(void);
+extern uint32_t my_if_uart_stack_free(void);
 
 #endif
 
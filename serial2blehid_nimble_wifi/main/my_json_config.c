@@ -0,0 +1,374 @@
+/**
+ * @file my_json_config.c
+ *   UARTの設定を1つのJSONオブジェクトで受け取るための、逐次読み込みのパーサ
+ *
+ *   以前は設定ごとにフォームのPOSTハンドラがあり、それぞれが受信、URLデコード、16進変換を繰り返していた。
+ *   ここでは次のような1つのオブジェクトを、httpd_req_recvで届いた分ずつ読み進める。
+ *
+ *     {"baud_rate":9600,"receive_buffer_len":20,"request_command":"51580d0a",
+ *      "terminator_sequence":"0d0a","terminator_sequence_replace":"09","save":true}
+ *
+ *   バイト列は16進文字列（偶数文字）で書く。書かなかったキーは、書き込み先の値のまま残る。
+ *   知らないキーは値ごと読み飛ばすので、GETで返したものに余分なキーがあってもそのまま送り返せる。
+ *   知らないキーの値なら、入れ子のオブジェクトや配列、エスケープ文字を含む文字列も読み飛ばす。
+ *   入れ子は深さと、文字列の中かどうかだけを覚えて読み飛ばすので、括弧の種類が合っているかや、
+ *   中身がJSONとして正しいかは調べない。
+ *   値は届いたそばから書き込み先へ直接書き込み、ヒープは使わない。文書全体を溜めることもしない。
+ *   キーと、知っているキーの値では、エスケープ文字を受け付けない。
+ *   エラーの位置は、エラーになった文字の位置。数値やtrue/falseの値のエラーは、値の直後の文字の位置になる。
+ *   値の範囲は調べないので、読み終わった後で呼び出し側が調べること。
+ */
+
+#include "my_json_config.h"
+
+#include <string.h>
+
+/**
+ * @brief 読み込みの状態
+ */
+enum {
+    MY_JSON_CONFIG_BEGIN = 0,  // '{' を待つ
+    MY_JSON_CONFIG_FIRST_KEY,  // 最初のキーか '}' を待つ
+    MY_JSON_CONFIG_KEY,        // キーの文字列の中
+    MY_JSON_CONFIG_COLON,      // ':' を待つ
+    MY_JSON_CONFIG_VALUE,      // 値の始まりを待つ
+    MY_JSON_CONFIG_STRING,     // 文字列の値の中
+    MY_JSON_CONFIG_SKIP,       // 読み飛ばすオブジェクトや配列の中
+    MY_JSON_CONFIG_SKIP_STRING,  // 読み飛ばすオブジェクトや配列の、文字列の中
+    MY_JSON_CONFIG_BARE,       // 数値やtrue/falseの中
+    MY_JSON_CONFIG_NEXT,       // ',' か '}' を待つ
+    MY_JSON_CONFIG_NEXT_KEY,   // ',' の後のキーを待つ
+    MY_JSON_CONFIG_DONE,       // オブジェクトが閉じた
+};
+
+/**
+ * @brief 知っているキー
+ */
+enum {
+    MY_JSON_CONFIG_BAUD_RATE = 0,
+    MY_JSON_CONFIG_RECEIVE_BUFFER_LEN,
+    MY_JSON_CONFIG_REQUEST_COMMAND,
+    MY_JSON_CONFIG_TERMINATOR_SEQUENCE,
+    MY_JSON_CONFIG_TERMINATOR_SEQUENCE_REPLACE,
+    MY_JSON_CONFIG_SAVE,
+    MY_JSON_CONFIG_FIELDS,
+};
+
+static const char *const my_json_config_keys[MY_JSON_CONFIG_FIELDS] = {
+    "baud_rate",
+    "receive_buffer_len",
+    "request_command",
+    "terminator_sequence",
+    "terminator_sequence_replace",
+    "save",
+};
+
+static bool my_json_config_is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int my_json_config_hex(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * @brief 16進文字列の値を書き込む先
+ * @param[out] len 長さの書き込み先
+ * @return バイト列の書き込み先。16進文字列のキーでなければNULL
+ */
+static uint8_t *my_json_config_seq(my_json_config_t *p, uint8_t **len) {
+    switch (p->field) {
+        case MY_JSON_CONFIG_REQUEST_COMMAND:
+            *len = &p->cfg->request_command_len;
+            return p->cfg->request_command;
+        case MY_JSON_CONFIG_TERMINATOR_SEQUENCE:
+            *len = &p->cfg->terminator_sequence_len;
+            return p->cfg->terminator_sequence;
+        case MY_JSON_CONFIG_TERMINATOR_SEQUENCE_REPLACE:
+            *len = &p->cfg->terminator_sequence_replace_len;
+            return p->cfg->terminator_sequence_replace;
+        default:
+            return NULL;
+    }
+}
+
+/**
+ * @brief キーを読み終えたときに呼ぶ
+ */
+static int my_json_config_end_key(my_json_config_t *p) {
+    p->tok[p->len] = '\0';
+    p->field = -1;
+    for (int i = 0; i < MY_JSON_CONFIG_FIELDS; i++) {
+        if (strcmp(p->tok, my_json_config_keys[i]) == 0) {
+            if (p->seen & (1u << i)) return MY_JSON_CONFIG_ERR_DUPLICATE;
+            p->seen |= 1u << i;
+            p->field = i;
+            break;
+        }
+    }
+    return MY_JSON_CONFIG_OK;
+}
+
+/**
+ * @brief 文字列の値の1文字。16進文字列なら、2文字ごとにバイト列へ書き込む
+ */
+static int my_json_config_string_char(my_json_config_t *p, char c) {
+    if (p->field < 0) return MY_JSON_CONFIG_OK;
+    uint8_t *len;
+    uint8_t *seq = my_json_config_seq(p, &len);
+    if (seq == NULL) return MY_JSON_CONFIG_ERR_TYPE;
+    int v = my_json_config_hex(c);
+    if (v < 0) return MY_JSON_CONFIG_ERR_VALUE;
+    if ((p->len & 1) == 0) {
+        if (p->len / 2 >= MY_CONFIG_BLOB_SEQ_MAX) {
+            return MY_JSON_CONFIG_ERR_TOO_LONG;
+        }
+        p->nibble = (uint8_t)v;
+    } else {
+        seq[p->len / 2] = (uint8_t)((p->nibble << 4) | v);
+    }
+    p->len++;
+    return MY_JSON_CONFIG_OK;
+}
+
+/**
+ * @brief 文字列の値を読み終えたときに呼ぶ
+ */
+static int my_json_config_end_string(my_json_config_t *p) {
+    if (p->field < 0) return MY_JSON_CONFIG_OK;
+    uint8_t *len;
+    if (my_json_config_seq(p, &len) == NULL) return MY_JSON_CONFIG_ERR_TYPE;
+    if (p->len & 1) return MY_JSON_CONFIG_ERR_VALUE;
+    *len = p->len / 2;
+    return MY_JSON_CONFIG_OK;
+}
+
+/**
+ * @brief 数値やtrue/falseを読み終えたときに呼ぶ
+ */
+static int my_json_config_end_bare(my_json_config_t *p) {
+    if (p->field < 0) return MY_JSON_CONFIG_OK;
+    p->tok[p->len] = '\0';
+    if (p->field == MY_JSON_CONFIG_SAVE) {
+        if (strcmp(p->tok, "true") == 0) {
+            p->save = true;
+        } else if (strcmp(p->tok, "false") == 0) {
+            p->save = false;
+        } else {
+            return MY_JSON_CONFIG_ERR_TYPE;
+        }
+        return MY_JSON_CONFIG_OK;
+    }
+    if (p->field != MY_JSON_CONFIG_BAUD_RATE &&
+        p->field != MY_JSON_CONFIG_RECEIVE_BUFFER_LEN) {
+        return MY_JSON_CONFIG_ERR_TYPE;
+    }
+    // 符号や小数点の無い、10進の整数だけを受け付ける
+    uint64_t v = 0;
+    if (p->len == 0 || p->len > 10) return MY_JSON_CONFIG_ERR_VALUE;
+    for (int i = 0; i < p->len; i++) {
+        if (p->tok[i] < '0' || p->tok[i] > '9') {
+            return (i == 0 && (p->tok[0] == 't' || p->tok[0] == 'f' ||
+                               p->tok[0] == 'n'))
+                       ? MY_JSON_CONFIG_ERR_TYPE
+                       : MY_JSON_CONFIG_ERR_VALUE;
+        }
+        v = v * 10 + (p->tok[i] - '0');
+    }
+    if (p->field == MY_JSON_CONFIG_BAUD_RATE) {
+        if (v > UINT32_MAX) return MY_JSON_CONFIG_ERR_VALUE;
+        p->cfg->baud_rate = (uint32_t)v;
+    } else {
+        if (v > UINT16_MAX) return MY_JSON_CONFIG_ERR_VALUE;
+        p->cfg->receive_buffer_len = (uint16_t)v;
+    }
+    return MY_JSON_CONFIG_OK;
+}
+
+/**
+ * @brief 1文字読み進める
+ */
+static int my_json_config_char(my_json_config_t *p, char c) {
+    switch (p->state) {
+        case MY_JSON_CONFIG_BEGIN:
+            if (my_json_config_is_space(c)) return MY_JSON_CONFIG_OK;
+            if (c != '{') return MY_JSON_CONFIG_ERR_SYNTAX;
+            p->state = MY_JSON_CONFIG_FIRST_KEY;
+            return MY_JSON_CONFIG_OK;
+        case MY_JSON_CONFIG_FIRST_KEY:
+        case MY_JSON_CONFIG_NEXT_KEY:
+            if (my_json_config_is_space(c)) return MY_JSON_CONFIG_OK;
+            if (c == '}' && p->state == MY_JSON_CONFIG_FIRST_KEY) {
+                p->state = MY_JSON_CONFIG_DONE;
+                return MY_JSON_CONFIG_OK;
+            }
+            if (c != '"') return MY_JSON_CONFIG_ERR_SYNTAX;
+            p->len = 0;
+            p->state = MY_JSON_CONFIG_KEY;
+            return MY_JSON_CONFIG_OK;
+        case MY_JSON_CONFIG_KEY:
+            if (c == '"') {
+                p->state = MY_JSON_CONFIG_COLON;
+                return my_json_config_end_key(p);
+            }
+            if (c == '\\' || (uint8_t)c < 0x20) {
+                return MY_JSON_CONFIG_ERR_SYNTAX;
+            }
+            if (p->len >= MY_JSON_CONFIG_KEY_MAX) {
+                return MY_JSON_CONFIG_ERR_TOO_LONG;
+            }
+            p->tok[p->len++] = c;
+            return MY_JSON_CONFIG_OK;
+        case MY_JSON_CONFIG_COLON:
+            if (my_json_config_is_space(c)) return MY_JSON_CONFIG_OK;
+            if (c != ':') return MY_JSON_CONFIG_ERR_SYNTAX;
+            p->state = MY_JSON_CONFIG_VALUE;
+            return MY_JSON_CONFIG_OK;
+        case MY_JSON_CONFIG_VALUE:
+            if (my_json_config_is_space(c)) return MY_JSON_CONFIG_OK;
+            p->len = 0;
+            if (c == '"') {
+                p->state = MY_JSON_CONFIG_STRING;
+                return MY_JSON_CONFIG_OK;
+            }
+            if (c == '{' || c == '[') {
+                if (p->field >= 0) return MY_JSON_CONFIG_ERR_TYPE;
+                p->depth = 1;
+                p->state = MY_JSON_CONFIG_SKIP;
+                return MY_JSON_CONFIG_OK;
+            }
+            if (c == '-' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z')) {
+                p->state = MY_JSON_CONFIG_BARE;
+                p->tok[p->len++] = c;
+                return MY_JSON_CONFIG_OK;
+            }
+            return MY_JSON_CONFIG_ERR_SYNTAX;
+        case MY_JSON_CONFIG_STRING:
+        case MY_JSON_CONFIG_SKIP_STRING:
+            if ((uint8_t)c < 0x20) return MY_JSON_CONFIG_ERR_SYNTAX;
+            if (p->field < 0 && (p->escape || c == '\\')) {
+                // 知らないキーの値なら、エスケープした文字も読み飛ばす
+                p->escape = !p->escape;
+                return MY_JSON_CONFIG_OK;
+            }
+            if (c == '"') {
+                if (p->state == MY_JSON_CONFIG_SKIP_STRING) {
+                    p->state = MY_JSON_CONFIG_SKIP;
+                    return MY_JSON_CONFIG_OK;
+                }
+                p->state = MY_JSON_CONFIG_NEXT;
+                return my_json_config_end_string(p);
+            }
+            if (c == '\\') return MY_JSON_CONFIG_ERR_SYNTAX;
+            return my_json_config_string_char(p, c);
+        case MY_JSON_CONFIG_SKIP:
+            if (c == '"') {
+                p->state = MY_JSON_CONFIG_SKIP_STRING;
+            } else if (c == '{' || c == '[') {
+                if (p->depth >= MY_JSON_CONFIG_DEPTH_MAX) {
+                    return MY_JSON_CONFIG_ERR_TOO_LONG;
+                }
+                p->depth++;
+            } else if (c == '}' || c == ']') {
+                if (--p->depth == 0) p->state = MY_JSON_CONFIG_NEXT;
+            }
+            return MY_JSON_CONFIG_OK;
+        case MY_JSON_CONFIG_BARE:
+            if (c == '-' || c == '+' || c == '.' || (c >= '0' && c <= '9') ||
+                (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+                if (p->len >= MY_JSON_CONFIG_BARE_MAX) {
+                    return MY_JSON_CONFIG_ERR_TOO_LONG;
+                }
+                p->tok[p->len++] = c;
+                return MY_JSON_CONFIG_OK;
+            }
+            // 値の終わり。この文字は次の状態で読む
+            p->state = MY_JSON_CONFIG_NEXT;
+            {
+                int ret = my_json_config_end_bare(p);
+                if (ret != MY_JSON_CONFIG_OK) return ret;
+            }
+            return my_json_config_char(p, c);
+        case MY_JSON_CONFIG_NEXT:
+            if (my_json_config_is_space(c)) return MY_JSON_CONFIG_OK;
+            if (c == ',') {
+                p->state = MY_JSON_CONFIG_NEXT_KEY;
+                return MY_JSON_CONFIG_OK;
+            }
+            if (c == '}') {
+                p->state = MY_JSON_CONFIG_DONE;
+                return MY_JSON_CONFIG_OK;
+            }
+            return MY_JSON_CONFIG_ERR_SYNTAX;
+        case MY_JSON_CONFIG_DONE:
+        default:
+            if (my_json_config_is_space(c)) return MY_JSON_CONFIG_OK;
+            return MY_JSON_CONFIG_ERR_SYNTAX;
+    }
+}
+
+/**
+ * @brief パーサを準備する
+ * @param p パーサ
+ * @param cfg 書き込み先。書かれなかったキーの値はそのまま残るので、現在の設定値を入れておく
+ */
+void my_json_config_init(my_json_config_t *p, my_config_blob_t *cfg) {
+    memset(p, 0, sizeof(*p));
+    p->cfg = cfg;
+    p->field = -1;
+}
+
+/**
+ * @brief 届いた分を読み進める。何度に分けて渡してもよい
+ * @param p パーサ
+ * @param buf 届いたバイト列
+ * @param len その長さ
+ * @return 今までにエラーが無ければ MY_JSON_CONFIG_OK。あれば最初のエラー
+ */
+int my_json_config_feed(my_json_config_t *p, const char *buf, int len) {
+    for (int i = 0; i < len && p->error == MY_JSON_CONFIG_OK; i++) {
+        p->error = my_json_config_char(p, buf[i]);
+        if (p->error == MY_JSON_CONFIG_OK) {
+            p->pos++;
+        }
+    }
+    return p->error;
+}
+
+/**
+ * @brief 全て渡し終えたときに呼ぶ
+ * @return オブジェクトが閉じていて、エラーが無ければ MY_JSON_CONFIG_OK
+ */
+int my_json_config_finish(my_json_config_t *p) {
+    if (p->error == MY_JSON_CONFIG_OK && p->state != MY_JSON_CONFIG_DONE) {
+        p->error = MY_JSON_CONFIG_ERR_INCOMPLETE;
+    }
+    return p->error;
+}
+
+/**
+ * @brief 読み込みの結果の名前
+ */
+const char *my_json_config_result_name(int result) {
+    switch (result) {
+        case MY_JSON_CONFIG_OK:
+            return "ok";
+        case MY_JSON_CONFIG_ERR_SYNTAX:
+            return "syntax";
+        case MY_JSON_CONFIG_ERR_TYPE:
+            return "type";
+        case MY_JSON_CONFIG_ERR_VALUE:
+            return "value";
+        case MY_JSON_CONFIG_ERR_TOO_LONG:
+            return "too long";
+        case MY_JSON_CONFIG_ERR_DUPLICATE:
+            return "duplicate";
+        case MY_JSON_CONFIG_ERR_INCOMPLETE:
+            return "incomplete";
+        default:
+            return "-";
+    }
+}
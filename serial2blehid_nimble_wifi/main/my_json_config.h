@@ -0,0 +1,59 @@
+/**
+ * @file my_json_config.h
+ *   UARTの設定を1つのJSONオブジェクトで受け取るための、逐次読み込みのパーサ
+ */
+
+#ifndef my_json_config_h
+#define my_json_config_h 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "my_config_blob.h"
+
+// キーの最大長
+#define MY_JSON_CONFIG_KEY_MAX (32)
+
+// 数値やtrue/falseの最大長
+#define MY_JSON_CONFIG_BARE_MAX (12)
+
+// 知らないキーの値として読み飛ばす、入れ子のオブジェクトや配列の最大の深さ
+#define MY_JSON_CONFIG_DEPTH_MAX (255)
+
+/**
+ * @brief 読み込みの結果
+ */
+typedef enum {
+    MY_JSON_CONFIG_OK = 0,
+    MY_JSON_CONFIG_ERR_SYNTAX = -1,      // JSONとして読めない
+    MY_JSON_CONFIG_ERR_TYPE = -2,        // 値の型が違う。知っているキーのオブジェクトや配列も含む
+    MY_JSON_CONFIG_ERR_VALUE = -3,       // 数値や16進文字列として読めない
+    MY_JSON_CONFIG_ERR_TOO_LONG = -4,    // キーや値が長すぎる、または入れ子が深すぎる
+    MY_JSON_CONFIG_ERR_DUPLICATE = -5,   // 同じキーが2度ある
+    MY_JSON_CONFIG_ERR_INCOMPLETE = -6,  // オブジェクトが閉じていない
+} my_json_config_result_t;
+
+/**
+ * @brief パーサ。届いた分だけ読み進め、値は設定値へ直接書き込む
+ */
+typedef struct {
+    my_config_blob_t *cfg;  // 書き込み先
+    uint8_t state;
+    int8_t field;     // 今読んでいる値のキー。知らないキーなら-1
+    uint8_t len;      // 今読んでいるキー、数値、16進文字列の長さ
+    uint8_t nibble;   // 16進文字列の、上位4ビット
+    char tok[MY_JSON_CONFIG_KEY_MAX + 1];  // キーか数値
+    uint32_t seen;    // 読んだキー（ビット）
+    bool save;        // "save": true なら、反映した後でNVSにも保存する
+    uint8_t depth;    // 読み飛ばしている入れ子の深さ
+    bool escape;      // 読み飛ばしている文字列の中で、直前が '\\'
+    int error;        // 最初のエラー
+    uint32_t pos;     // 読んだバイト数。エラーならエラーになった文字の位置（先頭がゼロ）
+} my_json_config_t;
+
+extern void my_json_config_init(my_json_config_t *p, my_config_blob_t *cfg);
+extern int my_json_config_feed(my_json_config_t *p, const char *buf, int len);
+extern int my_json_config_finish(my_json_config_t *p);
+extern const char *my_json_config_result_name(int result);
+
+#endif
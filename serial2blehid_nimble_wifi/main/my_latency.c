@@ -0,0 +1,337 @@
+/**
+ * @file my_latency.c
+ *   UARTの受信からBLE-HIDの送信完了までの時間を、段ごとに固定幅のヒストグラムに集計する
+ *
+ *   時刻は全て esp_timer_get_time() で取る。フレームの各段の時刻は my_frame_stamp_t で運ばれ、
+ *   送信タスクが最初のレポートを送った後に my_latency_record_frame() でまとめて集計する。
+ *   レポートごとの ble_gattc_notify から BLE_GAP_EVENT_NOTIFY_TX までの時間は、
+ *   接続ごとに送った時刻を順に覚えておき、送信完了が来たら古い順に取り出して計る。
+ *   notifyのNOTIFY_TXは、NimBLEがパケットをコントローラへ渡した時点で来るので、
+ *   この段はホスト内の時間になる。indicateは相手の応答までの時間になる。
+ *   トリガから最初のレポートの送信完了までは、フレームを送り始める前に起点を覚えておき、
+ *   次の送信完了で計る。
+ *
+ *   ビンは、100us〜1sを1-2-5で刻んだ固定の上限で分ける。集計は加算だけなので、
+ *   送信タスクやNimBLEのホストタスクから呼んでも時間はかからない。
+ *   結果はhttpdの /latency.json で読み出すか、my_latency_dump() でコンソールに出す。
+ */
+
+#include "my_latency.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "host/ble_hs.h"
+
+#define MY_LATENCY_TAG "LATENCY"
+
+// ビンの上限(us)。この値未満が入る。最後のビンは上限無し
+static const uint32_t my_latency_bounds[MY_LATENCY_BUCKETS - 1] = {
+    100,   200,    500,    1000,   2000,   5000,   10000,
+    20000, 50000,  100000, 200000, 500000, 1000000,
+};
+
+/**
+ * @brief 1つの接続で、送信完了を待っている通知の送信時刻
+ */
+typedef struct {
+    bool used;
+    uint16_t conn_handle;
+    int head;   // 次に取り出す位置
+    int count;  // 覚えている数
+    int64_t sent_us[MY_LATENCY_PENDING_MAX];
+} my_latency_conn_t;
+
+// 段ごとのヒストグラム
+static my_latency_hist_t my_latency_hists[MY_LATENCY_STAGES];
+
+// 接続ごとの送信時刻
+static my_latency_conn_t my_latency_conns[MY_LATENCY_CONN_MAX];
+
+// トリガから最初の送信完了までを計る起点。0なら計らない
+static int64_t my_latency_origin_us = 0;
+
+// 状態を読み書きするときのロック
+static SemaphoreHandle_t my_latency_mutex = NULL;
+
+static void my_latency_lock(void) {
+    if (my_latency_mutex != NULL) {
+        xSemaphoreTake(my_latency_mutex, portMAX_DELAY);
+    }
+}
+
+static void my_latency_unlock(void) {
+    if (my_latency_mutex != NULL) {
+        xSemaphoreGive(my_latency_mutex);
+    }
+}
+
+/**
+ * @brief 時間をヒストグラムに加える。ロックしてから呼ぶ
+ */
+static void my_latency_add(my_latency_stage_t stage, int64_t us) {
+    if (stage >= MY_LATENCY_STAGES || us < 0) return;
+    uint32_t v = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+    my_latency_hist_t *h = &my_latency_hists[stage];
+    int b = 0;
+    while (b < MY_LATENCY_BUCKETS - 1 && v >= my_latency_bounds[b]) {
+        b++;
+    }
+    h->buckets[b]++;
+    if (h->count == 0 || v < h->min_us) {
+        h->min_us = v;
+    }
+    if (v > h->max_us) {
+        h->max_us = v;
+    }
+    h->sum_us += v;
+    h->count++;
+}
+
+/**
+ * @brief 2つの時刻の差を加える。どちらかが分からない(0)ときは加えない。ロックしてから呼ぶ
+ */
+static void my_latency_add_span(my_latency_stage_t stage, int64_t from_us,
+                                int64_t to_us) {
+    if (from_us == 0 || to_us == 0) return;
+    my_latency_add(stage, to_us - from_us);
+}
+
+/**
+ * @brief 接続の送信時刻を探す。ロックしてから呼ぶ
+ * @param create 見つからなければ空きを使う
+ * @return 見つからなければNULL
+ */
+static my_latency_conn_t *my_latency_conn_find(uint16_t conn_handle,
+                                               bool create) {
+    my_latency_conn_t *free_slot = NULL;
+    for (int i = 0; i < MY_LATENCY_CONN_MAX; i++) {
+        my_latency_conn_t *c = &my_latency_conns[i];
+        if (c->used && c->conn_handle == conn_handle) {
+            return c;
+        }
+        if (!c->used && free_slot == NULL) {
+            free_slot = c;
+        }
+    }
+    if (create && free_slot != NULL) {
+        memset(free_slot, 0, sizeof(*free_slot));
+        free_slot->used = true;
+        free_slot->conn_handle = conn_handle;
+        return free_slot;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 初期化
+ */
+void my_latency_init(void) {
+    if (my_latency_mutex == NULL) {
+        my_latency_mutex = xSemaphoreCreateMutex();
+        if (my_latency_mutex == NULL) {
+            ESP_LOGE(MY_LATENCY_TAG, "Can not create mutex!");
+        }
+    }
+    my_latency_lock();
+    memset(my_latency_conns, 0, sizeof(my_latency_conns));
+    my_latency_unlock();
+    my_latency_reset();
+}
+
+/**
+ * @brief ヒストグラムを空にする
+ */
+void my_latency_reset(void) {
+    my_latency_lock();
+    memset(my_latency_hists, 0, sizeof(my_latency_hists));
+    my_latency_origin_us = 0;
+    my_latency_unlock();
+}
+
+/**
+ * @brief 1つの段の時間を加える
+ * @param us 時間。負なら加えない
+ */
+void my_latency_record(my_latency_stage_t stage, int64_t us) {
+    my_latency_lock();
+    my_latency_add(stage, us);
+    my_latency_unlock();
+}
+
+/**
+ * @brief フレームを送り始める前に呼ぶ。次の送信完了で、トリガからの時間を計る
+ * @param stamp フレームが各段を通過した時刻
+ */
+void my_latency_frame_begin(const my_frame_stamp_t *stamp) {
+    int64_t origin_us =
+        stamp->trigger_us != 0 ? stamp->trigger_us : stamp->rx_first_us;
+    my_latency_lock();
+    my_latency_origin_us = origin_us;
+    my_latency_unlock();
+}
+
+/**
+ * @brief 最初のレポートを送った後に呼ぶ。フレームの各段の時間を加える
+ * @param stamp フレームが各段を通過した時刻
+ * @param dequeued_us 送信タスクがキューから取り出した時刻
+ * @param first_report_us 最初のレポートを送信待ちに入れた時刻。送れなければ0
+ */
+void my_latency_record_frame(const my_frame_stamp_t *stamp,
+                             int64_t dequeued_us, int64_t first_report_us) {
+    my_latency_lock();
+    // ストリームで受信しているときは、リクエストを送っていない
+    if (stamp->request_us != 0) {
+        my_latency_add_span(MY_LATENCY_TRIGGER_TO_REQUEST, stamp->trigger_us,
+                            stamp->request_us);
+        my_latency_add_span(MY_LATENCY_REQUEST_TO_RX, stamp->request_us,
+                            stamp->rx_first_us);
+    }
+    my_latency_add_span(MY_LATENCY_RX_TO_TERMINATOR, stamp->rx_first_us,
+                        stamp->rx_done_us);
+    my_latency_add_span(MY_LATENCY_TERMINATOR_TO_HANDOFF, stamp->rx_done_us,
+                        stamp->queued_us);
+    my_latency_add_span(MY_LATENCY_HANDOFF_TO_SENDER, stamp->queued_us,
+                        dequeued_us);
+    my_latency_add_span(MY_LATENCY_SENDER_TO_REPORT, dequeued_us,
+                        first_report_us);
+    my_latency_unlock();
+}
+
+/**
+ * @brief ble_gattc_notify などでレポートを送る直前に呼ぶ
+ * @param conn_handle 送る接続
+ */
+void my_latency_notify_sent(uint16_t conn_handle) {
+    int64_t now_us = esp_timer_get_time();
+    my_latency_lock();
+    my_latency_conn_t *c = my_latency_conn_find(conn_handle, true);
+    if (c != NULL) {
+        if (c->count == MY_LATENCY_PENDING_MAX) {
+            // 送信完了が来なかったものは捨てる
+            c->head = (c->head + 1) % MY_LATENCY_PENDING_MAX;
+            c->count--;
+        }
+        c->sent_us[(c->head + c->count) % MY_LATENCY_PENDING_MAX] = now_us;
+        c->count++;
+    }
+    my_latency_unlock();
+}
+
+/**
+ * @brief BLE_GAP_EVENT_NOTIFY_TX で呼ぶ。送った時刻からの時間を加える。
+ *        indicateは送信直後(status=0)にも呼ばれるので、応答(status!=0)のときに計る。
+ *        送れなかったとき(notifyでstatus!=0、indicateでBLE_HS_EDONE以外)は加えない
+ */
+void my_latency_notify_tx(uint16_t conn_handle, int status, bool indication) {
+    if (indication && status == 0) return;
+    int64_t now_us = esp_timer_get_time();
+    my_latency_lock();
+    my_latency_conn_t *c = my_latency_conn_find(conn_handle, false);
+    if (c != NULL && c->count > 0) {
+        int64_t sent_us = c->sent_us[c->head];
+        c->head = (c->head + 1) % MY_LATENCY_PENDING_MAX;
+        c->count--;
+        bool ok = indication ? status == BLE_HS_EDONE : status == 0;
+        if (ok) {
+            my_latency_add(MY_LATENCY_NOTIFY_TO_TX, now_us - sent_us);
+            if (my_latency_origin_us != 0) {
+                my_latency_add(MY_LATENCY_TOTAL, now_us - my_latency_origin_us);
+                my_latency_origin_us = 0;
+            }
+        }
+    }
+    my_latency_unlock();
+}
+
+/**
+ * @brief 切断時に呼ぶ。送信完了を待っていた通知を忘れる
+ */
+void my_latency_conn_close(uint16_t conn_handle) {
+    my_latency_lock();
+    my_latency_conn_t *c = my_latency_conn_find(conn_handle, false);
+    if (c != NULL) {
+        c->used = false;
+    }
+    my_latency_unlock();
+}
+
+/**
+ * @brief 全ての段のヒストグラムを取り出す
+ * @param[out] hists MY_LATENCY_STAGES 個の取り出し先
+ */
+void my_latency_snapshot(my_latency_hist_t *hists) {
+    my_latency_lock();
+    memcpy(hists, my_latency_hists, sizeof(my_latency_hists));
+    my_latency_unlock();
+}
+
+/**
+ * @brief ビンの上限(us)。最後のビンは0（上限無し）
+ */
+uint32_t my_latency_bucket_bound(int bucket) {
+    if (bucket < 0 || bucket >= MY_LATENCY_BUCKETS - 1) return 0;
+    return my_latency_bounds[bucket];
+}
+
+/**
+ * @brief 段の名前
+ */
+const char *my_latency_stage_name(int stage) {
+    switch (stage) {
+        case MY_LATENCY_TRIGGER_TO_REQUEST:
+            return "trigger_to_request";
+        case MY_LATENCY_REQUEST_TO_RX:
+            return "request_to_rx";
+        case MY_LATENCY_RX_TO_TERMINATOR:
+            return "rx_to_terminator";
+        case MY_LATENCY_TERMINATOR_TO_HANDOFF:
+            return "terminator_to_handoff";
+        case MY_LATENCY_HANDOFF_TO_SENDER:
+            return "handoff_to_sender";
+        case MY_LATENCY_SENDER_TO_REPORT:
+            return "sender_to_report";
+        case MY_LATENCY_NOTIFY_TO_TX:
+            return "notify_to_tx";
+        case MY_LATENCY_TOTAL:
+            return "total";
+        default:
+            return "-";
+    }
+}
+
+/**
+ * @brief 全ての段のヒストグラムをコンソールに出す。1段1行
+ */
+void my_latency_dump(void) {
+    static my_latency_hist_t hists[MY_LATENCY_STAGES];
+    char line[256];
+    my_latency_snapshot(hists);
+
+    // ビンの上限を見出しにする
+    int pos = snprintf(line, sizeof(line), "bounds(us)");
+    for (int b = 0; b < MY_LATENCY_BUCKETS - 1; b++) {
+        pos += snprintf(line + pos, sizeof(line) - pos, " <%lu",
+                        my_latency_bounds[b]);
+    }
+    snprintf(line + pos, sizeof(line) - pos, " more");
+    ESP_LOGI(MY_LATENCY_TAG, "%s", line);
+
+    for (int s = 0; s < MY_LATENCY_STAGES; s++) {
+        const my_latency_hist_t *h = &hists[s];
+        pos = snprintf(line, sizeof(line), "%s n=%lu min=%lu avg=%lu max=%lu:",
+                       my_latency_stage_name(s), h->count, h->min_us,
+                       h->count ? (uint32_t)(h->sum_us / h->count) : 0,
+                       h->max_us);
+        for (int b = 0; b < MY_LATENCY_BUCKETS && pos < (int)sizeof(line);
+             b++) {
+            pos += snprintf(line + pos, sizeof(line) - pos, " %lu",
+                            h->buckets[b]);
+        }
+        ESP_LOGI(MY_LATENCY_TAG, "%s", line);
+    }
+}
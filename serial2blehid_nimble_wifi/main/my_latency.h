@@ -0,0 +1,66 @@
+/**
+ * @file my_latency.h
+ *   UARTの受信からBLE-HIDの送信完了までの時間を、段ごとに固定幅のヒストグラムに集計する
+ */
+
+#ifndef my_latency_h
+#define my_latency_h 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "my_frame_queue.h"
+#include "sdkconfig.h"
+
+// 送信完了を待っている通知を覚えておく接続の数
+#define MY_LATENCY_CONN_MAX CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+
+// 1接続で送信完了を待っている通知を覚えておく数。スケジューラのクレジットより多くする
+#define MY_LATENCY_PENDING_MAX (16)
+
+// ヒストグラムのビンの数。最後のビンは上限無し
+#define MY_LATENCY_BUCKETS (14)
+
+/**
+ * @brief 計る段
+ */
+typedef enum {
+    MY_LATENCY_TRIGGER_TO_REQUEST = 0,  // トリガ → リクエストコマンド送信
+    MY_LATENCY_REQUEST_TO_RX,           // リクエストコマンド送信 → 最初の1バイト受信
+    MY_LATENCY_RX_TO_TERMINATOR,        // 最初の1バイト受信 → 終端文字列
+    MY_LATENCY_TERMINATOR_TO_HANDOFF,   // 終端文字列 → フレームキューに入れる
+    MY_LATENCY_HANDOFF_TO_SENDER,       // フレームキューに入れる → 送信タスクが取り出す
+    MY_LATENCY_SENDER_TO_REPORT,        // 送信タスクが取り出す → 最初のレポートを送信待ちに入れる
+    MY_LATENCY_NOTIFY_TO_TX,            // ble_gattc_notify → BLE_GAP_EVENT_NOTIFY_TX（レポートごと）
+    MY_LATENCY_TOTAL,                   // トリガ → 最初のレポートのBLE_GAP_EVENT_NOTIFY_TX
+    MY_LATENCY_STAGES,
+} my_latency_stage_t;
+
+/**
+ * @brief 1つの段のヒストグラム
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t buckets[MY_LATENCY_BUCKETS];
+} my_latency_hist_t;
+
+extern void my_latency_init(void);
+extern void my_latency_reset(void);
+extern void my_latency_record(my_latency_stage_t stage, int64_t us);
+extern void my_latency_frame_begin(const my_frame_stamp_t *stamp);
+extern void my_latency_record_frame(const my_frame_stamp_t *stamp,
+                                    int64_t dequeued_us,
+                                    int64_t first_report_us);
+extern void my_latency_notify_sent(uint16_t conn_handle);
+extern void my_latency_notify_tx(uint16_t conn_handle, int status,
+                                 bool indication);
+extern void my_latency_conn_close(uint16_t conn_handle);
+extern void my_latency_snapshot(my_latency_hist_t *hists);
+extern uint32_t my_latency_bucket_bound(int bucket);
+extern const char *my_latency_stage_name(int stage);
+extern void my_latency_dump(void);
+
+#endif
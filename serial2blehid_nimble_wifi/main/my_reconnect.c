@@ -0,0 +1,221 @@
+/**
+ * @file my_reconnect.c
+ *   切断や起動のあと、ボンディング済みのセントラルへ早く再接続するためのアドバタイズの段階と、
+ *   再接続にかかった時間の記録
+ *
+ *   以前は常に既定の間隔で一般のアドバタイズを続けていたので、監視タイムアウトやPCのスリープ復帰の後は、
+ *   セントラルの遅いバックグラウンドスキャンに見つかるまで再接続できなかった。
+ *   ここでは、きっかけ（起動、切断）ごとに
+ *     1. 最後に接続していたボンディング済みのセントラルへ、高デューティの指向性アドバタイズ（1.28s）
+ *     2. 短い間隔(20ms〜30ms)のアドバタイズ（30s）
+ *     3. 誰でも接続できる、長い間隔(152.5ms〜211.25ms)のアドバタイズ（接続するまで）
+ *   の順に進める。相手のいない段階は飛ばす。
+ *   2.をホワイトリストで絞り、ボンディング済みのセントラルだけが接続できるようにするのは、
+ *   ボンディング済みのセントラルが切断したときだけ。起動や、接続後に次のセントラルを待つときに絞ると、
+ *   新しいセントラルやボンディングしていないセントラルが31s余り接続できない。
+ *   接続後に次のセントラルを待つときは、1.も飛ばして2.から始める。
+ *   アドバタイズそのものは ble_func.c の bleprph_advertise() が、ここで決めた段階で行う。
+ *
+ *   きっかけから接続までの時間を、接続できた段階ごとに記録する。
+ *   呼び出しはNimBLEのホストタスクから、読み出しはhttpdから行うので、ロックで守る。
+ */
+
+#include "my_reconnect.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define MY_RECONNECT_TAG "RECONNECT"
+
+// 記録
+static my_reconnect_stats_t my_reconnect_stats;
+
+// きっかけの時刻(ms)
+static uint32_t my_reconnect_begin_ms = 0;
+
+// 短い間隔の段階をホワイトリストで絞ってよいか
+static bool my_reconnect_whitelist_ok = false;
+
+// 状態を読み書きするときのロック
+static SemaphoreHandle_t my_reconnect_mutex = NULL;
+
+/**
+ * @brief 起動からの時刻(ms)
+ */
+static uint32_t my_reconnect_now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void my_reconnect_lock(void) {
+    if (my_reconnect_mutex != NULL) {
+        xSemaphoreTake(my_reconnect_mutex, portMAX_DELAY);
+    }
+}
+
+static void my_reconnect_unlock(void) {
+    if (my_reconnect_mutex != NULL) {
+        xSemaphoreGive(my_reconnect_mutex);
+    }
+}
+
+/**
+ * @brief 初期化。BLEの初期化前に呼ぶ
+ */
+void my_reconnect_init(void) {
+    if (my_reconnect_mutex == NULL) {
+        my_reconnect_mutex = xSemaphoreCreateMutex();
+        if (my_reconnect_mutex == NULL) {
+            ESP_LOGE(MY_RECONNECT_TAG, "Can not create mutex!");
+        }
+    }
+    my_reconnect_lock();
+    memset(&my_reconnect_stats, 0, sizeof(my_reconnect_stats));
+    for (int i = 0; i < MY_RECONNECT_STAGES; i++) {
+        my_reconnect_stats.stage_at_ms[i] = -1;
+    }
+    my_reconnect_stats.connected_ms = -1;
+    my_reconnect_unlock();
+}
+
+/**
+ * @brief アドバタイズを最初の段階から始めることにする
+ * @param cause きっかけ
+ * @param bonded 切断したセントラルがボンディング済みか。切断以外のきっかけでは使わない
+ */
+void my_reconnect_begin(my_reconnect_cause_t cause, bool bonded) {
+    my_reconnect_lock();
+    my_reconnect_begin_ms = my_reconnect_now_ms();
+    my_reconnect_whitelist_ok = cause == MY_RECONNECT_CAUSE_DISCONNECT && bonded;
+    my_reconnect_stats.active = true;
+    my_reconnect_stats.cause = (uint8_t)cause;
+    my_reconnect_stats.stage = cause == MY_RECONNECT_CAUSE_ANOTHER
+                                   ? MY_RECONNECT_FAST
+                                   : MY_RECONNECT_DIRECTED;
+    my_reconnect_stats.whitelist = false;
+    for (int i = 0; i < MY_RECONNECT_STAGES; i++) {
+        my_reconnect_stats.stage_at_ms[i] = -1;
+    }
+    my_reconnect_stats.connected_ms = -1;
+    my_reconnect_unlock();
+}
+
+/**
+ * @brief 次に始めるアドバタイズの段階
+ */
+my_reconnect_stage_t my_reconnect_stage(void) {
+    return (my_reconnect_stage_t)my_reconnect_stats.stage;
+}
+
+/**
+ * @brief 短い間隔の段階を、ホワイトリストで絞ってよいか。
+ *        ボンディング済みのセントラルが切断したときだけ絞る
+ */
+bool my_reconnect_whitelist_allowed(void) {
+    return my_reconnect_whitelist_ok;
+}
+
+/**
+ * @brief アドバタイズを始めたときに呼ぶ。相手がいなくて段階を飛ばしたときは、飛ばした先の段階を渡す
+ * @param stage 始めた段階
+ * @param whitelist ホワイトリストで絞ったか
+ */
+void my_reconnect_enter(my_reconnect_stage_t stage, bool whitelist) {
+    my_reconnect_lock();
+    my_reconnect_stats.stage = (uint8_t)stage;
+    if (stage == MY_RECONNECT_FAST) {
+        my_reconnect_stats.whitelist = whitelist;
+    }
+    if (my_reconnect_stats.stage_at_ms[stage] < 0) {
+        my_reconnect_stats.stage_at_ms[stage] =
+            (int32_t)(my_reconnect_now_ms() - my_reconnect_begin_ms);
+    }
+    my_reconnect_stats.started++;
+    my_reconnect_unlock();
+}
+
+/**
+ * @brief アドバタイズが時間切れになったときに呼ぶ。次の段階へ進む
+ */
+void my_reconnect_timeout(void) {
+    my_reconnect_lock();
+    if (my_reconnect_stats.stage + 1 < MY_RECONNECT_STAGES) {
+        my_reconnect_stats.stage++;
+    }
+    my_reconnect_stats.timeouts++;
+    my_reconnect_unlock();
+}
+
+/**
+ * @brief セントラルが接続したときに呼ぶ。きっかけから接続までの時間を、今の段階に記録する
+ */
+void my_reconnect_connected(void) {
+    my_reconnect_lock();
+    if (!my_reconnect_stats.active) {
+        my_reconnect_unlock();
+        return;
+    }
+    uint32_t elapsed = my_reconnect_now_ms() - my_reconnect_begin_ms;
+    int stage = my_reconnect_stats.stage;
+    my_reconnect_stage_stats_t *s = &my_reconnect_stats.stages[stage];
+    if (s->count == 0 || elapsed < s->min_ms) {
+        s->min_ms = elapsed;
+    }
+    if (elapsed > s->max_ms) {
+        s->max_ms = elapsed;
+    }
+    s->count++;
+    s->sum_ms += elapsed;
+    my_reconnect_stats.connected_ms = (int32_t)elapsed;
+    my_reconnect_stats.active = false;
+    int cause = my_reconnect_stats.cause;
+    my_reconnect_unlock();
+
+    ESP_LOGI(MY_RECONNECT_TAG, "connected %lu ms after %s, via %s", elapsed,
+             my_reconnect_cause_name(cause), my_reconnect_stage_name(stage));
+}
+
+/**
+ * @brief 記録を取り出す
+ * @param[out] out 取り出し先
+ */
+void my_reconnect_snapshot(my_reconnect_stats_t *out) {
+    my_reconnect_lock();
+    *out = my_reconnect_stats;
+    my_reconnect_unlock();
+}
+
+/**
+ * @brief 段階の名前
+ */
+const char *my_reconnect_stage_name(int stage) {
+    switch (stage) {
+        case MY_RECONNECT_DIRECTED:
+            return "directed";
+        case MY_RECONNECT_FAST:
+            return "fast";
+        case MY_RECONNECT_SLOW:
+            return "slow";
+        default:
+            return "-";
+    }
+}
+
+/**
+ * @brief きっかけの名前
+ */
+const char *my_reconnect_cause_name(int cause) {
+    switch (cause) {
+        case MY_RECONNECT_CAUSE_BOOT:
+            return "boot";
+        case MY_RECONNECT_CAUSE_DISCONNECT:
+            return "disconnect";
+        case MY_RECONNECT_CAUSE_ANOTHER:
+            return "connect";
+        default:
+            return "-";
+    }
+}
@@ -0,0 +1,82 @@
+/**
+ * @file my_reconnect.h
+ *   切断や起動のあと、ボンディング済みのセントラルへ早く再接続するためのアドバタイズの段階と、
+ *   再接続にかかった時間の記録
+ */
+
+#ifndef my_reconnect_h
+#define my_reconnect_h 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// 高デューティの指向性アドバタイズを続ける時間(ms)。規格上の上限は1.28s
+#define MY_RECONNECT_DIRECTED_MS (1280)
+
+// 短い間隔のアドバタイズを続ける時間(ms)
+#define MY_RECONNECT_FAST_MS (30000)
+
+// 短い間隔のアドバタイズの間隔（0.625ms単位。32 = 20ms, 48 = 30ms）
+#define MY_RECONNECT_FAST_ITVL_MIN (32)
+#define MY_RECONNECT_FAST_ITVL_MAX (48)
+
+// 長い間隔のアドバタイズの間隔（0.625ms単位。244 = 152.5ms, 338 = 211.25ms）
+#define MY_RECONNECT_SLOW_ITVL_MIN (244)
+#define MY_RECONNECT_SLOW_ITVL_MAX (338)
+
+/**
+ * @brief アドバタイズの段階
+ */
+typedef enum {
+    MY_RECONNECT_DIRECTED = 0,  // 最後のセントラルへの高デューティの指向性アドバタイズ
+    MY_RECONNECT_FAST,          // 短い間隔。ボンディング済みのセントラルが切断したときだけホワイトリストで絞る
+    MY_RECONNECT_SLOW,          // 長い間隔。誰でも接続できる
+    MY_RECONNECT_STAGES,
+} my_reconnect_stage_t;
+
+/**
+ * @brief アドバタイズを始めたきっかけ
+ */
+typedef enum {
+    MY_RECONNECT_CAUSE_BOOT = 0,    // 起動
+    MY_RECONNECT_CAUSE_DISCONNECT,  // 切断
+    MY_RECONNECT_CAUSE_ANOTHER,     // 接続後、次のセントラルを待つ。指向性アドバタイズは飛ばす
+} my_reconnect_cause_t;
+
+/**
+ * @brief 段階ごとの、その段階で接続できたときの時間の統計
+ */
+typedef struct {
+    uint32_t count;   // この段階で接続できた回数
+    uint32_t min_ms;  // きっかけから接続までの最短時間
+    uint32_t max_ms;  // 最長時間
+    uint32_t sum_ms;  // 合計。平均を出すのに使う
+} my_reconnect_stage_stats_t;
+
+/**
+ * @brief 再接続の記録
+ */
+typedef struct {
+    bool active;                // アドバタイズ中で、接続を待っている
+    uint8_t cause;              // 今回（接続済みなら最後）のきっかけ my_reconnect_cause_t
+    uint8_t stage;              // 今回（接続済みなら最後）の段階 my_reconnect_stage_t
+    bool whitelist;             // 短い間隔の段階をホワイトリストで絞ったか
+    int32_t stage_at_ms[MY_RECONNECT_STAGES];  // きっかけから各段階を始めるまでの時間。-1なら始めていない
+    int32_t connected_ms;       // きっかけから接続までの時間。-1なら接続していない
+    uint32_t started;           // アドバタイズを始めた回数
+    uint32_t timeouts;          // 段階の時間切れで次の段階へ進んだ回数
+    my_reconnect_stage_stats_t stages[MY_RECONNECT_STAGES];
+} my_reconnect_stats_t;
+
+extern void my_reconnect_init(void);
+extern void my_reconnect_begin(my_reconnect_cause_t cause, bool bonded);
+extern my_reconnect_stage_t my_reconnect_stage(void);
+extern bool my_reconnect_whitelist_allowed(void);
+extern void my_reconnect_enter(my_reconnect_stage_t stage, bool whitelist);
+extern void my_reconnect_timeout(void);
+extern void my_reconnect_connected(void);
+extern void my_reconnect_snapshot(my_reconnect_stats_t *out);
+extern const char *my_reconnect_stage_name(int stage);
+extern const char *my_reconnect_cause_name(int cause);
+
+#endif
@@ -5,17 +5,28 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef ESP_PLATFORM
+#include "esp_attr.h"
+// ISRからも呼ばれる関数はIRAMに置く
+#define MY_RING_BUFFER_ISR_ATTR IRAM_ATTR
+#else
+#define MY_RING_BUFFER_ISR_ATTR
+#endif
+
 /**
- * @brief リングバッファを指定サイズで初期化する
+ * @brief リングバッファを指定サイズで初期化する。
+ *        領域は2のべき乗に切り上げるが、残すデータ数はsizeのまま
  */
 bool my_ring_buffer_init(my_ring_buffer_t *rb, int size) {
+    uint32_t cap = 1;
+    while (cap < (uint32_t)size) cap <<= 1;
     free(rb->buffer);
-    rb->buffer = (uint8_t *)malloc(sizeof(uint8_t) * size);
+    rb->buffer = (uint8_t *)malloc(sizeof(uint8_t) * cap);
     if (rb->buffer == NULL) return false;
     rb->size = size;
+    rb->mask = cap - 1;
     rb->head = 0;
     rb->tail = 0;
-    rb->is_full = false;
     return true;
 }
 
@@ -25,26 +36,17 @@ void my_ring_buffer_deinit(my_ring_buffer_t *rb) { free(rb->buffer); }
  * @brief リングバッファ内のデータ数を返す
  */
 int my_ring_buffer_content_length(my_ring_buffer_t *rb) {
-    if (rb->is_full) {
-        return rb->size;
-    } else {
-        if (rb->head < rb->tail) {
-            return rb->size + rb->head - rb->tail;
-        } else {
-            return rb->head - rb->tail;
-        }
-    }
+    return (int)(rb->head - rb->tail);
 }
 
 /**
  * @brief リングバッファの状態をprintfで表す
  */
 void my_ring_buffer_status(my_ring_buffer_t *rb) {
-    printf("full : %d\n", rb->is_full);
-    printf("head : %d\n", rb->head);
-    printf("tail : %d\n", rb->tail);
+    printf("head : %lu\n", (unsigned long)rb->head);
+    printf("tail : %lu\n", (unsigned long)rb->tail);
     printf("buffer :");
-    for (int i = 0; i < rb->size; i++) {
+    for (uint32_t i = 0; i <= rb->mask; i++) {
         printf(" %c", rb->buffer[i]);
     }
     printf("\n");
@@ -53,13 +55,13 @@ void my_ring_buffer_status(my_ring_buffer_t *rb) {
 
 /**
  * @brief リングバッファにデータを1つ格納。リングバッファは更新される。
+ *        満杯なら最も古いデータを捨てる。
  * @param data 格納したいデータ
  */
 void my_ring_buffer_push(my_ring_buffer_t *rb, uint8_t data) {
-    rb->buffer[rb->head] = data;
-    rb->head = (rb->head + 1) % rb->size;
-    if (rb->is_full) rb->tail = rb->head;
-    rb->is_full = (rb->head == rb->tail);
+    rb->buffer[rb->head & rb->mask] = data;
+    rb->head++;
+    if (rb->head - rb->tail > (uint32_t)rb->size) rb->tail++;
 }
 
 /**
@@ -69,12 +71,11 @@ void my_ring_buffer_push(my_ring_buffer_t *rb, uint8_t data) {
  * @return 失敗（空っぽ）のときはfalse
  */
 bool my_ring_buffer_pop(my_ring_buffer_t *rb, uint8_t *data) {
-    if (!rb->is_full && rb->head == rb->tail) {
+    if (rb->head == rb->tail) {
         return false;  // empty
     }
-    *data = rb->buffer[rb->tail];
-    rb->tail = (rb->tail + 1) % rb->size;
-    rb->is_full = false;
+    *data = rb->buffer[rb->tail & rb->mask];
+    rb->tail++;
     return true;
 }
 
@@ -90,25 +91,233 @@ bool my_ring_buffer_at(my_ring_buffer_t *rb, int offset, uint8_t *data) {
     if (len == 0) {
         return false;  // empty
     }
-    int index;
+    uint32_t index;
     if (offset >= 0) {
         if (offset >= len) offset = len - 1;
-        index = (rb->tail + offset) % rb->size;
+        index = rb->tail + offset;
     } else {
         if (offset < (-1 * len)) offset = -1 * len;
-        index = (rb->head + offset + rb->size) % rb->size;
+        index = rb->head + offset;
     }
-    *data = rb->buffer[index];
+    *data = rb->buffer[index & rb->mask];
     return true;
 }
 
 /**
  * @brief リングバッファの中身を空にする。
- *        実際は、始点と終点をゼロ位置にし、満杯フラグをfalseにする。
+ *        実際は、始点と終点をゼロ位置にする。
  */
 void my_ring_buffer_reset(my_ring_buffer_t *rb) {
     rb->head = 0;
     rb->tail = 0;
-    rb->is_full = false;
 }
 
+/**
+ * @brief 格納されているデータを、領域内で連続した最大2つの範囲として返す。
+ *        リングバッファは変更されない。読み終えたらmy_ring_buffer_consume()で捨てる。
+ * @param span1 古い側の範囲の先頭が格納される
+ * @param len1 古い側の範囲の長さが格納される
+ * @param span2 折り返した後の範囲の先頭が格納される。折り返していなければNULL
+ * @param len2 折り返した後の範囲の長さが格納される。折り返していなければゼロ
+ * @return データ数（len1 + len2）
+ */
+int my_ring_buffer_peek_spans(my_ring_buffer_t *rb, const uint8_t **span1,
+                              int *len1, const uint8_t **span2, int *len2) {
+    uint32_t len = rb->head - rb->tail;
+    uint32_t pos = rb->tail & rb->mask;
+    uint32_t first = rb->mask + 1 - pos;
+    if (first > len) first = len;
+    *span1 = &rb->buffer[pos];
+    *len1 = (int)first;
+    *span2 = (len > first) ? rb->buffer : NULL;
+    *len2 = (int)(len - first);
+    return (int)len;
+}
+
+/**
+ * @brief 古い方からlen個のデータを捨てる
+ */
+void my_ring_buffer_consume(my_ring_buffer_t *rb, int len) {
+    int cnt = my_ring_buffer_content_length(rb);
+    if (len > cnt) len = cnt;
+    rb->tail += len;
+}
+
+/**
+ * @brief 次に書き込む、領域内で連続した範囲を返す。
+ *        書き込んだらmy_ring_buffer_commit()で確定する。
+ * @param span 範囲の先頭が格納される
+ * @return 範囲の長さ。size個を超えない
+ */
+int my_ring_buffer_write_span(my_ring_buffer_t *rb, uint8_t **span) {
+    uint32_t pos = rb->head & rb->mask;
+    uint32_t len = rb->mask + 1 - pos;
+    if (len > (uint32_t)rb->size) len = rb->size;
+    *span = &rb->buffer[pos];
+    return (int)len;
+}
+
+/**
+ * @brief my_ring_buffer_write_span()の範囲に書き込んだlen個を確定する。
+ *        size個を超えた分は、古い方から捨てる
+ */
+void my_ring_buffer_commit(my_ring_buffer_t *rb, int len) {
+    rb->head += len;
+    if (rb->head - rb->tail > (uint32_t)rb->size) {
+        rb->tail = rb->head - rb->size;
+    }
+}
+
+/**
+ * @brief データをまとめて格納する。満杯なら最も古いデータを捨てる
+ * @param data 格納したいデータ
+ * @param len データ数
+ */
+void my_ring_buffer_push_n(my_ring_buffer_t *rb, const uint8_t *data,
+                           int len) {
+    // 残るのは最新のsize個だけなので、それより前は書かない
+    if (len > rb->size) {
+        data += len - rb->size;
+        len = rb->size;
+    }
+    while (len > 0) {
+        uint8_t *span;
+        int n = my_ring_buffer_write_span(rb, &span);
+        if (n > len) n = len;
+        memcpy(span, data, n);
+        my_ring_buffer_commit(rb, n);
+        data += n;
+        len -= n;
+    }
+}
+
+/**
+ * @brief FIFOでデータをまとめて取り出す
+ * @param data 取り出したデータが格納される
+ * @param len 取り出したい数
+ * @return 取り出した数
+ */
+int my_ring_buffer_pop_n(my_ring_buffer_t *rb, uint8_t *data, int len) {
+    const uint8_t *span1, *span2;
+    int len1, len2;
+    int cnt = my_ring_buffer_peek_spans(rb, &span1, &len1, &span2, &len2);
+    if (len > cnt) len = cnt;
+    int n1 = (len < len1) ? len : len1;
+    memcpy(data, span1, n1);
+    if (len > n1) memcpy(data + n1, span2, len - n1);
+    my_ring_buffer_consume(rb, len);
+    return len;
+}
+
+/**
+ * @brief SPSCリングバッファを初期化する。容量は2のべき乗に切り上げる。
+ *        生産者・消費者どちらのタスクも使い始める前に呼ぶこと。
+ */
+bool my_ring_buffer_spsc_init(my_ring_buffer_spsc_t *rb, int size) {
+    uint32_t cap = 1;
+    while (cap < (uint32_t)size) cap <<= 1;
+    free(rb->buffer);
+    rb->buffer = (uint8_t *)malloc(sizeof(uint8_t) * cap);
+    if (rb->buffer == NULL) return false;
+    rb->size = cap;
+    rb->mask = cap - 1;
+    atomic_init(&rb->head, 0);
+    atomic_init(&rb->tail, 0);
+    return true;
+}
+
+void my_ring_buffer_spsc_deinit(my_ring_buffer_spsc_t *rb) {
+    free(rb->buffer);
+    rb->buffer = NULL;
+}
+
+/**
+ * @brief SPSCリングバッファ内のデータ数を返す
+ *        head,tailは折り返さずに増え続けるので、差がそのままデータ数になる
+ */
+MY_RING_BUFFER_ISR_ATTR int my_ring_buffer_spsc_content_length(
+    my_ring_buffer_spsc_t *rb) {
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    return (int)(head - tail);
+}
+
+/**
+ * @brief 生産者側。データを1つ格納する。ISRから呼んでもよい。
+ * @return 満杯で格納できなかったときはfalse
+ */
+MY_RING_BUFFER_ISR_ATTR bool my_ring_buffer_spsc_push(my_ring_buffer_spsc_t *rb,
+                                                      uint8_t data) {
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    if (head - tail >= rb->size) {
+        return false;  // full
+    }
+    rb->buffer[head & rb->mask] = data;
+    atomic_store_explicit(&rb->head, head + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief 消費者側。FIFOでデータを1つ取り出す。
+ * @return 空っぽのときはfalse
+ */
+bool my_ring_buffer_spsc_pop(my_ring_buffer_spsc_t *rb, uint8_t *data) {
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    if (head == tail) {
+        return false;  // empty
+    }
+    *data = rb->buffer[tail & rb->mask];
+    atomic_store_explicit(&rb->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief 生産者側。まとめて格納する。ISRから呼んでもよい。
+ *        空きが足りない場合は入るだけ格納する。
+ * @return 格納できたバイト数
+ */
+MY_RING_BUFFER_ISR_ATTR int my_ring_buffer_spsc_push_n(
+    my_ring_buffer_spsc_t *rb, const uint8_t *data, int len) {
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    uint32_t space = rb->size - (head - tail);
+    uint32_t n = (uint32_t)len < space ? (uint32_t)len : space;
+    // 折り返し位置までと、先頭からの２回に分けてコピーする
+    uint32_t idx = head & rb->mask;
+    uint32_t first = rb->size - idx;
+    if (first > n) first = n;
+    memcpy(&rb->buffer[idx], data, first);
+    memcpy(&rb->buffer[0], data + first, n - first);
+    atomic_store_explicit(&rb->head, head + n, memory_order_release);
+    return (int)n;
+}
+
+/**
+ * @brief 消費者側。まとめて取り出す。
+ * @return 取り出せたバイト数
+ */
+int my_ring_buffer_spsc_pop_n(my_ring_buffer_spsc_t *rb, uint8_t *data,
+                              int len) {
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    uint32_t avail = head - tail;
+    uint32_t n = (uint32_t)len < avail ? (uint32_t)len : avail;
+    uint32_t idx = tail & rb->mask;
+    uint32_t first = rb->size - idx;
+    if (first > n) first = n;
+    memcpy(data, &rb->buffer[idx], first);
+    memcpy(data + first, &rb->buffer[0], n - first);
+    atomic_store_explicit(&rb->tail, tail + n, memory_order_release);
+    return (int)n;
+}
+
+/**
+ * @brief 消費者側。中身を捨てて空にする。
+ *        生産者と同時に呼んでも壊れないよう、tailをheadに揃えるだけにしている。
+ */
+void my_ring_buffer_spsc_reset(my_ring_buffer_spsc_t *rb) {
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    atomic_store_explicit(&rb->tail, head, memory_order_release);
+}
@@ -3,16 +3,20 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 /**
  * @brief リングバッファ型の定義
+ *        満杯のときにpushすると、最も古いデータを捨てて最新のsize個を残す。
+ *        領域は2のべき乗に切り上げ、添字はマスクで求める。
+ *        head,tailは折り返さずに増え続けるので、差がそのままデータ数になる。
  */
 typedef struct {
   uint8_t *buffer;
-  int size;
-  int head;
-  int tail;
-  bool is_full;
+  int size;       // 残すデータ数の上限（初期化時に指定した大きさ）
+  uint32_t mask;  // 領域の大きさ - 1
+  uint32_t head;
+  uint32_t tail;
 } my_ring_buffer_t;
 
 bool my_ring_buffer_init(my_ring_buffer_t *rb, int size);
@@ -23,6 +27,37 @@ void my_ring_buffer_push(my_ring_buffer_t *rb, uint8_t data);
 bool my_ring_buffer_pop(my_ring_buffer_t *rb, uint8_t *data);
 bool my_ring_buffer_at(my_ring_buffer_t *rb, int offset, uint8_t *data);
 void my_ring_buffer_reset(my_ring_buffer_t *rb);
+int my_ring_buffer_peek_spans(my_ring_buffer_t *rb, const uint8_t **span1,
+                              int *len1, const uint8_t **span2, int *len2);
+void my_ring_buffer_consume(my_ring_buffer_t *rb, int len);
+int my_ring_buffer_write_span(my_ring_buffer_t *rb, uint8_t **span);
+void my_ring_buffer_commit(my_ring_buffer_t *rb, int len);
+void my_ring_buffer_push_n(my_ring_buffer_t *rb, const uint8_t *data, int len);
+int my_ring_buffer_pop_n(my_ring_buffer_t *rb, uint8_t *data, int len);
+
+/**
+ * @brief 単一生産者・単一消費者(SPSC)用のロックフリーリングバッファ型の定義
+ *        headは生産者だけが、tailは消費者だけが書き換えるので、
+ *        生産者がISRやイベントコールバックでも、セマフォ無しで消費者のタスクと共用できる。
+ *        容量は2のべき乗に切り上げ、添字はマスクで求める。
+ *        満杯のときは上書きせずにpushが失敗する。
+ */
+typedef struct {
+  uint8_t *buffer;
+  uint32_t size;
+  uint32_t mask;
+  _Atomic uint32_t head;
+  _Atomic uint32_t tail;
+} my_ring_buffer_spsc_t;
+
+bool my_ring_buffer_spsc_init(my_ring_buffer_spsc_t *rb, int size);
+void my_ring_buffer_spsc_deinit(my_ring_buffer_spsc_t *rb);
+int my_ring_buffer_spsc_content_length(my_ring_buffer_spsc_t *rb);
+bool my_ring_buffer_spsc_push(my_ring_buffer_spsc_t *rb, uint8_t data);
+bool my_ring_buffer_spsc_pop(my_ring_buffer_spsc_t *rb, uint8_t *data);
+int my_ring_buffer_spsc_push_n(my_ring_buffer_spsc_t *rb, const uint8_t *data, int len);
+int my_ring_buffer_spsc_pop_n(my_ring_buffer_spsc_t *rb, uint8_t *data, int len);
+void my_ring_buffer_spsc_reset(my_ring_buffer_spsc_t *rb);
 
 #endif
 
@@ -0,0 +1,136 @@
+/**
+ * @file my_term_match.c
+ *   受信データから終端文字列を見つける、逐次照合器
+ *
+ *   以前は1バイト受信するたびに、終端文字列の最後の文字と同じならリングバッファを遡って全体を比べていた。
+ *   ここでは、終端文字列から状態遷移表（Aho-Corasick法のオートマトン）を先に作っておき、
+ *   受信した1バイトごとに表を1回引くだけで、どれかの終端文字列で終わったかが分かるようにする。
+ *   途中まで一致してから外れても（"\r\r\n" など）、受信済みのデータを見直す必要はない。
+ *
+ *   終端文字列は複数を同時に照合できる（例えば CR, LF, CR+LF, ETX）。
+ *   どれかの終端文字列が揃った時点で一致とする。
+ *   同じバイトで複数の終端文字列が揃った場合は、長い方を一致とする（CR+LF と LF なら CR+LF）。
+ *   ただし CR と CR+LF を両方指定すると、CR を受け取った時点で CR が一致する。
+ *
+ *   表の大きさを抑えるため、終端文字列に現れない文字は全て同じ種類(0)として扱う。
+ */
+
+#include "my_term_match.h"
+
+#include <string.h>
+
+// 遷移先がまだ決まっていない印
+#define MY_TERM_MATCH_UNSET (0xff)
+
+/**
+ * @brief 終端文字列から照合器を作る
+ * @param m 作った照合器が格納される
+ * @param seqs 終端文字列の配列
+ * @param lens それぞれの終端文字列の長さ。1以上
+ * @param n 終端文字列の数。ゼロなら何にも一致しない照合器になる
+ * @return 成功したらゼロ。数や長さ、文字の種類が上限を超えたら-1
+ */
+int my_term_match_compile(my_term_match_t *m, const uint8_t *seqs[],
+                          const int lens[], int n) {
+    uint8_t fail[MY_TERM_MATCH_STATES_MAX];
+    uint8_t queue[MY_TERM_MATCH_STATES_MAX];
+    int states = 1;
+    int classes = 1;
+    if (n < 0 || n > MY_TERM_MATCH_PATTERNS_MAX) return -1;
+    memset(m->class_of, 0, sizeof(m->class_of));
+    memset(m->next, MY_TERM_MATCH_UNSET, sizeof(m->next));
+    memset(m->match, -1, sizeof(m->match));
+    memset(m->len, 0, sizeof(m->len));
+    m->state = 0;
+    m->patterns = 0;
+    // 終端文字列を木にする
+    for (int i = 0; i < n; i++) {
+        if (lens[i] <= 0 || lens[i] >= MY_TERM_MATCH_STATES_MAX) return -1;
+        int s = 0;
+        for (int j = 0; j < lens[i]; j++) {
+            uint8_t c = seqs[i][j];
+            if (m->class_of[c] == 0) {
+                if (classes >= MY_TERM_MATCH_CLASSES_MAX) return -1;
+                m->class_of[c] = classes++;
+            }
+            uint8_t k = m->class_of[c];
+            if (m->next[s][k] == MY_TERM_MATCH_UNSET) {
+                if (states >= MY_TERM_MATCH_STATES_MAX) return -1;
+                m->next[s][k] = states++;
+            }
+            s = m->next[s][k];
+        }
+        // 同じ終端文字列が2回あれば、先の方を使う
+        if (m->match[s] < 0) m->match[s] = i;
+        m->len[i] = lens[i];
+    }
+    // 浅い状態から順に、外れたときの戻り先と、全ての文字の遷移先を決める
+    int qh = 0, qt = 0;
+    for (int k = 0; k < MY_TERM_MATCH_CLASSES_MAX; k++) {
+        uint8_t u = m->next[0][k];
+        if (u == MY_TERM_MATCH_UNSET) {
+            m->next[0][k] = 0;
+        } else {
+            fail[u] = 0;
+            queue[qt++] = u;
+        }
+    }
+    while (qh < qt) {
+        uint8_t s = queue[qh++];
+        // 自分で終わる終端文字列が無ければ、戻り先で終わるもの（より短いもの）を使う
+        if (m->match[s] < 0) m->match[s] = m->match[fail[s]];
+        for (int k = 0; k < MY_TERM_MATCH_CLASSES_MAX; k++) {
+            uint8_t u = m->next[s][k];
+            if (u == MY_TERM_MATCH_UNSET) {
+                m->next[s][k] = m->next[fail[s]][k];
+            } else {
+                fail[u] = m->next[fail[s]][k];
+                queue[qt++] = u;
+            }
+        }
+    }
+    m->patterns = n;
+    return 0;
+}
+
+/**
+ * @brief 照合を最初からやり直す。受信を始める前に呼ぶ。
+ *        終端文字列が揃ったときは、自動で最初に戻る
+ */
+void my_term_match_reset(my_term_match_t *m) { m->state = 0; }
+
+/**
+ * @brief 1バイト進める
+ * @param c 受信した1バイト
+ * @return このバイトで揃った終端文字列の番号。揃っていなければ-1
+ */
+int my_term_match_feed(my_term_match_t *m, uint8_t c) {
+    uint8_t s = m->next[m->state][m->class_of[c]];
+    int r = m->match[s];
+    // 揃ったら、次のフレームのために最初に戻る
+    m->state = (r >= 0) ? 0 : s;
+    return r;
+}
+
+/**
+ * @brief 終端文字列が揃うまでまとめて進める
+ * @param buf 受信したデータ
+ * @param len データの長さ
+ * @param matched 揃った終端文字列の番号が格納される。揃わなければ-1
+ * @return 進めたバイト数。揃った場合は、揃ったバイトまでの長さ
+ */
+int my_term_match_scan(my_term_match_t *m, const uint8_t *buf, int len,
+                       int *matched) {
+    uint8_t s = m->state;
+    for (int i = 0; i < len; i++) {
+        s = m->next[s][m->class_of[buf[i]]];
+        if (m->match[s] >= 0) {
+            m->state = 0;
+            *matched = m->match[s];
+            return i + 1;
+        }
+    }
+    m->state = s;
+    *matched = -1;
+    return len;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file my_term_match.h
+ *   受信データから終端文字列を見つける、逐次照合器
+ */
+
+#ifndef my_term_match_h
+#define my_term_match_h 1
+
+#include <stdint.h>
+
+// 同時に照合できる終端文字列の数
+#define MY_TERM_MATCH_PATTERNS_MAX (4)
+
+// 状態数の上限。全ての終端文字列の長さの合計＋1まで
+#define MY_TERM_MATCH_STATES_MAX (64)
+
+// 文字の種類の上限。終端文字列に現れる文字の種類＋1（その他の文字）まで。
+// 設定できる終端文字列(40バイト)が全て違う文字でも作れる大きさにする
+#define MY_TERM_MATCH_CLASSES_MAX (41)
+
+/**
+ * @brief 照合器。終端文字列から作った状態遷移表と、現在の状態
+ */
+typedef struct {
+    uint8_t class_of[256];  // 文字 -> 文字の種類。終端文字列に現れない文字は0
+    uint8_t next[MY_TERM_MATCH_STATES_MAX][MY_TERM_MATCH_CLASSES_MAX];
+    int8_t match[MY_TERM_MATCH_STATES_MAX];  // この状態で一致した終端文字列の番号。無ければ-1
+    uint8_t len[MY_TERM_MATCH_PATTERNS_MAX];  // 終端文字列の長さ
+    uint8_t state;
+    int patterns;
+} my_term_match_t;
+
+extern int my_term_match_compile(my_term_match_t *m, const uint8_t *seqs[],
+                                 const int lens[], int n);
+extern void my_term_match_reset(my_term_match_t *m);
+extern int my_term_match_feed(my_term_match_t *m, uint8_t c);
+extern int my_term_match_scan(my_term_match_t *m, const uint8_t *buf, int len,
+                              int *matched);
+
+#endif
@@ -0,0 +1,166 @@
+/**
+ * @file my_trace.c
+ *   受信したバイト、フレーム、送ったレポートを、文字列にせずに記録するトレースリング
+ *
+ *   以前は1バイト受信するたびにESP_LOGIで1行出し、レポートを送る前に16進文字列を作っていた。
+ *   コンソールUARTへの出力はデータより遅く、ログを出すだけで受信と送信が遅れていた。
+ *   ここでは、時刻と数値だけの16バイトの記録をリングに書くだけにして、文字列にはしない。
+ *   文字列にするのは、httpdの /trace で見るときか、/trace.bin を持ち帰って読むとき。
+ *
+ *   UARTタスク、HID送信タスク、NimBLEのタスクから書かれるので、書く位置はアトミックに確保する。
+ *   読む側は、書き込み途中の記録（seqが合わないもの）を読み飛ばす。
+ */
+
+#include "my_trace.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_timer.h"
+
+#define MY_TRACE_MASK (MY_TRACE_RECORDS - 1)
+
+#if CONFIG_MY_TRACE_ENABLE
+// 記録のリング
+static volatile my_trace_record_t my_trace_ring[MY_TRACE_RECORDS];
+
+// 次に書く記録の通し番号
+static _Atomic uint32_t my_trace_head = 0;
+
+/**
+ * @brief 1件記録する
+ * @param type 記録の種類
+ * @param a b c 種類ごとの値。my_trace_type_t を参照
+ */
+void my_trace_rec(my_trace_type_t type, uint8_t a, uint16_t b, uint32_t c) {
+    uint32_t seq =
+        atomic_fetch_add_explicit(&my_trace_head, 1, memory_order_relaxed);
+    volatile my_trace_record_t *r = &my_trace_ring[seq & MY_TRACE_MASK];
+    // 書き込み中の印を先に付ける
+    r->seq = 0;
+    atomic_thread_fence(memory_order_release);
+    r->time_us = (uint32_t)esp_timer_get_time();
+    r->type = type;
+    r->a = a;
+    r->b = b;
+    r->c = c;
+    atomic_thread_fence(memory_order_release);
+    r->seq = seq + 1;
+}
+
+/**
+ * @brief 受信したバイト列を記録する。4バイトずつ1件にする
+ */
+void my_trace_bytes(const uint8_t *data, int len) {
+    for (int i = 0; i < len; i += 4) {
+        int n = (len - i < 4) ? len - i : 4;
+        uint32_t c = 0;
+        for (int j = 0; j < n; j++) {
+            c |= (uint32_t)data[i + j] << (8 * j);
+        }
+        my_trace_rec(MY_TRACE_RX_BYTES, n, 0, c);
+    }
+}
+
+/**
+ * @brief 送ったキーボード入力レポートを記録する。key[4],key[5]は記録しない
+ * @param report キーボード入力レポート。modifier, reserved, key x 6
+ * @param rc 送信した関数の返り値
+ */
+void my_trace_report(const uint8_t *report, int rc) {
+    uint32_t c = (uint32_t)report[2] | (uint32_t)report[3] << 8 |
+                 (uint32_t)report[4] << 16 | (uint32_t)report[5] << 24;
+    my_trace_rec(MY_TRACE_REPORT, report[0], (uint16_t)rc, c);
+}
+#endif
+
+/**
+ * @brief 記録を古い順に取り出す。リングは変更しない
+ * @param out 取り出した記録が格納される
+ * @param max outに格納できる件数。これより多ければ新しい方から数える
+ * @return 取り出した件数
+ */
+int my_trace_snapshot(my_trace_record_t *out, int max) {
+#if CONFIG_MY_TRACE_ENABLE
+    uint32_t head = atomic_load_explicit(&my_trace_head, memory_order_acquire);
+    uint32_t cnt = (head < MY_TRACE_RECORDS) ? head : MY_TRACE_RECORDS;
+    if (cnt > (uint32_t)max) cnt = max;
+    int n = 0;
+    for (uint32_t seq = head - cnt; seq != head; seq++) {
+        volatile my_trace_record_t *r = &my_trace_ring[seq & MY_TRACE_MASK];
+        if (r->seq != seq + 1) continue;
+        atomic_thread_fence(memory_order_acquire);
+        out[n].seq = seq + 1;
+        out[n].time_us = r->time_us;
+        out[n].type = r->type;
+        out[n].a = r->a;
+        out[n].b = r->b;
+        out[n].c = r->c;
+        atomic_thread_fence(memory_order_acquire);
+        // 読んでいる間に上書きされたら捨てる
+        if (r->seq == seq + 1) n++;
+    }
+    return n;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief 記録を1行の文字列にする
+ * @param r 記録
+ * @param buf 文字列が格納される。改行を含む
+ * @param size bufの大きさ
+ * @return 文字列の長さ
+ */
+int my_trace_format(const my_trace_record_t *r, char *buf, int size) {
+    uint8_t b0 = r->c & 0xff, b1 = (r->c >> 8) & 0xff;
+    uint8_t b2 = (r->c >> 16) & 0xff, b3 = (r->c >> 24) & 0xff;
+    int len = snprintf(buf, size, "%10lu %6lu ", (unsigned long)r->time_us,
+                       (unsigned long)r->seq - 1);
+    if (len < 0 || len >= size) return 0;
+    buf += len;
+    size -= len;
+    int l;
+    switch (r->type) {
+        case MY_TRACE_RX_BYTES: {
+            char hex[16];
+            int o = 0;
+            for (int i = 0; i < r->a && i < 4; i++) {
+                o += sprintf(hex + o, " %02x", (r->c >> (8 * i)) & 0xff);
+            }
+            l = snprintf(buf, size, "rx%s\n", hex);
+            break;
+        }
+        case MY_TRACE_RX_OVERFLOW:
+            l = snprintf(buf, size, "rx overflow event %u\n", r->a);
+            break;
+        case MY_TRACE_FRAME:
+            l = snprintf(buf, size, "frame len %u, terminator %u, reports %lu\n",
+                         r->b, r->a, (unsigned long)r->c);
+            break;
+        case MY_TRACE_FRAME_DROP:
+            l = snprintf(buf, size, "frame dropped, len %u\n", r->b);
+            break;
+        case MY_TRACE_REPORT:
+            l = snprintf(buf, size,
+                         "report %02x 00 %02x %02x %02x %02x .. .. rc %d\n",
+                         r->a, b0, b1, b2, b3, (int16_t)r->b);
+            break;
+        case MY_TRACE_REPORT_RETRY:
+            l = snprintf(buf, size, "report retry rc %d, conn %lu\n",
+                         (int16_t)r->b, (unsigned long)r->c);
+            break;
+        case MY_TRACE_REPORT_DROP:
+            l = snprintf(buf, size, "report dropped rc %d, conn %lu\n",
+                         (int16_t)r->b, (unsigned long)r->c);
+            break;
+        default:
+            l = snprintf(buf, size, "type %u %u %u %08lx\n", r->type, r->a,
+                         r->b, (unsigned long)r->c);
+            break;
+    }
+    if (l < 0 || l >= size) return len;
+    return len + l;
+}
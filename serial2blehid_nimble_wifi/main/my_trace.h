@@ -0,0 +1,56 @@
+/**
+ * @file my_trace.h
+ *   受信したバイト、フレーム、送ったレポートを、文字列にせずに記録するトレースリング
+ */
+
+#ifndef my_trace_h
+#define my_trace_h 1
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+// 記録できる件数。2のべき乗にすること。古いものから上書きされる
+#define MY_TRACE_RECORDS (256)
+
+/**
+ * @brief 記録の種類
+ */
+typedef enum {
+    MY_TRACE_NONE = 0,
+    MY_TRACE_RX_BYTES,     // UARTで受信した。a:バイト数(1-4), c:受信したバイト（先頭が下位）
+    MY_TRACE_RX_OVERFLOW,  // UARTの受信が溢れた。a:uart_event_type_t
+    MY_TRACE_FRAME,        // フレームをHID送信タスクに渡した。a:終端文字列の長さ, b:フレーム長, c:レポート数
+    MY_TRACE_FRAME_DROP,   // フレームを渡せずに捨てた。b:フレーム長
+    MY_TRACE_REPORT,       // キーボード入力レポートを送った。a:modifier, b:NimBLEの返り値, c:key[0-3]
+    MY_TRACE_REPORT_RETRY, // バッファ不足で送り直す。b:NimBLEの返り値, c:接続ハンドル
+    MY_TRACE_REPORT_DROP,  // 送れずに捨てた。b:NimBLEの返り値, c:接続ハンドル
+    MY_TRACE_TYPES,
+} my_trace_type_t;
+
+/**
+ * @brief 1件の記録。16バイト
+ */
+typedef struct {
+    uint32_t seq;      // 通し番号+1。書き込み途中はゼロ
+    uint32_t time_us;  // esp_timer_get_time() の下位32ビット
+    uint8_t type;      // my_trace_type_t
+    uint8_t a;
+    uint16_t b;
+    uint32_t c;
+} my_trace_record_t;
+
+#if CONFIG_MY_TRACE_ENABLE
+extern void my_trace_rec(my_trace_type_t type, uint8_t a, uint16_t b,
+                         uint32_t c);
+extern void my_trace_bytes(const uint8_t *data, int len);
+extern void my_trace_report(const uint8_t *report, int rc);
+#else
+#define my_trace_rec(type, a, b, c) ((void)0)
+#define my_trace_bytes(data, len) ((void)0)
+#define my_trace_report(report, rc) ((void)0)
+#endif
+extern int my_trace_snapshot(my_trace_record_t *out, int max);
+extern int my_trace_format(const my_trace_record_t *r, char *buf, int size);
+
+#endif
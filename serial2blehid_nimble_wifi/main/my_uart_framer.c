@@ -0,0 +1,103 @@
+/**
+ * @file my_uart_framer.c
+ *   UARTで受信したバイト列を、終端文字列か受信の途切れでフレームに区切る
+ *
+ *   UARTドライバやタイマーには触らず、受信したバイト列と時刻を受け取って区切りを返すだけにしてある。
+ *   UARTタスクはドライバのイベントで受け取ったバイト列を渡し、
+ *   イベントが来ないまま my_uart_framer_wait_us() が過ぎたら my_uart_framer_poll() を呼ぶ。
+ *   ドライバの代わりに記録したバイト列と時刻を渡せば、Linux上でも同じ区切りが得られる。
+ *
+ *   終端文字列は、設定されていれば途切れより優先する。
+ *   応答が遅い相手でも、途切れる前に届いた分は同じフレームになる。
+ */
+
+#include "my_uart_framer.h"
+
+#include <stddef.h>
+
+/**
+ * @brief フレーム区切りを準備する
+ * @param match 終端文字列の照合器。NULLか、終端文字列が無ければ途切れだけで区切る
+ * @param idle_us この時間受信が途切れたら区切る(us)。ゼロなら途切れでは区切らない
+ */
+void my_uart_framer_init(my_uart_framer_t *f, my_term_match_t *match,
+                         uint32_t idle_us) {
+    f->match = (match != NULL && match->patterns > 0) ? match : NULL;
+    f->idle_us = idle_us;
+    f->terminated_cnt = 0;
+    f->idle_cnt = 0;
+    my_uart_framer_reset(f);
+}
+
+/**
+ * @brief 区切れていないフレームを捨てて、最初からやり直す
+ */
+void my_uart_framer_reset(my_uart_framer_t *f) {
+    f->pending = 0;
+    f->last_us = 0;
+    f->term_len = 0;
+    if (f->match != NULL) my_term_match_reset(f->match);
+}
+
+/**
+ * @brief 受信したバイト列を渡す。区切れたら、そこまでで止まる
+ * @param data 受信したバイト列
+ * @param len バイト列の長さ
+ * @param now_us 受信した時刻(us)
+ * @param end 区切れたかどうかが格納される
+ * @return 今のフレームに入るバイト数。残りは次のフレームとして、もう一度渡すこと
+ */
+int my_uart_framer_feed(my_uart_framer_t *f, const uint8_t *data, int len,
+                        int64_t now_us, my_uart_framer_end_t *end) {
+    *end = MY_UART_FRAMER_END_NONE;
+    if (len <= 0) return 0;
+    // 前の受信から途切れていたら、受け取る前に今のフレームを区切る
+    if (my_uart_framer_poll(f, now_us) == MY_UART_FRAMER_END_IDLE) {
+        *end = MY_UART_FRAMER_END_IDLE;
+        return 0;
+    }
+    int used = len;
+    if (f->match != NULL) {
+        int matched;
+        used = my_term_match_scan(f->match, data, len, &matched);
+        if (matched >= 0) {
+            f->term_len = f->match->len[matched];
+            f->pending = 0;
+            f->terminated_cnt++;
+            *end = MY_UART_FRAMER_END_TERMINATOR;
+            return used;
+        }
+    }
+    f->pending += used;
+    f->last_us = now_us;
+    return used;
+}
+
+/**
+ * @brief 受信が途切れて区切れたかを調べる。受信イベントが来ないまま待ち時間が過ぎたら呼ぶ
+ * @param now_us 現在時刻(us)
+ * @return 途切れで区切れたら MY_UART_FRAMER_END_IDLE
+ */
+my_uart_framer_end_t my_uart_framer_poll(my_uart_framer_t *f, int64_t now_us) {
+    if (f->pending == 0 || f->idle_us == 0 ||
+        now_us - f->last_us < (int64_t)f->idle_us) {
+        return MY_UART_FRAMER_END_NONE;
+    }
+    f->pending = 0;
+    f->term_len = 0;
+    f->idle_cnt++;
+    // 途中まで揃っていた終端文字列は、次のフレームには持ち越さない
+    if (f->match != NULL) my_term_match_reset(f->match);
+    return MY_UART_FRAMER_END_IDLE;
+}
+
+/**
+ * @brief 途切れで区切るまでの残り時間
+ * @param now_us 現在時刻(us)
+ * @return 残り時間(us)。途切れで区切ることが無ければ-1
+ */
+int64_t my_uart_framer_wait_us(const my_uart_framer_t *f, int64_t now_us) {
+    if (f->pending == 0 || f->idle_us == 0) return -1;
+    int64_t remain = f->last_us + f->idle_us - now_us;
+    return remain > 0 ? remain : 0;
+}
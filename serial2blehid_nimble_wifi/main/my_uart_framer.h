@@ -0,0 +1,47 @@
+/**
+ * @file my_uart_framer.h
+ *   UARTで受信したバイト列を、終端文字列か受信の途切れでフレームに区切る
+ */
+
+#ifndef my_uart_framer_h
+#define my_uart_framer_h 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "my_term_match.h"
+
+/**
+ * @brief フレームの区切り方
+ */
+typedef enum {
+    MY_UART_FRAMER_END_NONE = 0,    // まだ区切れていない
+    MY_UART_FRAMER_END_TERMINATOR,  // 終端文字列が揃った
+    MY_UART_FRAMER_END_IDLE,        // 一定時間受信が途切れた
+} my_uart_framer_end_t;
+
+/**
+ * @brief フレーム区切りの状態。時刻は呼び出し側から渡すので、ESP-IDFに依存しない
+ */
+typedef struct {
+    my_term_match_t *match;  // 終端文字列の照合器。NULLなら終端文字列では区切らない
+    uint32_t idle_us;        // この時間受信が途切れたら区切る。ゼロなら途切れでは区切らない
+    int pending;             // 区切れていないフレームのバイト数
+    int64_t last_us;         // 最後に受信した時刻
+    int term_len;            // 最後に区切ったフレームの終端文字列の長さ。途切れで区切ったらゼロ
+    uint32_t terminated_cnt; // 終端文字列で区切ったフレーム数
+    uint32_t idle_cnt;       // 途切れで区切ったフレーム数
+} my_uart_framer_t;
+
+extern void my_uart_framer_init(my_uart_framer_t *f, my_term_match_t *match,
+                                uint32_t idle_us);
+extern void my_uart_framer_reset(my_uart_framer_t *f);
+extern int my_uart_framer_feed(my_uart_framer_t *f, const uint8_t *data,
+                               int len, int64_t now_us,
+                               my_uart_framer_end_t *end);
+extern my_uart_framer_end_t my_uart_framer_poll(my_uart_framer_t *f,
+                                                int64_t now_us);
+extern int64_t my_uart_framer_wait_us(const my_uart_framer_t *f,
+                                      int64_t now_us);
+
+#endif
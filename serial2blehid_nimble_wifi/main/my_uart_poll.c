@@ -0,0 +1,151 @@
+/**
+ * @file my_uart_poll.c
+ *   リクエストコマンドを一定周期で送る、ポーリングの予定と応答時間の統計
+ *
+ *   以前はトリガー1回につきリクエストを1回送り、応答の後300ms眠っていたため、
+ *   相手がもっと速く応答できても毎秒2回程度しか読めなかった。
+ *   ここでは、リクエストを送る時刻を「前回の予定時刻＋周期」で決める。
+ *   応答の処理（レポートへの変換とBLE送信）は別タスクで進むので、周期には含まれない。
+ *
+ *   周期と応答を待つ時間は、測った応答時間(RTT)に合わせて変える。
+ *     応答を待つ時間 = 平滑RTT + 4 x ばらつき（TCPの再送タイマーと同じ考え方）。上限はtimeout_max_us
+ *     実際の周期     = 設定された周期と、平滑RTT + 2 x ばらつき の大きい方
+ *   設定された周期が相手の応答より短い場合でも、毎回予定に遅れて詰まることがない。
+ *   応答が無ければretry_max回まで送り直し、それでも無ければタイムアウトとして数えて次の予定に進む。
+ */
+
+#include "my_uart_poll.h"
+
+// 応答を待つ時間の下限(us)。RTTが安定していても、これより短くはしない
+#define MY_UART_POLL_TIMEOUT_MIN_US (20000)
+
+/**
+ * @brief ポーリングを準備する。統計も消える
+ * @param period_us リクエストを送る周期(us)
+ * @param timeout_max_us 応答を待つ時間の上限(us)。RTTを測るまではこの時間待つ
+ * @param retry_max 応答が無いときに送り直す回数の上限
+ */
+void my_uart_poll_init(my_uart_poll_t *p, uint32_t period_us,
+                       uint32_t timeout_max_us, int retry_max) {
+    p->period_us = period_us;
+    p->timeout_max_us = timeout_max_us;
+    p->retry_max = retry_max;
+    p->retry = 0;
+    p->next_us = 0;
+    p->srtt_us = 0;
+    p->rttvar_us = 0;
+    p->rtt_min_us = 0;
+    p->rtt_max_us = 0;
+    p->rtt_sum_us = 0;
+    p->requests = 0;
+    p->responses = 0;
+    p->retries = 0;
+    p->timeouts = 0;
+    p->late = 0;
+}
+
+/**
+ * @brief 周期を変える。統計はそのまま
+ * @param period_us リクエストを送る周期(us)
+ */
+void my_uart_poll_set_period(my_uart_poll_t *p, uint32_t period_us) {
+    p->period_us = period_us;
+}
+
+/**
+ * @brief ポーリングを始める。最初のリクエストはすぐに送る
+ */
+void my_uart_poll_start(my_uart_poll_t *p, int64_t now_us) {
+    p->next_us = now_us;
+    p->retry = 0;
+}
+
+/**
+ * @brief 次にリクエストを送る予定の時刻(us)
+ */
+int64_t my_uart_poll_next_us(const my_uart_poll_t *p) { return p->next_us; }
+
+/**
+ * @brief RTTに合わせた実際の周期(us)
+ */
+uint32_t my_uart_poll_period_us(const my_uart_poll_t *p) {
+    int64_t min_us = p->srtt_us + 2 * p->rttvar_us;
+    return (min_us > p->period_us) ? (uint32_t)min_us : p->period_us;
+}
+
+/**
+ * @brief RTTに合わせた、応答を待つ時間(us)
+ */
+uint32_t my_uart_poll_timeout_us(const my_uart_poll_t *p) {
+    if (p->responses == 0) return p->timeout_max_us;
+    int64_t t = p->srtt_us + 4 * p->rttvar_us;
+    if (t < MY_UART_POLL_TIMEOUT_MIN_US) t = MY_UART_POLL_TIMEOUT_MIN_US;
+    if (t > p->timeout_max_us) t = p->timeout_max_us;
+    return (uint32_t)t;
+}
+
+/**
+ * @brief リクエストを送ったら呼ぶ
+ */
+void my_uart_poll_sent(my_uart_poll_t *p) { p->requests++; }
+
+/**
+ * @brief 次の予定を1周期進める。遅れていたら、今から1周期後にする
+ */
+static void my_uart_poll_advance(my_uart_poll_t *p, int64_t now_us) {
+    p->retry = 0;
+    p->next_us += my_uart_poll_period_us(p);
+    if (p->next_us < now_us) {
+        p->late++;
+        p->next_us = now_us;
+    }
+}
+
+/**
+ * @brief 応答を受け取ったら呼ぶ。RTTを記録して、次の予定に進む
+ * @param rtt_us リクエストを送ってから応答を受け取り終わるまでの時間(us)
+ * @param now_us 現在時刻(us)
+ */
+void my_uart_poll_response(my_uart_poll_t *p, uint32_t rtt_us,
+                           int64_t now_us) {
+    if (p->responses == 0) {
+        p->srtt_us = rtt_us;
+        p->rttvar_us = rtt_us / 2;
+        p->rtt_min_us = rtt_us;
+        p->rtt_max_us = rtt_us;
+    } else {
+        int64_t err = (int64_t)rtt_us - p->srtt_us;
+        if (err < 0) err = -err;
+        p->rttvar_us += (err - p->rttvar_us) / 4;
+        p->srtt_us += ((int64_t)rtt_us - p->srtt_us) / 8;
+        if (rtt_us < p->rtt_min_us) p->rtt_min_us = rtt_us;
+        if (rtt_us > p->rtt_max_us) p->rtt_max_us = rtt_us;
+    }
+    p->rtt_sum_us += rtt_us;
+    p->responses++;
+    my_uart_poll_advance(p, now_us);
+}
+
+/**
+ * @brief 応答を待つ時間が過ぎたら呼ぶ
+ * @param now_us 現在時刻(us)
+ * @return 送り直すならtrue。送り直さずに次の予定に進んだらfalse
+ */
+bool my_uart_poll_timeout(my_uart_poll_t *p, int64_t now_us) {
+    if (p->retry < p->retry_max) {
+        p->retry++;
+        p->retries++;
+        return true;
+    }
+    p->timeouts++;
+    my_uart_poll_advance(p, now_us);
+    return false;
+}
+
+/**
+ * @brief RTTの平均(us)。まだ応答が無ければゼロ
+ */
+uint32_t my_uart_poll_rtt_avg_us(const my_uart_poll_t *p) {
+    if (p->responses == 0) return 0;
+    return (uint32_t)(p->rtt_sum_us / p->responses);
+}
@@ -0,0 +1,46 @@
+/**
+ * @file my_uart_poll.h
+ *   リクエストコマンドを一定周期で送る、ポーリングの予定と応答時間の統計
+ */
+
+#ifndef my_uart_poll_h
+#define my_uart_poll_h 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief ポーリングの状態。時刻は呼び出し側から渡すので、ESP-IDFに依存しない
+ */
+typedef struct {
+    uint32_t period_us;       // 設定された周期
+    uint32_t timeout_max_us;  // 応答を待つ時間の上限
+    int retry_max;            // 1回のリクエストで送り直す回数の上限
+    int retry;                // 今のリクエストで送り直した回数
+    int64_t next_us;          // 次にリクエストを送る予定の時刻
+    int64_t srtt_us;          // 応答時間の平滑値
+    int64_t rttvar_us;        // 応答時間のばらつきの平滑値
+    uint32_t rtt_min_us;      // 応答時間の最小
+    uint32_t rtt_max_us;      // 応答時間の最大
+    uint64_t rtt_sum_us;      // 応答時間の合計。平均を出すのに使う
+    uint32_t requests;        // 送ったリクエスト数（送り直しを含む）
+    uint32_t responses;       // 受け取った応答数
+    uint32_t retries;         // 送り直した回数
+    uint32_t timeouts;        // 送り直しても応答が無かったリクエスト数
+    uint32_t late;            // 応答が遅れて、予定の時刻に送れなかった回数
+} my_uart_poll_t;
+
+extern void my_uart_poll_init(my_uart_poll_t *p, uint32_t period_us,
+                              uint32_t timeout_max_us, int retry_max);
+extern void my_uart_poll_set_period(my_uart_poll_t *p, uint32_t period_us);
+extern void my_uart_poll_start(my_uart_poll_t *p, int64_t now_us);
+extern int64_t my_uart_poll_next_us(const my_uart_poll_t *p);
+extern uint32_t my_uart_poll_period_us(const my_uart_poll_t *p);
+extern uint32_t my_uart_poll_timeout_us(const my_uart_poll_t *p);
+extern void my_uart_poll_sent(my_uart_poll_t *p);
+extern void my_uart_poll_response(my_uart_poll_t *p, uint32_t rtt_us,
+                                  int64_t now_us);
+extern bool my_uart_poll_timeout(my_uart_poll_t *p, int64_t now_us);
+extern uint32_t my_uart_poll_rtt_avg_us(const my_uart_poll_t *p);
+
+#endif